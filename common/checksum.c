@@ -0,0 +1,462 @@
+/*
+ * Checksum kernels shared by the host service and the guest library
+ *
+ * Every vector kernel loads unaligned, handles whole vectors and leaves the
+ * remaining words to the scalar kernel, so all variants return identical
+ * results for any buffer address and size.
+ */
+
+#include "checksum.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CHECKSUM_X86 1
+#define CHECKSUM_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define CHECKSUM_X86 1
+#define CHECKSUM_TARGET(isa)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#define CRC32C_POLY_REFLECTED 0x82F63B78u
+
+typedef uint32_t (*xor_kernel_t)(const unsigned char *p, size_t words);
+typedef size_t (*mismatch_kernel_t)(const unsigned char *p, size_t words, uint32_t pattern);
+typedef uint32_t (*crc_kernel_t)(uint32_t crc, const unsigned char *p, size_t size);
+
+/* Selected kernels, filled in once on first use (init_kernels) */
+static xor_kernel_t g_xor_kernel;
+static mismatch_kernel_t g_mismatch_kernel;
+static crc_kernel_t g_crc_kernel;
+static const char *g_kernel_name = "scalar";
+static uint32_t g_crc32c_table[256];
+
+/*
+ * Scalar kernels (any CPU, and the tails of the vector kernels)
+ */
+static uint32_t xor_scalar(const unsigned char *p, size_t words)
+{
+    uint32_t checksum = 0;
+    uint32_t word;
+    size_t i;
+
+    for (i = 0; i < words; i++) {
+        memcpy(&word, p + i * sizeof(uint32_t), sizeof(word));
+        checksum ^= word;
+    }
+    return checksum;
+}
+
+static size_t mismatch_scalar(const unsigned char *p, size_t words, uint32_t pattern)
+{
+    uint32_t word;
+    size_t i;
+
+    for (i = 0; i < words; i++) {
+        memcpy(&word, p + i * sizeof(uint32_t), sizeof(word));
+        if (word != pattern) {
+            break;
+        }
+    }
+    return i * sizeof(uint32_t);
+}
+
+static uint32_t crc32c_table(uint32_t crc, const unsigned char *p, size_t size)
+{
+    while (size--) {
+        crc = g_crc32c_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef CHECKSUM_X86
+
+/*
+ * SSE2
+ */
+CHECKSUM_TARGET("sse2")
+static uint32_t reduce_xor_128(__m128i v)
+{
+    v = _mm_xor_si128(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_xor_si128(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (uint32_t)_mm_cvtsi128_si32(v);
+}
+
+CHECKSUM_TARGET("sse2")
+static uint32_t xor_sse2(const unsigned char *p, size_t words)
+{
+    size_t bytes = words * sizeof(uint32_t);
+    size_t i = 0;
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+    __m128i acc2 = _mm_setzero_si128();
+    __m128i acc3 = _mm_setzero_si128();
+
+    // Four accumulators keep the loads independent
+    for (; i + 64 <= bytes; i += 64) {
+        acc0 = _mm_xor_si128(acc0, _mm_loadu_si128((const __m128i *)(p + i)));
+        acc1 = _mm_xor_si128(acc1, _mm_loadu_si128((const __m128i *)(p + i + 16)));
+        acc2 = _mm_xor_si128(acc2, _mm_loadu_si128((const __m128i *)(p + i + 32)));
+        acc3 = _mm_xor_si128(acc3, _mm_loadu_si128((const __m128i *)(p + i + 48)));
+    }
+    for (; i + 16 <= bytes; i += 16) {
+        acc0 = _mm_xor_si128(acc0, _mm_loadu_si128((const __m128i *)(p + i)));
+    }
+
+    acc0 = _mm_xor_si128(_mm_xor_si128(acc0, acc1), _mm_xor_si128(acc2, acc3));
+    return reduce_xor_128(acc0) ^ xor_scalar(p + i, (bytes - i) / sizeof(uint32_t));
+}
+
+CHECKSUM_TARGET("sse2")
+static size_t mismatch_sse2(const unsigned char *p, size_t words, uint32_t pattern)
+{
+    size_t bytes = words * sizeof(uint32_t);
+    size_t i = 0;
+    __m128i expected = _mm_set1_epi32((int)pattern);
+
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(v, expected)) != 0xFFFF) {
+            break;
+        }
+    }
+    return i + mismatch_scalar(p + i, (bytes - i) / sizeof(uint32_t), pattern);
+}
+
+/*
+ * AVX2
+ */
+CHECKSUM_TARGET("avx2")
+static uint32_t xor_avx2(const unsigned char *p, size_t words)
+{
+    size_t bytes = words * sizeof(uint32_t);
+    size_t i = 0;
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    __m256i acc2 = _mm256_setzero_si256();
+    __m256i acc3 = _mm256_setzero_si256();
+
+    for (; i + 128 <= bytes; i += 128) {
+        acc0 = _mm256_xor_si256(acc0, _mm256_loadu_si256((const __m256i *)(p + i)));
+        acc1 = _mm256_xor_si256(acc1, _mm256_loadu_si256((const __m256i *)(p + i + 32)));
+        acc2 = _mm256_xor_si256(acc2, _mm256_loadu_si256((const __m256i *)(p + i + 64)));
+        acc3 = _mm256_xor_si256(acc3, _mm256_loadu_si256((const __m256i *)(p + i + 96)));
+    }
+    for (; i + 32 <= bytes; i += 32) {
+        acc0 = _mm256_xor_si256(acc0, _mm256_loadu_si256((const __m256i *)(p + i)));
+    }
+
+    acc0 = _mm256_xor_si256(_mm256_xor_si256(acc0, acc1), _mm256_xor_si256(acc2, acc3));
+    __m128i half = _mm_xor_si128(_mm256_castsi256_si128(acc0), _mm256_extracti128_si256(acc0, 1));
+    return reduce_xor_128(half) ^ xor_scalar(p + i, (bytes - i) / sizeof(uint32_t));
+}
+
+CHECKSUM_TARGET("avx2")
+static size_t mismatch_avx2(const unsigned char *p, size_t words, uint32_t pattern)
+{
+    size_t bytes = words * sizeof(uint32_t);
+    size_t i = 0;
+    __m256i expected = _mm256_set1_epi32((int)pattern);
+
+    for (; i + 32 <= bytes; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(v, expected)) != -1) {
+            break;
+        }
+    }
+    return i + mismatch_scalar(p + i, (bytes - i) / sizeof(uint32_t), pattern);
+}
+
+/*
+ * AVX-512
+ */
+CHECKSUM_TARGET("avx512f")
+static uint32_t xor_avx512(const unsigned char *p, size_t words)
+{
+    size_t bytes = words * sizeof(uint32_t);
+    size_t i = 0;
+    __m512i acc0 = _mm512_setzero_si512();
+    __m512i acc1 = _mm512_setzero_si512();
+    __m512i acc2 = _mm512_setzero_si512();
+    __m512i acc3 = _mm512_setzero_si512();
+
+    for (; i + 256 <= bytes; i += 256) {
+        acc0 = _mm512_xor_si512(acc0, _mm512_loadu_si512((const void *)(p + i)));
+        acc1 = _mm512_xor_si512(acc1, _mm512_loadu_si512((const void *)(p + i + 64)));
+        acc2 = _mm512_xor_si512(acc2, _mm512_loadu_si512((const void *)(p + i + 128)));
+        acc3 = _mm512_xor_si512(acc3, _mm512_loadu_si512((const void *)(p + i + 192)));
+    }
+    for (; i + 64 <= bytes; i += 64) {
+        acc0 = _mm512_xor_si512(acc0, _mm512_loadu_si512((const void *)(p + i)));
+    }
+
+    acc0 = _mm512_xor_si512(_mm512_xor_si512(acc0, acc1), _mm512_xor_si512(acc2, acc3));
+    __m256i quarter = _mm256_xor_si256(_mm512_castsi512_si256(acc0), _mm512_extracti64x4_epi64(acc0, 1));
+    __m128i half = _mm_xor_si128(_mm256_castsi256_si128(quarter), _mm256_extracti128_si256(quarter, 1));
+    return reduce_xor_128(half) ^ xor_scalar(p + i, (bytes - i) / sizeof(uint32_t));
+}
+
+CHECKSUM_TARGET("avx512f")
+static size_t mismatch_avx512(const unsigned char *p, size_t words, uint32_t pattern)
+{
+    size_t bytes = words * sizeof(uint32_t);
+    size_t i = 0;
+    __m512i expected = _mm512_set1_epi32((int)pattern);
+
+    for (; i + 64 <= bytes; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void *)(p + i));
+        if (_mm512_cmpneq_epi32_mask(v, expected) != 0) {
+            break;
+        }
+    }
+    return i + mismatch_scalar(p + i, (bytes - i) / sizeof(uint32_t), pattern);
+}
+
+/*
+ * CRC32C with the SSE4.2 crc32 instruction
+ */
+CHECKSUM_TARGET("sse4.2")
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *p, size_t size)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    uint64_t crc64 = crc;
+    uint64_t quad;
+
+    for (; size >= 8; size -= 8, p += 8) {
+        memcpy(&quad, p, sizeof(quad));
+        crc64 = _mm_crc32_u64(crc64, quad);
+    }
+    crc = (uint32_t)crc64;
+#endif
+    uint32_t word;
+
+    for (; size >= 4; size -= 4, p += 4) {
+        memcpy(&word, p, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+    }
+    while (size--) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+
+enum { CPU_SSE2 = 1, CPU_SSE42 = 2, CPU_AVX2 = 4, CPU_AVX512 = 8 };
+
+/*
+ * Instruction sets usable by this process (CPU and OS support)
+ */
+static unsigned detect_cpu_features(void)
+{
+    unsigned features = 0;
+
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        features |= CPU_SSE2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        features |= CPU_SSE42;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        features |= CPU_AVX2;
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        features |= CPU_AVX512;
+    }
+#else
+    int info[4];
+
+    __cpuid(info, 1);
+    if (info[3] & (1 << 26)) {
+        features |= CPU_SSE2;
+    }
+    if (info[2] & (1 << 20)) {
+        features |= CPU_SSE42;
+    }
+
+    // AVX state must be enabled by the OS (OSXSAVE, then XCR0)
+    if (info[2] & (1 << 27)) {
+        unsigned long long xcr0 = _xgetbv(0);
+        __cpuidex(info, 7, 0);
+        if ((xcr0 & 0x06) == 0x06 && (info[1] & (1 << 5))) {
+            features |= CPU_AVX2;
+        }
+        if ((xcr0 & 0xE6) == 0xE6 && (info[1] & (1 << 16))) {
+            features |= CPU_AVX512;
+        }
+    }
+#endif
+
+    return features;
+}
+
+#endif /* CHECKSUM_X86 */
+
+/*
+ * Pick the kernels, honouring WINAPI_CHECKSUM_KERNEL (run once, by init_kernels)
+ */
+static void select_kernels(void)
+{
+    xor_kernel_t xor_kernel = xor_scalar;
+    mismatch_kernel_t mismatch_kernel = mismatch_scalar;
+    crc_kernel_t crc_kernel = crc32c_table;
+    const char *name = "scalar";
+    uint32_t i, bit;
+
+    for (i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY_REFLECTED : 0);
+        }
+        g_crc32c_table[i] = crc;
+    }
+
+#ifdef CHECKSUM_X86
+    const char *limit = getenv("WINAPI_CHECKSUM_KERNEL");
+    unsigned features = detect_cpu_features();
+
+    if (limit && strcmp(limit, "scalar") == 0) {
+        features = 0;
+    } else if (limit && strcmp(limit, "sse2") == 0) {
+        features &= CPU_SSE2 | CPU_SSE42;
+    } else if (limit && strcmp(limit, "avx2") == 0) {
+        features &= CPU_SSE2 | CPU_SSE42 | CPU_AVX2;
+    }
+
+    if (features & CPU_AVX512) {
+        xor_kernel = xor_avx512;
+        mismatch_kernel = mismatch_avx512;
+        name = "avx512";
+    } else if (features & CPU_AVX2) {
+        xor_kernel = xor_avx2;
+        mismatch_kernel = mismatch_avx2;
+        name = "avx2";
+    } else if (features & CPU_SSE2) {
+        xor_kernel = xor_sse2;
+        mismatch_kernel = mismatch_sse2;
+        name = "sse2";
+    }
+    if (features & CPU_SSE42) {
+        crc_kernel = crc32c_sse42;
+    }
+#endif
+
+    g_kernel_name = name;
+    g_crc_kernel = crc_kernel;
+    g_mismatch_kernel = mismatch_kernel;
+    g_xor_kernel = xor_kernel;
+}
+
+#ifdef _WIN32
+static INIT_ONCE g_kernels_once = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK select_kernels_once(PINIT_ONCE once, PVOID parameter, PVOID *context)
+{
+    (void)once;
+    (void)parameter;
+    (void)context;
+    select_kernels();
+    return TRUE;
+}
+#else
+static pthread_once_t g_kernels_once = PTHREAD_ONCE_INIT;
+#endif
+
+/*
+ * Select the kernels on first use; callers racing here all wait for one
+ * selection and see the table and pointers it wrote
+ */
+static void init_kernels(void)
+{
+#ifdef _WIN32
+    InitOnceExecuteOnce(&g_kernels_once, select_kernels_once, NULL, NULL);
+#else
+    pthread_once(&g_kernels_once, select_kernels);
+#endif
+}
+
+uint32_t winapi_checksum_xor(const void *data, size_t size)
+{
+    init_kernels();
+    return g_xor_kernel((const unsigned char *)data, size / sizeof(uint32_t));
+}
+
+uint32_t winapi_crc32c(uint32_t crc, const void *data, size_t size)
+{
+    init_kernels();
+    return ~g_crc_kernel(~crc, (const unsigned char *)data, size);
+}
+
+/*
+ * a * b modulo the CRC32C polynomial, both in reflected bit order (x^0 is the top bit)
+ */
+static uint32_t crc32c_multmodp(uint32_t a, uint32_t b)
+{
+    uint32_t m = (uint32_t)1 << 31;
+    uint32_t product = 0;
+
+    while (a) {
+        if (a & m) {
+            product ^= b;
+            a ^= m;
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLY_REFLECTED : b >> 1;
+    }
+    return product;
+}
+
+uint32_t winapi_crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t size2)
+{
+    uint32_t shift = (uint32_t)1 << 31;     /* x^0 */
+    uint32_t square = (uint32_t)1 << 23;    /* x^8, one byte of zeros */
+
+    /* crc1 moves past size2 bytes: times x^(8 * size2), by repeated squaring */
+    while (size2) {
+        if (size2 & 1) {
+            shift = crc32c_multmodp(square, shift);
+        }
+        square = crc32c_multmodp(square, square);
+        size2 >>= 1;
+    }
+    return crc32c_multmodp(shift, crc1) ^ crc2;
+}
+
+uint32_t winapi_frame_crc32c(const winapi_message_header_t *header,
+                             const void *descs, size_t desc_bytes,
+                             const void *inline_data, size_t inline_size)
+{
+    winapi_message_header_t copy = *header;
+    uint32_t crc;
+
+    copy.frame_crc = 0;
+    crc = winapi_crc32c(0, &copy, sizeof(copy));
+    crc = winapi_crc32c(crc, descs, desc_bytes);
+    return winapi_crc32c(crc, inline_data, inline_size);
+}
+
+size_t winapi_pattern_mismatch(const void *data, size_t size, uint32_t pattern)
+{
+    size_t words = size / sizeof(uint32_t);
+    size_t offset;
+
+    init_kernels();
+    offset = g_mismatch_kernel((const unsigned char *)data, words, pattern);
+    return offset == words * sizeof(uint32_t) ? size : offset;
+}
+
+const char *winapi_checksum_kernel(void)
+{
+    init_kernels();
+    return g_kernel_name;
+}
@@ -0,0 +1,47 @@
+/*
+ * Checksum kernels shared by the host service and the guest library
+ *
+ * Buffer tests checksum whole payloads (up to 64MB over the socket, more
+ * through shared buffers), which is CPU-bound with a scalar loop. These
+ * kernels come in scalar, SSE2, AVX2 and AVX-512 variants; the fastest one
+ * the CPU supports is picked on first use. WINAPI_CHECKSUM_KERNEL=scalar,
+ * sse2, avx2 or avx512 caps the choice, for comparing variants.
+ */
+
+#ifndef WINAPI_CHECKSUM_H
+#define WINAPI_CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* XOR of the buffer's 32-bit words (the buffer test checksum), trailing bytes are ignored */
+uint32_t winapi_checksum_xor(const void *data, size_t size);
+
+/* CRC32C (Castagnoli), continuing from crc; start with 0 */
+uint32_t winapi_crc32c(uint32_t crc, const void *data, size_t size);
+
+/* CRC32C of two buffers back to back, from the CRC32C of each and the size of the second */
+uint32_t winapi_crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t size2);
+
+/* CRC32C of a binary frame: header with frame_crc taken as zero, then descriptors and inline data */
+uint32_t winapi_frame_crc32c(const winapi_message_header_t *header,
+                             const void *descs, size_t desc_bytes,
+                             const void *inline_data, size_t inline_size);
+
+/* Byte offset of the first 32-bit word that differs from pattern, or size if all match */
+size_t winapi_pattern_mismatch(const void *data, size_t size, uint32_t pattern);
+
+/* Name of the selected XOR kernel ("scalar", "sse2", "avx2" or "avx512") */
+const char *winapi_checksum_kernel(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WINAPI_CHECKSUM_H */
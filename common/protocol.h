@@ -18,15 +18,43 @@
 typedef enum {
     WINAPI_MSG_REQUEST = 1,
     WINAPI_MSG_RESPONSE = 2,
-    WINAPI_MSG_ERROR = 3
+    WINAPI_MSG_ERROR = 3,
+    WINAPI_MSG_CREDIT = 4,    /* Stream flow control, see "Payload streams" */
+    WINAPI_MSG_DOORBELL = 5   /* Shared memory ring wakeup, see "Shared memory rings" */
 } winapi_message_type_t;
 
+/*
+ * API list: X(ID, value, JSON name), in ascending ID order
+ *
+ * The one place APIs are declared. The enum below, the client's JSON names
+ * and the host's dispatch table are all generated from it, so adding an API
+ * is a line here plus its handler on each side.
+ */
+#define WINAPI_API_LIST(X) \
+    X(ECHO,          1, "echo")          \
+    X(BUFFER_TEST,   2, "buffer_test")   \
+    X(PERF_TEST,     3, "performance")   \
+    X(SHARED_BUFFER, 4, "shared_buffer")  \
+    X(REGISTER_BUFFERS, 5, "register_buffers")
+
 /* API function IDs */
+#define WINAPI_API_ENUM_ENTRY(id, value, name) WINAPI_API_##id = value,
 typedef enum {
-    WINAPI_API_ECHO = 1,
-    WINAPI_API_BUFFER_TEST = 2,
-    WINAPI_API_PERF_TEST = 3
+    WINAPI_API_LIST(WINAPI_API_ENUM_ENTRY)
+    WINAPI_API_ID_LIMIT     /* One past the largest ID */
 } winapi_api_id_t;
+#undef WINAPI_API_ENUM_ENTRY
+
+/* JSON name of an API, NULL for unknown IDs */
+static inline const char *winapi_api_name(uint32_t api_id)
+{
+    switch (api_id) {
+#define WINAPI_API_NAME_ENTRY(id, value, name) case value: return name;
+    WINAPI_API_LIST(WINAPI_API_NAME_ENTRY)
+#undef WINAPI_API_NAME_ENTRY
+    }
+    return 0;
+}
 
 /* Error codes */
 typedef enum {
@@ -35,6 +63,8 @@ typedef enum {
     WINAPI_ERROR_INVALID_PARAMS = -2,
     WINAPI_ERROR_MEMORY_MAP_FAILED = -3,
     WINAPI_ERROR_BUFFER_TOO_LARGE = -4,
+    WINAPI_ERROR_TRANSFER_FAILED = -5,
+    WINAPI_ERROR_NO_MEMORY = -6,
     WINAPI_ERROR_UNKNOWN = -99
 } winapi_error_t;
 
@@ -50,7 +80,7 @@ typedef struct {
     uint32_t flags;         /* Buffer flags (read/write/etc) */
 } winapi_buffer_desc_t;
 
-/* Message header (fixed size: 64 bytes) */
+/* Message header (fixed size: WINAPI_MESSAGE_HEADER_SIZE bytes, part of the frame CRC) */
 typedef struct {
     uint32_t magic;         /* 0xCAFEBABE */
     uint32_t version;       /* Protocol version */
@@ -62,9 +92,15 @@ typedef struct {
     int32_t  error_code;    /* Error code (for responses) */
     uint32_t flags;         /* Message flags */
     uint64_t timestamp;     /* Timestamp for performance measurement */
-    uint32_t reserved[6];   /* Padding to 64 bytes */
+    uint32_t frame_crc;     /* CRC32C of the frame (WINAPI_MSG_FLAG_CRC32C) */
+    uint32_t payload_crc;   /* CRC32C of the socket payload after the frame (WINAPI_MSG_FLAG_CRC32C) */
+    uint32_t reserved[4];   /* Padding to 72 bytes */
 } winapi_message_header_t;
 
+/* The frame CRC covers the whole header, so its size is part of the wire format */
+#define WINAPI_MESSAGE_HEADER_SIZE 72
+typedef char winapi_message_header_size_check[sizeof(winapi_message_header_t) == WINAPI_MESSAGE_HEADER_SIZE ? 1 : -1];
+
 /* Complete message structure */
 typedef struct {
     winapi_message_header_t header;
@@ -80,10 +116,201 @@ typedef struct {
 /* Message flags */
 #define WINAPI_MSG_FLAG_SYNC    0x01  /* Synchronous call */
 #define WINAPI_MSG_FLAG_ASYNC   0x02  /* Asynchronous call */
+#define WINAPI_MSG_FLAG_SOCKET_PAYLOAD 0x04  /* Buffer payload follows the frame on the socket */
+#define WINAPI_MSG_FLAG_CRC32C  0x08  /* frame_crc and payload_crc are set */
+#define WINAPI_MSG_FLAG_STREAM  0x10  /* Buffer payload follows as a chunk stream */
+#define WINAPI_MSG_FLAG_STRIPED 0x20  /* Stream chunks travel on the session's data connections */
+#define WINAPI_MSG_FLAG_REGISTERED 0x40  /* Descriptors name registered buffers, see "Registered buffers" */
 
 /* Magic number for validation */
 #define WINAPI_MESSAGE_MAGIC 0xCAFEBABE
 
+/*
+ * Binary framing
+ *
+ * A binary frame is a winapi_message_header_t followed by buffer_count
+ * winapi_buffer_desc_t entries and inline_size bytes of inline data, all
+ * in little-endian byte order. JSON frames are prefixed by a 4-byte
+ * big-endian length that is always below WINAPI_MAX_JSON_MESSAGE, so a
+ * receiver can tell the two apart from the first 4 bytes: a binary frame
+ * always starts with WINAPI_MESSAGE_MAGIC.
+ *
+ * Binary framing is only used once both sides agreed on
+ * WINAPI_CAP_BINARY_FRAMING during the handshake.
+ */
+#define WINAPI_MAX_JSON_MESSAGE 65536
+
+/*
+ * Connection handshake
+ *
+ * Right after connecting, the client sends a "handshake" JSON call
+ * carrying its winapi_handshake_t fields. The host answers with the
+ * intersection of both sides and keeps it as the feature set of the
+ * connection. Older hosts answer with "Unknown API" and the client stays
+ * on plain JSON with no optional features. A version mismatch also
+ * disables every optional feature.
+ */
+#define WINAPI_CAP_BINARY_FRAMING   0x00000001  /* Binary frames (winapi_message_header_t) */
+#define WINAPI_CAP_PIPELINING       0x00000002  /* Multiple requests in flight, out-of-order completion */
+#define WINAPI_CAP_COMPRESSION      0x00000004  /* Compressed payloads */
+#define WINAPI_CAP_CHECKSUM_CRC32C  0x00000008  /* Per-frame CRC32C */
+#define WINAPI_CAP_BATCH            0x00000010  /* "batch" envelope carrying several calls */
+#define WINAPI_CAP_STREAMING        0x00000020  /* Chunked payload streams with credits */
+#define WINAPI_CAP_STRIPING         0x00000040  /* Streams striped across data connections */
+#define WINAPI_CAP_SHM_RING         0x00000080  /* Small frames through shared memory rings */
+#define WINAPI_CAP_REGISTERED_BUFFERS 0x00000100  /* Buffers described once, then named by index */
+
+/*
+ * Frame integrity
+ *
+ * Once both sides agreed on WINAPI_CAP_CHECKSUM_CRC32C, every binary frame
+ * sets WINAPI_MSG_FLAG_CRC32C. frame_crc covers the header (with frame_crc
+ * itself zero), the descriptors and the inline data; payload_crc covers the
+ * socket payload that follows the frame (WRITE/VERIFY data after a request,
+ * READ data after a response) and is 0 when there is none. Receivers check
+ * both as the bytes arrive and fail the request on a mismatch. JSON frames
+ * carry no header and are not covered.
+ */
+
+/*
+ * Batched calls
+ *
+ * A "batch" JSON request carries a "calls" array of ordinary requests
+ * (echo, buffer_test, performance, shared_buffer). The host runs them in
+ * order and answers with one response whose "results" array holds each
+ * call's own response. Calls that move socket payload, nested batches and
+ * handshakes are rejected per entry; the rest of the batch still runs.
+ */
+#define WINAPI_MAX_BATCH_CALLS 64
+
+/*
+ * Payload streams
+ *
+ * A plain socket payload is capped at WINAPI_MAX_BUFFER_SIZE. Once both
+ * sides agreed on WINAPI_CAP_STREAMING, a binary buffer test may set
+ * WINAPI_MSG_FLAG_STREAM instead of WINAPI_MSG_FLAG_SOCKET_PAYLOAD and give
+ * any total size in stream_size. Its payload then travels as chunks: a
+ * winapi_stream_chunk_t followed by up to WINAPI_STREAM_CHUNK_SIZE data
+ * bytes, the last chunk flagged WINAPI_STREAM_LAST. With CRC32C agreed each
+ * chunk carries the CRC of its data and payload_crc is unused.
+ *
+ * The sender never has more data bytes in flight than the receiver
+ * granted. WRITE/VERIFY: the host grants WINAPI_STREAM_WINDOW bytes once it
+ * has read the request, then the size of every chunk it consumes. READ: the
+ * request's stream_window is the first grant, the client grants each chunk
+ * it consumes; the stream follows a response flagged WINAPI_MSG_FLAG_STREAM.
+ * Grants are binary frames of type WINAPI_MSG_CREDIT carrying the stream's
+ * request_id and a winapi_stream_credit_t. Either side may send other
+ * frames between two chunks. Chunks carry their offset in the payload and
+ * WINAPI_STREAM_LAST marks the last chunk sent on its connection.
+ */
+#define WINAPI_STREAM_MAGIC      0xCAFED00D
+#define WINAPI_STREAM_LAST       0x01
+#define WINAPI_STREAM_CHUNK_SIZE (1024 * 1024)
+#define WINAPI_STREAM_WINDOW     (8 * WINAPI_STREAM_CHUNK_SIZE)
+
+typedef struct {
+    uint32_t magic;         /* WINAPI_STREAM_MAGIC */
+    uint32_t flags;         /* WINAPI_STREAM_LAST on the final chunk */
+    uint64_t request_id;    /* Request the stream belongs to */
+    uint64_t offset;        /* Position of the data in the payload */
+    uint32_t size;          /* Data bytes following this header */
+    uint32_t crc;           /* CRC32C of the data (WINAPI_CAP_CHECKSUM_CRC32C), else 0 */
+} winapi_stream_chunk_t;
+
+typedef struct {
+    uint64_t bytes;         /* Further data bytes the sender may stream */
+} winapi_stream_credit_t;
+
+/*
+ * Data connections
+ *
+ * With WINAPI_CAP_STRIPING agreed, the handshake result also carries the
+ * session_id and a random session_key. The client may then open further
+ * connections and send an "attach" JSON call on each, with session_id,
+ * session_key and its lane number (0 to WINAPI_MAX_DATA_CONNECTIONS - 1).
+ * Once attached, a data connection carries nothing but stream chunks and
+ * credits for its session.
+ *
+ * A stream request flagged WINAPI_MSG_FLAG_STRIPED with stripe_count K
+ * spreads its chunks over lanes 0 to K-1: the chunk at offset o (always a
+ * multiple of WINAPI_STREAM_CHUNK_SIZE, every chunk but the last is full)
+ * travels on lane (o / WINAPI_STREAM_CHUNK_SIZE) % K, and the receiver
+ * places it by offset. Each lane is credited on its own connection, starting
+ * from the stream window. Requests and responses stay on the connection
+ * that made the handshake; READ chunks follow the response on the lanes.
+ */
+#define WINAPI_MAX_DATA_CONNECTIONS 8
+
+/* Shared-buffer backing types */
+#define WINAPI_BACKING_SOCKET        0x01  /* Payload streamed over the socket */
+#define WINAPI_BACKING_SHARED_FILE   0x02  /* File under /mnt/c mapped by both sides */
+#define WINAPI_BACKING_SHARED_MEMORY 0x04  /* Fixed shared memory region */
+
+/* Default frame size: header, all descriptors and a full inline area */
+#define WINAPI_DEFAULT_MAX_FRAME_SIZE \
+    (sizeof(winapi_message_header_t) + WINAPI_MAX_BUFFERS * sizeof(winapi_buffer_desc_t) + WINAPI_MAX_INLINE_DATA)
+
+typedef struct {
+    uint32_t version;          /* WINAPI_PROTOCOL_VERSION of the sender */
+    uint32_t capabilities;     /* WINAPI_CAP_* bitmap */
+    uint32_t max_frame_size;   /* Largest binary frame the sender accepts */
+    uint32_t buffer_backings;  /* WINAPI_BACKING_* bitmap */
+} winapi_handshake_t;
+
+/*
+ * Shared memory rings
+ *
+ * With WINAPI_CAP_SHM_RING the client creates a region file both sides can
+ * map (under /mnt/c for a Windows host), lays it out as below and names it
+ * in the handshake's "ring_path"; the host only agrees once it has mapped
+ * and checked it. The region starts with a winapi_shm_header_t, and
+ * request_offset / response_offset locate two rings of request_count
+ * slots: client to host, then host to client. Each ring is a
+ * winapi_ring_control_t padded to WINAPI_RING_CONTROL_SIZE followed by its
+ * slots; a slot holds a uint32_t frame length and one binary frame.
+ *
+ * Each ring has a single producer and a single consumer. The producer
+ * fills slot head % count and then publishes head + 1; the consumer reads
+ * slot tail % count once it sees head move and then publishes tail + 1.
+ * A consumer that finds its ring empty sets doorbell and looks once more
+ * before it waits on the socket; a producer that publishes while doorbell
+ * is set clears it and sends a WINAPI_MSG_DOORBELL frame (no inline data)
+ * on the socket. The rings carry only frames without socket payload or
+ * stream flags, and any frame may still take the socket, e.g. when a ring
+ * is full.
+ */
+#define WINAPI_SHM_MAGIC           0x57494E41  /* "WINA" */
+#define WINAPI_CACHE_LINE          64
+#define WINAPI_RING_SLOTS          256
+#define WINAPI_RING_SLOT_SIZE      4096        /* Length word plus a full default frame */
+#define WINAPI_RING_CONTROL_SIZE   4096
+#define WINAPI_RING_SIZE           (WINAPI_RING_CONTROL_SIZE + WINAPI_RING_SLOTS * WINAPI_RING_SLOT_SIZE)
+#define WINAPI_SHM_HEADER_SIZE     4096
+#define WINAPI_SHM_RING_REGION_SIZE (WINAPI_SHM_HEADER_SIZE + 2 * WINAPI_RING_SIZE)
+
+typedef struct {
+    uint32_t magic;            /* WINAPI_SHM_MAGIC */
+    uint32_t version;          /* WINAPI_PROTOCOL_VERSION */
+    uint32_t request_count;    /* Slots per ring */
+    uint32_t flags;            /* Reserved, 0 */
+    uint64_t request_offset;   /* Client-to-host ring */
+    uint64_t response_offset;  /* Host-to-client ring */
+    uint32_t request_size;     /* Bytes of each ring, control block included */
+    uint32_t response_size;
+    uint32_t reserved[12];
+} winapi_shm_header_t;
+
+/* Ring indices, each on its own cache line so producer and consumer do not share one */
+typedef struct {
+    uint32_t head;             /* Written by the producer: frames published */
+    uint8_t head_pad[WINAPI_CACHE_LINE - sizeof(uint32_t)];
+    uint32_t tail;             /* Written by the consumer: frames released */
+    uint8_t tail_pad[WINAPI_CACHE_LINE - sizeof(uint32_t)];
+    uint32_t doorbell;         /* Set by an idle consumer, cleared by the producer that wakes it */
+    uint8_t doorbell_pad[WINAPI_CACHE_LINE - sizeof(uint32_t)];
+} winapi_ring_control_t;
+
 /* API-specific structures */
 
 /* Echo API */
@@ -101,8 +328,14 @@ typedef struct {
 typedef struct {
     uint32_t test_pattern;  /* Pattern to fill/verify buffer */
     uint32_t operation;     /* READ, WRITE, or VERIFY */
+    uint64_t stream_size;   /* Total payload of a WINAPI_MSG_FLAG_STREAM request */
+    uint32_t stream_window; /* READ streams: bytes granted up front (per lane when striped) */
+    uint32_t stripe_count;  /* Data connections carrying a WINAPI_MSG_FLAG_STRIPED stream */
 } winapi_buffer_test_request_t;
 
+/* Requests from before streaming end after operation */
+#define WINAPI_BUFFER_TEST_REQUEST_V1_SIZE 8
+
 typedef struct {
     uint64_t bytes_processed;
     uint32_t checksum;
@@ -133,6 +366,96 @@ typedef struct {
 #define WINAPI_PERF_LATENCY     1
 #define WINAPI_PERF_THROUGHPUT  2
 
+/* Shared buffer API */
+#define WINAPI_MAX_OPERATION_NAME 32
+#define WINAPI_MAX_PATH_LEN       256
+
+typedef struct {
+    uint32_t buffer_id;     /* Guest-assigned buffer identifier */
+    uint32_t reserved;
+    uint64_t buffer_size;   /* Size of the backing file in bytes */
+    char operation[WINAPI_MAX_OPERATION_NAME];
+    char file_path[WINAPI_MAX_PATH_LEN];  /* Guest path of the backing file */
+} winapi_shared_buffer_request_t;
+
+/* Registered shared buffer requests end after operation */
+#define WINAPI_SHARED_BUFFER_REQUEST_REGISTERED_SIZE 48
+
+typedef struct {
+    uint64_t bytes_processed;
+    uint32_t buffer_id;
+    uint32_t status;
+} winapi_shared_buffer_response_t;
+
+/*
+ * Registered buffers
+ *
+ * With WINAPI_CAP_REGISTERED_BUFFERS agreed (binary framing only), the
+ * client describes buffers once with register_buffers requests and the
+ * host keeps them in a per-session table of WINAPI_MAX_REGISTERED_BUFFERS
+ * entries. Each request sets or clears up to WINAPI_MAX_BUFFERS entries
+ * (its inline data ends after the last one), the first of a new set
+ * flagged WINAPI_REGISTER_RESET to drop the old set.
+ * A WINAPI_BACKING_SHARED_FILE entry names its file (a shared buffer file,
+ * see below), which the host maps for as long as the entry exists; a
+ * WINAPI_BACKING_SOCKET entry is user memory the host only knows the size
+ * of, and backing 0 clears an entry.
+ *
+ * A buffer test or shared buffer request flagged WINAPI_MSG_FLAG_REGISTERED
+ * then carries one descriptor per range instead of a description: guest_pa
+ * is the offset into the entry, size the length, and flags the access bits
+ * plus the entry index (WINAPI_BUFFER_INDEX). All ranges of a request lie in
+ * entries of the same backing. Shared-file ranges are read or written in
+ * place and move no payload; socket ranges carry theirs as usual. A
+ * registered shared buffer request stops before file_path
+ * (WINAPI_SHARED_BUFFER_REQUEST_REGISTERED_SIZE) and names one range.
+ */
+#define WINAPI_MAX_REGISTERED_BUFFERS 64
+#define WINAPI_REGISTER_RESET         0x01  /* Clear the whole table first */
+
+#define WINAPI_BUFFER_INDEX_SHIFT     16
+#define WINAPI_BUFFER_INDEX(flags)    ((flags) >> WINAPI_BUFFER_INDEX_SHIFT)
+#define WINAPI_BUFFER_REGISTERED(access, index) ((access) | ((uint32_t)(index) << WINAPI_BUFFER_INDEX_SHIFT))
+
+typedef struct {
+    uint32_t index;            /* Table entry, below WINAPI_MAX_REGISTERED_BUFFERS */
+    uint32_t backing;          /* WINAPI_BACKING_SOCKET or _SHARED_FILE, 0 to clear the entry */
+    uint64_t size;             /* Bytes of the buffer */
+    char file_path[WINAPI_MAX_PATH_LEN];  /* Guest path of a shared file */
+} winapi_registered_buffer_t;
+
+typedef struct {
+    uint32_t count;            /* Entries that follow */
+    uint32_t flags;            /* WINAPI_REGISTER_RESET */
+    winapi_registered_buffer_t entries[WINAPI_MAX_BUFFERS];
+} winapi_register_buffers_request_t;
+
+typedef struct {
+    uint32_t registered;       /* Entries the table holds now */
+    uint32_t status;
+} winapi_register_buffers_response_t;
+
+/*
+ * Shared buffer files
+ *
+ * The client creates them in its shared temp directory (/mnt/c/temp, C:\temp
+ * on the host) with one page past the data, rounded up to a page, and writes
+ * this trailer at the start of that page. The host maps a registered file
+ * only if it lies directly in that directory and carries a trailer matching
+ * the registered size, so naming a path never gets the host to write to a
+ * file the client did not make for it.
+ */
+#define WINAPI_SHARED_FILE_DIR           "/mnt/c/temp"
+#define WINAPI_SHARED_FILE_MAGIC         0x46534857  /* "WHSF" */
+#define WINAPI_SHARED_FILE_TRAILER(size) WINAPI_ALIGN_PAGE(size)  /* Trailer offset */
+#define WINAPI_SHARED_FILE_SIZE(size)    (WINAPI_SHARED_FILE_TRAILER(size) + WINAPI_PAGE_SIZE)
+
+typedef struct {
+    uint32_t magic;            /* WINAPI_SHARED_FILE_MAGIC */
+    uint32_t buffer_id;
+    uint64_t size;             /* Data bytes before the trailer page */
+} winapi_shared_file_trailer_t;
+
 /* Helper macros */
 #define WINAPI_ALIGN_UP(x, align) (((x) + (align) - 1) & ~((align) - 1))
 #define WINAPI_PAGE_SIZE 4096
@@ -149,6 +472,14 @@ typedef winapi_buffer_test_request_t WINAPI_BUFFER_TEST_REQUEST_T, *PWINAPI_BUFF
 typedef winapi_buffer_test_response_t WINAPI_BUFFER_TEST_RESPONSE_T, *PWINAPI_BUFFER_TEST_RESPONSE_T;
 typedef winapi_perf_test_request_t WINAPI_PERF_TEST_REQUEST_T, *PWINAPI_PERF_TEST_REQUEST_T;
 typedef winapi_perf_test_response_t WINAPI_PERF_TEST_RESPONSE_T, *PWINAPI_PERF_TEST_RESPONSE_T;
+typedef winapi_shared_buffer_request_t WINAPI_SHARED_BUFFER_REQUEST_T, *PWINAPI_SHARED_BUFFER_REQUEST_T;
+typedef winapi_shared_buffer_response_t WINAPI_SHARED_BUFFER_RESPONSE_T, *PWINAPI_SHARED_BUFFER_RESPONSE_T;
+typedef winapi_handshake_t WINAPI_HANDSHAKE_T, *PWINAPI_HANDSHAKE_T;
+typedef winapi_shm_header_t WINAPI_SHM_HEADER_T, *PWINAPI_SHM_HEADER_T;
+typedef winapi_registered_buffer_t WINAPI_REGISTERED_BUFFER_T, *PWINAPI_REGISTERED_BUFFER_T;
+typedef winapi_register_buffers_request_t WINAPI_REGISTER_BUFFERS_REQUEST_T, *PWINAPI_REGISTER_BUFFERS_REQUEST_T;
+typedef winapi_register_buffers_response_t WINAPI_REGISTER_BUFFERS_RESPONSE_T, *PWINAPI_REGISTER_BUFFERS_RESPONSE_T;
+typedef winapi_shared_file_trailer_t WINAPI_SHARED_FILE_TRAILER_T, *PWINAPI_SHARED_FILE_TRAILER_T;
 #endif
 
 #endif /* WINAPI_REMOTING_PROTOCOL_H */
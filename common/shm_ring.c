@@ -0,0 +1,443 @@
+/*
+ * Shared memory rings shared by the host service and the guest library
+ *
+ * Indices only ever grow (modulo 2^32) and slot i is i % slot_count. A
+ * producer's slot writes become visible before the head that publishes
+ * them (release/acquire), and the doorbell handshake needs a full fence on
+ * both sides: the consumer sets doorbell then rereads head, the producer
+ * publishes head then reads doorbell, so at least one of them sees the
+ * other and a frame never sits in the ring with its consumer asleep.
+ */
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "shm_ring.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#if defined(__GNUC__)
+
+static uint32_t load_acquire(const uint32_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void store_release(uint32_t *p, uint32_t value)
+{
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+static void full_fence(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static uint32_t exchange(uint32_t *p, uint32_t value)
+{
+    return __atomic_exchange_n(p, value, __ATOMIC_SEQ_CST);
+}
+
+static int compare_exchange(uint32_t *p, uint32_t *expected, uint32_t value)
+{
+    return __atomic_compare_exchange_n(p, expected, value, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#else
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+#elif defined(_MSC_VER)
+#include <intrin.h>
+
+/* x86 orders plain loads and stores as acquire/release already, the compiler must not reorder them */
+#if defined(_M_X64) || defined(_M_IX86)
+#define ORDER_BARRIER() _ReadWriteBarrier()
+#else
+#define ORDER_BARRIER() full_fence()
+#endif
+
+static void full_fence(void)
+{
+    volatile long fence = 0;
+    _InterlockedOr(&fence, 0);
+}
+
+static uint32_t load_acquire(const uint32_t *p)
+{
+    uint32_t value = *(const volatile uint32_t *)p;
+    ORDER_BARRIER();
+    return value;
+}
+
+static void store_release(uint32_t *p, uint32_t value)
+{
+    ORDER_BARRIER();
+    *(volatile uint32_t *)p = value;
+}
+
+static uint32_t exchange(uint32_t *p, uint32_t value)
+{
+    return (uint32_t)_InterlockedExchange((volatile long *)p, (long)value);
+}
+
+static int compare_exchange(uint32_t *p, uint32_t *expected, uint32_t value)
+{
+    uint32_t seen = (uint32_t)_InterlockedCompareExchange((volatile long *)p, (long)value, (long)*expected);
+
+    if (seen == *expected) {
+        return 1;
+    }
+    *expected = seen;
+    return 0;
+}
+
+static void cpu_relax(void)
+{
+    YieldProcessor();
+}
+
+#endif
+
+static void thread_yield(void)
+{
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+/* Largest ring a region may declare */
+#define MAX_RING_SLOTS 65536
+
+int winapi_shm_format(void *region, size_t size)
+{
+    winapi_shm_header_t *header = (winapi_shm_header_t *)region;
+    winapi_ring_control_t *requests;
+    winapi_ring_control_t *responses;
+
+    if (size < WINAPI_SHM_RING_REGION_SIZE) {
+        return -1;
+    }
+
+    memset(region, 0, WINAPI_SHM_HEADER_SIZE);
+    header->magic = WINAPI_SHM_MAGIC;
+    header->version = WINAPI_PROTOCOL_VERSION;
+    header->request_count = WINAPI_RING_SLOTS;
+    header->request_offset = WINAPI_SHM_HEADER_SIZE;
+    header->response_offset = WINAPI_SHM_HEADER_SIZE + WINAPI_RING_SIZE;
+    header->request_size = WINAPI_RING_SIZE;
+    header->response_size = WINAPI_RING_SIZE;
+
+    // Neither consumer is polling yet, the first frame each way rings
+    requests = (winapi_ring_control_t *)((uint8_t *)region + header->request_offset);
+    responses = (winapi_ring_control_t *)((uint8_t *)region + header->response_offset);
+    memset(requests, 0, sizeof(*requests));
+    memset(responses, 0, sizeof(*responses));
+    requests->doorbell = 1;
+    responses->doorbell = 1;
+    return 0;
+}
+
+/* View of the ring at offset, checked against the region bounds */
+static int attach_ring(uint8_t *base, size_t size, uint64_t offset, uint64_t ring_size, uint32_t slot_count,
+                       winapi_ring_t *ring)
+{
+    uint64_t needed = WINAPI_RING_CONTROL_SIZE + (uint64_t)slot_count * WINAPI_RING_SLOT_SIZE;
+
+    if (ring_size < needed || offset % WINAPI_CACHE_LINE != 0 || offset > size || size - offset < needed) {
+        return -1;
+    }
+
+    ring->control = (winapi_ring_control_t *)(base + offset);
+    ring->slots = base + offset + WINAPI_RING_CONTROL_SIZE;
+    ring->slot_count = slot_count;
+    ring->slot_size = WINAPI_RING_SLOT_SIZE;
+    ring->cursor = 0;
+    ring->published = 0;
+    return 0;
+}
+
+int winapi_shm_attach(void *region, size_t size, winapi_ring_t *requests, winapi_ring_t *responses)
+{
+    winapi_shm_header_t header;
+    uint64_t request_end;
+
+    if (size < sizeof(header)) {
+        return -1;
+    }
+    memcpy(&header, region, sizeof(header));
+
+    if (header.magic != WINAPI_SHM_MAGIC || header.version != WINAPI_PROTOCOL_VERSION ||
+        header.request_count == 0 || header.request_count > MAX_RING_SLOTS) {
+        return -1;
+    }
+
+    // The rings must not overlap the header or each other
+    request_end = header.request_offset + header.request_size;
+    if (header.request_offset < sizeof(header) || header.response_offset < request_end ||
+        attach_ring((uint8_t *)region, size, header.request_offset, header.request_size,
+                    header.request_count, requests) < 0 ||
+        attach_ring((uint8_t *)region, size, header.response_offset, header.response_size,
+                    header.request_count, responses) < 0) {
+        return -1;
+    }
+
+    // Both sides start from a fresh region
+    if (load_acquire(&requests->control->head) != 0 || load_acquire(&responses->control->head) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Total size of a frame's parts, 0 if it does not fit in a slot */
+static size_t frame_size(const winapi_ring_t *ring, const size_t *sizes, int count)
+{
+    size_t length = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        length += sizes[i];
+    }
+    return length > ring->slot_size - sizeof(uint32_t) ? 0 : length;
+}
+
+/* Length word, then the parts, into the slot of index */
+static void write_slot(winapi_ring_t *ring, uint32_t index, const void *const *parts, const size_t *sizes, int count,
+                       size_t length)
+{
+    uint8_t *slot = ring->slots + (size_t)(index % ring->slot_count) * ring->slot_size;
+    uint32_t frame_length = (uint32_t)length;
+    int i;
+
+    memcpy(slot, &frame_length, sizeof(frame_length));
+    slot += sizeof(frame_length);
+    for (i = 0; i < count; i++) {
+        memcpy(slot, parts[i], sizes[i]);
+        slot += sizes[i];
+    }
+}
+
+int winapi_ring_send(winapi_ring_t *ring, const void *const *parts, const size_t *sizes, int count)
+{
+    size_t length = frame_size(ring, sizes, count);
+
+    // A bogus tail from the consumer only makes the ring look full
+    if (length == 0 || ring->cursor - load_acquire(&ring->control->tail) >= ring->slot_count) {
+        return -1;
+    }
+
+    write_slot(ring, ring->cursor, parts, sizes, count, length);
+    ring->cursor++;
+    store_release(&ring->control->head, ring->cursor);
+    return 0;
+}
+
+/* Spins on a slower producer before yielding to it */
+#define PUBLISH_SPINS 64
+
+int winapi_ring_send_mp(winapi_ring_t *ring, const void *const *parts, const size_t *sizes, int count)
+{
+    size_t length = frame_size(ring, sizes, count);
+    uint32_t index = load_acquire(&ring->cursor);
+    int spins = 0;
+
+    if (length == 0) {
+        return -1;
+    }
+
+    do {
+        if (index - load_acquire(&ring->control->tail) >= ring->slot_count) {
+            return -1;
+        }
+    } while (!compare_exchange(&ring->cursor, &index, index + 1));
+
+    write_slot(ring, index, parts, sizes, count, length);
+
+    // Claims are published in order; the private copy of head is the one waited on, the region's is the consumer's to read
+    while (load_acquire(&ring->published) != index) {
+        if (++spins < PUBLISH_SPINS) {
+            cpu_relax();
+        } else {
+            thread_yield();
+        }
+    }
+    store_release(&ring->control->head, index + 1);
+    store_release(&ring->published, index + 1);
+    return 0;
+}
+
+int winapi_ring_doorbell(winapi_ring_t *ring)
+{
+    full_fence();
+    if (load_acquire(&ring->control->doorbell) == 0) {
+        return 0;
+    }
+    return exchange(&ring->control->doorbell, 0) != 0;
+}
+
+uint32_t winapi_ring_pending(const winapi_ring_t *ring)
+{
+    return load_acquire(&ring->control->head) - ring->cursor;
+}
+
+long winapi_ring_receive(winapi_ring_t *ring, void *frame, size_t size)
+{
+    uint32_t available = winapi_ring_pending(ring);
+    const uint8_t *slot;
+    uint32_t frame_length;
+
+    if (available == 0) {
+        return 0;
+    }
+    if (available > ring->slot_count) {
+        return -1;
+    }
+
+    // The length is read once; the producer cannot grow the copy after the check
+    slot = ring->slots + (size_t)(ring->cursor % ring->slot_count) * ring->slot_size;
+    memcpy(&frame_length, slot, sizeof(frame_length));
+    if (frame_length == 0 || frame_length > ring->slot_size - sizeof(frame_length) || frame_length > size) {
+        return -1;
+    }
+    memcpy(frame, slot + sizeof(frame_length), frame_length);
+
+    ring->cursor++;
+    store_release(&ring->control->tail, ring->cursor);
+    return (long)frame_length;
+}
+
+int winapi_ring_wait(winapi_ring_t *ring)
+{
+    store_release(&ring->control->doorbell, 1);
+    full_fence();
+    if (winapi_ring_pending(ring) == 0) {
+        return 1;
+    }
+
+    // Not needed after all; a doorbell the producer already took is just spurious
+    exchange(&ring->control->doorbell, 0);
+    return 0;
+}
+
+/* Spin iterations between clock reads */
+#define POLL_SPIN_BATCH 32
+
+/* Weight of a new gap in the smoothed one, as a shift (1/8) */
+#define POLL_GAP_SHIFT 3
+
+uint64_t winapi_clock_ns(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000ull +
+           (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000ull / (uint64_t)frequency.QuadPart;
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+#endif
+}
+
+static int cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    return (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+}
+
+void winapi_ring_poll_init(winapi_ring_poll_t *poller, uint64_t spin_limit_ns)
+{
+    poller->spin_limit_ns = spin_limit_ns;
+    poller->spin = cpu_count() > 1;
+    poller->gap_ns = spin_limit_ns / 2;   // Spin the whole limit until the first gap is measured
+    poller->idle_since_ns = 0;
+}
+
+int winapi_ring_poll(const winapi_ring_t *ring, winapi_ring_poll_t *poller, uint64_t slice_ns)
+{
+    uint64_t now = winapi_clock_ns();
+    uint64_t window = poller->gap_ns * 2;
+    uint64_t slice_end = now + slice_ns;
+    int i;
+
+    if (window > poller->spin_limit_ns) {
+        window = poller->gap_ns > poller->spin_limit_ns ? 0 : poller->spin_limit_ns;
+    }
+    if (poller->idle_since_ns == 0) {
+        poller->idle_since_ns = now;
+    }
+
+    for (;;) {
+        uint64_t idle = now - poller->idle_since_ns;
+
+        // Spin for the window, then yield the CPU for as long again
+        if (idle >= window * 2) {
+            return winapi_ring_pending(ring) > 0 ? WINAPI_POLL_READY : WINAPI_POLL_BLOCK;
+        }
+        if (idle < window && poller->spin) {
+            for (i = 0; i < POLL_SPIN_BATCH; i++) {
+                if (winapi_ring_pending(ring) > 0) {
+                    return WINAPI_POLL_READY;
+                }
+                cpu_relax();
+            }
+        } else {
+            thread_yield();
+            if (winapi_ring_pending(ring) > 0) {
+                return WINAPI_POLL_READY;
+            }
+        }
+
+        now = winapi_clock_ns();
+        if (now >= slice_end) {
+            return WINAPI_POLL_AGAIN;
+        }
+    }
+}
+
+void winapi_ring_poll_arrival(winapi_ring_poll_t *poller)
+{
+    uint64_t gap;
+
+    if (poller->idle_since_ns == 0) {
+        return;
+    }
+
+    // A long sleep counts as just past the limit, so the window reopens soon after load returns
+    gap = winapi_clock_ns() - poller->idle_since_ns;
+    if (gap > poller->spin_limit_ns * 2) {
+        gap = poller->spin_limit_ns * 2;
+    }
+    poller->gap_ns = poller->gap_ns - (poller->gap_ns >> POLL_GAP_SHIFT) + (gap >> POLL_GAP_SHIFT);
+    poller->idle_since_ns = 0;
+}
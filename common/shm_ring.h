@@ -0,0 +1,101 @@
+/*
+ * Shared memory rings shared by the host service and the guest library
+ *
+ * Small frames skip the socket: each side produces into one ring of the
+ * region described in protocol.h ("Shared memory rings") and consumes the
+ * other, and the socket only carries doorbells for a consumer that went
+ * idle. Everything read from the region is the other side's to write, so
+ * a view keeps its own copy of the geometry and of its index and checks
+ * whatever else it reads.
+ */
+
+#ifndef WINAPI_SHM_RING_H
+#define WINAPI_SHM_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* One side's view of a ring */
+typedef struct {
+    winapi_ring_control_t *control;
+    uint8_t *slots;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    uint32_t cursor;        /* Own index: head when producing, tail when consuming */
+    uint32_t published;     /* Multi-producer: head as last stored, claims up to cursor are being written */
+} winapi_ring_t;
+
+/* Lay out a new region of size bytes (the creator, before handing it over), 0 or -1 if too small */
+int winapi_shm_format(void *region, size_t size);
+
+/* Check a mapped region and set up views of its client-to-host and host-to-client rings, 0 or -1 */
+int winapi_shm_attach(void *region, size_t size, winapi_ring_t *requests, winapi_ring_t *responses);
+
+/* Producer: publish the concatenated parts as one frame, 0 or -1 if the ring is full or it does not fit */
+int winapi_ring_send(winapi_ring_t *ring, const void *const *parts, const size_t *sizes, int count);
+
+/*
+ * Producer shared by threads of one process: each claims a slot with a
+ * compare-and-swap on cursor, copies its frame in, and then publishes it
+ * once every earlier claim is published, so the consumer still sees one
+ * in-order head. Same results as winapi_ring_send.
+ */
+int winapi_ring_send_mp(winapi_ring_t *ring, const void *const *parts, const size_t *sizes, int count);
+
+/* Producer, after a send: 1 if the consumer was waiting and must get a doorbell */
+int winapi_ring_doorbell(winapi_ring_t *ring);
+
+/* Consumer: frames ready to be received */
+uint32_t winapi_ring_pending(const winapi_ring_t *ring);
+
+/* Consumer: copy the next frame out and release its slot; its size, 0 if none, -1 if the ring is corrupt */
+long winapi_ring_receive(winapi_ring_t *ring, void *frame, size_t size);
+
+/* Consumer found the ring empty: ask for a doorbell; 1 if still empty, 0 if a frame arrived meanwhile */
+int winapi_ring_wait(winapi_ring_t *ring);
+
+/*
+ * Adaptive busy-poll of a consumer that found its ring empty: spin on the
+ * head index, then back off with thread yields, and only then ask for a
+ * doorbell and block. The spin window follows the smoothed gap between the
+ * ring going empty and the next frame: twice that gap, at most spin_limit.
+ * Under load the answer shows up while spinning and neither side touches
+ * the socket; when arrivals are further apart than the limit the window
+ * closes and the consumer blocks right away, so an idle one costs no CPU.
+ * With a single CPU online the producer cannot run while the consumer
+ * spins, so the window is spent yielding instead.
+ */
+typedef struct {
+    uint64_t spin_limit_ns;   /* Longest spin window, 0 never spins */
+    int spin;                 /* Spin in the first half of the window, 0 to yield throughout */
+    uint64_t gap_ns;          /* Smoothed empty-to-next-frame gap */
+    uint64_t idle_since_ns;   /* When the ring was found empty, 0 while frames keep coming */
+} winapi_ring_poll_t;
+
+/* winapi_ring_poll results */
+#define WINAPI_POLL_READY   0   /* A frame is pending */
+#define WINAPI_POLL_AGAIN   1   /* Still empty, within the window: call again (after other work) */
+#define WINAPI_POLL_BLOCK   2   /* Window over: arm the doorbell (winapi_ring_wait) and block */
+
+/* Monotonic clock in nanoseconds */
+uint64_t winapi_clock_ns(void);
+
+void winapi_ring_poll_init(winapi_ring_poll_t *poller, uint64_t spin_limit_ns);
+
+/* Wait for a frame for up to slice_ns of the current window, one WINAPI_POLL_* */
+int winapi_ring_poll(const winapi_ring_t *ring, winapi_ring_poll_t *poller, uint64_t slice_ns);
+
+/* A frame was received: close the idle gap it ends, if any */
+void winapi_ring_poll_arrival(winapi_ring_poll_t *poller);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WINAPI_SHM_RING_H */
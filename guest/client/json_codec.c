@@ -0,0 +1,648 @@
+/*
+ * Allocation-free JSON for the library's JSON calls
+ *
+ * The writer appends to its buffer and only records overflow, so callers
+ * write a whole document and check once. The reader is a recursive-descent
+ * tokenizer: every value becomes one token holding its span and the index
+ * just past its contents, which lets lookups skip whole subtrees.
+ */
+
+#include "json_codec.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Writer */
+
+void json_writer_init(struct json_writer *writer, char *data, size_t size) {
+    writer->data = data;
+    writer->size = size;
+    writer->length = 0;
+    writer->overflow = 0;
+}
+
+long json_writer_length(const struct json_writer *writer) {
+    return writer->overflow ? -1 : (long)writer->length;
+}
+
+/* Append raw bytes */
+static void put_bytes(struct json_writer *writer, const char *data, size_t length) {
+    if (writer->overflow || length > writer->size - writer->length) {
+        writer->overflow = 1;
+        return;
+    }
+    memcpy(writer->data + writer->length, data, length);
+    writer->length += length;
+}
+
+static void put_char(struct json_writer *writer, char c) {
+    put_bytes(writer, &c, 1);
+}
+
+/* Append a quoted string, escaping quotes, backslashes and control characters */
+static void put_string(struct json_writer *writer, const char *value) {
+    static const char hex[] = "0123456789abcdef";
+    const char *run = value;
+    const char *p;
+
+    put_char(writer, '"');
+    for (p = value; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        char escape[6];
+        size_t escape_length = 2;
+
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        // Plain bytes go out in runs, each escape on its own
+        put_bytes(writer, run, (size_t)(p - run));
+        run = p + 1;
+
+        escape[0] = '\\';
+        switch (c) {
+            case '"':  escape[1] = '"'; break;
+            case '\\': escape[1] = '\\'; break;
+            case '\b': escape[1] = 'b'; break;
+            case '\f': escape[1] = 'f'; break;
+            case '\n': escape[1] = 'n'; break;
+            case '\r': escape[1] = 'r'; break;
+            case '\t': escape[1] = 't'; break;
+            default:
+                escape[1] = 'u';
+                escape[2] = '0';
+                escape[3] = '0';
+                escape[4] = hex[c >> 4];
+                escape[5] = hex[c & 0xF];
+                escape_length = 6;
+                break;
+        }
+        put_bytes(writer, escape, escape_length);
+    }
+    put_bytes(writer, run, (size_t)(p - run));
+    put_char(writer, '"');
+}
+
+/* Separator from the previous member or element, then the key if any */
+static void begin_value(struct json_writer *writer, const char *key) {
+    if (writer->length > 0 && !writer->overflow) {
+        char last = writer->data[writer->length - 1];
+        if (last != '{' && last != '[') {
+            put_char(writer, ',');
+        }
+    }
+    if (key) {
+        put_string(writer, key);
+        put_char(writer, ':');
+    }
+}
+
+/* Append the decimal digits of a value */
+static void put_decimal(struct json_writer *writer, uint64_t value) {
+    char digits[20];
+    size_t count = 0;
+
+    do {
+        digits[sizeof(digits) - ++count] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    put_bytes(writer, digits + sizeof(digits) - count, count);
+}
+
+void json_write_begin_object(struct json_writer *writer, const char *key) {
+    begin_value(writer, key);
+    put_char(writer, '{');
+}
+
+void json_write_end_object(struct json_writer *writer) {
+    put_char(writer, '}');
+}
+
+void json_write_begin_array(struct json_writer *writer, const char *key) {
+    begin_value(writer, key);
+    put_char(writer, '[');
+}
+
+void json_write_end_array(struct json_writer *writer) {
+    put_char(writer, ']');
+}
+
+void json_write_string(struct json_writer *writer, const char *key, const char *value) {
+    begin_value(writer, key);
+    put_string(writer, value);
+}
+
+void json_write_int(struct json_writer *writer, const char *key, int64_t value) {
+    begin_value(writer, key);
+    if (value < 0) {
+        put_char(writer, '-');
+        put_decimal(writer, 0 - (uint64_t)value);
+    } else {
+        put_decimal(writer, (uint64_t)value);
+    }
+}
+
+void json_write_uint(struct json_writer *writer, const char *key, uint64_t value) {
+    begin_value(writer, key);
+    put_decimal(writer, value);
+}
+
+void json_write_bool(struct json_writer *writer, const char *key, int value) {
+    begin_value(writer, key);
+    if (value) {
+        put_bytes(writer, "true", 4);
+    } else {
+        put_bytes(writer, "false", 5);
+    }
+}
+
+/* Reader */
+
+struct json_parser {
+    struct json_view *view;
+    const char *text;
+    size_t length;
+    size_t pos;
+};
+
+static int parse_value(struct json_parser *parser, int depth);
+
+static void skip_space(struct json_parser *parser) {
+    while (parser->pos < parser->length) {
+        char c = parser->text[parser->pos];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            break;
+        }
+        parser->pos++;
+    }
+}
+
+/* Claim the next token, -1 when the view is full */
+static int add_token(struct json_parser *parser, uint32_t type, size_t start) {
+    struct json_view *view = parser->view;
+    struct json_token *token;
+
+    if (view->count >= view->capacity) {
+        return -1;
+    }
+    token = &view->tokens[view->count];
+    token->type = type;
+    token->start = (uint32_t)start;
+    token->length = 0;
+    token->next = 0;
+    return view->count++;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* String starting at the opening quote */
+static int parse_string(struct json_parser *parser) {
+    size_t start = ++parser->pos;
+    int index;
+    int i;
+
+    while (parser->pos < parser->length) {
+        unsigned char c = (unsigned char)parser->text[parser->pos];
+
+        if (c == '"') {
+            index = add_token(parser, JSON_TYPE_STRING, start);
+            if (index < 0) {
+                return -1;
+            }
+            parser->view->tokens[index].length = (uint32_t)(parser->pos - start);
+            parser->view->tokens[index].next = (uint32_t)index + 1;
+            parser->pos++;
+            return index;
+        }
+        if (c < 0x20) {
+            return -1;
+        }
+        if (c == '\\') {
+            if (++parser->pos >= parser->length) {
+                return -1;
+            }
+            switch (parser->text[parser->pos]) {
+                case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+                    break;
+                case 'u':
+                    for (i = 1; i <= 4; i++) {
+                        if (parser->pos + i >= parser->length || hex_value(parser->text[parser->pos + i]) < 0) {
+                            return -1;
+                        }
+                    }
+                    parser->pos += 4;
+                    break;
+                default:
+                    return -1;
+            }
+        }
+        parser->pos++;
+    }
+    return -1;
+}
+
+/* Number in JSON's grammar */
+static int parse_number(struct json_parser *parser) {
+    const char *text = parser->text;
+    size_t start = parser->pos;
+    size_t pos = start;
+    size_t digits;
+    int index;
+
+    if (pos < parser->length && text[pos] == '-') {
+        pos++;
+    }
+    for (digits = 0; pos < parser->length && text[pos] >= '0' && text[pos] <= '9'; digits++) {
+        pos++;
+    }
+    if (digits == 0 || (digits > 1 && text[pos - digits] == '0')) {
+        return -1;
+    }
+    if (pos < parser->length && text[pos] == '.') {
+        for (pos++, digits = 0; pos < parser->length && text[pos] >= '0' && text[pos] <= '9'; digits++) {
+            pos++;
+        }
+        if (digits == 0) {
+            return -1;
+        }
+    }
+    if (pos < parser->length && (text[pos] == 'e' || text[pos] == 'E')) {
+        pos++;
+        if (pos < parser->length && (text[pos] == '+' || text[pos] == '-')) {
+            pos++;
+        }
+        for (digits = 0; pos < parser->length && text[pos] >= '0' && text[pos] <= '9'; digits++) {
+            pos++;
+        }
+        if (digits == 0) {
+            return -1;
+        }
+    }
+
+    index = add_token(parser, JSON_TYPE_NUMBER, start);
+    if (index < 0) {
+        return -1;
+    }
+    parser->view->tokens[index].length = (uint32_t)(pos - start);
+    parser->view->tokens[index].next = (uint32_t)index + 1;
+    parser->pos = pos;
+    return index;
+}
+
+/* true, false or null */
+static int parse_literal(struct json_parser *parser, const char *literal, uint32_t type) {
+    size_t length = strlen(literal);
+    int index;
+
+    if (parser->length - parser->pos < length || memcmp(parser->text + parser->pos, literal, length) != 0) {
+        return -1;
+    }
+    index = add_token(parser, type, parser->pos);
+    if (index < 0) {
+        return -1;
+    }
+    parser->view->tokens[index].length = (uint32_t)length;
+    parser->view->tokens[index].next = (uint32_t)index + 1;
+    parser->pos += length;
+    return index;
+}
+
+/* Object or array starting at its opening bracket */
+static int parse_container(struct json_parser *parser, int depth, int is_object) {
+    char close = is_object ? '}' : ']';
+    size_t start = parser->pos++;
+    int index;
+
+    if (depth >= JSON_MAX_DEPTH) {
+        return -1;
+    }
+    index = add_token(parser, is_object ? JSON_TYPE_OBJECT : JSON_TYPE_ARRAY, start);
+    if (index < 0) {
+        return -1;
+    }
+
+    skip_space(parser);
+    if (parser->pos < parser->length && parser->text[parser->pos] == close) {
+        parser->pos++;
+    } else {
+        for (;;) {
+            if (is_object) {
+                if (parser->pos >= parser->length || parser->text[parser->pos] != '"' || parse_string(parser) < 0) {
+                    return -1;
+                }
+                skip_space(parser);
+                if (parser->pos >= parser->length || parser->text[parser->pos] != ':') {
+                    return -1;
+                }
+                parser->pos++;
+                skip_space(parser);
+            }
+            if (parse_value(parser, depth + 1) < 0) {
+                return -1;
+            }
+            skip_space(parser);
+            if (parser->pos >= parser->length) {
+                return -1;
+            }
+            if (parser->text[parser->pos] == close) {
+                parser->pos++;
+                break;
+            }
+            if (parser->text[parser->pos] != ',') {
+                return -1;
+            }
+            parser->pos++;
+            skip_space(parser);
+        }
+    }
+
+    parser->view->tokens[index].length = (uint32_t)(parser->pos - start);
+    parser->view->tokens[index].next = (uint32_t)parser->view->count;
+    return index;
+}
+
+static int parse_value(struct json_parser *parser, int depth) {
+    if (parser->pos >= parser->length) {
+        return -1;
+    }
+    switch (parser->text[parser->pos]) {
+        case '{': return parse_container(parser, depth, 1);
+        case '[': return parse_container(parser, depth, 0);
+        case '"': return parse_string(parser);
+        case 't': return parse_literal(parser, "true", JSON_TYPE_TRUE);
+        case 'f': return parse_literal(parser, "false", JSON_TYPE_FALSE);
+        case 'n': return parse_literal(parser, "null", JSON_TYPE_NULL);
+        default:  return parse_number(parser);
+    }
+}
+
+void json_view_init(struct json_view *view, struct json_token *tokens, int capacity) {
+    view->text = NULL;
+    view->tokens = tokens;
+    view->capacity = capacity;
+    view->count = 0;
+}
+
+int json_view_parse(struct json_view *view, const char *text, size_t length) {
+    struct json_parser parser;
+
+    parser.view = view;
+    parser.text = text;
+    parser.length = length;
+    parser.pos = 0;
+
+    view->text = text;
+    view->count = 0;
+
+    skip_space(&parser);
+    if (parse_value(&parser, 0) < 0) {
+        view->count = 0;
+        return -1;
+    }
+    skip_space(&parser);
+    if (parser.pos != length) {
+        view->count = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static const struct json_token *get_token(const struct json_view *view, int token) {
+    return token >= 0 && token < view->count ? &view->tokens[token] : NULL;
+}
+
+int json_view_member(const struct json_view *view, int object, const char *key) {
+    const struct json_token *container = get_token(view, object);
+    size_t key_length = strlen(key);
+    uint32_t i;
+
+    if (!container || container->type != JSON_TYPE_OBJECT) {
+        return -1;
+    }
+    // Keys at i, values at i + 1, the next key after the value's contents
+    for (i = (uint32_t)object + 1; i < container->next; i = view->tokens[i + 1].next) {
+        const struct json_token *name = &view->tokens[i];
+        if (name->length == key_length && memcmp(view->text + name->start, key, key_length) == 0) {
+            return (int)i + 1;
+        }
+    }
+    return -1;
+}
+
+int json_view_element(const struct json_view *view, int array, int index) {
+    const struct json_token *container = get_token(view, array);
+    uint32_t i;
+
+    if (!container || container->type != JSON_TYPE_ARRAY || index < 0) {
+        return -1;
+    }
+    for (i = (uint32_t)array + 1; i < container->next; i = view->tokens[i].next) {
+        if (index-- == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+int json_view_size(const struct json_view *view, int container) {
+    const struct json_token *token = get_token(view, container);
+    int size = 0;
+    uint32_t i;
+
+    if (!token || (token->type != JSON_TYPE_OBJECT && token->type != JSON_TYPE_ARRAY)) {
+        return 0;
+    }
+    for (i = (uint32_t)container + 1; i < token->next; i = view->tokens[i].next) {
+        if (token->type == JSON_TYPE_OBJECT) {
+            i++;
+        }
+        size++;
+    }
+    return size;
+}
+
+/*
+ * Integer digits of a number token as a magnitude, saturating; fractions and
+ * exponents go through strtod. Returns 0 if the token is not a number.
+ */
+static int number_value(const struct json_view *view, int token, int *negative, uint64_t *magnitude, double *real,
+                        int *is_real) {
+    const struct json_token *number = get_token(view, token);
+    const char *p, *end;
+
+    if (!number || number->type != JSON_TYPE_NUMBER) {
+        return 0;
+    }
+    p = view->text + number->start;
+    end = p + number->length;
+    *negative = *p == '-';
+    *magnitude = 0;
+    *is_real = 0;
+    for (p += *negative; p < end && *p >= '0' && *p <= '9'; p++) {
+        unsigned digit = (unsigned)(*p - '0');
+        *magnitude = *magnitude > (UINT64_MAX - digit) / 10 ? UINT64_MAX : *magnitude * 10 + digit;
+    }
+    if (p < end) {
+        // The text is '\0'-terminated and the number is followed by a delimiter, strtod stops there
+        *real = strtod(view->text + number->start, NULL);
+        *is_real = 1;
+    }
+    return 1;
+}
+
+int64_t json_view_int64(const struct json_view *view, int token) {
+    uint64_t magnitude;
+    double real;
+    int negative, is_real;
+
+    if (!number_value(view, token, &negative, &magnitude, &real, &is_real)) {
+        return 0;
+    }
+    if (is_real) {
+        if (real >= 9223372036854775807.0) return INT64_MAX;
+        if (real <= -9223372036854775808.0) return INT64_MIN;
+        return (int64_t)real;
+    }
+    if (negative) {
+        return magnitude > (uint64_t)INT64_MAX ? INT64_MIN : -(int64_t)magnitude;
+    }
+    return magnitude > (uint64_t)INT64_MAX ? INT64_MAX : (int64_t)magnitude;
+}
+
+uint64_t json_view_uint64(const struct json_view *view, int token) {
+    uint64_t magnitude;
+    double real;
+    int negative, is_real;
+
+    if (!number_value(view, token, &negative, &magnitude, &real, &is_real)) {
+        return 0;
+    }
+    if (is_real) {
+        if (real <= 0) return 0;
+        if (real >= 18446744073709551615.0) return UINT64_MAX;
+        return (uint64_t)real;
+    }
+    return negative ? 0 : magnitude;
+}
+
+/* Decode one character of a validated string body into UTF-8; bytes produced */
+static size_t next_char(const char **cursor, const char *end, char utf8[4]) {
+    const char *p = *cursor;
+    unsigned code;
+
+    if (*p != '\\') {
+        utf8[0] = *p;
+        *cursor = p + 1;
+        return 1;
+    }
+
+    *cursor = p + 2;
+    switch (p[1]) {
+        case 'b': utf8[0] = '\b'; return 1;
+        case 'f': utf8[0] = '\f'; return 1;
+        case 'n': utf8[0] = '\n'; return 1;
+        case 'r': utf8[0] = '\r'; return 1;
+        case 't': utf8[0] = '\t'; return 1;
+        case 'u': break;
+        default:  utf8[0] = p[1]; return 1;
+    }
+
+    code = (unsigned)(hex_value(p[2]) << 12 | hex_value(p[3]) << 8 | hex_value(p[4]) << 4 | hex_value(p[5]));
+    *cursor = p + 6;
+    // A surrogate pair spells one code point above the BMP
+    if (code >= 0xD800 && code < 0xDC00 && end - *cursor >= 6 && (*cursor)[0] == '\\' && (*cursor)[1] == 'u') {
+        const char *q = *cursor;
+        unsigned low = (unsigned)(hex_value(q[2]) << 12 | hex_value(q[3]) << 8 | hex_value(q[4]) << 4 | hex_value(q[5]));
+        if (low >= 0xDC00 && low < 0xE000) {
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            *cursor = q + 6;
+        }
+    }
+
+    if (code < 0x80) {
+        utf8[0] = (char)code;
+        return 1;
+    }
+    if (code < 0x800) {
+        utf8[0] = (char)(0xC0 | code >> 6);
+        utf8[1] = (char)(0x80 | (code & 0x3F));
+        return 2;
+    }
+    if (code < 0x10000) {
+        utf8[0] = (char)(0xE0 | code >> 12);
+        utf8[1] = (char)(0x80 | (code >> 6 & 0x3F));
+        utf8[2] = (char)(0x80 | (code & 0x3F));
+        return 3;
+    }
+    utf8[0] = (char)(0xF0 | code >> 18);
+    utf8[1] = (char)(0x80 | (code >> 12 & 0x3F));
+    utf8[2] = (char)(0x80 | (code >> 6 & 0x3F));
+    utf8[3] = (char)(0x80 | (code & 0x3F));
+    return 4;
+}
+
+long json_view_string(const struct json_view *view, int token, char *output, size_t output_size) {
+    const struct json_token *string = get_token(view, token);
+    const char *p, *end;
+    size_t length = 0;
+
+    if (!string || string->type != JSON_TYPE_STRING) {
+        return -1;
+    }
+    p = view->text + string->start;
+    end = p + string->length;
+
+    // Unescaped strings are copied in one go
+    if (!memchr(p, '\\', string->length)) {
+        if (string->length >= output_size) {
+            return -1;
+        }
+        memcpy(output, p, string->length);
+        output[string->length] = '\0';
+        return (long)string->length;
+    }
+
+    while (p < end) {
+        char utf8[4];
+        size_t count = next_char(&p, end, utf8);
+        if (count >= output_size - length) {
+            return -1;
+        }
+        memcpy(output + length, utf8, count);
+        length += count;
+    }
+    output[length] = '\0';
+    return (long)length;
+}
+
+int json_view_string_equals(const struct json_view *view, int token, const char *value) {
+    const struct json_token *string = get_token(view, token);
+    const char *p, *end;
+    size_t value_length = strlen(value);
+    size_t length = 0;
+
+    if (!string || string->type != JSON_TYPE_STRING) {
+        return 0;
+    }
+    p = view->text + string->start;
+    end = p + string->length;
+
+    if (!memchr(p, '\\', string->length)) {
+        return string->length == value_length && memcmp(p, value, value_length) == 0;
+    }
+
+    while (p < end) {
+        char utf8[4];
+        size_t count = next_char(&p, end, utf8);
+        if (count > value_length - length || memcmp(value + length, utf8, count) != 0) {
+            return 0;
+        }
+        length += count;
+    }
+    return length == value_length;
+}
@@ -0,0 +1,99 @@
+/*
+ * Allocation-free JSON for the library's JSON calls
+ *
+ * Requests are written straight into a caller-owned buffer by json_writer;
+ * responses are tokenized in place by json_view into a caller-owned token
+ * array, and values are read as borrowed views of the received text. With
+ * both buffers kept per handle, a JSON call allocates nothing.
+ *
+ * The reader accepts any well-formed JSON document within its token and
+ * nesting limits. Member lookup compares raw key bytes, so a key spelled
+ * with escapes is not found; the host never writes one.
+ */
+
+#ifndef WINAPI_JSON_CODEC_H
+#define WINAPI_JSON_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define JSON_MAX_DEPTH            16       // Nesting the reader accepts
+
+/* Document being written into a fixed buffer */
+struct json_writer {
+    char *data;
+    size_t size;
+    size_t length;
+    int overflow;                    // Something did not fit, the document is incomplete
+};
+
+void json_writer_init(struct json_writer *writer, char *data, size_t size);
+
+/* Written length, or -1 if the document did not fit */
+long json_writer_length(const struct json_writer *writer);
+
+/*
+ * Members of the innermost open object take a key; array elements and the
+ * root value pass key NULL. Strings are escaped as needed.
+ */
+void json_write_begin_object(struct json_writer *writer, const char *key);
+void json_write_end_object(struct json_writer *writer);
+void json_write_begin_array(struct json_writer *writer, const char *key);
+void json_write_end_array(struct json_writer *writer);
+void json_write_string(struct json_writer *writer, const char *key, const char *value);
+void json_write_int(struct json_writer *writer, const char *key, int64_t value);
+void json_write_uint(struct json_writer *writer, const char *key, uint64_t value);
+void json_write_bool(struct json_writer *writer, const char *key, int value);
+
+enum json_type {
+    JSON_TYPE_OBJECT,
+    JSON_TYPE_ARRAY,
+    JSON_TYPE_STRING,
+    JSON_TYPE_NUMBER,
+    JSON_TYPE_TRUE,
+    JSON_TYPE_FALSE,
+    JSON_TYPE_NULL
+};
+
+/* Value of a parsed document; an object's members follow it as key, value pairs */
+struct json_token {
+    uint32_t type;
+    uint32_t start;                  // Offset into the text; strings: first byte inside the quotes
+    uint32_t length;                 // Strings: raw bytes between the quotes, escapes included
+    uint32_t next;                   // Index of the token after this value and everything inside it
+};
+
+#define JSON_ROOT                 0        // Token of the document's root value
+
+/* Parsed document borrowing its text and token storage */
+struct json_view {
+    const char *text;
+    struct json_token *tokens;
+    int capacity;
+    int count;
+};
+
+void json_view_init(struct json_view *view, struct json_token *tokens, int capacity);
+
+/* Tokenize a document; text[length] must be readable and '\0'. Returns -1 if malformed or too large */
+int json_view_parse(struct json_view *view, const char *text, size_t length);
+
+/*
+ * Lookups take and return token indices, -1 for "none", and accept -1 as
+ * input so they can be chained.
+ */
+int json_view_member(const struct json_view *view, int object, const char *key);
+int json_view_element(const struct json_view *view, int array, int index);
+int json_view_size(const struct json_view *view, int container);
+
+/* Numbers, converted like json-c: 0 for anything else, clamped to the type's range */
+int64_t json_view_int64(const struct json_view *view, int token);
+uint64_t json_view_uint64(const struct json_view *view, int token);
+
+/* Copy a string value unescaped; its length, or -1 if not a string or it does not fit with its '\0' */
+long json_view_string(const struct json_view *view, int token, char *output, size_t output_size);
+
+/* 1 if the token is a string equal to value (compared unescaped) */
+int json_view_string_equals(const struct json_view *view, int token, const char *value);
+
+#endif /* WINAPI_JSON_CODEC_H */
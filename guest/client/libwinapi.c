@@ -14,25 +14,36 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/socket.h>
 #include <sys/mman.h>
 #include <sys/time.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/uio.h>
 #include <linux/vm_sockets.h>  // For Hyper-V socket support
+#include <linux/errqueue.h>    // For MSG_ZEROCOPY completions
 #include <arpa/inet.h>         // For htonl/ntohl network byte order
 #include <netinet/in.h>        // For TCP socket support
-#include <json-c/json.h>       // For JSON protocol
+#include <netinet/tcp.h>       // For TCP_NODELAY
 
 #include "libwinapi.h"
 #include "../../common/protocol.h"
+#include "../../common/checksum.h"
+#include "../../common/shm_ring.h"
+#include "json_codec.h"
+#include "uring_io.h"
 
 /* Hyper-V Socket Configuration */
 #define HYPERV_SOCKET_PORT        0x400
 #define TCP_FALLBACK_PORT         4660               // TCP fallback port
 #define VMADDR_CID_PARENT         0x2     // Connect to parent (Windows host)
-#define TEMP_DIR_PATH             "/mnt/c/temp"
-#define SHARED_MEMORY_SIZE        (32 * 1024 * 1024) // 32MB
+#define TEMP_DIR_PATH             WINAPI_SHARED_FILE_DIR
 #define REQUEST_TIMEOUT_MS        5000
+#define RING_POLL_SLICE_NS        5000               // Socket check interval while busy-polling the ring
 
 /* Shared Memory Layout */
 #define HEADER_SIZE               4096
@@ -44,127 +55,2260 @@
 #define SAFE_WRITE_OFFSET         (RESPONSE_BUFFER_SIZE - SAFE_WRITE_BOUNDARY)
 
 /* Magic values */
-#define WINAPI_MAGIC              0x57494E41  // "WINA"
 #define PROTOCOL_VERSION          1
 
-/* Shared memory header */
-struct shared_memory_header {
-    uint32_t magic;
-    uint32_t version;
-    uint32_t request_count;
-    uint32_t flags;
-    uint64_t request_offset;
-    uint64_t response_offset;
-    uint32_t request_size;
-    uint32_t response_size;
-    uint32_t reserved[12];
+/* Features this library can use when the host agrees */
+#define CLIENT_CAPABILITIES       (WINAPI_CAP_BINARY_FRAMING | WINAPI_CAP_PIPELINING | WINAPI_CAP_BATCH | \
+                                   WINAPI_CAP_CHECKSUM_CRC32C | WINAPI_CAP_STREAMING | WINAPI_CAP_STRIPING | \
+                                   WINAPI_CAP_SHM_RING | WINAPI_CAP_REGISTERED_BUFFERS)
+#define CLIENT_BUFFER_BACKINGS    (WINAPI_BACKING_SOCKET | WINAPI_BACKING_SHARED_FILE)
+
+#define HAS_CAP(ctx, cap)         (((ctx)->capabilities & (cap)) != 0)
+
+/* Largest echo string that fits in a binary echo request */
+#define BINARY_ECHO_MAX           (sizeof(((winapi_echo_request_t *)0)->input_data))
+
+/* READ payloads are received and CRC-checked this much at a time */
+#define PAYLOAD_RECV_CHUNK        (256 * 1024)
+
+/* Streams are striped across data connections from this size on */
+#define STRIPE_MIN_SIZE           (8 * WINAPI_STREAM_CHUNK_SIZE)
+
+/* Auto-tuned striping: starting count, and transfers between probes of one more lane */
+#define STRIPE_AUTO_START         2
+#define STRIPE_PROBE_INTERVAL     16
+
+/* Pipelined requests: slot index is request_id % PIPELINE_DEPTH */
+#define PIPELINE_DEPTH            128
+
+/* Atomic counters and flags shared by the threads of a handle */
+#define ATOMIC_LOAD(p)            __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define ATOMIC_STORE(p, v)        __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define ATOMIC_ADD(p, v)          __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define ATOMIC_SUB(p, v)          __atomic_sub_fetch((p), (v), __ATOMIC_SEQ_CST)
+
+/* Tokens a JSON response may parse into, enough for a full batch of results */
+#define JSON_MAX_TOKENS           2048
+
+/*
+ * MSG_ZEROCOPY sends on one socket. The kernel numbers them per socket and
+ * reports ranges of finished ones on the error queue, in order for TCP.
+ */
+struct zerocopy_state {
+    uint32_t sent;                   // Zero-copy sendmsg calls that took data
+    uint32_t done;                   // Calls the kernel is finished with
+    int copied;                      // The kernel fell back to copying (e.g. loopback)
+};
+
+enum pending_state {
+    PENDING_FREE = 0,
+    PENDING_INFLIGHT,
+    PENDING_DONE,
+    PENDING_DELIVERING,              // A thread took the completion to run its callback
+    PENDING_QUEUED                   // Done, waiting in the completion queue
+};
+
+/* Outstanding request and where its response goes */
+struct pending_request {
+    uint32_t request_id;
+    uint32_t api_id;
+    int state;
+    int status;
+    winapi_completion_cb callback;   // Async completion, run from winapi_dispatch_completions()
+    int queued;                      // Async completion, taken by winapi_poll_completions()
+    void *user_data;
+    uint64_t stream_credit;          // WRITE/VERIFY stream bytes the host accepts
+    union {
+        struct {
+            char *output;
+            size_t output_size;
+        } echo;
+        struct {
+            winapi_buffer_t buffers[WINAPI_MAX_BUFFERS];  // Copied, registered ranges have no array of their own
+            int buffer_count;
+            uint32_t operation;
+            winapi_buffer_test_result_t *result;
+            uint64_t total_size;
+            int stripes;             // Data connections the payload is striped across
+            int zerocopy;            // Payload went out with MSG_ZEROCOPY on the main socket
+            uint32_t zerocopy_mark;  // ...and the buffers are free once this many sends are done
+        } buffer_test;
+        struct {
+            winapi_perf_test_result_t *result;
+        } perf;
+    } out;
+};
+
+/* Registered buffer, as the host was told about it */
+struct registered_buffer {
+    void *data;
+    size_t size;
+    uint32_t backing;                // WINAPI_BACKING_SHARED_FILE, or _SOCKET for memory the host cannot map
+    int pinned;                      // mlock() took, undone when the entry goes
+    winapi_shared_buffer_t *shared;  // Shared buffer it was registered from, NULL for user memory
+};
+
+/* Private context structure */
+struct winapi_context {
+    int socket_fd;
+    int is_connected;
+    void *shared_memory;             // Ring region (WINAPI_SHM_RING_REGION_SIZE bytes), NULL without rings
+    winapi_shm_header_t *header;
+    winapi_ring_t ring_out;          // Requests to the host, produced here
+    winapi_ring_t ring_in;           // Responses from the host, consumed here
+    char ring_path[WINAPI_MAX_PATH_LEN];  // Region file, until the host has mapped it
+    winapi_ring_poll_t ring_poll;    // Busy-poll state of the response ring
+    uint32_t ring_requests;          // Requests sent through the ring and not answered through it yet
+    void *request_buffer;
+    void *response_buffer;
+    uint32_t next_request_id;
+
+    /* Feature set agreed during the handshake */
+    uint32_t host_version;
+    uint32_t capabilities;
+    uint32_t max_frame_size;
+    uint32_t buffer_backings;
+
+    /* Requests sent but not yet answered */
+    struct pending_request pending[PIPELINE_DEPTH];
+    uint32_t inflight_count;         // Slots in PENDING_INFLIGHT
+    uint32_t completion_cursor;      // Slot winapi_poll_completions() looks at first
+
+    /* Threads sharing the handle (see "Multi-threaded use") */
+    pthread_mutex_t send_lock;       // One frame at a time on the main socket
+    pthread_mutex_t completion_lock; // Dispatcher role and exclusive hand-offs
+    pthread_cond_t completed;        // A dispatch round finished, an exclusive call left or submissions drained
+    int dispatching;                 // A thread holds the dispatcher role
+    uint32_t dispatch_count;         // Dispatch rounds finished
+    int rearm;                       // Arm the ring doorbell when the dispatcher role is given back
+    uint32_t submitting;             // Shared submissions under way
+    pthread_mutex_t exclusive_lock;
+    int exclusive;                   // An exclusive call holds or is taking the connection
+    pthread_t exclusive_owner;
+    int exclusive_depth;
+    pthread_mutex_t engine_lock;     // Whole calls while the io_uring engine is on, recursive
+
+    /* Async completion notification: epoll set of the socket and notify_fd */
+    int event_fd;
+    int notify_fd;
+
+    /* Data connections striped streams travel on (WINAPI_CAP_STRIPING) */
+    struct sockaddr_in host_addr;
+    uint32_t session_id;
+    uint64_t session_key;
+    int data_connections;            // As configured: 0, N or WINAPI_DATA_CONNECTIONS_AUTO
+    int lane_fds[WINAPI_MAX_DATA_CONNECTIONS];
+    int lane_count;                  // Lanes 0 to lane_count - 1 are attached
+    int stripe_count;                // Lanes the next striped transfer uses
+    double stripe_rate[WINAPI_MAX_DATA_CONNECTIONS + 1];  // Auto: smoothed bytes/ns by stripe count
+    uint32_t stripe_transfers;
+    uint32_t striped_reads;          // Striped READs whose response is still to come
+
+    /* Zero-copy transmit of large payloads, 0 when disabled */
+    size_t zerocopy_threshold;
+    struct zerocopy_state zerocopy;
+    struct zerocopy_state lane_zerocopy[WINAPI_MAX_DATA_CONNECTIONS];
+
+    /* Registered buffers by index (see "Registered buffers"), set between calls */
+    struct registered_buffer registered[WINAPI_MAX_REGISTERED_BUFFERS];
+    int registered_count;
+
+    /* io_uring engine for the main socket, NULL for plain system calls */
+    struct uring_io *uring;
+    int engine_kicked;               // notify_fd was raised for work the engine holds
+
+    /* JSON calls write their request and parse their response in place, allocating nothing */
+    struct json_writer json_out;
+    struct json_view json_in;
+    char json_request[sizeof(uint32_t) + WINAPI_MAX_JSON_MESSAGE];  // Length prefix, then the document
+    char json_response[WINAPI_MAX_JSON_MESSAGE + 1];
+    struct json_token json_tokens[JSON_MAX_TOKENS];
+};
+
+/* Helper to get Windows host IP (default gateway) */
+static int get_windows_host_ip(char* ip_buffer, size_t buffer_size) {
+    FILE* fp;
+    char line[256];
+    const char* host_override = getenv("WINAPI_HOST_IP");
+
+    // Explicit host address (e.g. a Linux build of the service on another machine)
+    if (host_override && *host_override) {
+        if (strlen(host_override) >= buffer_size) {
+            return -1;
+        }
+        strcpy(ip_buffer, host_override);
+        return 0;
+    }
+
+    // Get default gateway from route table
+    fp = popen("ip route show default", "r");
+    if (!fp) {
+        return -1;
+    }
+
+    if (fgets(line, sizeof(line), fp)) {
+        char* via_pos = strstr(line, "via ");
+        if (via_pos) {
+            via_pos += 4; // Skip "via "
+            char* space_pos = strchr(via_pos, ' ');
+            if (space_pos) {
+                size_t ip_len = space_pos - via_pos;
+                if (ip_len < buffer_size) {
+                    strncpy(ip_buffer, via_pos, ip_len);
+                    ip_buffer[ip_len] = '\0';
+                    pclose(fp);
+                    return 0;
+                }
+            }
+        }
+    }
+
+    pclose(fp);
+    return -1;
+}
+
+/* Request ID for a call outside the pipeline (JSON, attach) */
+static uint32_t next_id(struct winapi_context *ctx) {
+    return __atomic_fetch_add(&ctx->next_request_id, 1, __ATOMIC_RELAXED);
+}
+
+/* JSON Protocol Helpers */
+/* Open a request object (the root, or a batch entry) with the fields every request carries */
+static void begin_request(struct json_writer *writer, const char *api, uint32_t request_id) {
+    json_write_begin_object(writer, NULL);
+    json_write_string(writer, "api", api);
+    json_write_uint(writer, "request_id", request_id);
+    json_write_int(writer, "version", PROTOCOL_VERSION);
+}
+
+/* Request for a listed API: the numeric ID lets the host skip name lookup */
+static void begin_api_request(struct json_writer *writer, winapi_api_id_t api_id, uint32_t request_id) {
+    begin_request(writer, winapi_api_name(api_id), request_id);
+    json_write_int(writer, "api_id", api_id);
+}
+
+/* Start a request in the handle's request buffer, behind room for its length prefix */
+static struct json_writer *create_request(struct winapi_context *ctx, const char *api, uint32_t request_id) {
+    struct json_writer *request = &ctx->json_out;
+
+    // The length sent must stay below WINAPI_MAX_JSON_MESSAGE
+    json_writer_init(request, ctx->json_request + sizeof(uint32_t), WINAPI_MAX_JSON_MESSAGE - 1);
+    begin_request(request, api, request_id);
+    return request;
+}
+
+/* Same, for a listed API */
+static struct json_writer *create_api_request(struct winapi_context *ctx, winapi_api_id_t api_id, uint32_t request_id) {
+    struct json_writer *request = &ctx->json_out;
+
+    json_writer_init(request, ctx->json_request + sizeof(uint32_t), WINAPI_MAX_JSON_MESSAGE - 1);
+    begin_api_request(request, api_id, request_id);
+    return request;
+}
+
+/* Socket helpers */
+/*
+ * Send everything an iovec array points at. With MSG_ZEROCOPY, each call
+ * that takes data is counted in *calls; the kernel falls back to copying
+ * when it is short of pinned memory.
+ */
+static int send_iov(int socket_fd, struct iovec *iov, int count, int flags, uint32_t *calls) {
+    struct msghdr msg;
+
+    while (count > 0) {
+        ssize_t sent;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        sent = sendmsg(socket_fd, &msg, MSG_NOSIGNAL | flags);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+                flags &= ~MSG_ZEROCOPY;
+                continue;
+            }
+            return -1;
+        }
+        if (flags & MSG_ZEROCOPY) {
+            (*calls)++;
+        }
+
+        while (count > 0 && (size_t)sent >= iov->iov_len) {
+            sent -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + sent;
+            iov->iov_len -= sent;
+        }
+    }
+
+    return 0;
+}
+
+static int send_iov_all(int socket_fd, struct iovec *iov, int count) {
+    return send_iov(socket_fd, iov, count, 0, NULL);
+}
+
+/*
+ * Send a gather whose first head entries are protocol headers and the rest
+ * caller buffers. With zc set the headers are copied (they live on the
+ * stack) and the buffers go out with MSG_ZEROCOPY.
+ */
+static int send_gather(int socket_fd, struct iovec *iov, int head, int count, struct zerocopy_state *zc) {
+    if (!zc || head == count) {
+        return send_iov_all(socket_fd, iov, count);
+    }
+    if (send_iov(socket_fd, iov, head, MSG_MORE, NULL) < 0) {
+        return -1;
+    }
+    return send_iov(socket_fd, iov + head, count - head, MSG_ZEROCOPY, &zc->sent);
+}
+
+/*
+ * Collect zero-copy completions from the socket's error queue. With wait
+ * set, block until the kernel is done with the first mark sends; otherwise
+ * take what is there. Returns -1 on a socket error or timeout.
+ */
+static int zerocopy_reap(int socket_fd, struct zerocopy_state *zc, uint32_t mark, int wait) {
+    for (;;) {
+        char control[CMSG_SPACE(sizeof(struct sock_extended_err)) * 4];
+        struct msghdr msg;
+        struct cmsghdr *cmsg;
+
+        if (wait && (int32_t)(zc->done - mark) >= 0) {
+            return 0;
+        }
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(socket_fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            struct pollfd pfd;
+
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return -1;
+            }
+            if (!wait) {
+                return 0;
+            }
+
+            // Completions raise POLLERR, whatever else is pending on the socket
+            pfd.fd = socket_fd;
+            pfd.events = 0;
+            pfd.revents = 0;
+            if (poll(&pfd, 1, REQUEST_TIMEOUT_MS) <= 0 || !(pfd.revents & POLLERR)) {
+                return -1;
+            }
+            continue;
+        }
+
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            struct sock_extended_err err;
+
+            memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0) {
+                continue;
+            }
+            // ee_info to ee_data (inclusive) are done
+            zc->done = err.ee_data + 1;
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                zc->copied = 1;
+            }
+        }
+    }
+}
+
+/* Ask the kernel for zero-copy sends on a socket */
+static int enable_zerocopy(int socket_fd) {
+    int one = 1;
+
+    return setsockopt(socket_fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one));
+}
+
+/* Pinning pages only to have the kernel copy them anyway is slower than copying: stop */
+static void zerocopy_check_copied(struct winapi_context *ctx) {
+    if (ctx->zerocopy.copied && ATOMIC_LOAD(&ctx->zerocopy_threshold) > 0) {
+        printf("[INFO] Kernel copied zero-copy sends (loopback or no NIC support), zero-copy disabled\n");
+        ATOMIC_STORE(&ctx->zerocopy_threshold, 0);
+    }
+}
+
+static int recv_all(int socket_fd, void *data, size_t len) {
+    char *ptr = (char *)data;
+
+    while (len > 0) {
+        ssize_t received = recv(socket_fd, ptr, len, MSG_WAITALL);
+        if (received <= 0) {
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        ptr += received;
+        len -= received;
+    }
+
+    return 0;
+}
+
+/*
+ * Main socket I/O: through the io_uring engine when init set one up, plain
+ * system calls otherwise. Queued sends leave with the next receive, a flush,
+ * or when the queue fills up. Frames from different threads go out whole,
+ * one after the other; receiving is the dispatcher's alone.
+ */
+static int conn_send(struct winapi_context *ctx, struct iovec *iov, int head, int count, struct zerocopy_state *zc) {
+    int status;
+
+    pthread_mutex_lock(&ctx->send_lock);
+    if (ctx->uring && !zc) {
+        status = uring_io_queue(ctx->uring, iov, head, iov + head, count - head);
+    } else if (ctx->uring && uring_io_flush(ctx->uring) < 0) {
+        // Zero-copy sends need a sendmsg of their own, behind everything queued so far
+        status = -1;
+    } else {
+        status = send_gather(ctx->socket_fd, iov, head, count, zc);
+    }
+    pthread_mutex_unlock(&ctx->send_lock);
+    return status;
+}
+
+static int conn_flush(struct winapi_context *ctx) {
+    return ctx->uring ? uring_io_flush(ctx->uring) : 0;
+}
+
+static int conn_recv(struct winapi_context *ctx, void *data, size_t len) {
+    return ctx->uring ? uring_io_recv(ctx->uring, data, len) : recv_all(ctx->socket_fd, data, len);
+}
+
+static int conn_discard(struct winapi_context *ctx, size_t len) {
+    char scratch[4096];
+
+    while (len > 0) {
+        size_t chunk = len < sizeof(scratch) ? len : sizeof(scratch);
+        if (conn_recv(ctx, scratch, chunk) < 0) {
+            return -1;
+        }
+        len -= chunk;
+    }
+
+    return 0;
+}
+
+/*
+ * Finish the request being written and send it with any socket payload after
+ * it in one gather; neither the request nor the payload is copied
+ */
+static int send_json_payload(struct winapi_context *ctx, int socket_fd, const winapi_buffer_t *payload, int payload_count) {
+    struct json_writer *request = &ctx->json_out;
+    uint32_t msg_len;
+    struct iovec iov[1 + WINAPI_MAX_BUFFERS];
+    long json_len;
+    int count = 0;
+    int i;
+
+    if (payload_count > WINAPI_MAX_BUFFERS) {
+        return -1;
+    }
+
+    json_write_end_object(request);
+    json_len = json_writer_length(request);
+    if (json_len < 0) {
+        fprintf(stderr, "JSON request too large\n");
+        return -1;
+    }
+
+    // Length first (4 bytes), right in front of the JSON data
+    msg_len = htonl((uint32_t)json_len);
+    memcpy(ctx->json_request, &msg_len, sizeof(msg_len));
+    iov[count].iov_base = ctx->json_request;
+    iov[count++].iov_len = sizeof(msg_len) + (size_t)json_len;
+    for (i = 0; i < payload_count; i++) {
+        iov[count].iov_base = payload[i].data;
+        iov[count++].iov_len = payload[i].size;
+    }
+
+    return send_iov_all(socket_fd, iov, count);
+}
+
+static int send_json_request(struct winapi_context *ctx, int socket_fd) {
+    return send_json_payload(ctx, socket_fd, NULL, 0);
+}
+
+/* Receive a response into the handle's response buffer and parse it into ctx->json_in */
+static int receive_json_response(struct winapi_context *ctx, int socket_fd) {
+    // Receive length first
+    uint32_t msg_len;
+    if (recv(socket_fd, &msg_len, sizeof(msg_len), MSG_WAITALL) != sizeof(msg_len)) {
+        return -1;
+    }
+
+    // Ring doorbells the binary calls before did not wait for may come first (never a valid length)
+    while (msg_len == WINAPI_MESSAGE_MAGIC) {
+        char doorbell[sizeof(winapi_message_header_t) - sizeof(msg_len)];
+
+        if (recv(socket_fd, doorbell, sizeof(doorbell), MSG_WAITALL) != sizeof(doorbell) ||
+            recv(socket_fd, &msg_len, sizeof(msg_len), MSG_WAITALL) != sizeof(msg_len)) {
+            return -1;
+        }
+    }
+
+    msg_len = ntohl(msg_len);
+    if (msg_len > WINAPI_MAX_JSON_MESSAGE) { // Reasonable limit
+        return -1;
+    }
+
+    // Receive JSON data
+    if (recv(socket_fd, ctx->json_response, msg_len, MSG_WAITALL) != (ssize_t)msg_len) {
+        return -1;
+    }
+
+    ctx->json_response[msg_len] = '\0';
+    if (json_view_parse(&ctx->json_in, ctx->json_response, msg_len) < 0) {
+        fprintf(stderr, "Malformed JSON response\n");
+        return -1;
+    }
+    return 0;
+}
+
+static uint64_t get_timestamp_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Binary Protocol Helpers */
+
+static int ring_send(struct winapi_context *ctx, const struct iovec *iov, int count);
+
+/*
+ * Send a binary frame and any socket payload after it as one gather: header,
+ * descriptors, inline data and the caller's buffers go out through sendmsg
+ * without being copied, by the kernel too when zc is set
+ */
+static int send_binary_frame(struct winapi_context *ctx, int socket_fd, uint32_t message_type, uint32_t api_id,
+                             uint32_t request_id, uint32_t flags, const winapi_buffer_desc_t *descs, uint32_t desc_count,
+                             const void *inline_data, uint32_t inline_size, uint32_t payload_crc,
+                             const winapi_buffer_t *payload, int payload_count, struct zerocopy_state *zc) {
+    winapi_message_header_t header;
+    struct iovec iov[3 + WINAPI_MAX_BUFFERS];
+    size_t desc_bytes = (size_t)desc_count * sizeof(winapi_buffer_desc_t);
+    int count = 0;
+    int head;
+    int i;
+
+    if (desc_count > WINAPI_MAX_BUFFERS || inline_size > WINAPI_MAX_INLINE_DATA || payload_count > WINAPI_MAX_BUFFERS) {
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = WINAPI_MESSAGE_MAGIC;
+    header.version = WINAPI_PROTOCOL_VERSION;
+    header.message_type = message_type;
+    header.api_id = api_id;
+    header.request_id = request_id;
+    header.buffer_count = desc_count;
+    header.inline_size = inline_size;
+    header.flags = flags;
+    header.timestamp = get_timestamp_ns();
+
+    if (HAS_CAP(ctx, WINAPI_CAP_CHECKSUM_CRC32C)) {
+        header.flags |= WINAPI_MSG_FLAG_CRC32C;
+        header.payload_crc = payload_crc;
+        header.frame_crc = winapi_frame_crc32c(&header, descs, desc_bytes, inline_data, inline_size);
+    }
+
+    // Descriptors and inline data follow the header on the wire, then the payload
+    iov[count].iov_base = &header;
+    iov[count++].iov_len = sizeof(header);
+    if (desc_bytes > 0) {
+        iov[count].iov_base = (void *)descs;
+        iov[count++].iov_len = desc_bytes;
+    }
+    if (inline_size > 0) {
+        iov[count].iov_base = (void *)inline_data;
+        iov[count++].iov_len = inline_size;
+    }
+    head = count;
+
+    // Requests without payload go through the shared memory ring while it has room
+    if (socket_fd == ctx->socket_fd && message_type == WINAPI_MSG_REQUEST && payload_count == 0 &&
+        !(flags & (WINAPI_MSG_FLAG_SOCKET_PAYLOAD | WINAPI_MSG_FLAG_STREAM | WINAPI_MSG_FLAG_STRIPED)) &&
+        ring_send(ctx, iov, count) == 0) {
+        return 0;
+    }
+
+    for (i = 0; i < payload_count; i++) {
+        iov[count].iov_base = payload[i].data;
+        iov[count++].iov_len = payload[i].size;
+    }
+
+    return socket_fd == ctx->socket_fd ? conn_send(ctx, iov, head, count, zc) : send_gather(socket_fd, iov, head, count, zc);
+}
+
+static int receive_binary_response(struct winapi_context *ctx, winapi_message_header_t *header,
+                                   void *inline_data, size_t inline_capacity) {
+    winapi_buffer_desc_t descs[WINAPI_MAX_BUFFERS];
+    size_t desc_bytes;
+
+    if (conn_recv(ctx, header, sizeof(*header)) < 0) {
+        return -1;
+    }
+
+    if (header->magic != WINAPI_MESSAGE_MAGIC) {
+        fprintf(stderr, "Invalid binary response magic: 0x%08x\n", header->magic);
+        return -1;
+    }
+
+    if (header->buffer_count > WINAPI_MAX_BUFFERS || header->inline_size > WINAPI_MAX_INLINE_DATA) {
+        fprintf(stderr, "Invalid binary response: %u buffers, %u inline bytes\n",
+                header->buffer_count, header->inline_size);
+        return -1;
+    }
+
+    // Responses do not carry descriptors, any the host sent only count towards the CRC
+    desc_bytes = (size_t)header->buffer_count * sizeof(winapi_buffer_desc_t);
+    if (desc_bytes > 0 && conn_recv(ctx, descs, desc_bytes) < 0) {
+        return -1;
+    }
+
+    if (header->message_type == WINAPI_MSG_ERROR) {
+        char error_msg[WINAPI_MAX_INLINE_DATA + 1];
+
+        if (conn_recv(ctx, error_msg, header->inline_size) < 0) {
+            return -1;
+        }
+        error_msg[header->inline_size] = '\0';
+        fprintf(stderr, "Host error %d: %s\n", header->error_code, error_msg);
+        return 0;
+    }
+
+    if (header->inline_size > inline_capacity) {
+        fprintf(stderr, "Binary response too large: %u bytes\n", header->inline_size);
+        conn_discard(ctx, header->inline_size);
+        return -1;
+    }
+
+    if (conn_recv(ctx, inline_data, header->inline_size) < 0) {
+        return -1;
+    }
+
+    // A corrupted frame cannot be trusted to describe what follows it
+    if ((header->flags & WINAPI_MSG_FLAG_CRC32C) &&
+        winapi_frame_crc32c(header, descs, desc_bytes, inline_data, header->inline_size) != header->frame_crc) {
+        fprintf(stderr, "Frame CRC mismatch on response %llu\n", (unsigned long long)header->request_id);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Shared memory rings
+ *
+ * With WINAPI_CAP_SHM_RING agreed, requests without socket payload are
+ * published in the request ring and the host answers them in the response
+ * ring. The socket only carries a doorbell frame when the other side went
+ * idle: the host asks for one once it has polled the empty request ring
+ * for its spin window, and this side asks for one right before it blocks
+ * on the socket (or hands the event fd back to an event loop) with the
+ * response ring empty. A blocking wait busy-polls the ring first while
+ * requests sent through it are out (see poll_response_ring).
+ */
+
+/* Set up a ring region in dir for the host to map, path is left empty on failure */
+static int create_ring_region(struct winapi_context *ctx, const char *dir) {
+    static uint32_t next_region = 1;
+    void *region;
+    int fd;
+
+    snprintf(ctx->ring_path, sizeof(ctx->ring_path), "%s/winapi_ring_%d_%u", dir, (int)getpid(),
+             __atomic_fetch_add(&next_region, 1, __ATOMIC_RELAXED));
+    fd = open(ctx->ring_path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        ctx->ring_path[0] = '\0';
+        return -1;
+    }
+
+    if (ftruncate(fd, WINAPI_SHM_RING_REGION_SIZE) < 0) {
+        region = MAP_FAILED;
+    } else {
+        region = mmap(NULL, WINAPI_SHM_RING_REGION_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (region == MAP_FAILED || winapi_shm_format(region, WINAPI_SHM_RING_REGION_SIZE) < 0 ||
+        winapi_shm_attach(region, WINAPI_SHM_RING_REGION_SIZE, &ctx->ring_out, &ctx->ring_in) < 0) {
+        if (region != MAP_FAILED) {
+            munmap(region, WINAPI_SHM_RING_REGION_SIZE);
+        }
+        unlink(ctx->ring_path);
+        ctx->ring_path[0] = '\0';
+        return -1;
+    }
+
+    ctx->shared_memory = region;
+    ctx->header = (winapi_shm_header_t *)region;
+    return 0;
+}
+
+/* Unmap the ring region */
+static void release_ring_region(struct winapi_context *ctx) {
+    if (ctx->shared_memory) {
+        munmap(ctx->shared_memory, WINAPI_SHM_RING_REGION_SIZE);
+    }
+    ctx->shared_memory = NULL;
+    ctx->header = NULL;
+    ctx->capabilities &= ~WINAPI_CAP_SHM_RING;
+}
+
+/*
+ * Publish a frame in the request ring, waking the host if it went idle; -1
+ * if it has to take the socket. Threads claim slots without a lock.
+ */
+static int ring_send(struct winapi_context *ctx, const struct iovec *iov, int count) {
+    const void *parts[3];
+    size_t sizes[3];
+    int i;
+
+    if (!HAS_CAP(ctx, WINAPI_CAP_SHM_RING) || count > 3) {
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        parts[i] = iov[i].iov_base;
+        sizes[i] = iov[i].iov_len;
+    }
+
+    // Counted first, so the dispatcher polls for a response that beats the count
+    ATOMIC_ADD(&ctx->ring_requests, 1);
+    if (winapi_ring_send_mp(&ctx->ring_out, parts, sizes, count) < 0) {
+        ATOMIC_SUB(&ctx->ring_requests, 1);
+        return -1;
+    }
+
+    // The request is out either way; a socket that failed here fails the next receive too
+    if (winapi_ring_doorbell(&ctx->ring_out)) {
+        send_binary_frame(ctx, ctx->socket_fd, WINAPI_MSG_DOORBELL, 0, 0, 0, NULL, 0, NULL, 0, 0, NULL, 0, NULL);
+    }
+    return 0;
+}
+
+/*
+ * Busy-poll the empty response ring within its adaptive window while ring
+ * requests are out: WINAPI_POLL_READY once a frame is there, _AGAIN if the
+ * socket has something first (responses with payload still come that way),
+ * _BLOCK when it is time to ask for a doorbell and sleep
+ */
+static int poll_response_ring(struct winapi_context *ctx) {
+    int state;
+    char byte;
+
+    if (ATOMIC_LOAD(&ctx->ring_requests) == 0) {
+        return WINAPI_POLL_BLOCK;
+    }
+
+    // A doorbell for a sleeping host may still sit in the io_uring queue; a failed flush fails the receive too
+    if (ctx->uring && (uring_io_flush(ctx->uring) < 0 || uring_io_buffered(ctx->uring) > 0)) {
+        return WINAPI_POLL_AGAIN;
+    }
+
+    for (;;) {
+        state = winapi_ring_poll(&ctx->ring_in, &ctx->ring_poll, RING_POLL_SLICE_NS);
+        if (state != WINAPI_POLL_AGAIN) {
+            return state;
+        }
+        if (recv(ctx->socket_fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            return WINAPI_POLL_AGAIN;
+        }
+    }
+}
+
+/* A ring request was answered; the count is reset to 0 when nothing is in flight, never below */
+static void ring_request_done(struct winapi_context *ctx) {
+    uint32_t count = ATOMIC_LOAD(&ctx->ring_requests);
+
+    while (count > 0 && !__atomic_compare_exchange_n(&ctx->ring_requests, &count, count - 1, 0,
+                                                      __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+    }
+}
+
+/*
+ * Take a response from the response ring: 1 if there was one, 0 if not
+ * (busy-polling, then asking the host for a doorbell, when wait is set),
+ * -1 if it is corrupt
+ */
+static int ring_receive(struct winapi_context *ctx, winapi_message_header_t *header, void *inline_data, int wait) {
+    uint64_t frame[WINAPI_RING_SLOT_SIZE / sizeof(uint64_t)];
+    long size;
+    int state;
+
+    if (!HAS_CAP(ctx, WINAPI_CAP_SHM_RING)) {
+        return 0;
+    }
+
+    for (;;) {
+        size = winapi_ring_receive(&ctx->ring_in, frame, sizeof(frame));
+        if (size != 0 || !wait) {
+            break;
+        }
+        state = poll_response_ring(ctx);
+        if (state == WINAPI_POLL_AGAIN || (state == WINAPI_POLL_BLOCK && winapi_ring_wait(&ctx->ring_in))) {
+            break;
+        }
+    }
+
+    if (size <= 0) {
+        return size < 0 ? -1 : 0;
+    }
+    winapi_ring_poll_arrival(&ctx->ring_poll);
+
+    // Ring responses are one whole frame and never announce a payload
+    memcpy(header, frame, sizeof(*header) < (size_t)size ? sizeof(*header) : (size_t)size);
+    if ((size_t)size < sizeof(*header) || header->magic != WINAPI_MESSAGE_MAGIC || header->buffer_count != 0 ||
+        header->inline_size > WINAPI_MAX_INLINE_DATA || (size_t)size != sizeof(*header) + header->inline_size ||
+        (header->flags & (WINAPI_MSG_FLAG_SOCKET_PAYLOAD | WINAPI_MSG_FLAG_STREAM))) {
+        fprintf(stderr, "Invalid frame in the response ring\n");
+        return -1;
+    }
+    memcpy(inline_data, (const char *)frame + sizeof(*header), header->inline_size);
+
+    if ((header->flags & WINAPI_MSG_FLAG_CRC32C) &&
+        winapi_frame_crc32c(header, NULL, 0, inline_data, header->inline_size) != header->frame_crc) {
+        fprintf(stderr, "Frame CRC mismatch on response %llu\n", (unsigned long long)header->request_id);
+        return -1;
+    }
+
+    if (header->message_type == WINAPI_MSG_ERROR) {
+        fprintf(stderr, "Host error %d: %.*s\n", header->error_code, (int)header->inline_size, (const char *)inline_data);
+    }
+    ring_request_done(ctx);
+    return 1;
+}
+
+/* Exchange capabilities with the host and keep the agreed feature set */
+static void perform_handshake(struct winapi_context *ctx, const winapi_config_t *config) {
+    struct json_writer *request;
+    const struct json_view *response = &ctx->json_in;
+    winapi_handshake_t offer, agreed;
+    int result;
+
+    // Until the host answers, only plain JSON is safe
+    ctx->host_version = 0;
+    ctx->capabilities = 0;
+    ctx->max_frame_size = 0;
+    ctx->buffer_backings = WINAPI_BACKING_SOCKET;
+
+    offer.version = WINAPI_PROTOCOL_VERSION;
+    offer.capabilities = config->capabilities & CLIENT_CAPABILITIES;
+    offer.max_frame_size = config->max_frame_size ? config->max_frame_size : (uint32_t)WINAPI_DEFAULT_MAX_FRAME_SIZE;
+    offer.buffer_backings = CLIENT_BUFFER_BACKINGS;
+    if (config->data_connections == 0) {
+        offer.capabilities &= ~WINAPI_CAP_STRIPING;
+    }
+    if (!ctx->shared_memory) {
+        offer.capabilities &= ~WINAPI_CAP_SHM_RING;
+    }
+
+    request = create_request(ctx, "handshake", next_id(ctx));
+    json_write_uint(request, "capabilities", offer.capabilities);
+    json_write_uint(request, "max_frame_size", offer.max_frame_size);
+    json_write_uint(request, "buffer_backings", offer.buffer_backings);
+    if (offer.capabilities & WINAPI_CAP_SHM_RING) {
+        json_write_string(request, "ring_path", ctx->ring_path);
+    }
+
+    if (send_json_request(ctx, ctx->socket_fd) < 0 || receive_json_response(ctx, ctx->socket_fd) < 0) {
+        return;
+    }
+
+    // Older hosts answer with "Unknown API" and no result section
+    result = json_view_member(response, JSON_ROOT, "result");
+    if (result < 0) {
+        printf("[INFO] Host does not support the handshake, using plain JSON\n");
+        return;
+    }
+
+    agreed.version = (uint32_t)json_view_int64(response, json_view_member(response, result, "version"));
+    agreed.capabilities = (uint32_t)json_view_int64(response, json_view_member(response, result, "capabilities"));
+    agreed.max_frame_size = (uint32_t)json_view_int64(response, json_view_member(response, result, "max_frame_size"));
+    agreed.buffer_backings = (uint32_t)json_view_int64(response, json_view_member(response, result, "buffer_backings"));
+    ctx->session_id = (uint32_t)json_view_int64(response, json_view_member(response, result, "session_id"));
+    ctx->session_key = json_view_uint64(response, json_view_member(response, result, "session_key"));
+
+    ctx->host_version = agreed.version;
+    if (agreed.version != WINAPI_PROTOCOL_VERSION) {
+        printf("[WARN] Host protocol version %u differs from %u, optional features disabled\n",
+               agreed.version, WINAPI_PROTOCOL_VERSION);
+        return;
+    }
+
+    // Never trust the host to grant more than we offered
+    ctx->capabilities = agreed.capabilities & offer.capabilities;
+    ctx->max_frame_size = agreed.max_frame_size < offer.max_frame_size ? agreed.max_frame_size : offer.max_frame_size;
+    ctx->buffer_backings = (agreed.buffer_backings & offer.buffer_backings) | WINAPI_BACKING_SOCKET;
+
+    // Binary frames must at least fit a full default frame
+    if (ctx->max_frame_size < WINAPI_DEFAULT_MAX_FRAME_SIZE) {
+        ctx->capabilities &= ~WINAPI_CAP_BINARY_FRAMING;
+    }
+
+    // Rings carry binary frames
+    if (!HAS_CAP(ctx, WINAPI_CAP_BINARY_FRAMING)) {
+        ctx->capabilities &= ~WINAPI_CAP_SHM_RING;
+    }
+
+    // Data connections carry stream chunks and cannot attach without the session key
+    if (!HAS_CAP(ctx, WINAPI_CAP_BINARY_FRAMING) || !HAS_CAP(ctx, WINAPI_CAP_STREAMING) || ctx->session_key == 0) {
+        ctx->capabilities &= ~WINAPI_CAP_STRIPING;
+    }
+}
+
+/* CRC32C of the socket payload of a WRITE/VERIFY request */
+static uint32_t buffers_crc32c(const winapi_buffer_t *buffers, int buffer_count) {
+    uint32_t crc = 0;
+    int i;
+
+    for (i = 0; i < buffer_count; i++) {
+        crc = winapi_crc32c(crc, buffers[i].data, buffers[i].size);
+    }
+
+    return crc;
+}
+
+/* Receive socket payload for READ operations, accumulating its CRC32C into *crc when crc is set */
+static int recv_buffer_payload(struct winapi_context *ctx, winapi_buffer_t *buffers, int buffer_count,
+                               uint32_t *crc) {
+    int i;
+
+    for (i = 0; i < buffer_count; i++) {
+        char *data = (char *)buffers[i].data;
+        size_t offset = 0;
+
+        while (offset < buffers[i].size) {
+            size_t chunk = buffers[i].size - offset;
+            if (crc && chunk > PAYLOAD_RECV_CHUNK) {
+                chunk = PAYLOAD_RECV_CHUNK;
+            }
+
+            if (conn_recv(ctx, data + offset, chunk) < 0) {
+                fprintf(stderr, "Failed to receive buffer data\n");
+                return -1;
+            }
+
+            // Checksum each chunk as it lands, while it is still in cache
+            if (crc) {
+                *crc = winapi_crc32c(*crc, data + offset, chunk);
+            }
+            offset += chunk;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Request pipelining
+ *
+ * Every binary call takes a slot in ctx->pending, sends its frame and
+ * returns. Responses are routed back to their slot by request_id, in
+ * whatever order the host completes them, and decoded straight into the
+ * caller's output buffers.
+ *
+ * Multi-threaded use
+ *
+ * Threads share a handle without a lock around the call. A submitter draws
+ * request IDs atomically until one maps to a free slot and claims that
+ * slot with a compare-and-swap, then publishes its frame in the request
+ * ring (claimed and published in order, see winapi_ring_send_mp) or, for
+ * frames with socket payload or a full ring, sends it under send_lock.
+ * Responses have one reader at a time, the dispatcher: a thread whose
+ * request is still in flight takes the role if it is free and reads the
+ * next response, whoever it is for, or else sleeps until the current
+ * dispatcher finishes its round. JSON calls (which share the handle's JSON
+ * buffers and write straight to the socket) and payload streams, stripes
+ * and zero-copy sends (whose chunks and completions interleave with
+ * responses) run exclusive: submissions wait, every outstanding response
+ * is read, and the caller keeps the dispatcher role until it is done. The
+ * io_uring engine's queue and read-ahead belong to one caller at a time,
+ * so with it on, calls go through engine_lock whole.
+ */
+
+static void release_registered(struct winapi_context *ctx);
+static int pump_response(struct winapi_context *ctx);
+static int pump_response_until(struct winapi_context *ctx, uint64_t deadline);
+static int run_callback(struct winapi_context *ctx, struct pending_request *slot);
+static void notify_completion(struct winapi_context *ctx);
+
+/* Dispatch rounds so far; read before finding a request unfinished, then passed to advance_completions */
+static uint32_t dispatch_seen(struct winapi_context *ctx) {
+    return ATOMIC_LOAD(&ctx->dispatch_count);
+}
+
+/* Hand the dispatcher role back and wake the threads waiting for the round */
+static void finish_dispatch(struct winapi_context *ctx) {
+    pthread_mutex_lock(&ctx->completion_lock);
+
+    // An async call went out while this thread was reading: the event fd only sees the socket
+    if (ctx->rearm && ATOMIC_LOAD(&ctx->inflight_count) > 0 && HAS_CAP(ctx, WINAPI_CAP_SHM_RING) &&
+        !winapi_ring_wait(&ctx->ring_in)) {
+        notify_completion(ctx);
+    }
+    ctx->rearm = 0;
+    ctx->dispatching = 0;
+    ATOMIC_ADD(&ctx->dispatch_count, 1);
+    pthread_cond_broadcast(&ctx->completed);
+    pthread_mutex_unlock(&ctx->completion_lock);
+}
+
+/* Take the dispatcher role if it is free; otherwise leave its holder a note to arm the ring doorbell */
+static int try_dispatch(struct winapi_context *ctx) {
+    int taken;
+
+    pthread_mutex_lock(&ctx->completion_lock);
+    taken = !ctx->dispatching;
+    if (taken) {
+        ctx->dispatching = 1;
+    } else {
+        ctx->rearm = 1;
+    }
+    pthread_mutex_unlock(&ctx->completion_lock);
+    return taken;
+}
+
+/* This thread holds the connection through enter_exclusive */
+static int exclusive_owner(struct winapi_context *ctx) {
+    return ATOMIC_LOAD(&ctx->exclusive) && pthread_equal(ctx->exclusive_owner, pthread_self());
+}
+
+/*
+ * Make progress for a thread whose request is still in flight: read the
+ * next response if no other thread is, or sleep until the one that is has
+ * finished a round. A deadline (monotonic ns, 0 for none) bounds the wait.
+ * Returns 0 to check again, -1 once the connection is lost.
+ */
+static int advance_completions(struct winapi_context *ctx, uint32_t seen, uint64_t deadline) {
+    struct timespec until;
+    int status;
+
+    if (!ctx->is_connected) {
+        return -1;
+    }
+    if (exclusive_owner(ctx)) {
+        return pump_response(ctx);
+    }
+
+    until.tv_sec = (time_t)(deadline / 1000000000ULL);
+    until.tv_nsec = (long)(deadline % 1000000000ULL);
+
+    pthread_mutex_lock(&ctx->completion_lock);
+    while (ctx->dispatching && dispatch_seen(ctx) == seen) {
+        if (!deadline) {
+            pthread_cond_wait(&ctx->completed, &ctx->completion_lock);
+        } else if (pthread_cond_timedwait(&ctx->completed, &ctx->completion_lock, &until) == ETIMEDOUT) {
+            break;
+        }
+    }
+    if (dispatch_seen(ctx) != seen || ctx->dispatching) {
+        // Another thread's round may have completed the request, or the deadline passed
+        pthread_mutex_unlock(&ctx->completion_lock);
+        return 0;
+    }
+    ctx->dispatching = 1;
+    pthread_mutex_unlock(&ctx->completion_lock);
+
+    status = deadline ? pump_response_until(ctx, deadline) : pump_response(ctx);
+    finish_dispatch(ctx);
+    return status;
+}
+
+/* Unregister a submission; the last one out wakes an exclusive call waiting for them to finish */
+static void leave_shared(struct winapi_context *ctx) {
+    // Pairs with enter_exclusive: it sets the flag then reads the count, this drops the count then reads the flag
+    if (ATOMIC_SUB(&ctx->submitting, 1) == 0 && ATOMIC_LOAD(&ctx->exclusive)) {
+        pthread_mutex_lock(&ctx->completion_lock);
+        pthread_cond_broadcast(&ctx->completed);
+        pthread_mutex_unlock(&ctx->completion_lock);
+    }
+}
+
+/* Register a submission, waiting out an exclusive call of another thread */
+static void enter_shared(struct winapi_context *ctx) {
+    for (;;) {
+        ATOMIC_ADD(&ctx->submitting, 1);
+        if (!ATOMIC_LOAD(&ctx->exclusive) || exclusive_owner(ctx)) {
+            return;
+        }
+        leave_shared(ctx);
+
+        pthread_mutex_lock(&ctx->completion_lock);
+        while (ATOMIC_LOAD(&ctx->exclusive)) {
+            pthread_cond_wait(&ctx->completed, &ctx->completion_lock);
+        }
+        pthread_mutex_unlock(&ctx->completion_lock);
+    }
+}
+
+static void leave_exclusive(struct winapi_context *ctx);
+
+/*
+ * Have the connection to this thread alone: new submissions wait, those
+ * under way finish, every outstanding response is read, and the dispatcher
+ * role is held until leave_exclusive. Nests on the owning thread.
+ */
+static int enter_exclusive(struct winapi_context *ctx) {
+    if (exclusive_owner(ctx)) {
+        ctx->exclusive_depth++;
+        return 0;
+    }
+
+    pthread_mutex_lock(&ctx->exclusive_lock);
+    ctx->exclusive_owner = pthread_self();
+    ctx->exclusive_depth = 1;
+    ATOMIC_STORE(&ctx->exclusive, 1);
+
+    // Submitters check the flag after registering, so once the count drops to 0 no frame is half-sent
+    pthread_mutex_lock(&ctx->completion_lock);
+    while (ATOMIC_LOAD(&ctx->submitting) > 0) {
+        pthread_cond_wait(&ctx->completed, &ctx->completion_lock);
+    }
+    while (ctx->dispatching) {
+        pthread_cond_wait(&ctx->completed, &ctx->completion_lock);
+    }
+    ctx->dispatching = 1;
+    pthread_mutex_unlock(&ctx->completion_lock);
+
+    // JSON calls cannot share the wire with outstanding binary responses
+    while (ATOMIC_LOAD(&ctx->inflight_count) > 0) {
+        if (pump_response(ctx) < 0) {
+            leave_exclusive(ctx);
+            return -1;
+        }
+    }
+    if (conn_flush(ctx) < 0) {
+        leave_exclusive(ctx);
+        return -1;
+    }
+    return 0;
+}
+
+static void leave_exclusive(struct winapi_context *ctx) {
+    if (--ctx->exclusive_depth > 0) {
+        return;
+    }
+    ATOMIC_STORE(&ctx->exclusive, 0);
+    finish_dispatch(ctx);
+    pthread_mutex_unlock(&ctx->exclusive_lock);
+}
+
+/* Calls hold the io_uring engine from start to end */
+static void engine_enter(struct winapi_context *ctx) {
+    if (ctx->uring) {
+        pthread_mutex_lock(&ctx->engine_lock);
+    }
+}
+
+static void engine_leave(struct winapi_context *ctx) {
+    if (ctx->uring) {
+        pthread_mutex_unlock(&ctx->engine_lock);
+    }
+}
+
+/* Start submitting a call, shared with other threads or exclusive (JSON, payload streams) */
+static int begin_call(struct winapi_context *ctx, int exclusive) {
+    engine_enter(ctx);
+    if (!exclusive) {
+        enter_shared(ctx);
+    } else if (enter_exclusive(ctx) < 0) {
+        engine_leave(ctx);
+        return -1;
+    }
+    return 0;
+}
+
+static void end_call(struct winapi_context *ctx, int exclusive) {
+    if (exclusive) {
+        leave_exclusive(ctx);
+    } else {
+        leave_shared(ctx);
+    }
+    engine_leave(ctx);
+}
+
+/*
+ * Every slot is taken: deliver completed async calls, or read responses
+ * until one frees up; -1 if all of them hold results nobody waited for
+ */
+static int make_room(struct winapi_context *ctx, uint32_t seen) {
+    int delivered = 0;
+    int i;
+
+    if (!ctx->is_connected) {
+        return -1;
+    }
+
+    // A callback may make an exclusive call itself, so this submission steps aside meanwhile
+    for (i = 0; i < PIPELINE_DEPTH; i++) {
+        struct pending_request *slot = &ctx->pending[i];
+
+        if (ATOMIC_LOAD(&slot->state) == PENDING_DONE && ATOMIC_LOAD(&slot->callback)) {
+            if (!exclusive_owner(ctx)) {
+                leave_shared(ctx);
+            }
+            delivered += run_callback(ctx, slot);
+            if (!exclusive_owner(ctx)) {
+                enter_shared(ctx);
+            }
+        }
+    }
+    if (delivered > 0) {
+        return 0;
+    }
+
+    if (ATOMIC_LOAD(&ctx->inflight_count) > 0) {
+        return advance_completions(ctx, seen, 0);
+    }
+    fprintf(stderr, "All %d request slots hold results not waited for\n", PIPELINE_DEPTH);
+    return -1;
+}
+
+/* Reserve a slot and request ID: IDs are drawn until one maps to a free slot */
+static struct pending_request *alloc_pending(struct winapi_context *ctx, uint32_t api_id) {
+    struct pending_request *slot;
+    uint32_t request_id;
+    int tries = 0;
+
+    for (;;) {
+        uint32_t seen = dispatch_seen(ctx);
+        int state = PENDING_FREE;
+
+        request_id = next_id(ctx);
+        slot = &ctx->pending[request_id % PIPELINE_DEPTH];
+        if (__atomic_compare_exchange_n(&slot->state, &state, PENDING_INFLIGHT, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            break;
+        }
+        if (++tries % PIPELINE_DEPTH == 0 && make_room(ctx, seen) < 0) {
+            return NULL;
+        }
+    }
+    ATOMIC_ADD(&ctx->inflight_count, 1);
+
+    // The state stays claimed, a dispatcher may look at the slot while it is set up
+    slot->request_id = request_id;
+    slot->api_id = api_id;
+    slot->status = -1;
+    ATOMIC_STORE(&slot->callback, (winapi_completion_cb)NULL);
+    ATOMIC_STORE(&slot->queued, 0);
+    slot->user_data = NULL;
+    slot->stream_credit = 0;
+    memset(&slot->out, 0, sizeof(slot->out));
+    return slot;
+}
+
+/* Move a done slot into the completion queue; the submitter and the dispatcher both try, one of them does */
+static void queue_slot(struct winapi_context *ctx, struct pending_request *slot) {
+    int state = PENDING_DONE;
+
+    if (__atomic_compare_exchange_n(&slot->state, &state, PENDING_QUEUED, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        notify_completion(ctx);
+    }
+}
+
+/* Mark an in-flight slot done, for its waiter, its callback or the completion queue */
+static void complete_slot(struct winapi_context *ctx, struct pending_request *slot) {
+    int state = PENDING_INFLIGHT;
+
+    if (!__atomic_compare_exchange_n(&slot->state, &state, PENDING_DONE, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        return;
+    }
+    if (ATOMIC_SUB(&ctx->inflight_count, 1) == 0) {
+        // Ring requests the host answered on the socket leave nothing to poll for
+        ATOMIC_STORE(&ctx->ring_requests, 0);
+    }
+    // attach_callback stores the callback (or the queued mark) before it looks at the state
+    if (ATOMIC_LOAD(&slot->queued)) {
+        queue_slot(ctx, slot);
+    } else if (ATOMIC_LOAD(&slot->callback)) {
+        notify_completion(ctx);
+    }
+}
+
+/* Give a slot back; one still in flight no longer counts */
+static void release_pending(struct winapi_context *ctx, struct pending_request *slot) {
+    if (__atomic_exchange_n(&slot->state, PENDING_FREE, __ATOMIC_SEQ_CST) == PENDING_INFLIGHT) {
+        ATOMIC_SUB(&ctx->inflight_count, 1);
+    }
+}
+
+/* Complete a request that was served without the pipeline (JSON fallback) */
+static int complete_inline(struct winapi_context *ctx, uint32_t api_id, int status, winapi_request_t *request) {
+    struct pending_request *slot = alloc_pending(ctx, api_id);
+
+    if (!slot) {
+        return -1;
+    }
+
+    slot->status = status;
+    complete_slot(ctx, slot);
+    *request = slot->request_id;
+    return 0;
+}
+
+/* Decode a response inline area into the slot's output */
+static int decode_response(struct winapi_context *ctx, struct pending_request *slot,
+                           const winapi_message_header_t *header, const void *inline_data) {
+    switch (slot->api_id) {
+        case WINAPI_API_ECHO: {
+            const winapi_echo_response_t *echo = (const winapi_echo_response_t *)inline_data;
+
+            if (header->inline_size < sizeof(echo->output_len) ||
+                echo->output_len > header->inline_size - sizeof(echo->output_len)) {
+                fprintf(stderr, "Invalid echo response format\n");
+                return -1;
+            }
+            if (echo->output_len >= slot->out.echo.output_size) {
+                fprintf(stderr, "Echo response too long\n");
+                return -1;
+            }
+            memcpy(slot->out.echo.output, echo->output_data, echo->output_len);
+            slot->out.echo.output[echo->output_len] = '\0';
+            return 0;
+        }
+
+        case WINAPI_API_BUFFER_TEST: {
+            const winapi_buffer_test_response_t *response = (const winapi_buffer_test_response_t *)inline_data;
+            winapi_buffer_test_result_t *result = slot->out.buffer_test.result;
+
+            if (header->inline_size != sizeof(*response)) {
+                fprintf(stderr, "Invalid buffer test response format\n");
+                return -1;
+            }
+            result->bytes_processed = response->bytes_processed;
+            result->checksum = response->checksum;
+            result->status = (int)response->status;
+            return result->status;
+        }
+
+        case WINAPI_API_PERF_TEST: {
+            const winapi_perf_test_response_t *response = (const winapi_perf_test_response_t *)inline_data;
+            winapi_perf_test_result_t *result = slot->out.perf.result;
+
+            if (header->inline_size != sizeof(*response)) {
+                fprintf(stderr, "Invalid performance test response format\n");
+                return -1;
+            }
+            result->min_latency_ns = response->min_latency_ns;
+            result->max_latency_ns = response->max_latency_ns;
+            result->avg_latency_ns = response->avg_latency_ns;
+            result->throughput_mbps = response->throughput_mbps;
+            result->iterations_completed = response->iterations_completed;
+            return 0;
+        }
+
+        case WINAPI_API_SHARED_BUFFER: {
+            const winapi_shared_buffer_response_t *response = (const winapi_shared_buffer_response_t *)inline_data;
+
+            if (header->inline_size != sizeof(*response) || response->status != 0) {
+                fprintf(stderr, "Shared buffer processing failed\n");
+                return -1;
+            }
+            return 0;
+        }
+
+        case WINAPI_API_REGISTER_BUFFERS: {
+            const winapi_register_buffers_response_t *response = (const winapi_register_buffers_response_t *)inline_data;
+
+            if (header->inline_size != sizeof(*response) || response->status != 0) {
+                fprintf(stderr, "Buffer registration failed\n");
+                return -1;
+            }
+            return 0;
+        }
+    }
+
+    (void)ctx;
+    return -1;
+}
+
+/* Wake up an event loop polling the handle's event fd */
+static void notify_completion(struct winapi_context *ctx) {
+    uint64_t one = 1;
+    ssize_t written;
+
+    if (ctx->notify_fd >= 0) {
+        written = write(ctx->notify_fd, &one, sizeof(one));
+        (void)written;  // A full counter already means "readable"
+    }
+}
+
+/* The event fd only watches the socket: raise it for work the io_uring engine holds back */
+static void notify_engine_work(struct winapi_context *ctx) {
+    if (ctx->uring && !ctx->engine_kicked &&
+        (uring_io_pending(ctx->uring) > 0 || uring_io_buffered(ctx->uring) > 0)) {
+        notify_completion(ctx);
+        ctx->engine_kicked = 1;
+    }
+}
+
+/* The connection is unusable, fail every outstanding request */
+static void abort_pending(struct winapi_context *ctx) {
+    int i;
+
+    ctx->is_connected = 0;
+    ctx->striped_reads = 0;
+    for (i = 0; i < PIPELINE_DEPTH; i++) {
+        if (ATOMIC_LOAD(&ctx->pending[i].state) == PENDING_INFLIGHT) {
+            ctx->pending[i].status = -1;
+            complete_slot(ctx, &ctx->pending[i]);
+        }
+    }
+    ATOMIC_STORE(&ctx->ring_requests, 0);
+    notify_completion(ctx);
+}
+
+/* Release a completed async slot and invoke its callback, 0 if another thread got to it first */
+static int run_callback(struct winapi_context *ctx, struct pending_request *slot) {
+    winapi_completion_cb callback;
+    void *user_data;
+    winapi_request_t request;
+    int state = PENDING_DONE;
+    int status;
+
+    if (!__atomic_compare_exchange_n(&slot->state, &state, PENDING_DELIVERING, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        return 0;
+    }
+    callback = slot->callback;
+    user_data = slot->user_data;
+    request = slot->request_id;
+    status = slot->status;
+
+    // Free the slot first so the callback can submit new requests
+    ATOMIC_STORE(&slot->state, PENDING_FREE);
+    callback((winapi_handle_t)ctx, request, status, user_data);
+    return 1;
+}
+
+/*
+ * Payload streams
+ *
+ * Payloads above WINAPI_MAX_BUFFER_SIZE go as chunk streams when the host
+ * agreed on WINAPI_CAP_STREAMING. Neither side sends more chunk data than
+ * the other granted, so waiting for credit pumps responses like any wait.
+ */
+
+/* Let the host stream bytes more of a READ payload on socket_fd */
+static int send_credit(struct winapi_context *ctx, int socket_fd, uint32_t request_id, uint64_t bytes) {
+    winapi_stream_credit_t credit;
+
+    credit.bytes = bytes;
+    return send_binary_frame(ctx, socket_fd, WINAPI_MSG_CREDIT, 0, request_id, 0, NULL, 0, &credit, sizeof(credit), 0,
+                             NULL, 0, NULL);
+}
+
+/* Send WRITE/VERIFY payload as chunks, no further than the host's credit */
+static int send_stream_payload(struct winapi_context *ctx, struct pending_request *slot,
+                               winapi_buffer_t *buffers, int buffer_count, uint64_t total_size) {
+    uint64_t remaining = total_size;
+    size_t offset = 0;
+    int index = 0;
+
+    do {
+        winapi_stream_chunk_t chunk;
+        struct iovec iov[2];
+        const char *data = NULL;
+        size_t length = 0;
+
+        while (slot->stream_credit == 0) {
+            if (ATOMIC_LOAD(&slot->state) != PENDING_INFLIGHT || pump_response(ctx) < 0) {
+                return -1;
+            }
+        }
+
+        // Chunks do not span buffers
+        while (index < buffer_count && offset == buffers[index].size) {
+            index++;
+            offset = 0;
+        }
+        if (index < buffer_count) {
+            data = (const char *)buffers[index].data + offset;
+            length = buffers[index].size - offset;
+            if (length > WINAPI_STREAM_CHUNK_SIZE) {
+                length = WINAPI_STREAM_CHUNK_SIZE;
+            }
+            if (length > slot->stream_credit) {
+                length = (size_t)slot->stream_credit;
+            }
+        }
+        chunk.offset = total_size - remaining;
+        remaining -= length;
+
+        chunk.magic = WINAPI_STREAM_MAGIC;
+        chunk.flags = remaining == 0 ? WINAPI_STREAM_LAST : 0;
+        chunk.request_id = slot->request_id;
+        chunk.size = (uint32_t)length;
+        chunk.crc = HAS_CAP(ctx, WINAPI_CAP_CHECKSUM_CRC32C) ? winapi_crc32c(0, data, length) : 0;
+
+        iov[0].iov_base = &chunk;
+        iov[0].iov_len = sizeof(chunk);
+        iov[1].iov_base = (void *)data;
+        iov[1].iov_len = length;
+        if (conn_send(ctx, iov, 1, length > 0 ? 2 : 1, slot->out.buffer_test.zerocopy ? &ctx->zerocopy : NULL) < 0) {
+            fprintf(stderr, "ERROR: Failed to send stream chunk (%zu bytes): %s\n", length, strerror(errno));
+            return -1;
+        }
+
+        slot->stream_credit -= length;
+        offset += length;
+    } while (remaining > 0);
+
+    return 0;
+}
+
+/* Receive a READ chunk stream into the slot's buffers, granting credit for each chunk consumed */
+static int recv_stream_payload(struct winapi_context *ctx, struct pending_request *slot, int *corrupt) {
+    winapi_buffer_t *buffers = slot->out.buffer_test.buffers;
+    int buffer_count = slot->out.buffer_test.buffer_count;
+    int check_crc = HAS_CAP(ctx, WINAPI_CAP_CHECKSUM_CRC32C);
+    uint64_t received = 0;
+    size_t offset = 0;
+    int index = 0;
+    int last = 0;
+
+    while (!last) {
+        winapi_stream_chunk_t chunk;
+        uint32_t crc = 0;
+        size_t left;
+
+        if (conn_recv(ctx, &chunk, sizeof(chunk)) < 0) {
+            return -1;
+        }
+        if (chunk.magic != WINAPI_STREAM_MAGIC || chunk.request_id != slot->request_id ||
+            chunk.offset != received || chunk.size > WINAPI_STREAM_CHUNK_SIZE) {
+            fprintf(stderr, "Invalid stream chunk for request %u\n", slot->request_id);
+            return -1;
+        }
+
+        for (left = chunk.size; left > 0; ) {
+            char *data;
+            size_t length;
+
+            while (index < buffer_count && offset == buffers[index].size) {
+                index++;
+                offset = 0;
+            }
+            if (index == buffer_count) {
+                fprintf(stderr, "Stream for request %u overflows its buffers\n", slot->request_id);
+                return -1;
+            }
+
+            data = (char *)buffers[index].data + offset;
+            length = buffers[index].size - offset;
+            if (length > left) {
+                length = left;
+            }
+            if (conn_recv(ctx, data, length) < 0) {
+                return -1;
+            }
+            if (check_crc) {
+                crc = winapi_crc32c(crc, data, length);
+            }
+            offset += length;
+            left -= length;
+        }
+
+        if (check_crc && crc != chunk.crc) {
+            fprintf(stderr, "Stream chunk CRC mismatch on request %u: 0x%08x, expected 0x%08x\n",
+                    slot->request_id, crc, chunk.crc);
+            *corrupt = 1;
+        }
+
+        received += chunk.size;
+        last = (chunk.flags & WINAPI_STREAM_LAST) != 0;
+        if (!last && send_credit(ctx, ctx->socket_fd, slot->request_id, chunk.size) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Data connections
+ *
+ * With WINAPI_CAP_STRIPING agreed and data connections configured, streams
+ * of STRIPE_MIN_SIZE and up are striped across lanes: extra connections
+ * attached to the session, each driven by its own thread for the length of
+ * a transfer. Chunk i travels on lane i % K and both sides place it by its
+ * offset. In auto mode K moves one lane at a time towards the best measured
+ * throughput, and lanes are only opened once K reaches them.
+ */
+
+/* One lane's share of a striped transfer */
+struct stripe_lane {
+    struct winapi_context *ctx;
+    pthread_t thread;
+    int lane;
+    int stripes;
+    uint32_t request_id;
+    winapi_buffer_t *buffers;
+    int buffer_count;
+    uint64_t total_size;
+    int zerocopy;                    // Send with MSG_ZEROCOPY, the lane waits for the kernel before it finishes
+    int corrupt;
+    int status;
 };
 
-/* Private context structure */
-struct winapi_context {
-    int socket_fd;
-    int is_connected;
-    void *shared_memory;
-    struct shared_memory_header *header;
-    void *request_buffer;
-    void *response_buffer;
-    uint32_t next_request_id;
-};
+/* Connect a data connection and attach it to the session as lane */
+static int open_data_connection(struct winapi_context *ctx, int lane) {
+    struct json_writer *request;
+    int attached;
+    int fd;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    // Lanes must honour MSG_ZEROCOPY like the main socket, or their sends would never be reported done
+    if ((ctx->zerocopy_threshold > 0 && enable_zerocopy(fd) < 0) ||
+        connect(fd, (struct sockaddr *)&ctx->host_addr, sizeof(ctx->host_addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    request = create_request(ctx, "attach", next_id(ctx));
+    json_write_uint(request, "session_id", ctx->session_id);
+    json_write_uint(request, "session_key", ctx->session_key);
+    json_write_int(request, "lane", lane);
+
+    attached = send_json_request(ctx, fd) == 0 && receive_json_response(ctx, fd) == 0 &&
+               json_view_string_equals(&ctx->json_in, json_view_member(&ctx->json_in, JSON_ROOT, "status"), "success");
+
+    if (!attached) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Attach lanes until count are open, returns how many are */
+static int open_lanes(struct winapi_context *ctx, int count) {
+    while (ctx->lane_count < count) {
+        int fd = open_data_connection(ctx, ctx->lane_count);
+        if (fd < 0) {
+            // Keep what the host accepted instead of retrying on every transfer
+            fprintf(stderr, "[WARN] Data connection %d failed, striping across %d\n",
+                    ctx->lane_count, ctx->lane_count);
+            ctx->data_connections = ctx->lane_count;
+            ctx->stripe_count = ctx->lane_count;
+            break;
+        }
+        ctx->lane_fds[ctx->lane_count++] = fd;
+    }
+    return ctx->lane_count;
+}
+
+/* Lanes to stripe a stream of total_size bytes across, 0 to keep it on the connection */
+static int choose_stripes(struct winapi_context *ctx, uint64_t total_size) {
+    if (!HAS_CAP(ctx, WINAPI_CAP_STRIPING) || ctx->data_connections == 0 || total_size < STRIPE_MIN_SIZE) {
+        return 0;
+    }
+    return open_lanes(ctx, ctx->stripe_count);
+}
+
+/* Auto mode: fold a transfer's throughput in and pick the stripe count for the next one */
+static void tune_stripes(struct winapi_context *ctx, int stripes, uint64_t bytes, uint64_t elapsed_ns) {
+    double *rate = ctx->stripe_rate;
+    double sample;
+    int next = stripes;
+
+    if (ctx->data_connections != WINAPI_DATA_CONNECTIONS_AUTO || elapsed_ns == 0) {
+        return;
+    }
+
+    sample = (double)bytes / (double)elapsed_ns;
+    rate[stripes] = rate[stripes] == 0 ? sample : 0.75 * rate[stripes] + 0.25 * sample;
+
+    // Move towards a faster or unexplored neighbour
+    if (stripes > 1 && rate[stripes - 1] > rate[stripes]) {
+        next = stripes - 1;
+    } else if (stripes < WINAPI_MAX_DATA_CONNECTIONS &&
+               (rate[stripes + 1] == 0 || rate[stripes + 1] > rate[stripes])) {
+        next = stripes + 1;
+    } else if (++ctx->stripe_transfers % STRIPE_PROBE_INTERVAL == 0) {
+        // Throughput shifts with load, look at a neighbour again now and then
+        int up = (ctx->stripe_transfers / STRIPE_PROBE_INTERVAL) % 2 != 0;
+        next = (up && stripes < WINAPI_MAX_DATA_CONNECTIONS) || stripes == 1 ? stripes + 1 : stripes - 1;
+    }
+
+    ctx->stripe_count = next;
+}
+
+/* Point iov at length bytes of the buffers from payload offset on, returns the entries used */
+static int payload_iov(winapi_buffer_t *buffers, int buffer_count, uint64_t offset, size_t length,
+                       struct iovec *iov, int max_iov) {
+    int count = 0;
+    int i;
+
+    for (i = 0; i < buffer_count && length > 0 && count < max_iov; i++) {
+        size_t take;
+
+        if (offset >= buffers[i].size) {
+            offset -= buffers[i].size;
+            continue;
+        }
+        take = buffers[i].size - (size_t)offset;
+        if (take > length) {
+            take = length;
+        }
+        iov[count].iov_base = (char *)buffers[i].data + offset;
+        iov[count].iov_len = take;
+        count++;
+        length -= take;
+        offset = 0;
+    }
+
+    return length == 0 ? count : -1;
+}
+
+/* Read a credit frame from a lane, adding it up (and counting it) if it is for request_id */
+static int recv_lane_credit(int socket_fd, uint32_t request_id, uint64_t *credit, uint64_t *grants) {
+    winapi_message_header_t header;
+    winapi_stream_credit_t grant;
+
+    if (recv_all(socket_fd, &header, sizeof(header)) < 0) {
+        return -1;
+    }
+    if (header.magic != WINAPI_MESSAGE_MAGIC || header.message_type != WINAPI_MSG_CREDIT ||
+        header.buffer_count != 0 || header.inline_size != sizeof(grant) ||
+        recv_all(socket_fd, &grant, sizeof(grant)) < 0) {
+        return -1;
+    }
+    if ((header.flags & WINAPI_MSG_FLAG_CRC32C) &&
+        winapi_frame_crc32c(&header, NULL, 0, &grant, sizeof(grant)) != header.frame_crc) {
+        return -1;
+    }
+
+    if (header.request_id == request_id) {
+        *credit += grant.bytes;
+        (*grants)++;
+    }
+    return 0;
+}
+
+/* Lane thread of a striped WRITE/VERIFY: every K-th chunk, as far as the lane's credit goes */
+static void *stripe_send_lane(void *arg) {
+    struct stripe_lane *lane = (struct stripe_lane *)arg;
+    struct winapi_context *ctx = lane->ctx;
+    int socket_fd = ctx->lane_fds[lane->lane];
+    struct zerocopy_state *zc = &ctx->lane_zerocopy[lane->lane];
+    uint64_t step = (uint64_t)lane->stripes * WINAPI_STREAM_CHUNK_SIZE;
+    uint64_t credit = 0;
+    uint64_t grants = 0;
+    uint64_t chunks = 0;
+    uint64_t offset;
+
+    lane->status = -1;
+    for (offset = (uint64_t)lane->lane * WINAPI_STREAM_CHUNK_SIZE; offset < lane->total_size; offset += step) {
+        struct iovec iov[WINAPI_MAX_BUFFERS + 1];
+        winapi_stream_chunk_t chunk;
+        uint64_t left = lane->total_size - offset;
+        size_t length = left < WINAPI_STREAM_CHUNK_SIZE ? (size_t)left : WINAPI_STREAM_CHUNK_SIZE;
+        int count;
+        int i;
+
+        while (credit < length) {
+            if (recv_lane_credit(socket_fd, lane->request_id, &credit, &grants) < 0) {
+                fprintf(stderr, "ERROR: No credit on data connection %d\n", lane->lane);
+                return NULL;
+            }
+        }
+        chunks++;
+
+        count = payload_iov(lane->buffers, lane->buffer_count, offset, length, &iov[1], WINAPI_MAX_BUFFERS);
+        if (count < 0) {
+            return NULL;
+        }
+
+        chunk.magic = WINAPI_STREAM_MAGIC;
+        chunk.flags = offset + step >= lane->total_size ? WINAPI_STREAM_LAST : 0;
+        chunk.request_id = lane->request_id;
+        chunk.offset = offset;
+        chunk.size = (uint32_t)length;
+        chunk.crc = 0;
+        if (HAS_CAP(ctx, WINAPI_CAP_CHECKSUM_CRC32C)) {
+            for (i = 1; i <= count; i++) {
+                chunk.crc = winapi_crc32c(chunk.crc, iov[i].iov_base, iov[i].iov_len);
+            }
+        }
+
+        iov[0].iov_base = &chunk;
+        iov[0].iov_len = sizeof(chunk);
+        if (send_gather(socket_fd, iov, 1, count + 1, lane->zerocopy ? zc : NULL) < 0) {
+            fprintf(stderr, "ERROR: Failed to send on data connection %d: %s\n", lane->lane, strerror(errno));
+            return NULL;
+        }
+        credit -= length;
+    }
+
+    // The window plus one grant per chunk but the last: read them all so the lane is clean for the next stream
+    while (grants < chunks) {
+        if (recv_lane_credit(socket_fd, lane->request_id, &credit, &grants) < 0) {
+            fprintf(stderr, "ERROR: Lost data connection %d\n", lane->lane);
+            return NULL;
+        }
+    }
+
+    // The caller may reuse the buffers once the transfer returns
+    if (lane->zerocopy && zerocopy_reap(socket_fd, zc, zc->sent, 1) < 0) {
+        fprintf(stderr, "ERROR: Zero-copy sends not completed on data connection %d\n", lane->lane);
+        return NULL;
+    }
+
+    lane->status = 0;
+    return NULL;
+}
+
+/* Lane thread of a striped READ: place every K-th chunk by offset and credit the lane */
+static void *stripe_recv_lane(void *arg) {
+    struct stripe_lane *lane = (struct stripe_lane *)arg;
+    struct winapi_context *ctx = lane->ctx;
+    int socket_fd = ctx->lane_fds[lane->lane];
+    int check_crc = HAS_CAP(ctx, WINAPI_CAP_CHECKSUM_CRC32C);
+    uint64_t step = (uint64_t)lane->stripes * WINAPI_STREAM_CHUNK_SIZE;
+    uint64_t offset;
+
+    lane->status = -1;
+    for (offset = (uint64_t)lane->lane * WINAPI_STREAM_CHUNK_SIZE; offset < lane->total_size; offset += step) {
+        struct iovec iov[WINAPI_MAX_BUFFERS];
+        winapi_stream_chunk_t chunk;
+        uint64_t left = lane->total_size - offset;
+        size_t length = left < WINAPI_STREAM_CHUNK_SIZE ? (size_t)left : WINAPI_STREAM_CHUNK_SIZE;
+        uint32_t crc = 0;
+        int count;
+        int i;
+
+        if (recv_all(socket_fd, &chunk, sizeof(chunk)) < 0) {
+            return NULL;
+        }
+        count = payload_iov(lane->buffers, lane->buffer_count, offset, length, iov, WINAPI_MAX_BUFFERS);
+        if (chunk.magic != WINAPI_STREAM_MAGIC || chunk.request_id != lane->request_id ||
+            chunk.offset != offset || chunk.size != length || count < 0) {
+            fprintf(stderr, "Invalid stream chunk on data connection %d for request %u\n",
+                    lane->lane, lane->request_id);
+            return NULL;
+        }
+
+        for (i = 0; i < count; i++) {
+            if (recv_all(socket_fd, iov[i].iov_base, iov[i].iov_len) < 0) {
+                return NULL;
+            }
+            if (check_crc) {
+                crc = winapi_crc32c(crc, iov[i].iov_base, iov[i].iov_len);
+            }
+        }
+
+        if (check_crc && crc != chunk.crc) {
+            fprintf(stderr, "Stream chunk CRC mismatch on request %u at offset %llu: 0x%08x, expected 0x%08x\n",
+                    lane->request_id, (unsigned long long)offset, crc, chunk.crc);
+            lane->corrupt = 1;
+        }
+
+        if (offset + step < lane->total_size && send_credit(ctx, socket_fd, lane->request_id, length) < 0) {
+            return NULL;
+        }
+    }
+
+    lane->status = 0;
+    return NULL;
+}
+
+/* Run a striped transfer over lanes 0 to stripes - 1, returns -1 if a lane failed */
+static int run_stripes(struct winapi_context *ctx, void *(*lane_main)(void *), int stripes, uint32_t request_id,
+                       winapi_buffer_t *buffers, int buffer_count, uint64_t total_size, int zerocopy, int *corrupt) {
+    struct stripe_lane lanes[WINAPI_MAX_DATA_CONNECTIONS];
+    int started[WINAPI_MAX_DATA_CONNECTIONS];
+    uint64_t start_ns = get_timestamp_ns();
+    int status = 0;
+    int i;
+
+    for (i = 0; i < stripes; i++) {
+        lanes[i].ctx = ctx;
+        lanes[i].lane = i;
+        lanes[i].stripes = stripes;
+        lanes[i].request_id = request_id;
+        lanes[i].buffers = buffers;
+        lanes[i].buffer_count = buffer_count;
+        lanes[i].total_size = total_size;
+        lanes[i].zerocopy = zerocopy;
+        lanes[i].corrupt = 0;
+        lanes[i].status = -1;
+        started[i] = i > 0 && pthread_create(&lanes[i].thread, NULL, lane_main, &lanes[i]) == 0;
+    }
+
+    // Lane 0, and any lane without a thread, runs here; lanes are credited
+    // independently, so running them one after another cannot stall
+    for (i = 0; i < stripes; i++) {
+        if (!started[i]) {
+            lane_main(&lanes[i]);
+        }
+    }
+
+    for (i = 0; i < stripes; i++) {
+        if (started[i]) {
+            pthread_join(lanes[i].thread, NULL);
+        }
+        if (lanes[i].status < 0) {
+            status = -1;
+        }
+        if (lanes[i].corrupt) {
+            *corrupt = 1;
+        }
+        if (ctx->lane_zerocopy[i].copied) {
+            ctx->zerocopy.copied = 1;
+        }
+    }
+
+    if (status == 0) {
+        tune_stripes(ctx, stripes, total_size, get_timestamp_ns() - start_ns);
+    }
+    return status;
+}
+
+/* Read one response from the socket and complete its slot */
+static int pump_response(struct winapi_context *ctx) {
+    winapi_message_header_t header;
+    uint8_t inline_data[WINAPI_MAX_INLINE_DATA];
+    struct pending_request *slot;
+    int from_ring;
 
-/* Helper to get Windows host IP (default gateway) */
-static int get_windows_host_ip(char* ip_buffer, size_t buffer_size) {
-    FILE* fp;
-    char line[256];
+    // The response ring first; the socket then either has a response or wakes us up for the ring
+    from_ring = ring_receive(ctx, &header, inline_data, 1);
+    if (from_ring < 0 || (from_ring == 0 && receive_binary_response(ctx, &header, inline_data, sizeof(inline_data)) < 0)) {
+        abort_pending(ctx);
+        return -1;
+    }
+    if (header.message_type == WINAPI_MSG_DOORBELL) {
+        return 0;
+    }
 
-    // Get default gateway from route table
-    fp = popen("ip route show default", "r");
-    if (!fp) {
+    slot = &ctx->pending[header.request_id % PIPELINE_DEPTH];
+
+    // Credit for a WRITE/VERIFY stream, the request is still in flight
+    if (header.message_type == WINAPI_MSG_CREDIT) {
+        winapi_stream_credit_t credit;
+
+        if (header.inline_size != sizeof(credit)) {
+            fprintf(stderr, "Invalid credit frame\n");
+            abort_pending(ctx);
+            return -1;
+        }
+        memcpy(&credit, inline_data, sizeof(credit));
+        if (ATOMIC_LOAD(&slot->state) == PENDING_INFLIGHT && slot->request_id == header.request_id) {
+            slot->stream_credit += credit.bytes;
+        }
+        return 0;
+    }
+
+    if (ATOMIC_LOAD(&slot->state) != PENDING_INFLIGHT || slot->request_id != header.request_id) {
+        fprintf(stderr, "Unexpected response id %llu\n", (unsigned long long)header.request_id);
+        abort_pending(ctx);
         return -1;
     }
 
-    if (fgets(line, sizeof(line), fp)) {
-        char* via_pos = strstr(line, "via ");
-        if (via_pos) {
-            via_pos += 4; // Skip "via "
-            char* space_pos = strchr(via_pos, ' ');
-            if (space_pos) {
-                size_t ip_len = space_pos - via_pos;
-                if (ip_len < buffer_size) {
-                    strncpy(ip_buffer, via_pos, ip_len);
-                    ip_buffer[ip_len] = '\0';
-                    pclose(fp);
-                    return 0;
-                }
-            }
+    if (header.message_type == WINAPI_MSG_ERROR) {
+        slot->status = -1;
+    } else {
+        slot->status = decode_response(ctx, slot, &header, inline_data);
+    }
+
+    // READ payload follows the response on the socket
+    if (header.flags & WINAPI_MSG_FLAG_SOCKET_PAYLOAD) {
+        uint32_t payload_crc = 0;
+        int check_crc = (header.flags & WINAPI_MSG_FLAG_CRC32C) != 0;
+
+        if (slot->api_id != WINAPI_API_BUFFER_TEST || slot->status != 0 ||
+            recv_buffer_payload(ctx, slot->out.buffer_test.buffers, slot->out.buffer_test.buffer_count,
+                                check_crc ? &payload_crc : NULL) < 0) {
+            fprintf(stderr, "Failed to receive payload for request %u\n", slot->request_id);
+            slot->status = -1;
+            abort_pending(ctx);
+            return -1;
+        }
+
+        // The stream is still in sync, only this request failed
+        if (check_crc && payload_crc != header.payload_crc) {
+            fprintf(stderr, "Payload CRC mismatch on request %u: 0x%08x, expected 0x%08x\n",
+                    slot->request_id, payload_crc, header.payload_crc);
+            slot->status = -1;
         }
     }
 
-    pclose(fp);
-    return -1;
+    // READ payload follows as a chunk stream, on this connection or striped across the data connections
+    if (header.flags & WINAPI_MSG_FLAG_STREAM) {
+        int striped = (header.flags & WINAPI_MSG_FLAG_STRIPED) != 0;
+        int corrupt = 0;
+
+        if (slot->api_id != WINAPI_API_BUFFER_TEST || slot->status != 0 ||
+            striped != (slot->out.buffer_test.stripes > 0) ||
+            (striped ? run_stripes(ctx, stripe_recv_lane, slot->out.buffer_test.stripes, slot->request_id,
+                                   slot->out.buffer_test.buffers, slot->out.buffer_test.buffer_count,
+                                   slot->out.buffer_test.total_size, 0, &corrupt) :
+                       recv_stream_payload(ctx, slot, &corrupt)) < 0) {
+            fprintf(stderr, "Failed to receive payload stream for request %u\n", slot->request_id);
+            slot->status = -1;
+            abort_pending(ctx);
+            return -1;
+        }
+        if (corrupt) {
+            slot->status = -1;
+        }
+    }
+
+    if (slot->api_id == WINAPI_API_BUFFER_TEST && slot->out.buffer_test.stripes > 0 &&
+        slot->out.buffer_test.operation == WINAPI_BUFFER_OP_READ) {
+        ctx->striped_reads--;
+    }
+
+    // The host has the payload, but the buffers are not the caller's again until the kernel says so
+    if (slot->api_id == WINAPI_API_BUFFER_TEST && slot->out.buffer_test.zerocopy) {
+        if (zerocopy_reap(ctx->socket_fd, &ctx->zerocopy, slot->out.buffer_test.zerocopy_mark, 1) < 0) {
+            fprintf(stderr, "Zero-copy sends not completed for request %u\n", slot->request_id);
+            slot->status = -1;
+        }
+        zerocopy_check_copied(ctx);
+    }
+
+    complete_slot(ctx, slot);
+    return 0;
 }
 
-/* JSON Protocol Helpers */
-static json_object* create_request(const char* api, uint32_t request_id) {
-    json_object *root = json_object_new_object();
-    json_object *api_obj = json_object_new_string(api);
-    json_object *id_obj = json_object_new_int(request_id);
-    json_object *version_obj = json_object_new_int(PROTOCOL_VERSION);
+/* pump_response once something has arrived, waiting no later than deadline (monotonic ns) for it */
+static int pump_response_until(struct winapi_context *ctx, uint64_t deadline) {
+    struct pollfd pfd;
+    uint64_t now;
+
+    // Requests the io_uring engine queued go out before their responses are waited for
+    if (conn_flush(ctx) < 0) {
+        abort_pending(ctx);
+        return -1;
+    }
 
-    json_object_object_add(root, "api", api_obj);
-    json_object_object_add(root, "request_id", id_obj);
-    json_object_object_add(root, "version", version_obj);
+    // Responses in the ring or read ahead by the engine are there already; an armed ring rings the socket
+    if ((ctx->uring && uring_io_buffered(ctx->uring) > 0) ||
+        (HAS_CAP(ctx, WINAPI_CAP_SHM_RING) && (winapi_ring_pending(&ctx->ring_in) > 0 || !winapi_ring_wait(&ctx->ring_in)))) {
+        return pump_response(ctx);
+    }
 
-    return root;
+    now = get_timestamp_ns();
+    pfd.fd = ctx->socket_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (now >= deadline || poll(&pfd, 1, (int)((deadline - now + 999999) / 1000000)) <= 0 ||
+        !(pfd.revents & (POLLIN | POLLHUP | POLLERR))) {
+        return 0;
+    }
+    // Zero-copy completions raise POLLERR too, without a response to read
+    if (pfd.revents == POLLERR) {
+        zerocopy_reap(ctx->socket_fd, &ctx->zerocopy, 0, 0);
+        return 0;
+    }
+    return pump_response(ctx);
 }
 
-static int send_json_request(int socket_fd, json_object *request) {
-    const char *json_string = json_object_to_json_string(request);
-    size_t json_len = strlen(json_string);
+/* Wait for a request to complete and release its slot */
+static int wait_pending(struct winapi_context *ctx, uint32_t request_id) {
+    struct pending_request *slot = &ctx->pending[request_id % PIPELINE_DEPTH];
+    int status;
+
+    if (slot->request_id != request_id || ATOMIC_LOAD(&slot->state) == PENDING_FREE) {
+        fprintf(stderr, "Unknown request %u\n", request_id);
+        return -1;
+    }
 
-    // Send length first (4 bytes)
-    uint32_t msg_len = htonl(json_len);
-    if (send(socket_fd, &msg_len, sizeof(msg_len), 0) != sizeof(msg_len)) {
+    if (ATOMIC_LOAD(&slot->callback) || ATOMIC_LOAD(&slot->queued)) {
+        fprintf(stderr, "Request %u completes through %s\n", request_id,
+                ATOMIC_LOAD(&slot->queued) ? "the completion queue" : "its callback");
         return -1;
     }
 
-    // Send JSON data
-    if (send(socket_fd, json_string, json_len, 0) != (ssize_t)json_len) {
+    // A lost connection aborts every in-flight slot, including this one
+    for (;;) {
+        uint32_t seen = dispatch_seen(ctx);
+
+        if (ATOMIC_LOAD(&slot->state) != PENDING_INFLIGHT || advance_completions(ctx, seen, 0) < 0) {
+            break;
+        }
+    }
+
+    status = slot->status;
+    release_pending(ctx, slot);
+
+    // Responses to other requests may have been read ahead along with this one
+    notify_engine_work(ctx);
+    return status;
+}
+
+/* Send a binary frame (and its socket payload, if any) for a reserved slot, releasing it on failure */
+static int send_pending(struct winapi_context *ctx, struct pending_request *slot, uint32_t flags,
+                        const winapi_buffer_desc_t *descs, uint32_t desc_count,
+                        const void *inline_data, uint32_t inline_size, uint32_t payload_crc,
+                        const winapi_buffer_t *payload, int payload_count, int zerocopy) {
+    if (send_binary_frame(ctx, ctx->socket_fd, WINAPI_MSG_REQUEST, slot->api_id, slot->request_id, flags,
+                          descs, desc_count, inline_data, inline_size, payload_crc, payload, payload_count,
+                          zerocopy ? &ctx->zerocopy : NULL) < 0) {
+        release_pending(ctx, slot);
         return -1;
     }
 
     return 0;
 }
 
-static json_object* receive_json_response(int socket_fd) {
-    // Receive length first
-    uint32_t msg_len;
-    if (recv(socket_fd, &msg_len, sizeof(msg_len), MSG_WAITALL) != sizeof(msg_len)) {
-        return NULL;
+/* Route a submitted request's completion to a callback, or to the completion queue without one */
+static void attach_callback(struct winapi_context *ctx, winapi_request_t request,
+                            winapi_completion_cb callback, void *user_data) {
+    struct pending_request *slot = &ctx->pending[request % PIPELINE_DEPTH];
+
+    slot->user_data = user_data;
+    if (callback) {
+        ATOMIC_STORE(&slot->callback, callback);
+    } else {
+        ATOMIC_STORE(&slot->queued, 1);
     }
 
-    msg_len = ntohl(msg_len);
-    if (msg_len > 65536) { // Reasonable limit
-        return NULL;
+    // JSON fallbacks complete during submission, and another thread may have read the response already
+    if (ATOMIC_LOAD(&slot->state) == PENDING_DONE) {
+        if (callback) {
+            notify_completion(ctx);
+        } else {
+            queue_slot(ctx, slot);
+        }
+        return;
     }
 
-    // Receive JSON data
-    char *buffer = malloc(msg_len + 1);
-    if (!buffer) return NULL;
+    // The event fd only sees the socket, so a response through the ring must
+    // ring the doorbell; a thread reading responses right now arms it when done.
+    // Queued calls are often submitted in bulk and reaped by blocking polls,
+    // so winapi_poll_completions() arms it instead, when it returns to an event loop
+    if (callback && HAS_CAP(ctx, WINAPI_CAP_SHM_RING) && try_dispatch(ctx)) {
+        if (!winapi_ring_wait(&ctx->ring_in)) {
+            notify_completion(ctx);
+        }
+        finish_dispatch(ctx);
+    }
+}
 
-    if (recv(socket_fd, buffer, msg_len, MSG_WAITALL) != (ssize_t)msg_len) {
-        free(buffer);
-        return NULL;
+/* Create the pollable fd (epoll set of the socket and a completion eventfd) */
+static int setup_event_fd(struct winapi_context *ctx) {
+    struct epoll_event ev;
+
+    ctx->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ctx->event_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (ctx->notify_fd < 0 || ctx->event_fd < 0) {
+        return -1;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = ctx->socket_fd;
+    if (epoll_ctl(ctx->event_fd, EPOLL_CTL_ADD, ctx->socket_fd, &ev) < 0) {
+        return -1;
+    }
+
+    ev.data.fd = ctx->notify_fd;
+    if (epoll_ctl(ctx->event_fd, EPOLL_CTL_ADD, ctx->notify_fd, &ev) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Locks of a handle shared between threads; the io_uring engine's is taken
+ * again by nested calls, and completion deadlines are on the monotonic clock
+ */
+static void init_locks(struct winapi_context *ctx) {
+    pthread_mutexattr_t recursive;
+    pthread_condattr_t monotonic;
+
+    pthread_mutex_init(&ctx->send_lock, NULL);
+    pthread_mutex_init(&ctx->completion_lock, NULL);
+    pthread_condattr_init(&monotonic);
+    pthread_condattr_setclock(&monotonic, CLOCK_MONOTONIC);
+    pthread_cond_init(&ctx->completed, &monotonic);
+    pthread_condattr_destroy(&monotonic);
+    pthread_mutex_init(&ctx->exclusive_lock, NULL);
+
+    pthread_mutexattr_init(&recursive);
+    pthread_mutexattr_settype(&recursive, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&ctx->engine_lock, &recursive);
+    pthread_mutexattr_destroy(&recursive);
+}
+
+static void destroy_locks(struct winapi_context *ctx) {
+    pthread_mutex_destroy(&ctx->send_lock);
+    pthread_mutex_destroy(&ctx->completion_lock);
+    pthread_cond_destroy(&ctx->completed);
+    pthread_mutex_destroy(&ctx->exclusive_lock);
+    pthread_mutex_destroy(&ctx->engine_lock);
+}
+
+/* Fill a configuration with the library defaults */
+void winapi_config_init(winapi_config_t *config)
+{
+    const char *data_connections;
+    const char *zerocopy_threshold;
+    const char *io_engine;
+    const char *ring_dir;
+    const char *ring_spin_us;
+
+    if (!config) {
+        return;
+    }
+
+    memset(config, 0, sizeof(*config));
+    config->capabilities = WINAPI_FEATURE_ALL;
+    config->max_frame_size = 0;
+
+    data_connections = getenv("WINAPI_DATA_CONNECTIONS");
+    if (data_connections && strcmp(data_connections, "auto") == 0) {
+        config->data_connections = WINAPI_DATA_CONNECTIONS_AUTO;
+    } else if (data_connections) {
+        config->data_connections = atoi(data_connections);
+    }
+
+    zerocopy_threshold = getenv("WINAPI_ZEROCOPY_THRESHOLD");
+    if (zerocopy_threshold) {
+        config->zerocopy_threshold = (size_t)strtoull(zerocopy_threshold, NULL, 0);
     }
 
-    buffer[msg_len] = '\0';
-    json_object *response = json_tokener_parse(buffer);
-    free(buffer);
+    io_engine = getenv("WINAPI_IO_ENGINE");
+    config->io_engine = io_engine && strcmp(io_engine, "uring") == 0 ? WINAPI_IO_ENGINE_URING : WINAPI_IO_ENGINE_SYSCALLS;
 
-    return response;
+    ring_dir = getenv("WINAPI_RING_DIR");
+    config->ring_dir = ring_dir ? ring_dir : TEMP_DIR_PATH;
+
+    ring_spin_us = getenv("WINAPI_RING_SPIN_US");
+    config->ring_spin_us = ring_spin_us ? (unsigned)strtoul(ring_spin_us, NULL, 0) : WINAPI_RING_SPIN_US_DEFAULT;
 }
 
 /* Initialize the API remoting library */
 winapi_handle_t winapi_init(void)
+{
+    winapi_config_t config;
+
+    winapi_config_init(&config);
+    return winapi_init_ex(&config);
+}
+
+/* Initialize the API remoting library with an explicit configuration */
+winapi_handle_t winapi_init_ex(const winapi_config_t *config)
 {
     struct winapi_context *ctx;
     //struct sockaddr_vm vsock_addr;
@@ -173,6 +2317,10 @@ winapi_handle_t winapi_init(void)
     int fd;
     int vsock_failed = 0;
 
+    if (!config) {
+        return NULL;
+    }
+
     ctx = malloc(sizeof(*ctx));
     if (!ctx) {
         return NULL;
@@ -180,7 +2328,10 @@ winapi_handle_t winapi_init(void)
 
     memset(ctx, 0, sizeof(*ctx));
     ctx->socket_fd = -1;
+    ctx->event_fd = -1;
+    ctx->notify_fd = -1;
     ctx->next_request_id = 1;
+    json_view_init(&ctx->json_in, ctx->json_tokens, JSON_MAX_TOKENS);
 
     // Skip VSOCK and go directly to TCP for debugging
     printf("Skipping VSOCK, using TCP connection directly...\n");
@@ -305,117 +2456,405 @@ winapi_handle_t winapi_init(void)
             printf("[WARN] Could not restore blocking mode\n");
         }
 
+        // Ring doorbells are lone small writes, Nagle would hold one back for the previous one's delayed ACK
+        int no_delay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
         printf("[OK] TCP connection successful\n");
         printf("[INFO] Using TCP mode with dynamic shared buffers\n");
+        ctx->host_addr = tcp_addr;
         ctx->socket_fd = fd;
         ctx->is_connected = 1;
     }
 
-    // Initialize shared memory pointers to NULL (using dynamic shared buffers now)
-    ctx->shared_memory = NULL;
-    ctx->header = NULL;
+    // The fixed request/response buffers are not used, buffers are dynamic shared files now
     ctx->request_buffer = NULL;
     ctx->response_buffer = NULL;
 
+    // Ring region for small calls, offered in the handshake if it could be set up
+    if ((config->capabilities & WINAPI_FEATURE_SHM_RING) && config->ring_dir && config->ring_dir[0]) {
+        create_ring_region(ctx, config->ring_dir);
+    }
+
+    // Agree on protocol version and optional features
+    perform_handshake(ctx, config);
+    printf("[INFO] Handshake: host version %u, capabilities 0x%08x, max frame %u bytes\n",
+           ctx->host_version, ctx->capabilities, ctx->max_frame_size);
+
+    // Once the host has mapped the region its file is no longer needed
+    if (ctx->ring_path[0]) {
+        unlink(ctx->ring_path);
+        ctx->ring_path[0] = '\0';
+    }
+    if (HAS_CAP(ctx, WINAPI_CAP_SHM_RING)) {
+        winapi_ring_poll_init(&ctx->ring_poll, (uint64_t)config->ring_spin_us * 1000);
+        printf("[INFO] Small calls go through shared memory rings, polled for up to %u us\n", config->ring_spin_us);
+    } else {
+        release_ring_region(ctx);
+    }
+
+    // Zero-copy needs the socket's consent before the first MSG_ZEROCOPY send, lanes included
+    if (config->zerocopy_threshold > 0) {
+        if (enable_zerocopy(ctx->socket_fd) == 0) {
+            ctx->zerocopy_threshold = config->zerocopy_threshold;
+            printf("[INFO] Zero-copy sends for payloads of %zu bytes and up\n", ctx->zerocopy_threshold);
+        } else {
+            printf("[WARN] Zero-copy sends unavailable: %s\n", strerror(errno));
+        }
+    }
+
+    // Binary frames can go through io_uring; JSON calls stay on plain system calls
+    if (config->io_engine == WINAPI_IO_ENGINE_URING && HAS_CAP(ctx, WINAPI_CAP_BINARY_FRAMING)) {
+        ctx->uring = uring_io_create(ctx->socket_fd);
+        if (ctx->uring) {
+            printf("[INFO] Using the io_uring engine\n");
+        } else {
+            printf("[INFO] io_uring unavailable (%s), using plain socket calls\n", strerror(errno));
+        }
+    }
+
+    // Fixed data connections open now, auto-tuned ones as the stripe count grows
+    if (HAS_CAP(ctx, WINAPI_CAP_STRIPING)) {
+        if (config->data_connections == WINAPI_DATA_CONNECTIONS_AUTO) {
+            ctx->data_connections = WINAPI_DATA_CONNECTIONS_AUTO;
+            ctx->stripe_count = STRIPE_AUTO_START;
+        } else {
+            ctx->data_connections = config->data_connections < WINAPI_MAX_DATA_CONNECTIONS ?
+                                    config->data_connections : WINAPI_MAX_DATA_CONNECTIONS;
+            ctx->stripe_count = ctx->data_connections;
+            open_lanes(ctx, ctx->data_connections);
+        }
+        printf("[INFO] Striping large transfers across %s data connections\n",
+               ctx->data_connections == WINAPI_DATA_CONNECTIONS_AUTO ? "auto-tuned" : "fixed");
+    }
+
+    if (setup_event_fd(ctx) < 0) {
+        printf("[WARN] Async event fd unavailable: %s\n", strerror(errno));
+    }
+
+    // From here on the handle may be shared between threads
+    init_locks(ctx);
+
     printf("Connected to Windows API remoting service\n");
     return ctx;
 }
 
+/* Query the feature set agreed with the host */
+int winapi_get_capabilities(winapi_handle_t handle, uint32_t *capabilities)
+{
+    struct winapi_context *ctx = (struct winapi_context *)handle;
+
+    if (!ctx || !capabilities) {
+        return -1;
+    }
+
+    *capabilities = ctx->capabilities;
+    return 0;
+}
+
 /* Cleanup the API remoting library */
 void winapi_cleanup(winapi_handle_t handle)
 {
     struct winapi_context *ctx = (struct winapi_context *)handle;
+    int i;
 
     if (ctx) {
-        if (ctx->shared_memory && ctx->shared_memory != MAP_FAILED) {
-            munmap(ctx->shared_memory, SHARED_MEMORY_SIZE);
+        destroy_locks(ctx);
+        release_ring_region(ctx);
+        release_registered(ctx);
+        if (ctx->event_fd >= 0) {
+            close(ctx->event_fd);
+        }
+        if (ctx->notify_fd >= 0) {
+            close(ctx->notify_fd);
         }
-        if (ctx->is_connected && ctx->socket_fd >= 0) {
+        for (i = 0; i < ctx->lane_count; i++) {
+            close(ctx->lane_fds[i]);
+        }
+        // Requests the io_uring engine still holds go out as they would have without it
+        if (ctx->uring) {
+            uring_io_flush(ctx->uring);
+            uring_io_destroy(ctx->uring);
+        }
+        if (ctx->socket_fd >= 0) {
             close(ctx->socket_fd);
         }
         free(ctx);
     }
 }
 
-/* Echo API call */
-int winapi_echo(winapi_handle_t handle, const char *input, char *output, size_t output_size)
+/* Submit a binary echo call */
+static int submit_echo_binary(struct winapi_context *ctx, const char *input, size_t input_len,
+                              char *output, size_t output_size, winapi_request_t *request_out)
 {
-    struct winapi_context *ctx = (struct winapi_context *)handle;
-    json_object *request, *response;
-    json_object *input_obj, *result_obj;
-    const char *result_str;
+    winapi_echo_request_t request;
+    struct pending_request *slot = alloc_pending(ctx, WINAPI_API_ECHO);
+
+    if (!slot) {
+        return -1;
+    }
+
+    slot->out.echo.output = output;
+    slot->out.echo.output_size = output_size;
+
+    request.input_len = (uint32_t)input_len;
+    memcpy(request.input_data, input, input_len);
+
+    if (send_pending(ctx, slot, WINAPI_MSG_FLAG_ASYNC, NULL, 0,
+                     &request, (uint32_t)(sizeof(request.input_len) + input_len), 0, NULL, 0, 0) < 0) {
+        fprintf(stderr, "Failed to send echo request\n");
+        return -1;
+    }
+
+    *request_out = slot->request_id;
+    return 0;
+}
+
+/* JSON echo call */
+static int echo_json(struct winapi_context *ctx, const char *input, char *output, size_t output_size)
+{
+    struct json_writer *request;
+    const struct json_view *response = &ctx->json_in;
     uint32_t request_id;
+    int result;
+
+    // Create JSON request
+    request_id = next_id(ctx);
+    request = create_api_request(ctx, WINAPI_API_ECHO, request_id);
+    json_write_string(request, "input", input);
+
+    // Send request
+    if (send_json_request(ctx, ctx->socket_fd) < 0) {
+        fprintf(stderr, "Failed to send echo request\n");
+        return -1;
+    }
+
+    // Receive response
+    if (receive_json_response(ctx, ctx->socket_fd) < 0) {
+        fprintf(stderr, "Failed to receive echo response\n");
+        return -1;
+    }
+
+    // Parse response
+    result = json_view_member(response, JSON_ROOT, "result");
+    if (result < 0) {
+        fprintf(stderr, "Invalid echo response format\n");
+        return -1;
+    }
+
+    if (json_view_string(response, result, output, output_size) < 0) {
+        fprintf(stderr, "Echo response too long\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* Queue or send an echo call, the io_uring engine may still hold it */
+static int echo_submit(struct winapi_context *ctx, const char *input, char *output, size_t output_size,
+                       winapi_request_t *request)
+{
     size_t input_len;
+    int binary;
+    int exclusive;
+    int status;
+
+    if (!ctx || !ctx->is_connected || !input || !output || !request) {
+        return -1;
+    }
+
+    input_len = strlen(input);
+    if (input_len > 4096) { // Reasonable limit
+        fprintf(stderr, "Input string too long\n");
+        return -1;
+    }
+
+    // JSON cannot be pipelined, complete the call right away; without host pipelining neither can binary calls
+    binary = HAS_CAP(ctx, WINAPI_CAP_BINARY_FRAMING) && input_len <= BINARY_ECHO_MAX;
+    exclusive = !binary || !HAS_CAP(ctx, WINAPI_CAP_PIPELINING);
+    if (begin_call(ctx, exclusive) < 0) {
+        return -1;
+    }
+
+    if (binary) {
+        status = submit_echo_binary(ctx, input, input_len, output, output_size, request);
+    } else {
+        status = complete_inline(ctx, WINAPI_API_ECHO, echo_json(ctx, input, output, output_size), request);
+    }
+
+    end_call(ctx, exclusive);
+    return status;
+}
+
+/* Submit an echo call without waiting for the response */
+int winapi_echo_submit(winapi_handle_t handle, const char *input, char *output, size_t output_size,
+                       winapi_request_t *request)
+{
+    struct winapi_context *ctx = (struct winapi_context *)handle;
+    int status;
+
+    if (!ctx) {
+        return -1;
+    }
+
+    engine_enter(ctx);
+    status = echo_submit(ctx, input, output, output_size, request);
+    notify_engine_work(ctx);
+    engine_leave(ctx);
+    return status;
+}
+
+/* Echo API call */
+int winapi_echo(winapi_handle_t handle, const char *input, char *output, size_t output_size)
+{
+    winapi_request_t request;
+
+    // The wait submits a queued frame together with the read of its response
+    if (echo_submit((struct winapi_context *)handle, input, output, output_size, &request) < 0) {
+        return -1;
+    }
+
+    return winapi_wait(handle, request);
+}
+
+/* Submit a binary buffer test (request and socket payload) */
+static int submit_buffer_test_binary(struct winapi_context *ctx,
+                                     winapi_buffer_t *buffers,
+                                     int buffer_count,
+                                     winapi_buffer_operation_t operation,
+                                     uint32_t test_pattern,
+                                     winapi_buffer_test_result_t *result,
+                                     winapi_request_t *request_out)
+{
+    winapi_buffer_desc_t descs[WINAPI_MAX_BUFFERS];
+    winapi_buffer_test_request_t request;
+    struct pending_request *slot;
+    uint32_t payload_crc = 0;
+    uint64_t total_size = 0;
+    size_t zerocopy_threshold;
+    uint32_t flags;
+    int stream;
+    int stripes;
+    int inline_payload;
+    int zerocopy;
+    int i;
+
+    for (i = 0; i < buffer_count; i++) {
+        descs[i].guest_pa = 0;
+        descs[i].size = buffers[i].size > UINT32_MAX ? UINT32_MAX : (uint32_t)buffers[i].size;
+        descs[i].flags = operation == WINAPI_BUFFER_OP_READ ? WINAPI_BUFFER_WRITE : WINAPI_BUFFER_READ;
+        total_size += buffers[i].size;
+    }
 
-    if (!ctx || !ctx->is_connected || !input || !output) {
-        return -1;
+    // Beyond a plain socket payload, the size travels in the request instead of the descriptors;
+    // large streams go over the data connections when there are any
+    stripes = choose_stripes(ctx, total_size);
+    stream = total_size > WINAPI_MAX_BUFFER_SIZE || stripes > 0;
+    flags = WINAPI_MSG_FLAG_ASYNC | (stream ? WINAPI_MSG_FLAG_STREAM : WINAPI_MSG_FLAG_SOCKET_PAYLOAD);
+
+    memset(&request, 0, sizeof(request));
+    request.test_pattern = test_pattern;
+    request.operation = operation;
+    if (stream) {
+        request.stream_size = total_size;
+        request.stream_window = WINAPI_STREAM_WINDOW;
+    }
+    if (stripes > 0) {
+        request.stripe_count = (uint32_t)stripes;
+        flags |= WINAPI_MSG_FLAG_STRIPED;
     }
 
-    input_len = strlen(input);
-    if (input_len > 4096) { // Reasonable limit
-        fprintf(stderr, "Input string too long\n");
+    // A striped WRITE's credits would queue on the lanes behind READ chunks nobody is reading yet
+    while (stripes > 0 && operation != WINAPI_BUFFER_OP_READ && ctx->striped_reads > 0) {
+        if (pump_response(ctx) < 0) {
+            return -1;
+        }
+    }
+
+    slot = alloc_pending(ctx, WINAPI_API_BUFFER_TEST);
+    if (!slot) {
         return -1;
     }
 
-    // Create JSON request
-    request_id = ctx->next_request_id++;
-    request = create_request("echo", request_id);
-    input_obj = json_object_new_string(input);
-    json_object_object_add(request, "input", input_obj);
+    memcpy(slot->out.buffer_test.buffers, buffers, buffer_count * sizeof(*buffers));
+    slot->out.buffer_test.buffer_count = buffer_count;
+    slot->out.buffer_test.operation = operation;
+    slot->out.buffer_test.result = result;
+    slot->out.buffer_test.total_size = total_size;
+    slot->out.buffer_test.stripes = stripes;
 
-    // Send request
-    if (send_json_request(ctx->socket_fd, request) < 0) {
-        fprintf(stderr, "Failed to send echo request\n");
-        json_object_put(request);
-        return -1;
+    // Large payloads can go out straight from the caller's buffers; striped lanes wait for the kernel themselves
+    zerocopy_threshold = ATOMIC_LOAD(&ctx->zerocopy_threshold);
+    zerocopy = zerocopy_threshold > 0 && total_size >= zerocopy_threshold &&
+               (operation == WINAPI_BUFFER_OP_WRITE || operation == WINAPI_BUFFER_OP_VERIFY);
+    slot->out.buffer_test.zerocopy = zerocopy && stripes == 0;
+    slot->out.buffer_test.zerocopy_mark = 0;
+
+    // The payload CRC goes in the header, so it is computed before anything is sent (streams carry it per chunk)
+    if (HAS_CAP(ctx, WINAPI_CAP_CHECKSUM_CRC32C) && !stream &&
+        (operation == WINAPI_BUFFER_OP_WRITE || operation == WINAPI_BUFFER_OP_VERIFY)) {
+        payload_crc = buffers_crc32c(buffers, buffer_count);
     }
-    json_object_put(request);
 
-    // Receive response
-    response = receive_json_response(ctx->socket_fd);
-    if (!response) {
-        fprintf(stderr, "Failed to receive echo response\n");
+    // A plain socket payload goes out in the same gather as the frame the host reads it after
+    inline_payload = !stream && (operation == WINAPI_BUFFER_OP_WRITE || operation == WINAPI_BUFFER_OP_VERIFY);
+
+    if (send_pending(ctx, slot, flags, descs, (uint32_t)buffer_count, &request, sizeof(request), payload_crc,
+                     buffers, inline_payload ? buffer_count : 0, zerocopy) < 0) {
+        fprintf(stderr, "ERROR: Failed to send buffer test request: %s\n", strerror(errno));
+        if (inline_payload) {
+            ctx->is_connected = 0;
+        }
         return -1;
     }
 
-    // Parse response
-    if (!json_object_object_get_ex(response, "result", &result_obj)) {
-        fprintf(stderr, "Invalid echo response format\n");
-        json_object_put(response);
-        return -1;
+    if (stripes > 0 && operation == WINAPI_BUFFER_OP_READ) {
+        ctx->striped_reads++;
     }
 
-    result_str = json_object_get_string(result_obj);
-    if (strlen(result_str) >= output_size) {
-        fprintf(stderr, "Echo response too long\n");
-        json_object_put(response);
-        return -1;
+    // Streamed WRITE/VERIFY payloads follow the frame as the host grants credit;
+    // the lanes only get credit once the host has the frame
+    if (stream && (operation == WINAPI_BUFFER_OP_WRITE || operation == WINAPI_BUFFER_OP_VERIFY)) {
+        int corrupt = 0;
+        int sent;
+
+        if (stripes > 0) {
+            sent = conn_flush(ctx) < 0 ? -1 : run_stripes(ctx, stripe_send_lane, stripes, slot->request_id, buffers,
+                                                          buffer_count, total_size, zerocopy, &corrupt);
+        } else {
+            sent = send_stream_payload(ctx, slot, buffers, buffer_count, total_size);
+        }
+        if (sent < 0) {
+            // The frame went out, so fail it with everything else in flight; the caller gets no token to wait on
+            abort_pending(ctx);
+            release_pending(ctx, slot);
+            return -1;
+        }
+        zerocopy_check_copied(ctx);
     }
 
-    strcpy(output, result_str);
-    json_object_put(response);
+    // Every zero-copy send of this payload has been issued
+    slot->out.buffer_test.zerocopy_mark = ctx->zerocopy.sent;
+
+    *request_out = slot->request_id;
     return 0;
 }
 
-/* Buffer test API call */
-int winapi_buffer_test(winapi_handle_t handle,
-                      winapi_buffer_t *buffers,
-                      int buffer_count,
-                      winapi_buffer_operation_t operation,
-                      uint32_t test_pattern,
-                      winapi_buffer_test_result_t *result)
+/* JSON buffer test call */
+static int buffer_test_json(struct winapi_context *ctx,
+                            winapi_buffer_t *buffers,
+                            int buffer_count,
+                            winapi_buffer_operation_t operation,
+                            uint32_t test_pattern,
+                            winapi_buffer_test_result_t *result)
 {
-    struct winapi_context *ctx = (struct winapi_context *)handle;
-    json_object *request, *response;
-    json_object *op_obj, *pattern_obj, *size_obj, *result_obj;
+    struct json_writer *request;
+    const struct json_view *response = &ctx->json_in;
     uint32_t request_id;
     uint64_t total_size = 0;
+    int payload_count;
+    int result_token;
     int i;
 
-    if (!ctx || !ctx->is_connected || !buffers || buffer_count <= 0 || !result) {
-        return -1;
-    }
-
     // Calculate total buffer size
     for (i = 0; i < buffer_count; i++) {
         total_size += buffers[i].size;
@@ -452,65 +2891,42 @@ int winapi_buffer_test(winapi_handle_t handle,
     }
 
     // Create JSON request
-    request_id = ctx->next_request_id++;
-    request = create_request("buffer_test", request_id);
-    op_obj = json_object_new_int(operation);
-    pattern_obj = json_object_new_int64((int64_t)test_pattern);  // Ensure unsigned values are handled correctly
-    size_obj = json_object_new_int64(total_size);
-
-    json_object_object_add(request, "operation", op_obj);
-    json_object_object_add(request, "test_pattern", pattern_obj);
-    json_object_object_add(request, "payload_size", size_obj);
+    request_id = next_id(ctx);
+    request = create_api_request(ctx, WINAPI_API_BUFFER_TEST, request_id);
+    json_write_int(request, "operation", operation);
+    json_write_int(request, "test_pattern", (int64_t)test_pattern);  // Ensure unsigned values are handled correctly
+    json_write_uint(request, "payload_size", total_size);
 
     // Add flag for socket buffer transfer
-    json_object *socket_transfer_obj = json_object_new_boolean(use_socket_transfer);
-    json_object_object_add(request, "socket_transfer", socket_transfer_obj);
+    json_write_bool(request, "socket_transfer", use_socket_transfer);
 
 
-    // Send request
-    if (send_json_request(ctx->socket_fd, request) < 0) {
+    // Send request, followed in the same gather by the buffer data when it travels over the socket
+    payload_count = use_socket_transfer && (operation == WINAPI_BUFFER_OP_WRITE || operation == WINAPI_BUFFER_OP_VERIFY) ?
+                    buffer_count : 0;
+    if (send_json_payload(ctx, ctx->socket_fd, buffers, payload_count) < 0) {
         fprintf(stderr, "ERROR: Failed to send buffer test request: %s\n", strerror(errno));
-        json_object_put(request);
         return -1;
     }
-    json_object_put(request);
-
-    // Send buffer data over socket if using socket transfer
-    if (use_socket_transfer && (operation == WINAPI_BUFFER_OP_WRITE || operation == WINAPI_BUFFER_OP_VERIFY)) {
-        for (i = 0; i < buffer_count; i++) {
-            ssize_t sent = send(ctx->socket_fd, buffers[i].data, buffers[i].size, 0);
-            if (sent != (ssize_t)buffers[i].size) {
-                fprintf(stderr, "ERROR: Failed to send buffer data: sent %zd/%zu bytes, error: %s\n",
-                        sent, buffers[i].size, strerror(errno));
-                return -1;
-            }
-        }
-    }
 
     // Receive response
-    response = receive_json_response(ctx->socket_fd);
-    if (!response) {
+    if (receive_json_response(ctx, ctx->socket_fd) < 0) {
         fprintf(stderr, "ERROR: Failed to receive buffer test response: %s\n", strerror(errno));
         fprintf(stderr, "       This may indicate server crash or connection loss\n");
         return -1;
     }
 
     // Parse response
-    if (!json_object_object_get_ex(response, "result", &result_obj)) {
+    result_token = json_view_member(response, JSON_ROOT, "result");
+    if (result_token < 0) {
         fprintf(stderr, "Invalid buffer test response format\n");
-        json_object_put(response);
         return -1;
     }
 
-    // Extract results
-    json_object *bytes_obj, *checksum_obj, *status_obj;
-    json_object_object_get_ex(result_obj, "bytes_processed", &bytes_obj);
-    json_object_object_get_ex(result_obj, "checksum", &checksum_obj);
-    json_object_object_get_ex(result_obj, "status", &status_obj);
-
-    result->bytes_processed = json_object_get_int64(bytes_obj);
-    result->checksum = json_object_get_int(checksum_obj);
-    result->status = json_object_get_int(status_obj);
+    // Extract results; the XOR checksum spans all 32 bits
+    result->bytes_processed = json_view_int64(response, json_view_member(response, result_token, "bytes_processed"));
+    result->checksum = (uint32_t)json_view_uint64(response, json_view_member(response, result_token, "checksum"));
+    result->status = (int)json_view_int64(response, json_view_member(response, result_token, "status"));
 
     // Handle buffer data reception
     if (operation == WINAPI_BUFFER_OP_READ && result->status == 0) {
@@ -523,93 +2939,475 @@ int winapi_buffer_test(winapi_handle_t handle,
             }
         } else {
             // Receive buffer data over socket
-            for (i = 0; i < buffer_count; i++) {
-                if (recv(ctx->socket_fd, buffers[i].data, buffers[i].size, MSG_WAITALL) != (ssize_t)buffers[i].size) {
-                    fprintf(stderr, "Failed to receive buffer data\n");
-                    json_object_put(response);
-                    return -1;
-                }
+            if (recv_buffer_payload(ctx, buffers, buffer_count, NULL) < 0) {
+                return -1;
             }
         }
     }
 
-    json_object_put(response);
     return result->status;
 }
 
-/* Performance test API call */
-int winapi_perf_test(winapi_handle_t handle,
-                    winapi_perf_test_params_t *params,
-                    winapi_buffer_t *buffers,
-                    int buffer_count,
-                    winapi_perf_test_result_t *result)
+/*
+ * Binary buffer tests that stream, may stripe or send zero-copy interleave
+ * their payload with other traffic on the connection
+ */
+static int buffer_test_exclusive(struct winapi_context *ctx, winapi_buffer_operation_t operation, uint64_t total_size)
+{
+    size_t zerocopy_threshold = ATOMIC_LOAD(&ctx->zerocopy_threshold);
+
+    return !HAS_CAP(ctx, WINAPI_CAP_PIPELINING) || total_size > WINAPI_MAX_BUFFER_SIZE ||
+           (HAS_CAP(ctx, WINAPI_CAP_STRIPING) && ctx->data_connections != 0 && total_size >= STRIPE_MIN_SIZE) ||
+           (zerocopy_threshold > 0 && total_size >= zerocopy_threshold &&
+            (operation == WINAPI_BUFFER_OP_WRITE || operation == WINAPI_BUFFER_OP_VERIFY));
+}
+
+/* Queue or send a buffer test, the io_uring engine may still hold its frame */
+static int buffer_test_submit(struct winapi_context *ctx,
+                              winapi_buffer_t *buffers,
+                              int buffer_count,
+                              winapi_buffer_operation_t operation,
+                              uint32_t test_pattern,
+                              winapi_buffer_test_result_t *result,
+                              winapi_request_t *request)
 {
-    struct winapi_context *ctx = (struct winapi_context *)handle;
-    json_object *request, *response;
-    json_object *type_obj, *iter_obj, *bytes_obj, *result_obj;
-    uint32_t request_id;
     uint64_t total_size = 0;
+    int binary;
+    int exclusive;
+    int status;
     int i;
 
-    if (!ctx || !ctx->is_connected || !params || !result) {
+    if (!ctx || !ctx->is_connected || !buffers || buffer_count <= 0 || !result || !request) {
         return -1;
     }
 
-    if (buffers && buffer_count > 0) {
-        for (i = 0; i < buffer_count; i++) {
-            total_size += buffers[i].size;
+    for (i = 0; i < buffer_count; i++) {
+        total_size += buffers[i].size;
+    }
+
+    // Larger requests need a payload stream, without one they stay on JSON
+    binary = HAS_CAP(ctx, WINAPI_CAP_BINARY_FRAMING) && !ctx->request_buffer && buffer_count <= WINAPI_MAX_BUFFERS &&
+             (total_size <= WINAPI_MAX_BUFFER_SIZE || HAS_CAP(ctx, WINAPI_CAP_STREAMING));
+    exclusive = !binary || buffer_test_exclusive(ctx, operation, total_size);
+    if (begin_call(ctx, exclusive) < 0) {
+        return -1;
+    }
+
+    if (binary) {
+        status = submit_buffer_test_binary(ctx, buffers, buffer_count, operation, test_pattern, result, request);
+    } else {
+        // JSON cannot be pipelined, complete the call right away
+        status = complete_inline(ctx, WINAPI_API_BUFFER_TEST,
+                                 buffer_test_json(ctx, buffers, buffer_count, operation, test_pattern, result),
+                                 request);
+    }
+
+    end_call(ctx, exclusive);
+    return status;
+}
+
+/* Submit a buffer test without waiting for the response */
+int winapi_buffer_test_submit(winapi_handle_t handle,
+                              winapi_buffer_t *buffers,
+                              int buffer_count,
+                              winapi_buffer_operation_t operation,
+                              uint32_t test_pattern,
+                              winapi_buffer_test_result_t *result,
+                              winapi_request_t *request)
+{
+    struct winapi_context *ctx = (struct winapi_context *)handle;
+    int status;
+
+    if (!ctx) {
+        return -1;
+    }
+
+    engine_enter(ctx);
+    status = buffer_test_submit(ctx, buffers, buffer_count, operation, test_pattern, result, request);
+    notify_engine_work(ctx);
+    engine_leave(ctx);
+    return status;
+}
+
+/* Buffer test API call */
+int winapi_buffer_test(winapi_handle_t handle,
+                      winapi_buffer_t *buffers,
+                      int buffer_count,
+                      winapi_buffer_operation_t operation,
+                      uint32_t test_pattern,
+                      winapi_buffer_test_result_t *result)
+{
+    winapi_request_t request;
+
+    if (buffer_test_submit((struct winapi_context *)handle, buffers, buffer_count, operation, test_pattern, result,
+                           &request) < 0) {
+        return -1;
+    }
+
+    return winapi_wait(handle, request);
+}
+
+/* Wait for a submitted call and return its status */
+int winapi_wait(winapi_handle_t handle, winapi_request_t request)
+{
+    struct winapi_context *ctx = (struct winapi_context *)handle;
+
+    int status;
+
+    if (!ctx) {
+        return -1;
+    }
+
+    engine_enter(ctx);
+    status = wait_pending(ctx, request);
+    engine_leave(ctx);
+    return status;
+}
+
+/* Asynchronous echo call, completes through callback or the completion queue */
+int winapi_echo_async(winapi_handle_t handle, const char *input, char *output, size_t output_size,
+                      winapi_completion_cb callback, void *user_data, winapi_request_t *request)
+{
+    struct winapi_context *ctx = (struct winapi_context *)handle;
+
+    if (!ctx) {
+        return -1;
+    }
+
+    engine_enter(ctx);
+    if (winapi_echo_submit(handle, input, output, output_size, request) < 0) {
+        engine_leave(ctx);
+        return -1;
+    }
+    attach_callback(ctx, *request, callback, user_data);
+    engine_leave(ctx);
+    return 0;
+}
+
+/* Asynchronous buffer test, completes through callback or the completion queue */
+int winapi_buffer_test_async(winapi_handle_t handle,
+                             winapi_buffer_t *buffers,
+                             int buffer_count,
+                             winapi_buffer_operation_t operation,
+                             uint32_t test_pattern,
+                             winapi_buffer_test_result_t *result,
+                             winapi_completion_cb callback,
+                             void *user_data,
+                             winapi_request_t *request)
+{
+    struct winapi_context *ctx = (struct winapi_context *)handle;
+
+    if (!ctx) {
+        return -1;
+    }
+
+    engine_enter(ctx);
+    if (winapi_buffer_test_submit(handle, buffers, buffer_count, operation, test_pattern, result, request) < 0) {
+        engine_leave(ctx);
+        return -1;
+    }
+    attach_callback(ctx, *request, callback, user_data);
+    engine_leave(ctx);
+    return 0;
+}
+
+/* File descriptor that polls readable while completions are pending */
+int winapi_get_event_fd(winapi_handle_t handle)
+{
+    struct winapi_context *ctx = (struct winapi_context *)handle;
+
+    if (!ctx) {
+        return -1;
+    }
+
+    return ctx->event_fd;
+}
+
+/* Read the responses that are there without blocking, as the dispatcher; arm the ring for an event loop */
+static void read_ready_responses(struct winapi_context *ctx, int arm)
+{
+    struct pollfd pfd;
+
+    // Requests the io_uring engine queued since the last dispatch go out now
+    ctx->engine_kicked = 0;
+    if (conn_flush(ctx) < 0) {
+        abort_pending(ctx);
+    }
+
+    pfd.fd = ctx->socket_fd;
+    pfd.events = POLLIN;
+    while (ATOMIC_LOAD(&ctx->inflight_count) > 0) {
+        // Responses in the ring or read ahead by the engine are ready without the socket saying so
+        if ((HAS_CAP(ctx, WINAPI_CAP_SHM_RING) && winapi_ring_pending(&ctx->ring_in) > 0) ||
+            (ctx->uring && uring_io_buffered(ctx->uring) > 0)) {
+            if (pump_response(ctx) < 0) {
+                break;
+            }
+            continue;
+        }
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & (POLLIN | POLLHUP | POLLERR))) {
+            break;
+        }
+        // Zero-copy completions raise POLLERR too, without a response to read
+        if (pfd.revents == POLLERR) {
+            uint32_t done = ctx->zerocopy.done;
+
+            if (zerocopy_reap(ctx->socket_fd, &ctx->zerocopy, 0, 0) == 0 && ctx->zerocopy.done != done) {
+                continue;
+            }
+        }
+        if (pump_response(ctx) < 0) {
+            break;
         }
     }
 
-    // Create JSON request
-    request_id = ctx->next_request_id++;
-    request = create_request("performance", request_id);
-    type_obj = json_object_new_int(params->test_type);
-    iter_obj = json_object_new_int(params->iterations);
-    bytes_obj = json_object_new_int64(params->target_bytes);
+    // Back to the event loop: have the host ring for responses still to come through the ring
+    if (arm && ATOMIC_LOAD(&ctx->inflight_count) > 0 && HAS_CAP(ctx, WINAPI_CAP_SHM_RING) && !winapi_ring_wait(&ctx->ring_in)) {
+        notify_completion(ctx);
+    }
+}
+
+/* Reap ready responses and run async callbacks, never blocks waiting for the host */
+int winapi_dispatch_completions(winapi_handle_t handle)
+{
+    struct winapi_context *ctx = (struct winapi_context *)handle;
+    uint64_t counter;
+    ssize_t drained;
+    int dispatched = 0;
+    int i;
+
+    if (!ctx) {
+        return -1;
+    }
+
+    if (ctx->notify_fd >= 0) {
+        drained = read(ctx->notify_fd, &counter, sizeof(counter));
+        (void)drained;
+    }
+
+    // Another thread reading responses completes them (and arms the ring) for this one
+    engine_enter(ctx);
+    if (try_dispatch(ctx)) {
+        read_ready_responses(ctx, 1);
+        finish_dispatch(ctx);
+    }
+
+    for (i = 0; i < PIPELINE_DEPTH; i++) {
+        if (ATOMIC_LOAD(&ctx->pending[i].state) == PENDING_DONE && ATOMIC_LOAD(&ctx->pending[i].callback)) {
+            dispatched += run_callback(ctx, &ctx->pending[i]);
+        }
+    }
+
+    engine_leave(ctx);
+    return dispatched;
+}
+
+/* Move up to max queued completions into entries, starting where the last poll left off */
+static int collect_completions(struct winapi_context *ctx, winapi_completion_t *completions, int max)
+{
+    uint32_t start = ATOMIC_LOAD(&ctx->completion_cursor);
+    int count = 0;
+    int i;
+
+    for (i = 0; i < PIPELINE_DEPTH && count < max; i++) {
+        struct pending_request *slot = &ctx->pending[(start + i) % PIPELINE_DEPTH];
+        winapi_completion_t *entry = &completions[count];
+        int state = PENDING_QUEUED;
+
+        if (ATOMIC_LOAD(&slot->state) != PENDING_QUEUED ||
+            !__atomic_compare_exchange_n(&slot->state, &state, PENDING_DELIVERING, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            continue;
+        }
+
+        memset(entry, 0, sizeof(*entry));
+        entry->request = slot->request_id;
+        entry->type = (winapi_call_type_t)slot->api_id;
+        entry->status = slot->status;
+        entry->user_data = slot->user_data;
+        if (slot->api_id == WINAPI_API_ECHO) {
+            entry->u.echo.output = slot->out.echo.output;
+            entry->u.echo.output_len = slot->status == 0 ? strlen(slot->out.echo.output) : 0;
+        } else if (slot->api_id == WINAPI_API_BUFFER_TEST && slot->out.buffer_test.result) {
+            entry->u.buffer_test = *slot->out.buffer_test.result;
+        }
+        ATOMIC_STORE(&slot->state, PENDING_FREE);
+        count++;
+    }
+    ATOMIC_STORE(&ctx->completion_cursor, (start + i) % PIPELINE_DEPTH);
+    return count;
+}
+
+/* Take finished completion-queue calls, waiting up to timeout_ms for the first */
+int winapi_poll_completions(winapi_handle_t handle, winapi_completion_t *completions, int max, int timeout_ms)
+{
+    struct winapi_context *ctx = (struct winapi_context *)handle;
+    uint64_t deadline = 0;
+    uint64_t counter;
+    ssize_t drained;
+    int count;
+
+    if (!ctx || !completions || max <= 0) {
+        return -1;
+    }
+
+    if (timeout_ms > 0) {
+        deadline = get_timestamp_ns() + (uint64_t)timeout_ms * 1000000ULL;
+    }
+    if (ctx->notify_fd >= 0) {
+        drained = read(ctx->notify_fd, &counter, sizeof(counter));
+        (void)drained;
+    }
+
+    engine_enter(ctx);
+    for (;;) {
+        uint32_t seen;
+
+        // Whatever has arrived is read without blocking and taken in one go
+        if (try_dispatch(ctx)) {
+            read_ready_responses(ctx, timeout_ms == 0);
+            finish_dispatch(ctx);
+        }
+        seen = dispatch_seen(ctx);
+
+        count = collect_completions(ctx, completions, max);
+        if (count > 0 || timeout_ms == 0 || ATOMIC_LOAD(&ctx->inflight_count) == 0 ||
+            (deadline && get_timestamp_ns() >= deadline) || advance_completions(ctx, seen, deadline) < 0) {
+            break;
+        }
+    }
+    if (count == 0 && !ctx->is_connected) {
+        count = -1;
+    }
+    // More may be queued than fit: keep the event fd readable for them
+    if (count == max) {
+        notify_completion(ctx);
+    }
+
+    engine_leave(ctx);
+    return count;
+}
+
+/* Binary performance test call */
+static int perf_test_binary(struct winapi_context *ctx,
+                            winapi_perf_test_params_t *params,
+                            winapi_perf_test_result_t *result)
+{
+    winapi_perf_test_request_t request;
+    struct pending_request *slot;
+    int exclusive = !HAS_CAP(ctx, WINAPI_CAP_PIPELINING);
+    uint32_t request_id;
+
+    if (begin_call(ctx, exclusive) < 0) {
+        return -1;
+    }
+
+    slot = alloc_pending(ctx, WINAPI_API_PERF_TEST);
+    if (!slot) {
+        end_call(ctx, exclusive);
+        return -1;
+    }
+
+    slot->out.perf.result = result;
+
+    request.test_type = params->test_type;
+    request.iterations = params->iterations;
+    request.target_bytes = params->target_bytes;
+
+    if (send_pending(ctx, slot, WINAPI_MSG_FLAG_SYNC, NULL, 0, &request, sizeof(request), 0, NULL, 0, 0) < 0) {
+        fprintf(stderr, "Failed to send performance test request\n");
+        end_call(ctx, exclusive);
+        return -1;
+    }
+    request_id = slot->request_id;
+    end_call(ctx, exclusive);
+
+    return wait_pending(ctx, request_id);
+}
+
+/* JSON performance test call */
+static int perf_test_json(struct winapi_context *ctx,
+                          winapi_perf_test_params_t *params,
+                          winapi_perf_test_result_t *result)
+{
+    struct json_writer *request;
+    const struct json_view *response;
+    uint32_t request_id;
+    int result_token;
 
-    json_object_object_add(request, "test_type", type_obj);
-    json_object_object_add(request, "iterations", iter_obj);
-    json_object_object_add(request, "target_bytes", bytes_obj);
+    // Create JSON request
+    request_id = next_id(ctx);
+    request = create_api_request(ctx, WINAPI_API_PERF_TEST, request_id);
+    json_write_int(request, "test_type", params->test_type);
+    json_write_int(request, "iterations", params->iterations);
+    json_write_int(request, "target_bytes", (int64_t)params->target_bytes);
 
     // Send request
-    if (send_json_request(ctx->socket_fd, request) < 0) {
+    if (send_json_request(ctx, ctx->socket_fd) < 0) {
         fprintf(stderr, "Failed to send performance test request\n");
-        json_object_put(request);
         return -1;
     }
-    json_object_put(request);
 
-    // Receive response
-    response = receive_json_response(ctx->socket_fd);
-    if (!response) {
-        fprintf(stderr, "Failed to receive performance test response\n");
+    // Receive response
+    if (receive_json_response(ctx, ctx->socket_fd) < 0) {
+        fprintf(stderr, "Failed to receive performance test response\n");
+        return -1;
+    }
+
+    // Parse response
+    response = &ctx->json_in;
+    result_token = json_view_member(response, JSON_ROOT, "result");
+    if (result_token < 0) {
+        fprintf(stderr, "Invalid performance test response format\n");
+        return -1;
+    }
+
+    // Extract results
+    result->min_latency_ns = json_view_int64(response, json_view_member(response, result_token, "min_latency_ns"));
+    result->max_latency_ns = json_view_int64(response, json_view_member(response, result_token, "max_latency_ns"));
+    result->avg_latency_ns = json_view_int64(response, json_view_member(response, result_token, "avg_latency_ns"));
+    result->throughput_mbps = json_view_int64(response, json_view_member(response, result_token, "throughput_mbps"));
+    result->iterations_completed = (int)json_view_int64(response,
+                                                        json_view_member(response, result_token, "iterations_completed"));
+    return 0;
+}
+
+/* Performance test API call */
+int winapi_perf_test(winapi_handle_t handle,
+                    winapi_perf_test_params_t *params,
+                    winapi_buffer_t *buffers,
+                    int buffer_count,
+                    winapi_perf_test_result_t *result)
+{
+    struct winapi_context *ctx = (struct winapi_context *)handle;
+    uint64_t total_size = 0;
+    int status;
+    int i;
+
+    if (!ctx || !ctx->is_connected || !params || !result) {
         return -1;
     }
 
-    // Parse response
-    if (!json_object_object_get_ex(response, "result", &result_obj)) {
-        fprintf(stderr, "Invalid performance test response format\n");
-        json_object_put(response);
-        return -1;
+    if (buffers && buffer_count > 0) {
+        for (i = 0; i < buffer_count; i++) {
+            total_size += buffers[i].size;
+        }
     }
 
-    // Extract results
-    json_object *min_obj, *max_obj, *avg_obj, *tput_obj, *completed_obj;
-    json_object_object_get_ex(result_obj, "min_latency_ns", &min_obj);
-    json_object_object_get_ex(result_obj, "max_latency_ns", &max_obj);
-    json_object_object_get_ex(result_obj, "avg_latency_ns", &avg_obj);
-    json_object_object_get_ex(result_obj, "throughput_mbps", &tput_obj);
-    json_object_object_get_ex(result_obj, "iterations_completed", &completed_obj);
-
-    result->min_latency_ns = json_object_get_int64(min_obj);
-    result->max_latency_ns = json_object_get_int64(max_obj);
-    result->avg_latency_ns = json_object_get_int64(avg_obj);
-    result->throughput_mbps = json_object_get_int64(tput_obj);
-    result->iterations_completed = json_object_get_int(completed_obj);
+    if (HAS_CAP(ctx, WINAPI_CAP_BINARY_FRAMING)) {
+        engine_enter(ctx);
+        status = perf_test_binary(ctx, params, result);
+        engine_leave(ctx);
+        return status;
+    }
 
-    json_object_put(response);
-    return 0;
+    // JSON cannot be pipelined, reap outstanding binary responses first
+    if (begin_call(ctx, 1) < 0) {
+        return -1;
+    }
+    status = perf_test_json(ctx, params, result);
+    end_call(ctx, 1);
+    return status;
 }
 
 /* Helper function to allocate aligned buffer */
@@ -651,6 +3449,7 @@ static uint32_t g_next_buffer_id = 1;
 int winapi_alloc_shared_buffer(winapi_handle_t handle, size_t size, winapi_shared_buffer_t *buffer)
 {
     struct winapi_context *ctx = (struct winapi_context *)handle;
+    winapi_shared_file_trailer_t trailer;
 
     if (!ctx || !buffer || size == 0) {
         return -1;
@@ -659,7 +3458,7 @@ int winapi_alloc_shared_buffer(winapi_handle_t handle, size_t size, winapi_share
     // Initialize buffer structure
     memset(buffer, 0, sizeof(*buffer));
     buffer->size = size;
-    buffer->buffer_id = g_next_buffer_id++;
+    buffer->buffer_id = __atomic_fetch_add(&g_next_buffer_id, 1, __ATOMIC_RELAXED);
 
     // Create unique temporary file name
     snprintf(buffer->file_path, sizeof(buffer->file_path),
@@ -682,8 +3481,12 @@ int winapi_alloc_shared_buffer(winapi_handle_t handle, size_t size, winapi_share
         return -1;
     }
 
-    // Set file size
-    if (ftruncate(buffer->fd, size) < 0) {
+    // Set file size; the trailer page past the data tells the host the file is ours to share
+    trailer.magic = WINAPI_SHARED_FILE_MAGIC;
+    trailer.buffer_id = buffer->buffer_id;
+    trailer.size = size;
+    if (ftruncate(buffer->fd, WINAPI_SHARED_FILE_SIZE(size)) < 0 ||
+        pwrite(buffer->fd, &trailer, sizeof(trailer), WINAPI_SHARED_FILE_TRAILER(size)) != (ssize_t)sizeof(trailer)) {
         printf("Failed to set buffer file size: %s\n", strerror(errno));
         close(buffer->fd);
         unlink(buffer->file_path);
@@ -703,63 +3506,626 @@ int winapi_alloc_shared_buffer(winapi_handle_t handle, size_t size, winapi_share
     return 0;
 }
 
-/* Send shared buffer to host for processing */
-int winapi_process_shared_buffer(winapi_handle_t handle, winapi_shared_buffer_t *buffer, const char *operation)
+/* Binary shared buffer call, on a registered range of the buffer when desc is set */
+static int process_shared_buffer_binary(struct winapi_context *ctx, winapi_shared_buffer_t *buffer,
+                                        const winapi_buffer_desc_t *desc, const char *operation)
 {
-    struct winapi_context *ctx = (struct winapi_context *)handle;
-    json_object *request, *response;
-    json_object *op_obj, *path_obj, *size_obj, *id_obj;
+    winapi_shared_buffer_request_t request;
+    struct pending_request *slot;
+    int exclusive = !HAS_CAP(ctx, WINAPI_CAP_PIPELINING);
     uint32_t request_id;
+    uint32_t flags = WINAPI_MSG_FLAG_SYNC;
+    uint32_t inline_size = sizeof(request);
 
-    if (!ctx || !ctx->is_connected || !buffer || !operation) {
+    if (begin_call(ctx, exclusive) < 0) {
         return -1;
     }
 
-    // Create JSON request
-    request_id = ctx->next_request_id++;
-    request = create_request("shared_buffer", request_id);
+    slot = alloc_pending(ctx, WINAPI_API_SHARED_BUFFER);
+    if (!slot) {
+        end_call(ctx, exclusive);
+        return -1;
+    }
+
+    memset(&request, 0, sizeof(request));
+    request.buffer_id = buffer->buffer_id;
+    request.buffer_size = buffer->size;
+    snprintf(request.operation, sizeof(request.operation), "%s", operation);
+
+    // The host mapped a registered buffer's file when it was registered, the path stays behind
+    if (desc) {
+        request.buffer_size = desc->size;
+        flags |= WINAPI_MSG_FLAG_REGISTERED;
+        inline_size = WINAPI_SHARED_BUFFER_REQUEST_REGISTERED_SIZE;
+    } else {
+        snprintf(request.file_path, sizeof(request.file_path), "%s", buffer->file_path);
+    }
+
+    if (send_pending(ctx, slot, flags, desc, desc ? 1 : 0, &request, inline_size, 0, NULL, 0, 0) < 0) {
+        fprintf(stderr, "Failed to send shared buffer request\n");
+        end_call(ctx, exclusive);
+        return -1;
+    }
+    request_id = slot->request_id;
+    end_call(ctx, exclusive);
+
+    if (wait_pending(ctx, request_id) < 0) {
+        return -1;
+    }
+
+    if (!desc) {
+        printf("[OK] Host processed shared buffer: %s\n", buffer->file_path);
+    }
+    return 0;
+}
 
-    op_obj = json_object_new_string(operation);
-    path_obj = json_object_new_string(buffer->file_path);
-    size_obj = json_object_new_int64(buffer->size);
-    id_obj = json_object_new_int(buffer->buffer_id);
+/* JSON shared buffer call */
+static int process_shared_buffer_json(struct winapi_context *ctx, winapi_shared_buffer_t *buffer,
+                                      const char *operation)
+{
+    struct json_writer *request;
+    const struct json_view *response;
+    int status;
+    uint32_t request_id;
 
-    json_object_object_add(request, "operation", op_obj);
-    json_object_object_add(request, "file_path", path_obj);
-    json_object_object_add(request, "buffer_size", size_obj);
-    json_object_object_add(request, "buffer_id", id_obj);
+    // Create JSON request
+    request_id = next_id(ctx);
+    request = create_api_request(ctx, WINAPI_API_SHARED_BUFFER, request_id);
+    json_write_string(request, "operation", operation);
+    json_write_string(request, "file_path", buffer->file_path);
+    json_write_int(request, "buffer_size", (int64_t)buffer->size);
+    json_write_int(request, "buffer_id", buffer->buffer_id);
 
     // Send request
-    if (send_json_request(ctx->socket_fd, request) < 0) {
+    if (send_json_request(ctx, ctx->socket_fd) < 0) {
         fprintf(stderr, "Failed to send shared buffer request\n");
-        json_object_put(request);
         return -1;
     }
-    json_object_put(request);
 
     // Receive response
-    response = receive_json_response(ctx->socket_fd);
-    if (!response) {
+    if (receive_json_response(ctx, ctx->socket_fd) < 0) {
         fprintf(stderr, "Failed to receive shared buffer response\n");
         return -1;
     }
 
     // Check response status
-    json_object *status_obj;
-    if (json_object_object_get_ex(response, "status", &status_obj)) {
-        const char *status = json_object_get_string(status_obj);
-        if (strcmp(status, "success") != 0) {
-            fprintf(stderr, "Shared buffer processing failed\n");
-            json_object_put(response);
+    response = &ctx->json_in;
+    status = json_view_member(response, JSON_ROOT, "status");
+    if (status >= 0 && !json_view_string_equals(response, status, "success")) {
+        fprintf(stderr, "Shared buffer processing failed\n");
+        return -1;
+    }
+
+    printf("[OK] Host processed shared buffer: %s\n", buffer->file_path);
+    return 0;
+}
+
+/* Send shared buffer to host for processing */
+int winapi_process_shared_buffer(winapi_handle_t handle, winapi_shared_buffer_t *buffer, const char *operation)
+{
+    struct winapi_context *ctx = (struct winapi_context *)handle;
+    int status;
+
+    if (!ctx || !ctx->is_connected || !buffer || !operation) {
+        return -1;
+    }
+
+    if (HAS_CAP(ctx, WINAPI_CAP_BINARY_FRAMING) &&
+        strlen(operation) < WINAPI_MAX_OPERATION_NAME && strlen(buffer->file_path) < WINAPI_MAX_PATH_LEN) {
+        engine_enter(ctx);
+        status = process_shared_buffer_binary(ctx, buffer, NULL, operation);
+        engine_leave(ctx);
+        return status;
+    }
+
+    // JSON cannot be pipelined, reap outstanding binary responses first
+    if (begin_call(ctx, 1) < 0) {
+        return -1;
+    }
+    status = process_shared_buffer_json(ctx, buffer, operation);
+    end_call(ctx, 1);
+    return status;
+}
+
+/*
+ * Registered buffers
+ */
+
+/* Unpin and forget the registered buffers; the host's table goes with the next registration */
+static void release_registered(struct winapi_context *ctx)
+{
+    int i;
+
+    for (i = 0; i < ctx->registered_count; i++) {
+        if (ctx->registered[i].pinned) {
+            munlock(ctx->registered[i].data, ctx->registered[i].size);
+        }
+    }
+    memset(ctx->registered, 0, sizeof(ctx->registered));
+    ctx->registered_count = 0;
+}
+
+/* Tell the host about the table, WINAPI_MAX_BUFFERS entries per request, the first one replacing its table */
+static int send_registrations(struct winapi_context *ctx)
+{
+    winapi_register_buffers_request_t request;
+    int exclusive = !HAS_CAP(ctx, WINAPI_CAP_PIPELINING);
+    int first = 0;
+
+    do {
+        struct pending_request *slot;
+        uint32_t request_id;
+        uint32_t i;
+
+        memset(&request, 0, sizeof(request));
+        request.flags = first == 0 ? WINAPI_REGISTER_RESET : 0;
+        request.count = ctx->registered_count - first > WINAPI_MAX_BUFFERS ? WINAPI_MAX_BUFFERS
+                                                                            : (uint32_t)(ctx->registered_count - first);
+        for (i = 0; i < request.count; i++) {
+            const struct registered_buffer *entry = &ctx->registered[first + i];
+
+            request.entries[i].index = first + i;
+            request.entries[i].backing = entry->backing;
+            request.entries[i].size = entry->size;
+            if (entry->backing == WINAPI_BACKING_SHARED_FILE) {
+                snprintf(request.entries[i].file_path, sizeof(request.entries[i].file_path), "%s",
+                         entry->shared->file_path);
+            }
+        }
+
+        if (begin_call(ctx, exclusive) < 0) {
             return -1;
         }
+        slot = alloc_pending(ctx, WINAPI_API_REGISTER_BUFFERS);
+        if (!slot || send_pending(ctx, slot, WINAPI_MSG_FLAG_SYNC, NULL, 0, &request,
+                                  offsetof(winapi_register_buffers_request_t, entries) +
+                                  request.count * sizeof(request.entries[0]), 0, NULL, 0, 0) < 0) {
+            fprintf(stderr, "Failed to send buffer registration\n");
+            end_call(ctx, exclusive);
+            return -1;
+        }
+        request_id = slot->request_id;
+        end_call(ctx, exclusive);
+
+        if (wait_pending(ctx, request_id) < 0) {
+            return -1;
+        }
+        first += request.count;
+    } while (first < ctx->registered_count);
+
+    return 0;
+}
+
+/* Register buffers by index, replacing the previous set */
+int winapi_register_buffers(winapi_handle_t handle, const winapi_buffer_registration_t *buffers, int count)
+{
+    struct winapi_context *ctx = (struct winapi_context *)handle;
+    int status = 0;
+    int i;
+
+    if (!ctx || !ctx->is_connected || count < 0 || count > WINAPI_MAX_REGISTERED_BUFFERS || (count > 0 && !buffers)) {
+        return -1;
     }
+    for (i = 0; i < count; i++) {
+        const winapi_shared_buffer_t *shared = buffers[i].shared;
 
-    json_object_put(response);
-    printf("[OK] Host processed shared buffer: %s\n", buffer->file_path);
+        if (shared ? !shared->data || shared->size == 0 : !buffers[i].data || buffers[i].size == 0) {
+            return -1;
+        }
+    }
+
+    release_registered(ctx);
+    for (i = 0; i < count; i++) {
+        struct registered_buffer *entry = &ctx->registered[i];
+        winapi_shared_buffer_t *shared = buffers[i].shared;
+
+        if (shared) {
+            // Without shared-file backing the host gets a shared buffer's data like any other
+            entry->data = shared->data;
+            entry->size = shared->size;
+            entry->shared = shared;
+            entry->backing = (ctx->buffer_backings & WINAPI_BACKING_SHARED_FILE) &&
+                             strlen(shared->file_path) < WINAPI_MAX_PATH_LEN ? WINAPI_BACKING_SHARED_FILE
+                                                                              : WINAPI_BACKING_SOCKET;
+        } else {
+            // RLIMIT_MEMLOCK is often small, an unpinned buffer works all the same
+            entry->data = buffers[i].data;
+            entry->size = buffers[i].size;
+            entry->backing = WINAPI_BACKING_SOCKET;
+            entry->pinned = mlock(entry->data, entry->size) == 0;
+        }
+    }
+    ctx->registered_count = count;
+
+    if (HAS_CAP(ctx, WINAPI_CAP_REGISTERED_BUFFERS)) {
+        engine_enter(ctx);
+        status = send_registrations(ctx);
+        engine_leave(ctx);
+        if (status < 0) {
+            release_registered(ctx);
+        }
+    }
+    return status;
+}
+
+/* Drop every registered buffer */
+int winapi_unregister_buffers(winapi_handle_t handle)
+{
+    return winapi_register_buffers(handle, NULL, 0);
+}
+
+/*
+ * Registered ranges as plain buffers and descriptors naming them; -1 unless
+ * each lies within its entry and all share one backing
+ */
+static int resolve_ranges(struct winapi_context *ctx, const winapi_buffer_range_t *ranges, int range_count,
+                          uint32_t access, winapi_buffer_t *buffers, winapi_buffer_desc_t *descs, uint32_t *backing)
+{
+    int i;
+
+    if (!ranges || range_count <= 0 || range_count > WINAPI_MAX_BUFFERS) {
+        return -1;
+    }
+
+    for (i = 0; i < range_count; i++) {
+        const winapi_buffer_range_t *range = &ranges[i];
+        const struct registered_buffer *entry;
+
+        if (range->index >= (uint32_t)ctx->registered_count) {
+            return -1;
+        }
+        entry = &ctx->registered[range->index];
+        if (range->length == 0 || range->length > UINT32_MAX || range->offset > entry->size ||
+            range->length > entry->size - range->offset || (i > 0 && entry->backing != *backing)) {
+            return -1;
+        }
+
+        *backing = entry->backing;
+        buffers[i].data = (char *)entry->data + range->offset;
+        buffers[i].size = range->length;
+        descs[i].guest_pa = range->offset;
+        descs[i].size = (uint32_t)range->length;
+        descs[i].flags = WINAPI_BUFFER_REGISTERED(access, range->index);
+    }
+    return 0;
+}
+
+/* Submit a buffer test on registered ranges: a descriptor each, and no payload when the host has them mapped */
+static int submit_registered_binary(struct winapi_context *ctx,
+                                    const winapi_buffer_t *buffers,
+                                    const winapi_buffer_desc_t *descs,
+                                    int range_count,
+                                    uint32_t backing,
+                                    winapi_buffer_operation_t operation,
+                                    uint32_t test_pattern,
+                                    winapi_buffer_test_result_t *result,
+                                    winapi_request_t *request_out)
+{
+    winapi_buffer_test_request_t request;
+    struct pending_request *slot;
+    uint32_t flags = WINAPI_MSG_FLAG_ASYNC | WINAPI_MSG_FLAG_REGISTERED;
+    uint32_t payload_crc = 0;
+    uint64_t total_size = 0;
+    int payload_count = 0;
+    int i;
+
+    for (i = 0; i < range_count; i++) {
+        total_size += buffers[i].size;
+    }
+
+    // Memory the host cannot reach still moves over the socket, READ payload lands in place
+    if (backing == WINAPI_BACKING_SOCKET) {
+        flags |= WINAPI_MSG_FLAG_SOCKET_PAYLOAD;
+        if (operation == WINAPI_BUFFER_OP_WRITE || operation == WINAPI_BUFFER_OP_VERIFY) {
+            payload_count = range_count;
+            if (HAS_CAP(ctx, WINAPI_CAP_CHECKSUM_CRC32C)) {
+                payload_crc = buffers_crc32c(buffers, range_count);
+            }
+        }
+    }
+
+    slot = alloc_pending(ctx, WINAPI_API_BUFFER_TEST);
+    if (!slot) {
+        return -1;
+    }
+
+    memcpy(slot->out.buffer_test.buffers, buffers, range_count * sizeof(*buffers));
+    slot->out.buffer_test.buffer_count = range_count;
+    slot->out.buffer_test.operation = operation;
+    slot->out.buffer_test.result = result;
+    slot->out.buffer_test.total_size = total_size;
+
+    memset(&request, 0, sizeof(request));
+    request.test_pattern = test_pattern;
+    request.operation = operation;
+
+    if (send_pending(ctx, slot, flags, descs, (uint32_t)range_count, &request, sizeof(request), payload_crc,
+                     buffers, payload_count, 0) < 0) {
+        fprintf(stderr, "ERROR: Failed to send buffer test request: %s\n", strerror(errno));
+        if (payload_count > 0) {
+            ctx->is_connected = 0;
+        }
+        return -1;
+    }
+
+    *request_out = slot->request_id;
+    return 0;
+}
+
+/* Queue or send a buffer test on registered ranges, described in full to hosts without the table */
+static int buffer_test_registered_submit(struct winapi_context *ctx,
+                                         const winapi_buffer_range_t *ranges,
+                                         int range_count,
+                                         winapi_buffer_operation_t operation,
+                                         uint32_t test_pattern,
+                                         winapi_buffer_test_result_t *result,
+                                         winapi_request_t *request)
+{
+    winapi_buffer_t buffers[WINAPI_MAX_BUFFERS];
+    winapi_buffer_desc_t descs[WINAPI_MAX_BUFFERS];
+    uint32_t access = operation == WINAPI_BUFFER_OP_READ ? WINAPI_BUFFER_WRITE : WINAPI_BUFFER_READ;
+    uint32_t backing = 0;
+    uint64_t total_size = 0;
+    int exclusive;
+    int status;
+    int i;
+
+    if (!ctx || !ctx->is_connected || !result || !request ||
+        resolve_ranges(ctx, ranges, range_count, access, buffers, descs, &backing) < 0) {
+        return -1;
+    }
+
+    for (i = 0; i < range_count; i++) {
+        total_size += buffers[i].size;
+    }
+
+    // A socket payload too large for one frame needs a stream, which only plain buffer tests have
+    if (!HAS_CAP(ctx, WINAPI_CAP_REGISTERED_BUFFERS) ||
+        (backing == WINAPI_BACKING_SOCKET && total_size > WINAPI_MAX_BUFFER_SIZE)) {
+        return buffer_test_submit(ctx, buffers, range_count, operation, test_pattern, result, request);
+    }
+
+    exclusive = !HAS_CAP(ctx, WINAPI_CAP_PIPELINING);
+    if (begin_call(ctx, exclusive) < 0) {
+        return -1;
+    }
+    status = submit_registered_binary(ctx, buffers, descs, range_count, backing, operation, test_pattern, result,
+                                      request);
+    end_call(ctx, exclusive);
+    return status;
+}
+
+/* Submit a buffer test on registered ranges without waiting for the response */
+int winapi_buffer_test_registered_submit(winapi_handle_t handle,
+                                         const winapi_buffer_range_t *ranges,
+                                         int range_count,
+                                         winapi_buffer_operation_t operation,
+                                         uint32_t test_pattern,
+                                         winapi_buffer_test_result_t *result,
+                                         winapi_request_t *request)
+{
+    struct winapi_context *ctx = (struct winapi_context *)handle;
+    int status;
+
+    if (!ctx) {
+        return -1;
+    }
+
+    engine_enter(ctx);
+    status = buffer_test_registered_submit(ctx, ranges, range_count, operation, test_pattern, result, request);
+    notify_engine_work(ctx);
+    engine_leave(ctx);
+    return status;
+}
+
+/* Buffer test on registered ranges */
+int winapi_buffer_test_registered(winapi_handle_t handle,
+                                  const winapi_buffer_range_t *ranges,
+                                  int range_count,
+                                  winapi_buffer_operation_t operation,
+                                  uint32_t test_pattern,
+                                  winapi_buffer_test_result_t *result)
+{
+    winapi_request_t request;
+
+    if (buffer_test_registered_submit((struct winapi_context *)handle, ranges, range_count, operation, test_pattern,
+                                      result, &request) < 0) {
+        return -1;
+    }
+
+    return winapi_wait(handle, request);
+}
+
+/* Process a range of a registered shared buffer; hosts without the table process the whole buffer */
+int winapi_process_registered_buffer(winapi_handle_t handle, const winapi_buffer_range_t *range, const char *operation)
+{
+    struct winapi_context *ctx = (struct winapi_context *)handle;
+    winapi_buffer_t buffer;
+    winapi_buffer_desc_t desc;
+    uint32_t backing = 0;
+    int status;
+
+    if (!ctx || !ctx->is_connected || !operation ||
+        resolve_ranges(ctx, range, 1, WINAPI_BUFFER_READWRITE, &buffer, &desc, &backing) < 0 ||
+        !ctx->registered[range->index].shared) {
+        return -1;
+    }
+
+    if (HAS_CAP(ctx, WINAPI_CAP_REGISTERED_BUFFERS) && backing == WINAPI_BACKING_SHARED_FILE &&
+        strlen(operation) < WINAPI_MAX_OPERATION_NAME) {
+        engine_enter(ctx);
+        status = process_shared_buffer_binary(ctx, ctx->registered[range->index].shared, &desc, operation);
+        engine_leave(ctx);
+        return status;
+    }
+
+    return winapi_process_shared_buffer(handle, ctx->registered[range->index].shared, operation);
+}
+
+/* Run one batch entry as an individual call (host without batch support) */
+static int run_call(winapi_handle_t handle, winapi_call_t *call)
+{
+    switch (call->type) {
+        case WINAPI_CALL_ECHO:
+            return winapi_echo(handle, call->u.echo.input, call->u.echo.output, call->u.echo.output_size);
+        case WINAPI_CALL_PERF_TEST:
+            return winapi_perf_test(handle, call->u.perf_test.params, NULL, 0, call->u.perf_test.result);
+        case WINAPI_CALL_SHARED_BUFFER:
+            return winapi_process_shared_buffer(handle, call->u.shared_buffer.buffer, call->u.shared_buffer.operation);
+        default:
+            break;
+    }
+    return -1;
+}
+
+/* Encode one batch entry as an ordinary JSON request */
+static int encode_call(struct winapi_context *ctx, struct json_writer *writer, const winapi_call_t *call)
+{
+    switch (call->type) {
+        case WINAPI_CALL_ECHO:
+            begin_api_request(writer, WINAPI_API_ECHO, next_id(ctx));
+            json_write_string(writer, "input", call->u.echo.input);
+            break;
+
+        case WINAPI_CALL_PERF_TEST:
+            begin_api_request(writer, WINAPI_API_PERF_TEST, next_id(ctx));
+            json_write_int(writer, "test_type", call->u.perf_test.params->test_type);
+            json_write_int(writer, "iterations", call->u.perf_test.params->iterations);
+            json_write_int(writer, "target_bytes", (int64_t)call->u.perf_test.params->target_bytes);
+            break;
+
+        case WINAPI_CALL_SHARED_BUFFER:
+            begin_api_request(writer, WINAPI_API_SHARED_BUFFER, next_id(ctx));
+            json_write_string(writer, "operation", call->u.shared_buffer.operation);
+            json_write_string(writer, "file_path", call->u.shared_buffer.buffer->file_path);
+            json_write_int(writer, "buffer_size", (int64_t)call->u.shared_buffer.buffer->size);
+            json_write_int(writer, "buffer_id", call->u.shared_buffer.buffer->buffer_id);
+            break;
+
+        default:
+            return -1;
+    }
+    json_write_end_object(writer);
     return 0;
 }
 
+/* Decode one entry of the batch "results" array */
+static int decode_call(winapi_call_t *call, const struct json_view *response, int entry)
+{
+    winapi_perf_test_result_t *perf;
+    int result;
+
+    result = json_view_member(response, entry, "result");
+    if (!json_view_string_equals(response, json_view_member(response, entry, "status"), "success") || result < 0) {
+        return -1;
+    }
+
+    switch (call->type) {
+        case WINAPI_CALL_ECHO:
+            if (json_view_string(response, result, call->u.echo.output, call->u.echo.output_size) < 0) {
+                fprintf(stderr, "Echo response too long\n");
+                return -1;
+            }
+            return 0;
+
+        case WINAPI_CALL_PERF_TEST:
+            perf = call->u.perf_test.result;
+            memset(perf, 0, sizeof(*perf));
+            perf->min_latency_ns = json_view_int64(response, json_view_member(response, result, "min_latency_ns"));
+            perf->max_latency_ns = json_view_int64(response, json_view_member(response, result, "max_latency_ns"));
+            perf->avg_latency_ns = json_view_int64(response, json_view_member(response, result, "avg_latency_ns"));
+            perf->throughput_mbps = json_view_int64(response, json_view_member(response, result, "throughput_mbps"));
+            perf->iterations_completed = (int)json_view_int64(response,
+                                                              json_view_member(response, result, "iterations_completed"));
+            return 0;
+
+        case WINAPI_CALL_SHARED_BUFFER:
+            return 0;
+
+        default:
+            break;
+    }
+    return -1;
+}
+
+/* Send a batch request and decode its results into the calls */
+static int batch_json(struct winapi_context *ctx, winapi_call_t *calls, int call_count)
+{
+    struct json_writer *request;
+    const struct json_view *response;
+    int results;
+    int failed = 0;
+    int i;
+
+    request = create_request(ctx, "batch", next_id(ctx));
+    json_write_begin_array(request, "calls");
+    for (i = 0; i < call_count; i++) {
+        if (encode_call(ctx, request, &calls[i]) < 0) {
+            fprintf(stderr, "Invalid call type %d in batch\n", (int)calls[i].type);
+            return -1;
+        }
+    }
+    json_write_end_array(request);
+
+    if (send_json_request(ctx, ctx->socket_fd) < 0) {
+        fprintf(stderr, "Failed to send batch request\n");
+        return -1;
+    }
+
+    if (receive_json_response(ctx, ctx->socket_fd) < 0) {
+        fprintf(stderr, "Failed to receive batch response\n");
+        return -1;
+    }
+
+    response = &ctx->json_in;
+    results = json_view_member(response, JSON_ROOT, "results");
+    if (results < 0 || json_view_size(response, results) != call_count) {
+        fprintf(stderr, "Invalid batch response format\n");
+        return -1;
+    }
+
+    for (i = 0; i < call_count; i++) {
+        calls[i].status = decode_call(&calls[i], response, json_view_element(response, results, i));
+        failed += calls[i].status != 0;
+    }
+
+    return failed ? -1 : 0;
+}
+
+/* Run several calls in one round trip */
+int winapi_batch(winapi_handle_t handle, winapi_call_t *calls, int call_count)
+{
+    struct winapi_context *ctx = (struct winapi_context *)handle;
+    int failed = 0;
+    int status;
+    int i;
+
+    if (!ctx || !ctx->is_connected || !calls || call_count <= 0) {
+        return -1;
+    }
+
+    for (i = 0; i < call_count; i++) {
+        calls[i].status = -1;
+    }
+
+    // Older hosts: same calls, one round trip each
+    if (!HAS_CAP(ctx, WINAPI_CAP_BATCH) || call_count > WINAPI_MAX_BATCH_CALLS) {
+        for (i = 0; i < call_count; i++) {
+            calls[i].status = run_call(handle, &calls[i]) < 0 ? -1 : 0;
+            failed += calls[i].status != 0;
+        }
+        return failed ? -1 : 0;
+    }
+
+    // JSON cannot be pipelined, reap outstanding binary responses first
+    if (begin_call(ctx, 1) < 0) {
+        return -1;
+    }
+    status = batch_json(ctx, calls, call_count);
+    end_call(ctx, 1);
+    return status;
+}
+
 /* Free a shared memory buffer */
 void winapi_free_shared_buffer(winapi_shared_buffer_t *buffer)
 {
@@ -60,10 +60,85 @@ typedef struct {
     uint32_t iterations_completed;
 } winapi_perf_test_result_t;
 
+/* Optional features negotiated with the host (values match WINAPI_CAP_* in protocol.h) */
+#define WINAPI_FEATURE_BINARY_FRAMING   0x00000001
+#define WINAPI_FEATURE_PIPELINING       0x00000002
+#define WINAPI_FEATURE_COMPRESSION      0x00000004
+#define WINAPI_FEATURE_CHECKSUM_CRC32C  0x00000008
+#define WINAPI_FEATURE_BATCH            0x00000010
+#define WINAPI_FEATURE_STREAMING        0x00000020  /* Buffer tests above 64MB, sent as credited chunks */
+#define WINAPI_FEATURE_STRIPING         0x00000040  /* Large streams striped across data connections */
+#define WINAPI_FEATURE_SHM_RING         0x00000080  /* Small calls through shared memory rings */
+#define WINAPI_FEATURE_REGISTERED_BUFFERS 0x00000100  /* Registered buffers named by index (below) */
+#define WINAPI_FEATURE_ALL              0xFFFFFFFF
+
+/* data_connections: pick the count from measured throughput */
+#define WINAPI_DATA_CONNECTIONS_AUTO    (-1)
+
+/* io_engine: how the library drives its connection to the host */
+#define WINAPI_IO_ENGINE_SYSCALLS       0   /* Plain send/recv per frame */
+#define WINAPI_IO_ENGINE_URING          1   /* io_uring, falls back to SYSCALLS if the kernel lacks it */
+
+/* zerocopy_threshold: a reasonable starting point when enabling zero-copy sends */
+#define WINAPI_ZEROCOPY_THRESHOLD_DEFAULT  (1024 * 1024)
+
+/* ring_spin_us: longest busy-poll of the response ring before blocking */
+#define WINAPI_RING_SPIN_US_DEFAULT     50
+
+/*
+ * Connection configuration
+ *
+ * data_connections opens extra connections to the host that large buffer
+ * test payloads are striped across (up to 8; 0 disables striping). It
+ * defaults to the WINAPI_DATA_CONNECTIONS environment variable, a count or
+ * "auto".
+ *
+ * zerocopy_threshold turns on MSG_ZEROCOPY sends for buffer test payloads of
+ * at least that many bytes (0, the default, always copies). The kernel then
+ * transmits straight from the caller's buffers, and a request does not
+ * complete until the kernel has let go of them. It defaults to the
+ * WINAPI_ZEROCOPY_THRESHOLD environment variable, in bytes.
+ *
+ * io_engine WINAPI_IO_ENGINE_URING batches binary frames into io_uring
+ * submissions: submitted calls are queued and go to the host together at
+ * the next winapi_wait() or winapi_dispatch_completions(), linked with the
+ * read of the responses, and the event fd turns readable meanwhile so event
+ * loops dispatch. It defaults to the WINAPI_IO_ENGINE environment variable,
+ * "uring" or "syscalls".
+ *
+ * ring_dir is where the region file for the shared memory rings is
+ * created; it must be visible to the host under the same file (the default,
+ * /mnt/c/temp, is C:\temp on a Windows host). Calls without socket payload
+ * then skip the socket, which only carries wakeups while a side is idle.
+ * NULL or "" disables the rings. It defaults to the WINAPI_RING_DIR
+ * environment variable.
+ *
+ * ring_spin_us bounds how long a blocking call busy-polls the response
+ * ring before it asks the host for a doorbell and sleeps on the socket.
+ * The window adapts to how quickly responses have been arriving and closes
+ * entirely while they take longer than this; 0 always sleeps. It defaults
+ * to the WINAPI_RING_SPIN_US environment variable, or
+ * WINAPI_RING_SPIN_US_DEFAULT.
+ */
+typedef struct {
+    uint32_t capabilities;    /* WINAPI_FEATURE_* bits to request from the host */
+    uint32_t max_frame_size;  /* Largest binary frame to accept, 0 for the default */
+    int data_connections;     /* Bulk data connections, 0, N or WINAPI_DATA_CONNECTIONS_AUTO */
+    size_t zerocopy_threshold; /* Smallest payload sent with MSG_ZEROCOPY, 0 to always copy */
+    int io_engine;            /* WINAPI_IO_ENGINE_* */
+    const char *ring_dir;     /* Directory for the shared memory ring region, NULL or "" for none */
+    unsigned ring_spin_us;    /* Longest busy-poll of the response ring, 0 to always block */
+} winapi_config_t;
+
 /* Library initialization and cleanup */
+void winapi_config_init(winapi_config_t *config);
 winapi_handle_t winapi_init(void);
+winapi_handle_t winapi_init_ex(const winapi_config_t *config);
 void winapi_cleanup(winapi_handle_t handle);
 
+/* Feature set agreed with the host during the handshake */
+int winapi_get_capabilities(winapi_handle_t handle, uint32_t *capabilities);
+
 /* API calls */
 int winapi_echo(winapi_handle_t handle, const char *input, char *output, size_t output_size);
 
@@ -80,6 +155,73 @@ int winapi_perf_test(winapi_handle_t handle,
                     int buffer_count,
                     winapi_perf_test_result_t *result);
 
+/*
+ * Pipelined calls
+ *
+ * Submit functions send the request and return immediately with a request
+ * token; many requests can be outstanding on one connection and the host
+ * may complete them in any order. Output buffers, result structures and
+ * payload buffers must stay valid until winapi_wait() returns for that
+ * token. Up to PIPELINE_DEPTH (128) requests can be outstanding per handle:
+ * a submit waits for a free slot, and fails if every slot holds a result
+ * nobody has waited for yet.
+ *
+ * A handle can be shared by several threads without locking around calls.
+ * Request IDs and slots are claimed atomically and small frames are
+ * published in the shared memory ring without a lock; whichever waiting
+ * thread is free reads the next response and hands it to its owner. JSON
+ * calls, payload streams, striped and zero-copy transfers briefly take the
+ * connection for themselves, and with the io_uring engine calls run one at
+ * a time. Wait for a token from any thread, but only once.
+ */
+typedef uint32_t winapi_request_t;
+
+int winapi_echo_submit(winapi_handle_t handle, const char *input, char *output, size_t output_size,
+                       winapi_request_t *request);
+
+int winapi_buffer_test_submit(winapi_handle_t handle,
+                              winapi_buffer_t *buffers,
+                              int buffer_count,
+                              winapi_buffer_operation_t operation,
+                              uint32_t test_pattern,
+                              winapi_buffer_test_result_t *result,
+                              winapi_request_t *request);
+
+/* Wait for a submitted call, returns the same status as the blocking call */
+int winapi_wait(winapi_handle_t handle, winapi_request_t request);
+
+/*
+ * Asynchronous calls
+ *
+ * Async calls are submitted like the pipelined ones but complete through a
+ * callback instead of winapi_wait(). Callbacks run on the caller's thread
+ * from winapi_dispatch_completions(), which never blocks waiting for the
+ * host. The fd returned by winapi_get_event_fd() polls readable (epoll,
+ * poll, libuv...) whenever there is something to dispatch. With a NULL
+ * callback the call completes into the completion queue instead (below).
+ */
+typedef void (*winapi_completion_cb)(winapi_handle_t handle, winapi_request_t request,
+                                     int status, void *user_data);
+
+int winapi_echo_async(winapi_handle_t handle, const char *input, char *output, size_t output_size,
+                      winapi_completion_cb callback, void *user_data, winapi_request_t *request);
+
+int winapi_buffer_test_async(winapi_handle_t handle,
+                             winapi_buffer_t *buffers,
+                             int buffer_count,
+                             winapi_buffer_operation_t operation,
+                             uint32_t test_pattern,
+                             winapi_buffer_test_result_t *result,
+                             winapi_completion_cb callback,
+                             void *user_data,
+                             winapi_request_t *request);
+
+/* Pollable completion fd, owned by the library (do not close or read it) */
+int winapi_get_event_fd(winapi_handle_t handle);
+
+/* Run callbacks for completed async calls, returns how many ran or -1 */
+int winapi_dispatch_completions(winapi_handle_t handle);
+
 /* Helper functions */
 int winapi_alloc_buffer(winapi_buffer_t *buffer, size_t size);
 void winapi_free_buffer(winapi_buffer_t *buffer);
@@ -102,6 +244,127 @@ int winapi_process_shared_buffer(winapi_handle_t handle, winapi_shared_buffer_t
 /* Free a shared memory buffer */
 void winapi_free_shared_buffer(winapi_shared_buffer_t *buffer);
 
+/*
+ * Registered buffers
+ *
+ * A working set used over and over can be registered once: user buffers
+ * are pinned (mlock, where RLIMIT_MEMLOCK allows) and the host is told
+ * about every buffer up front, mapping shared buffers' files right away.
+ * Calls then name a range by index, offset and length, each costing one
+ * descriptor instead of a buffer description and path translation on
+ * every call. Ranges of shared buffers are read and written by the host
+ * in place, with no payload on the socket; ranges of user buffers still
+ * carry their payload. Indices are positions in the array given to
+ * winapi_register_buffers(), which replaces any earlier registration. The
+ * buffers (and shared buffer structures) must stay valid until they are
+ * unregistered or replaced, and registering must not overlap calls that
+ * use the table. Hosts without support get the same calls described in
+ * full.
+ */
+#define WINAPI_MAX_REGISTERED 64
+
+typedef struct {
+    void *data;                              /* User buffer, ignored with shared */
+    size_t size;
+    winapi_shared_buffer_t *shared;          /* Shared buffer to register instead, or NULL */
+} winapi_buffer_registration_t;
+
+typedef struct {
+    uint32_t index;                          /* Position in the registration array */
+    size_t offset;
+    size_t length;
+} winapi_buffer_range_t;
+
+int winapi_register_buffers(winapi_handle_t handle, const winapi_buffer_registration_t *buffers, int count);
+int winapi_unregister_buffers(winapi_handle_t handle);
+
+/* Buffer test over registered ranges, all of user buffers or all of shared buffers */
+int winapi_buffer_test_registered(winapi_handle_t handle,
+                                  const winapi_buffer_range_t *ranges,
+                                  int range_count,
+                                  winapi_buffer_operation_t operation,
+                                  uint32_t test_pattern,
+                                  winapi_buffer_test_result_t *result);
+
+int winapi_buffer_test_registered_submit(winapi_handle_t handle,
+                                         const winapi_buffer_range_t *ranges,
+                                         int range_count,
+                                         winapi_buffer_operation_t operation,
+                                         uint32_t test_pattern,
+                                         winapi_buffer_test_result_t *result,
+                                         winapi_request_t *request);
+
+/* winapi_process_shared_buffer() on a range of a registered shared buffer */
+int winapi_process_registered_buffer(winapi_handle_t handle, const winapi_buffer_range_t *range, const char *operation);
+
+/*
+ * Batched calls
+ *
+ * winapi_batch() sends every call in one request and gets all results back
+ * in one response; calls run on the host in array order. Each entry's status
+ * is 0 or -1, and the function returns -1 if any call (or the batch itself)
+ * failed. Hosts without batch support get the calls one at a time.
+ */
+typedef enum {
+    WINAPI_CALL_ECHO = 1,
+    WINAPI_CALL_BUFFER_TEST = 2,    /* Completion queue entries only, not batched */
+    WINAPI_CALL_PERF_TEST = 3,
+    WINAPI_CALL_SHARED_BUFFER = 4
+} winapi_call_type_t;
+
+typedef struct {
+    winapi_call_type_t type;
+    int status;                     /* Filled in by winapi_batch() */
+    union {
+        struct {
+            const char *input;
+            char *output;
+            size_t output_size;
+        } echo;
+        struct {
+            winapi_perf_test_params_t *params;
+            winapi_perf_test_result_t *result;
+        } perf_test;
+        struct {
+            winapi_shared_buffer_t *buffer;
+            const char *operation;
+        } shared_buffer;
+    } u;
+} winapi_call_t;
+
+int winapi_batch(winapi_handle_t handle, winapi_call_t *calls, int call_count);
+
+/*
+ * Completion queue
+ *
+ * Async calls submitted with a NULL callback are collected in bulk instead:
+ * winapi_poll_completions() moves up to max finished ones into completions
+ * and returns how many it moved, or -1 once the connection is lost and none
+ * are left. With timeout_ms 0 it only takes what has arrived; otherwise it
+ * waits up to timeout_ms (-1 for no limit) for the first one, but returns 0
+ * right away when no call is outstanding. Submitting many calls and reaping
+ * them together costs one wait per batch rather than one per call. Each
+ * entry carries the typed result of the host's response. In an event loop,
+ * timeout 0 polls take the place of winapi_dispatch_completions(): the event
+ * fd polls readable for queued calls once one has run after they were
+ * submitted.
+ */
+typedef struct {
+    winapi_request_t request;
+    winapi_call_type_t type;        /* WINAPI_CALL_ECHO or WINAPI_CALL_BUFFER_TEST */
+    int status;                     /* As winapi_wait() would have returned */
+    void *user_data;
+    union {
+        struct {
+            char *output;           /* The call's output buffer */
+            size_t output_len;
+        } echo;
+        winapi_buffer_test_result_t buffer_test;
+    } u;
+} winapi_completion_t;
+
+int winapi_poll_completions(winapi_handle_t handle, winapi_completion_t *completions, int max, int timeout_ms);
+
 #ifdef __cplusplus
 }
 #endif
@@ -12,8 +12,11 @@
 #include <time.h>
 #include <sys/time.h>
 #include <stdbool.h>
+#include <poll.h>
+#include <pthread.h>
 
 #include "libwinapi.h"
+#include "../../common/checksum.h"
 
 /* Test configuration */
 #define TEST_BUFFER_SIZES_COUNT 8
@@ -27,6 +30,16 @@ static const size_t test_buffer_sizes[] = {
     12 * 1024 * 1024, /* 12MB */
     15 * 1024 * 1024 /* 15MB - Max shared memory buffer */
 };
+#define PIPELINED_ECHO_COUNT 16
+
+/* Shared handle test: threads, rounds each, and buffer sizes (the striped one goes over data connections) */
+#define THREAD_TEST_THREADS      4
+#define THREAD_TEST_ROUNDS       32
+#define THREAD_TEST_BUFFER_SIZE  (64 * 1024)
+#define THREAD_TEST_STRIPED_SIZE (8 * 1024 * 1024)
+
+/* Data connections for the striped transfer test (--stripes) */
+static int g_data_connections = WINAPI_DATA_CONNECTIONS_AUTO;
 
 /* Helper function to format bytes */
 static void format_bytes(uint64_t bytes, char *buf, size_t buf_size)
@@ -72,6 +85,280 @@ static int test_echo(winapi_handle_t handle)
     return 0;
 }
 
+/* Test pipelined echo calls completing out of order */
+static int test_pipelined_echo(winapi_handle_t handle)
+{
+    char inputs[PIPELINED_ECHO_COUNT][32];
+    char outputs[PIPELINED_ECHO_COUNT][32];
+    winapi_request_t requests[PIPELINED_ECHO_COUNT];
+    int i;
+
+    printf("\n=== Pipelined Echo Test ===\n");
+
+    for (i = 0; i < PIPELINED_ECHO_COUNT; i++) {
+        snprintf(inputs[i], sizeof(inputs[i]), "pipelined #%d", i);
+        if (winapi_echo_submit(handle, inputs[i], outputs[i], sizeof(outputs[i]), &requests[i]) < 0) {
+            printf("ERROR: Echo submit failed for request %d\n", i);
+            return -1;
+        }
+    }
+
+    // Wait in reverse order, earlier responses are parked in their slots
+    for (i = PIPELINED_ECHO_COUNT - 1; i >= 0; i--) {
+        if (winapi_wait(handle, requests[i]) < 0 || strcmp(inputs[i], outputs[i]) != 0) {
+            printf("ERROR: Pipelined echo %d returned \"%s\"\n", i, outputs[i]);
+            return -1;
+        }
+    }
+
+    printf("%d pipelined echo calls completed successfully!\n", PIPELINED_ECHO_COUNT);
+    return 0;
+}
+
+/* Async echo completion */
+static void async_echo_done(winapi_handle_t handle, winapi_request_t request, int status, void *user_data)
+{
+    int *remaining = (int *)user_data;
+
+    (void)handle;
+    (void)request;
+    if (status == 0) {
+        (*remaining)--;
+    }
+}
+
+/* Test async echo calls driven by the event fd */
+static int test_async_echo(winapi_handle_t handle)
+{
+    char inputs[PIPELINED_ECHO_COUNT][32];
+    char outputs[PIPELINED_ECHO_COUNT][32];
+    winapi_request_t request;
+    struct pollfd pfd;
+    int remaining = PIPELINED_ECHO_COUNT;
+    int i;
+
+    printf("\n=== Async Echo Test ===\n");
+
+    pfd.fd = winapi_get_event_fd(handle);
+    pfd.events = POLLIN;
+    if (pfd.fd < 0) {
+        printf("ERROR: No event fd available\n");
+        return -1;
+    }
+
+    for (i = 0; i < PIPELINED_ECHO_COUNT; i++) {
+        snprintf(inputs[i], sizeof(inputs[i]), "async #%d", i);
+        if (winapi_echo_async(handle, inputs[i], outputs[i], sizeof(outputs[i]),
+                              async_echo_done, &remaining, &request) < 0) {
+            printf("ERROR: Async echo submit failed for request %d\n", i);
+            return -1;
+        }
+    }
+
+    while (remaining > 0) {
+        if (poll(&pfd, 1, 5000) <= 0) {
+            printf("ERROR: Timed out with %d async echo calls outstanding\n", remaining);
+            return -1;
+        }
+        if (winapi_dispatch_completions(handle) < 0) {
+            printf("ERROR: Dispatching completions failed\n");
+            return -1;
+        }
+    }
+
+    for (i = 0; i < PIPELINED_ECHO_COUNT; i++) {
+        if (strcmp(inputs[i], outputs[i]) != 0) {
+            printf("ERROR: Async echo %d returned \"%s\"\n", i, outputs[i]);
+            return -1;
+        }
+    }
+
+    printf("%d async echo calls completed successfully!\n", PIPELINED_ECHO_COUNT);
+    return 0;
+}
+
+/* Test async echo calls reaped in bulk from the completion queue */
+static int test_completion_queue(winapi_handle_t handle)
+{
+    char inputs[PIPELINED_ECHO_COUNT][32];
+    char outputs[PIPELINED_ECHO_COUNT][32];
+    winapi_completion_t completions[PIPELINED_ECHO_COUNT];
+    winapi_request_t request;
+    int remaining = PIPELINED_ECHO_COUNT;
+    int polls = 0;
+    int count;
+    int i;
+
+    printf("\n=== Completion Queue Test ===\n");
+
+    for (i = 0; i < PIPELINED_ECHO_COUNT; i++) {
+        snprintf(inputs[i], sizeof(inputs[i]), "queued #%d", i);
+        if (winapi_echo_async(handle, inputs[i], outputs[i], sizeof(outputs[i]),
+                              NULL, inputs[i], &request) < 0) {
+            printf("ERROR: Queued echo submit failed for request %d\n", i);
+            return -1;
+        }
+    }
+
+    while (remaining > 0) {
+        count = winapi_poll_completions(handle, completions, PIPELINED_ECHO_COUNT, 5000);
+        if (count <= 0) {
+            printf("ERROR: Timed out with %d queued echo calls outstanding\n", remaining);
+            return -1;
+        }
+        for (i = 0; i < count; i++) {
+            const char *input = (const char *)completions[i].user_data;
+
+            if (completions[i].status != 0 || completions[i].type != WINAPI_CALL_ECHO ||
+                completions[i].u.echo.output_len != strlen(input) ||
+                strcmp(input, completions[i].u.echo.output) != 0) {
+                printf("ERROR: Queued echo \"%s\" completed with status %d\n", input, completions[i].status);
+                return -1;
+            }
+        }
+        remaining -= count;
+        polls++;
+    }
+
+    printf("%d queued echo calls completed in %d polls!\n", PIPELINED_ECHO_COUNT, polls);
+    return 0;
+}
+
+/* Test several calls sent as one batch */
+static int test_batch(winapi_handle_t handle)
+{
+    const char *inputs[] = { "batch one", "batch two", "batch three" };
+    char outputs[3][32];
+    winapi_perf_test_params_t params;
+    winapi_perf_test_result_t perf;
+    winapi_call_t calls[4];
+    int i;
+
+    printf("\n=== Batch Test ===\n");
+
+    memset(calls, 0, sizeof(calls));
+    for (i = 0; i < 3; i++) {
+        calls[i].type = WINAPI_CALL_ECHO;
+        calls[i].u.echo.input = inputs[i];
+        calls[i].u.echo.output = outputs[i];
+        calls[i].u.echo.output_size = sizeof(outputs[i]);
+    }
+
+    params.test_type = WINAPI_PERF_LATENCY;
+    params.iterations = 10;
+    params.target_bytes = 0;
+    calls[3].type = WINAPI_CALL_PERF_TEST;
+    calls[3].u.perf_test.params = &params;
+    calls[3].u.perf_test.result = &perf;
+
+    if (winapi_batch(handle, calls, 4) < 0) {
+        printf("ERROR: Batch failed\n");
+        return -1;
+    }
+
+    for (i = 0; i < 3; i++) {
+        if (strcmp(inputs[i], outputs[i]) != 0) {
+            printf("ERROR: Batched echo %d returned \"%s\"\n", i, outputs[i]);
+            return -1;
+        }
+    }
+
+    printf("Batch of 4 calls completed (perf iterations: %u)\n", perf.iterations_completed);
+    return 0;
+}
+
+/* Test checksum kernels against a plain loop, across sizes and alignments */
+static int test_checksum_kernels(void)
+{
+    static const char crc_check[] = "123456789";
+    size_t size = 4096 + 64;
+    unsigned char *data = malloc(size + 64);
+    size_t offset, length, i;
+
+    printf("\n=== Checksum Kernel Test (%s) ===\n", winapi_checksum_kernel());
+
+    if (!data) {
+        printf("ERROR: Failed to allocate checksum test buffer\n");
+        return -1;
+    }
+    for (i = 0; i < size + 64; i++) {
+        data[i] = (unsigned char)(i * 131 + 7);
+    }
+
+    for (offset = 0; offset < 8; offset++) {
+        for (length = 0; length <= size; length += (length < 300) ? 1 : 97) {
+            uint32_t expected = 0, word;
+            for (i = 0; i + 4 <= length; i += 4) {
+                memcpy(&word, data + offset + i, sizeof(word));
+                expected ^= word;
+            }
+            if (winapi_checksum_xor(data + offset, length) != expected) {
+                printf("ERROR: XOR checksum mismatch (offset %zu, length %zu)\n", offset, length);
+                free(data);
+                return -1;
+            }
+        }
+    }
+
+    /* Pattern check must find the first bad word wherever it is */
+    for (i = 0; i < size / 4; i++) {
+        ((uint32_t *)data)[i] = 0xDEADBEEF;
+    }
+    if (winapi_pattern_mismatch(data, size, 0xDEADBEEF) != size) {
+        printf("ERROR: Pattern check reported a mismatch in a clean buffer\n");
+        free(data);
+        return -1;
+    }
+    for (i = 0; i < size / 4; i += 37) {
+        ((uint32_t *)data)[i] = 0;
+        if (winapi_pattern_mismatch(data, size, 0xDEADBEEF) != i * 4) {
+            printf("ERROR: Pattern check missed the mismatch at word %zu\n", i);
+            free(data);
+            return -1;
+        }
+        ((uint32_t *)data)[i] = 0xDEADBEEF;
+    }
+
+    /* Unaligned starts and ragged sizes: trailing bytes are not compared */
+    for (offset = 1; offset < 4; offset++) {
+        uint32_t word = 0xDEADBEEF;
+        for (i = 0; i + 4 <= size; i += 4) {
+            memcpy(data + offset + i, &word, sizeof(word));
+        }
+        for (length = 0; length <= size - 4; length += (length < 300) ? 1 : 97) {
+            if (winapi_pattern_mismatch(data + offset, length, 0xDEADBEEF) != length) {
+                printf("ERROR: Pattern check mismatch (offset %zu, length %zu)\n", offset, length);
+                free(data);
+                return -1;
+            }
+        }
+        data[offset + 4 * 300 + 1] ^= 0xFF;
+        if (winapi_pattern_mismatch(data + offset, size - 4, 0xDEADBEEF) != 4 * 300) {
+            printf("ERROR: Pattern check missed the mismatch (offset %zu)\n", offset);
+            free(data);
+            return -1;
+        }
+    }
+    free(data);
+
+    if (winapi_crc32c(0, crc_check, 9) != 0xE3069283 ||
+        winapi_crc32c(winapi_crc32c(0, crc_check, 4), crc_check + 4, 5) != 0xE3069283) {
+        printf("ERROR: CRC32C check value mismatch\n");
+        return -1;
+    }
+    for (length = 0; length <= 9; length++) {
+        uint32_t head = winapi_crc32c(0, crc_check, length);
+        uint32_t tail = winapi_crc32c(0, crc_check + length, 9 - length);
+        if (winapi_crc32c_combine(head, tail, 9 - length) != 0xE3069283) {
+            printf("ERROR: CRC32C combine mismatch (split at %zu)\n", length);
+            return -1;
+        }
+    }
+
+    printf("Checksum kernels match the reference\n");
+    return 0;
+}
+
 /* Test buffer operations */
 static int test_buffer_operations(winapi_handle_t handle)
 {
@@ -107,6 +394,11 @@ static int test_buffer_operations(winapi_handle_t handle)
         }
         printf(" OK (processed %llu bytes, checksum: 0x%08x)\n",
                (unsigned long long)result.bytes_processed, result.checksum);
+        if (result.checksum != winapi_checksum_xor(buffer.data, size)) {
+            printf("  ERROR: Host checksum differs from local 0x%08x\n",
+                   winapi_checksum_xor(buffer.data, size));
+            ret = -1;
+        }
 
         /* Test 2: Verify pattern in buffer */
         printf("  Verifying test pattern...\n");
@@ -205,6 +497,590 @@ cleanup:
     return -1;
 }
 
+/* Test buffer tests on ranges of registered buffers */
+static int test_registered_buffers(winapi_handle_t handle)
+{
+    winapi_buffer_t buffers[2];
+    winapi_buffer_registration_t registrations[2];
+    winapi_buffer_range_t ranges[2];
+    winapi_buffer_range_t outside = { 1, 1024 * 1024 - 4096, 8192 };
+    winapi_buffer_test_result_t result;
+    winapi_shared_buffer_t shared, forged;
+    uint32_t test_pattern = 0x5A5AA5A5;
+    uint32_t expected;
+    int have_shared = 0;
+    int ret = -1;
+    int i;
+
+    printf("\n=== Registered Buffer Test ===\n");
+
+    memset(buffers, 0, sizeof(buffers));
+    for (i = 0; i < 2; i++) {
+        if (winapi_alloc_buffer(&buffers[i], test_buffer_sizes[1 + 2 * i]) < 0) {
+            printf("ERROR: Failed to allocate buffer %d\n", i);
+            goto cleanup;
+        }
+        memset(buffers[i].data, 0x3C + i, buffers[i].size);
+        registrations[i].data = buffers[i].data;
+        registrations[i].size = buffers[i].size;
+        registrations[i].shared = NULL;
+    }
+
+    printf("Registering 64KB and 1MB buffers...");
+    if (winapi_register_buffers(handle, registrations, 2) < 0) {
+        printf(" FAILED\n");
+        goto cleanup;
+    }
+    printf(" OK\n");
+
+    /* One range in each buffer, checksummed as one payload */
+    ranges[0].index = 0;
+    ranges[0].offset = 4096;
+    ranges[0].length = 16 * 1024;
+    ranges[1].index = 1;
+    ranges[1].offset = 512 * 1024;
+    ranges[1].length = 256 * 1024;
+    expected = winapi_checksum_xor((char *)buffers[0].data + ranges[0].offset, ranges[0].length) ^
+               winapi_checksum_xor((char *)buffers[1].data + ranges[1].offset, ranges[1].length);
+
+    printf("Verifying two registered ranges...");
+    if (winapi_buffer_test_registered(handle, ranges, 2, WINAPI_BUFFER_OP_VERIFY, test_pattern, &result) < 0 ||
+        result.checksum != expected || result.bytes_processed != ranges[0].length + ranges[1].length) {
+        printf(" FAILED (checksum 0x%08x, expected 0x%08x)\n", result.checksum, expected);
+        goto cleanup;
+    }
+    printf(" OK\n");
+
+    printf("Reading into a registered range...");
+    if (winapi_buffer_test_registered(handle, &ranges[1], 1, WINAPI_BUFFER_OP_READ, test_pattern, &result) < 0 ||
+        winapi_pattern_mismatch((char *)buffers[1].data + ranges[1].offset, ranges[1].length, test_pattern) !=
+        ranges[1].length) {
+        printf(" FAILED\n");
+        goto cleanup;
+    }
+    printf(" OK\n");
+
+    printf("Rejecting a range past the end of its buffer...");
+    if (winapi_buffer_test_registered(handle, &outside, 1, WINAPI_BUFFER_OP_VERIFY, test_pattern, &result) == 0) {
+        printf(" FAILED\n");
+        goto cleanup;
+    }
+    printf(" OK\n");
+
+    /* Shared buffer files are filled in place by the host, so it maps only the ones the client made */
+    if (winapi_alloc_shared_buffer(handle, 64 * 1024, &shared) < 0) {
+        printf("No shared buffer directory, shared-file registration skipped\n");
+    } else {
+        FILE *file;
+        int made;
+
+        have_shared = 1;
+        registrations[0].data = NULL;
+        registrations[0].size = 0;
+        registrations[0].shared = &shared;
+        ranges[0].index = 0;
+        ranges[0].offset = 8192;
+        ranges[0].length = 32 * 1024;
+
+        printf("Reading into a registered shared buffer...");
+        if (winapi_register_buffers(handle, registrations, 1) < 0 ||
+            winapi_buffer_test_registered(handle, ranges, 1, WINAPI_BUFFER_OP_READ, test_pattern, &result) < 0 ||
+            winapi_pattern_mismatch((char *)shared.data + ranges[0].offset, ranges[0].length, test_pattern) !=
+            ranges[0].length) {
+            printf(" FAILED\n");
+            goto cleanup;
+        }
+        printf(" OK\n");
+
+        /* Same file reached through "..", then a file of the right size without the trailer */
+        forged = shared;
+        registrations[0].shared = &forged;
+        snprintf(forged.file_path, sizeof(forged.file_path), "%s/../%s", WINAPI_SHARED_FILE_DIR,
+                 strrchr(shared.file_path, '/') + 1);
+        printf("Refusing a shared file path with \"..\"...");
+        if (winapi_register_buffers(handle, registrations, 1) == 0) {
+            printf(" FAILED\n");
+            goto cleanup;
+        }
+        printf(" OK\n");
+
+        snprintf(forged.file_path, sizeof(forged.file_path), "%s/winapi_forged_%d", WINAPI_SHARED_FILE_DIR, getpid());
+        file = fopen(forged.file_path, "w");
+        made = file && ftruncate(fileno(file), 2 * 64 * 1024) == 0;
+        if (file) {
+            fclose(file);
+        }
+        printf("Refusing a shared file without its trailer...");
+        i = winapi_register_buffers(handle, registrations, 1);
+        unlink(forged.file_path);
+        if (!made || i == 0) {
+            printf(" FAILED\n");
+            goto cleanup;
+        }
+        printf(" OK\n");
+    }
+
+    printf("Registered buffer test completed successfully!\n");
+    ret = 0;
+
+cleanup:
+    winapi_unregister_buffers(handle);
+    if (have_shared) {
+        winapi_free_shared_buffer(&shared);
+    }
+    for (i = 0; i < 2; i++) {
+        winapi_free_buffer(&buffers[i]);
+    }
+    return ret;
+}
+
+/* Test a transfer above the 64MB plain payload limit, sent as a chunk stream */
+static int test_stream_transfer(winapi_handle_t handle)
+{
+    static const size_t sizes[2] = { 96 * 1024 * 1024, 68 * 1024 * 1024 };
+    winapi_buffer_t buffers[2];
+    winapi_buffer_test_result_t result;
+    uint32_t test_pattern = 0xA5A55A5A;
+    uint32_t checksum = 0;
+    uint32_t capabilities = 0;
+    int i, ret = -1;
+
+    printf("\n=== Stream Transfer Test ===\n");
+
+    if (winapi_get_capabilities(handle, &capabilities) < 0 || !(capabilities & WINAPI_FEATURE_STREAMING)) {
+        printf("Host does not support payload streams, skipped\n");
+        return 0;
+    }
+
+    memset(buffers, 0, sizeof(buffers));
+    for (i = 0; i < 2; i++) {
+        size_t j;
+
+        if (winapi_alloc_buffer(&buffers[i], sizes[i]) < 0) {
+            printf("ERROR: Failed to allocate stream buffer %d\n", i);
+            goto cleanup;
+        }
+        for (j = 0; j < sizes[i] / sizeof(uint32_t); j++) {
+            ((uint32_t *)buffers[i].data)[j] = (uint32_t)(j * 2654435761u) ^ (uint32_t)i;
+        }
+        checksum ^= winapi_checksum_xor(buffers[i].data, sizes[i]);
+    }
+
+    printf("Writing 164MB in two buffers...\n");
+    if (winapi_buffer_test(handle, buffers, 2, WINAPI_BUFFER_OP_WRITE, test_pattern, &result) < 0 ||
+        result.bytes_processed != sizes[0] + sizes[1] || result.checksum != checksum) {
+        printf(" FAILED (checksum 0x%08x, expected 0x%08x)\n", result.checksum, checksum);
+        goto cleanup;
+    }
+    printf(" OK (processed %llu bytes, checksum: 0x%08x)\n",
+           (unsigned long long)result.bytes_processed, result.checksum);
+
+    printf("Reading 164MB of test pattern...\n");
+    if (winapi_buffer_test(handle, buffers, 2, WINAPI_BUFFER_OP_READ, test_pattern, &result) < 0) {
+        printf(" FAILED\n");
+        goto cleanup;
+    }
+    for (i = 0; i < 2; i++) {
+        size_t mismatch = winapi_pattern_mismatch(buffers[i].data, sizes[i], test_pattern);
+        if (mismatch != sizes[i]) {
+            printf(" FAILED (buffer %d differs at offset %zu)\n", i, mismatch);
+            goto cleanup;
+        }
+    }
+    printf(" OK\n");
+
+    printf("Stream transfer test completed successfully!\n");
+    ret = 0;
+
+cleanup:
+    for (i = 0; i < 2; i++) {
+        winapi_free_buffer(&buffers[i]);
+    }
+    return ret;
+}
+
+/* Test buffer tests striped across data connections, on a connection of its own */
+static int test_striped_transfer(void)
+{
+    /* Odd sizes: chunks span buffers and the last chunk is partial */
+    static const size_t sizes[3] = { 21 * 1024 * 1024 + 4096, 3 * 1024 * 1024 - 12, 9 * 1024 * 1024 + 520 };
+    winapi_buffer_t sources[3], targets[3];
+    winapi_buffer_test_result_t write_result, read_result;
+    winapi_request_t write_request, read_request;
+    winapi_config_t config;
+    winapi_handle_t handle;
+    uint32_t test_pattern = 0x5AA5C33C;
+    uint32_t checksum = 0;
+    uint32_t capabilities = 0;
+    uint64_t total = 0;
+    struct timeval start, end;
+    int round, i, ret = -1;
+
+    printf("\n=== Striped Transfer Test ===\n");
+
+    winapi_config_init(&config);
+    config.data_connections = g_data_connections;
+    handle = winapi_init_ex(&config);
+    if (!handle) {
+        printf("ERROR: Failed to open a connection for striping\n");
+        return -1;
+    }
+    if (winapi_get_capabilities(handle, &capabilities) < 0 || !(capabilities & WINAPI_FEATURE_STRIPING)) {
+        printf("Host does not support data connections, skipped\n");
+        winapi_cleanup(handle);
+        return 0;
+    }
+
+    memset(sources, 0, sizeof(sources));
+    memset(targets, 0, sizeof(targets));
+    for (i = 0; i < 3; i++) {
+        size_t j;
+
+        if (winapi_alloc_buffer(&sources[i], sizes[i]) < 0 || winapi_alloc_buffer(&targets[i], sizes[i]) < 0) {
+            printf("ERROR: Failed to allocate striped buffer %d\n", i);
+            goto cleanup;
+        }
+        for (j = 0; j < sizes[i] / sizeof(uint32_t); j++) {
+            ((uint32_t *)sources[i].data)[j] = (uint32_t)(j * 2246822519u) + (uint32_t)i;
+        }
+        total += sizes[i];
+    }
+
+    /* The host checksums the payload as one run of words */
+    for (i = 0; i < 3; i++) {
+        checksum ^= winapi_checksum_xor(sources[i].data, sizes[i]);
+    }
+
+    /* Several rounds so auto-tuning gets to move; each READ is pipelined with a WRITE */
+    gettimeofday(&start, NULL);
+    for (round = 0; round < 8; round++) {
+        memset(&read_result, 0, sizeof(read_result));
+        memset(&write_result, 0, sizeof(write_result));
+
+        if (winapi_buffer_test_submit(handle, targets, 3, WINAPI_BUFFER_OP_READ, test_pattern,
+                                      &read_result, &read_request) < 0 ||
+            winapi_buffer_test_submit(handle, sources, 3, WINAPI_BUFFER_OP_WRITE, test_pattern,
+                                      &write_result, &write_request) < 0) {
+            printf(" FAILED (round %d: submit)\n", round);
+            goto cleanup;
+        }
+        if (winapi_wait(handle, read_request) < 0 || winapi_wait(handle, write_request) < 0) {
+            printf(" FAILED (round %d: transfer)\n", round);
+            goto cleanup;
+        }
+
+        if (write_result.bytes_processed != total || write_result.checksum != checksum) {
+            printf(" FAILED (round %d: checksum 0x%08x, expected 0x%08x)\n", round, write_result.checksum, checksum);
+            goto cleanup;
+        }
+        for (i = 0; i < 3; i++) {
+            size_t mismatch = winapi_pattern_mismatch(targets[i].data, sizes[i] & ~(size_t)3, test_pattern);
+            if (mismatch != (sizes[i] & ~(size_t)3)) {
+                printf(" FAILED (round %d: buffer %d differs at offset %zu)\n", round, i, mismatch);
+                goto cleanup;
+            }
+            memset(targets[i].data, 0, sizes[i]);
+        }
+    }
+    gettimeofday(&end, NULL);
+
+    {
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+        char size_str[32];
+
+        format_bytes(total, size_str, sizeof(size_str));
+        printf("8 rounds of %s READ + WRITE: %.2f MB/s\n", size_str, 16.0 * total / (1024.0 * 1024.0) / seconds);
+    }
+    printf("Striped transfer test completed successfully!\n");
+    ret = 0;
+
+cleanup:
+    for (i = 0; i < 3; i++) {
+        winapi_free_buffer(&sources[i]);
+        winapi_free_buffer(&targets[i]);
+    }
+    winapi_cleanup(handle);
+    return ret;
+}
+
+/* One thread of the shared handle test */
+struct thread_test {
+    winapi_handle_t handle;
+    const winapi_buffer_t *striped;  /* Large source buffer, read only */
+    uint32_t striped_checksum;
+    int index;
+    int failed;
+};
+
+/* Pipelined echo and buffer tests, with a striped (exclusive) write now and then */
+static void *thread_test_worker(void *arg)
+{
+    struct thread_test *test = (struct thread_test *)arg;
+    winapi_buffer_t source, target;
+    winapi_buffer_test_result_t write_result, read_result;
+    winapi_request_t echo_request, write_request, read_request;
+    uint32_t test_pattern = 0x11111111u * (uint32_t)(test->index + 1);
+    char input[32], output[32];
+    int round;
+    size_t j;
+
+    memset(&source, 0, sizeof(source));
+    memset(&target, 0, sizeof(target));
+    if (winapi_alloc_buffer(&source, THREAD_TEST_BUFFER_SIZE) < 0 ||
+        winapi_alloc_buffer(&target, THREAD_TEST_BUFFER_SIZE) < 0) {
+        printf("ERROR: Thread %d failed to allocate its buffers\n", test->index);
+        winapi_free_buffer(&source);
+        test->failed = 1;
+        return NULL;
+    }
+    for (j = 0; j < THREAD_TEST_BUFFER_SIZE / sizeof(uint32_t); j++) {
+        ((uint32_t *)source.data)[j] = (uint32_t)(j * 2654435761u) ^ test_pattern;
+    }
+
+    for (round = 0; round < THREAD_TEST_ROUNDS && !test->failed; round++) {
+        memset(&write_result, 0, sizeof(write_result));
+        memset(&read_result, 0, sizeof(read_result));
+        snprintf(input, sizeof(input), "thread %d round %d", test->index, round);
+
+        if (winapi_echo_submit(test->handle, input, output, sizeof(output), &echo_request) < 0 ||
+            winapi_buffer_test_submit(test->handle, &source, 1, WINAPI_BUFFER_OP_WRITE, test_pattern,
+                                      &write_result, &write_request) < 0 ||
+            winapi_buffer_test_submit(test->handle, &target, 1, WINAPI_BUFFER_OP_READ, test_pattern,
+                                      &read_result, &read_request) < 0) {
+            printf("ERROR: Thread %d round %d: submit failed\n", test->index, round);
+            test->failed = 1;
+            break;
+        }
+
+        /* Wait in reverse order, so other threads' rounds complete these too */
+        if (winapi_wait(test->handle, read_request) < 0 || winapi_wait(test->handle, write_request) < 0 ||
+            winapi_wait(test->handle, echo_request) < 0) {
+            printf("ERROR: Thread %d round %d: wait failed\n", test->index, round);
+            test->failed = 1;
+            break;
+        }
+
+        if (strcmp(input, output) != 0 ||
+            write_result.checksum != winapi_checksum_xor(source.data, THREAD_TEST_BUFFER_SIZE) ||
+            winapi_pattern_mismatch(target.data, THREAD_TEST_BUFFER_SIZE, test_pattern) != THREAD_TEST_BUFFER_SIZE) {
+            printf("ERROR: Thread %d round %d: echo \"%s\", checksum 0x%08x\n", test->index, round, output,
+                   write_result.checksum);
+            test->failed = 1;
+            break;
+        }
+        memset(target.data, 0, THREAD_TEST_BUFFER_SIZE);
+
+        /* Striped writes take the connection exclusively while the other threads keep submitting */
+        if (round % THREAD_TEST_THREADS == test->index) {
+            if (winapi_buffer_test(test->handle, (winapi_buffer_t *)test->striped, 1, WINAPI_BUFFER_OP_WRITE,
+                                   test_pattern, &write_result) < 0 ||
+                write_result.checksum != test->striped_checksum) {
+                printf("ERROR: Thread %d round %d: striped write failed\n", test->index, round);
+                test->failed = 1;
+            }
+        }
+    }
+
+    winapi_free_buffer(&source);
+    winapi_free_buffer(&target);
+    return NULL;
+}
+
+/* Run the thread test on a handle of its own, with or without shared memory rings */
+static int test_shared_handle(const char *ring_dir, const winapi_buffer_t *striped, uint32_t striped_checksum)
+{
+    struct thread_test tests[THREAD_TEST_THREADS];
+    pthread_t threads[THREAD_TEST_THREADS];
+    winapi_config_t config;
+    winapi_handle_t handle;
+    uint32_t capabilities = 0;
+    int i, started, ret = 0;
+
+    printf("\n=== Shared Handle Test (%d threads, %s) ===\n", THREAD_TEST_THREADS,
+           ring_dir ? "shared memory rings" : "socket only");
+
+    winapi_config_init(&config);
+    config.ring_dir = ring_dir;
+    config.data_connections = 2;
+    handle = winapi_init_ex(&config);
+    if (!handle) {
+        printf("ERROR: Failed to open a connection for the thread test\n");
+        return -1;
+    }
+    winapi_get_capabilities(handle, &capabilities);
+    if (ring_dir && !(capabilities & WINAPI_FEATURE_SHM_RING)) {
+        printf("Shared memory rings not agreed, skipped\n");
+        winapi_cleanup(handle);
+        return 0;
+    }
+
+    for (started = 0; started < THREAD_TEST_THREADS; started++) {
+        tests[started].handle = handle;
+        tests[started].striped = striped;
+        tests[started].striped_checksum = striped_checksum;
+        tests[started].index = started;
+        tests[started].failed = 0;
+        if (pthread_create(&threads[started], NULL, thread_test_worker, &tests[started]) != 0) {
+            printf("ERROR: Failed to start thread %d\n", started);
+            ret = -1;
+            break;
+        }
+    }
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        if (tests[i].failed) {
+            ret = -1;
+        }
+    }
+
+    winapi_cleanup(handle);
+    if (ret == 0) {
+        printf("%d threads x %d rounds completed successfully!\n", THREAD_TEST_THREADS, THREAD_TEST_ROUNDS);
+    }
+    return ret;
+}
+
+/* Test one handle shared by several threads, over the socket alone and through rings */
+static int test_threads(void)
+{
+    winapi_config_t defaults;
+    winapi_buffer_t striped;
+    uint32_t checksum;
+    size_t j;
+    int ret = 0;
+
+    if (winapi_alloc_buffer(&striped, THREAD_TEST_STRIPED_SIZE) < 0) {
+        printf("ERROR: Failed to allocate the striped buffer\n");
+        return -1;
+    }
+    for (j = 0; j < THREAD_TEST_STRIPED_SIZE / sizeof(uint32_t); j++) {
+        ((uint32_t *)striped.data)[j] = (uint32_t)(j * 2246822519u);
+    }
+    checksum = winapi_checksum_xor(striped.data, THREAD_TEST_STRIPED_SIZE);
+
+    winapi_config_init(&defaults);
+    if (test_shared_handle(NULL, &striped, checksum) < 0) {
+        ret = -1;
+    }
+    if (test_shared_handle(defaults.ring_dir, &striped, checksum) < 0) {
+        ret = -1;
+    }
+
+    winapi_free_buffer(&striped);
+    return ret;
+}
+
+/* Connect with the given config, keeping a copy of the startup log to check which engines came up */
+static winapi_handle_t init_logged(const winapi_config_t *config, char *log, size_t log_size)
+{
+    winapi_handle_t handle;
+    FILE *capture;
+    size_t length = 0;
+    int saved;
+
+    log[0] = '\0';
+    capture = tmpfile();
+    if (!capture) {
+        return winapi_init_ex(config);
+    }
+
+    fflush(stdout);
+    saved = dup(STDOUT_FILENO);
+    dup2(fileno(capture), STDOUT_FILENO);
+    handle = winapi_init_ex(config);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    rewind(capture);
+    length = fread(log, 1, log_size - 1, capture);
+    log[length] = '\0';
+    fclose(capture);
+
+    fputs(log, stdout);
+    return handle;
+}
+
+/* Rerun the echo and buffer suites on a connection with one transport engine turned on */
+static int test_transport(const char *name, const winapi_config_t *config, const char *expected, const char *unavailable)
+{
+    winapi_handle_t handle;
+    char log[4096];
+    int ret = 0;
+
+    printf("\n=== Transport: %s ===\n", name);
+
+    handle = init_logged(config, log, sizeof(log));
+    if (!handle) {
+        printf("ERROR: Failed to connect with %s\n", name);
+        return -1;
+    }
+
+    /* The kernel may lack the feature; a host that refused it is a failure */
+    if (!strstr(log, expected)) {
+        winapi_cleanup(handle);
+        if (unavailable && strstr(log, unavailable)) {
+            printf("%s unavailable on this kernel, skipped\n", name);
+            return 0;
+        }
+        printf("ERROR: %s not in use, expected \"%s\" in the startup log\n", name, expected);
+        return -1;
+    }
+
+    if (test_echo(handle) < 0 || test_pipelined_echo(handle) < 0 ||
+        test_buffer_operations(handle) < 0 || test_multi_buffer(handle) < 0) {
+        ret = -1;
+    }
+
+    winapi_cleanup(handle);
+    return ret;
+}
+
+/* Test each transport engine on a connection of its own */
+static int test_transports(void)
+{
+    winapi_config_t base, config;
+    char expected[128];
+    int ret = 0;
+
+    /* Start from plain sockets so each pass measures one engine */
+    winapi_config_init(&base);
+    base.zerocopy_threshold = 0;
+    base.io_engine = WINAPI_IO_ENGINE_SYSCALLS;
+
+    config = base;
+    config.ring_dir = NULL;
+    config.zerocopy_threshold = 64 * 1024;
+    snprintf(expected, sizeof(expected), "[INFO] Zero-copy sends for payloads of %zu bytes and up", config.zerocopy_threshold);
+    if (test_transport("MSG_ZEROCOPY", &config, expected, "[WARN] Zero-copy sends unavailable") < 0) {
+        ret = -1;
+    }
+
+    config = base;
+    config.ring_dir = NULL;
+    config.io_engine = WINAPI_IO_ENGINE_URING;
+    if (test_transport("io_uring", &config, "[INFO] Using the io_uring engine", "[INFO] io_uring unavailable") < 0) {
+        ret = -1;
+    }
+
+    /* Rings with adaptive polling, then with every wait going to the doorbell */
+    config = base;
+    config.ring_spin_us = WINAPI_RING_SPIN_US_DEFAULT;
+    snprintf(expected, sizeof(expected), "[INFO] Small calls go through shared memory rings, polled for up to %u us",
+             config.ring_spin_us);
+    if (test_transport("shared memory rings", &config, expected, NULL) < 0) {
+        ret = -1;
+    }
+
+    config.ring_spin_us = 0;
+    snprintf(expected, sizeof(expected), "[INFO] Small calls go through shared memory rings, polled for up to 0 us");
+    if (test_transport("shared memory rings without polling", &config, expected, NULL) < 0) {
+        ret = -1;
+    }
+
+    return ret;
+}
+
 /* Test latency performance */
 static int test_latency_performance(winapi_handle_t handle)
 {
@@ -383,6 +1259,11 @@ int main(int argc, char *argv[])
             test_mask = 0x04;
         } else if (strcmp(argv[i], "--shared-only") == 0) {
             test_mask = 0x08;
+        } else if (strcmp(argv[i], "--transports-only") == 0) {
+            test_mask = 0x10;
+        } else if (strcmp(argv[i], "--stripes") == 0 && i + 1 < argc) {
+            i++;
+            g_data_connections = strcmp(argv[i], "auto") == 0 ? WINAPI_DATA_CONNECTIONS_AUTO : atoi(argv[i]);
         } else if (strcmp(argv[i], "--help") == 0) {
             printf("Usage: %s [options]\n", argv[0]);
             printf("Options:\n");
@@ -390,6 +1271,8 @@ int main(int argc, char *argv[])
             printf("  --buffer-only  Run only buffer tests\n");
             printf("  --perf-only    Run only performance tests\n");
             printf("  --shared-only  Run only dynamic shared buffer tests\n");
+            printf("  --transports-only  Run only the echo and buffer tests on each transport engine\n");
+            printf("  --stripes N    Data connections for the striped transfer test (default: auto)\n");
             printf("  --help         Show this help\n");
             return 0;
         }
@@ -405,6 +1288,13 @@ int main(int argc, char *argv[])
 
     printf("Connected to Windows host successfully!\n");
 
+    uint32_t capabilities = 0;
+    if (winapi_get_capabilities(handle, &capabilities) == 0) {
+        printf("Negotiated features: 0x%08x (binary framing: %s, CRC32C: %s)\n", capabilities,
+               (capabilities & WINAPI_FEATURE_BINARY_FRAMING) ? "yes" : "no",
+               (capabilities & WINAPI_FEATURE_CHECKSUM_CRC32C) ? "yes" : "no");
+    }
+
     /* Run tests based on mask */
     int overall_result = 0;
 
@@ -412,15 +1302,42 @@ int main(int argc, char *argv[])
         if (test_echo(handle) < 0) {
             overall_result = 1;
         }
+        if (test_pipelined_echo(handle) < 0) {
+            overall_result = 1;
+        }
+        if (test_async_echo(handle) < 0) {
+            overall_result = 1;
+        }
+        if (test_completion_queue(handle) < 0) {
+            overall_result = 1;
+        }
+        if (test_batch(handle) < 0) {
+            overall_result = 1;
+        }
     }
 
     if (test_mask & 0x02) {
+        if (test_checksum_kernels() < 0) {
+            overall_result = 1;
+        }
         if (test_buffer_operations(handle) < 0) {
             overall_result = 1;
         }
         if (test_multi_buffer(handle) < 0) {
             overall_result = 1;
         }
+        if (test_registered_buffers(handle) < 0) {
+            overall_result = 1;
+        }
+        if (test_stream_transfer(handle) < 0) {
+            overall_result = 1;
+        }
+        if (g_data_connections != 0 && test_striped_transfer() < 0) {
+            overall_result = 1;
+        }
+        if (test_threads() < 0) {
+            overall_result = 1;
+        }
     }
 
     if (test_mask & 0x04) {
@@ -438,6 +1355,12 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (test_mask & 0x10) {
+        if (test_transports() < 0) {
+            overall_result = 1;
+        }
+    }
+
     /* Cleanup */
     winapi_cleanup(handle);
 
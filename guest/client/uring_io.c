@@ -0,0 +1,528 @@
+/*
+ * io_uring engine for the library's main socket
+ *
+ * The engine owns the submission and completion rings and two registered
+ * buffers, the send area for copied headers and the read-ahead area. Every
+ * submission is waited for in full before the next one is built, so the
+ * rings never hold more than one batch and the kernel-side order of the
+ * linked chain is the order frames were queued in.
+ */
+
+#define _GNU_SOURCE
+
+#include "uring_io.h"
+#include "../../common/protocol.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/* The io_uring system calls have the same numbers on every architecture */
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup       425
+#define __NR_io_uring_enter       426
+#define __NR_io_uring_register    427
+#endif
+
+#define URING_ENTRIES             64
+#define URING_AREA_SIZE           (64 * 1024)        // Send area and read-ahead area, each
+#define URING_MAX_SENDS           (URING_ENTRIES - 1)  // One entry stays free for the linked receive
+#define URING_PAYLOAD_IOV         WINAPI_MAX_BUFFERS
+#define URING_RECV_TAG            UINT64_MAX
+
+/* Registered buffer and file indices */
+#define URING_SEND_BUFFER         0
+#define URING_RECV_BUFFER         1
+#define URING_SOCKET_FILE         0
+
+enum uring_send_kind {
+    SEND_STAGED,                      // A run of the send area
+    SEND_PAYLOAD                      // Caller buffers, in place
+};
+
+struct uring_send {
+    enum uring_send_kind kind;
+    size_t offset;                    // Staged: start in the send area
+    size_t length;                    // Bytes in total
+    struct msghdr msg;                // Payload: sendmsg over iov
+    struct iovec iov[URING_PAYLOAD_IOV];
+    int result;
+};
+
+struct uring_io {
+    int ring_fd;
+    int socket_fd;
+
+    /* Submission ring */
+    void *sq_ring;
+    size_t sq_ring_size;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    /* Completion ring, in the submission ring's mapping with IORING_FEAT_SINGLE_MMAP */
+    void *cq_ring;
+    size_t cq_ring_size;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    /* Registered buffers */
+    char *areas;
+    char *send_area;
+    size_t send_used;
+    char *recv_area;
+    size_t recv_start;                // Unconsumed bytes are [recv_start, recv_end)
+    size_t recv_end;
+
+    struct uring_send sends[URING_MAX_SENDS];
+    int send_count;
+};
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int ring_fd, unsigned opcode, const void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+/* Whether the kernel implements every operation the engine issues */
+static int ops_supported(int ring_fd) {
+    static const int needed[] = { IORING_OP_WRITE_FIXED, IORING_OP_READ_FIXED, IORING_OP_SENDMSG, IORING_OP_RECV };
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    int supported = probe != NULL;
+    size_t i;
+
+    if (supported && sys_io_uring_register(ring_fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        supported = 0;
+    }
+    for (i = 0; supported && i < sizeof(needed) / sizeof(needed[0]); i++) {
+        if (needed[i] > probe->last_op || !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED)) {
+            supported = 0;
+        }
+    }
+
+    free(probe);
+    return supported;
+}
+
+/* Map the rings the kernel set up */
+static int map_rings(struct uring_io *io, const struct io_uring_params *params) {
+    void *ring;
+
+    io->sq_ring_size = params->sq_off.array + params->sq_entries * sizeof(unsigned);
+    io->cq_ring_size = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+    if (params->features & IORING_FEAT_SINGLE_MMAP) {
+        if (io->cq_ring_size > io->sq_ring_size) {
+            io->sq_ring_size = io->cq_ring_size;
+        }
+        io->cq_ring_size = 0;
+    }
+
+    ring = mmap(NULL, io->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                io->ring_fd, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) {
+        return -1;
+    }
+    io->sq_ring = ring;
+
+    if (io->cq_ring_size > 0) {
+        ring = mmap(NULL, io->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    io->ring_fd, IORING_OFF_CQ_RING);
+        if (ring == MAP_FAILED) {
+            return -1;
+        }
+        io->cq_ring = ring;
+    }
+
+    io->sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+    ring = mmap(NULL, io->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                io->ring_fd, IORING_OFF_SQES);
+    if (ring == MAP_FAILED) {
+        return -1;
+    }
+    io->sqes = ring;
+
+    ring = io->cq_ring ? io->cq_ring : io->sq_ring;
+    io->sq_tail = (unsigned *)((char *)io->sq_ring + params->sq_off.tail);
+    io->sq_mask = (unsigned *)((char *)io->sq_ring + params->sq_off.ring_mask);
+    io->sq_array = (unsigned *)((char *)io->sq_ring + params->sq_off.array);
+    io->cq_head = (unsigned *)((char *)ring + params->cq_off.head);
+    io->cq_tail = (unsigned *)((char *)ring + params->cq_off.tail);
+    io->cq_mask = (unsigned *)((char *)ring + params->cq_off.ring_mask);
+    io->cqes = (struct io_uring_cqe *)((char *)ring + params->cq_off.cqes);
+    return 0;
+}
+
+struct uring_io *uring_io_create(int socket_fd) {
+    struct io_uring_params params;
+    struct uring_io *io;
+    struct iovec areas[2];
+    void *memory;
+
+    io = calloc(1, sizeof(*io));
+    if (!io) {
+        return NULL;
+    }
+    io->socket_fd = socket_fd;
+
+    memset(&params, 0, sizeof(params));
+    io->ring_fd = sys_io_uring_setup(URING_ENTRIES, &params);
+    if (io->ring_fd < 0 || !(params.features & IORING_FEAT_SUBMIT_STABLE) || !ops_supported(io->ring_fd) ||
+        map_rings(io, &params) < 0) {
+        goto fail;
+    }
+
+    memory = mmap(NULL, 2 * URING_AREA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        goto fail;
+    }
+    io->areas = memory;
+    io->send_area = io->areas;
+    io->recv_area = io->areas + URING_AREA_SIZE;
+
+    areas[URING_SEND_BUFFER].iov_base = io->send_area;
+    areas[URING_SEND_BUFFER].iov_len = URING_AREA_SIZE;
+    areas[URING_RECV_BUFFER].iov_base = io->recv_area;
+    areas[URING_RECV_BUFFER].iov_len = URING_AREA_SIZE;
+    if (sys_io_uring_register(io->ring_fd, IORING_REGISTER_BUFFERS, areas, 2) < 0 ||
+        sys_io_uring_register(io->ring_fd, IORING_REGISTER_FILES, &io->socket_fd, 1) < 0) {
+        goto fail;
+    }
+
+    return io;
+
+fail:
+    uring_io_destroy(io);
+    return NULL;
+}
+
+void uring_io_destroy(struct uring_io *io) {
+    if (!io) {
+        return;
+    }
+
+    // Closing the ring drops the registrations
+    if (io->ring_fd >= 0) {
+        close(io->ring_fd);
+    }
+    if (io->sqes) {
+        munmap(io->sqes, io->sqes_size);
+    }
+    if (io->cq_ring) {
+        munmap(io->cq_ring, io->cq_ring_size);
+    }
+    if (io->sq_ring) {
+        munmap(io->sq_ring, io->sq_ring_size);
+    }
+    if (io->areas) {
+        munmap(io->areas, 2 * URING_AREA_SIZE);
+    }
+    free(io);
+}
+
+/* Next free submission entry, cleared and aimed at the registered socket */
+static struct io_uring_sqe *next_sqe(struct uring_io *io, unsigned *tail, uint8_t opcode, uint64_t user_data) {
+    unsigned index = *tail & *io->sq_mask;
+    struct io_uring_sqe *sqe = &io->sqes[index];
+
+    io->sq_array[index] = index;
+    (*tail)++;
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = URING_SOCKET_FILE;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->user_data = user_data;
+    return sqe;
+}
+
+/* Send what a queued entry still holds from skip on with plain sendmsg */
+static int send_rest(struct uring_io *io, struct uring_send *send, size_t skip) {
+    struct iovec staged;
+    struct iovec *iov = send->iov;
+    int count = (int)send->msg.msg_iovlen;
+
+    if (send->kind == SEND_STAGED) {
+        staged.iov_base = io->send_area + send->offset;
+        staged.iov_len = send->length;
+        iov = &staged;
+        count = 1;
+    }
+
+    while (count > 0) {
+        struct msghdr msg;
+        ssize_t sent;
+
+        while (count > 0 && skip >= iov->iov_len) {
+            skip -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count == 0) {
+            break;
+        }
+        iov->iov_base = (char *)iov->iov_base + skip;
+        iov->iov_len -= skip;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        sent = sendmsg(io->socket_fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                sent = 0;
+            } else {
+                return -1;
+            }
+        }
+        skip = (size_t)sent;
+    }
+
+    return 0;
+}
+
+/*
+ * Submit the queue as one linked chain, with a receive of up to recv_len
+ * bytes linked behind it when recv_len is set, and wait for all of it.
+ * Returns the bytes received, -1 on failure.
+ */
+static ssize_t submit(struct uring_io *io, void *recv_data, size_t recv_len) {
+    unsigned count = (unsigned)io->send_count + (recv_len > 0);
+    unsigned tail = *io->sq_tail;
+    unsigned submitted = 0;
+    unsigned completed = 0;
+    int recv_result = 0;
+    int i;
+
+    for (i = 0; i < io->send_count; i++) {
+        struct uring_send *send = &io->sends[i];
+        struct io_uring_sqe *sqe;
+
+        if (send->kind == SEND_STAGED) {
+            sqe = next_sqe(io, &tail, IORING_OP_WRITE_FIXED, (uint64_t)i);
+            sqe->addr = (uint64_t)(uintptr_t)(io->send_area + send->offset);
+            sqe->len = (uint32_t)send->length;
+            sqe->buf_index = URING_SEND_BUFFER;
+        } else {
+            // MSG_WAITALL: a short send fails the link instead of letting the rest overtake it
+            sqe = next_sqe(io, &tail, IORING_OP_SENDMSG, (uint64_t)i);
+            sqe->addr = (uint64_t)(uintptr_t)&send->msg;
+            sqe->len = 1;
+            sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        }
+        if ((unsigned)i + 1 < count) {
+            sqe->flags |= IOSQE_IO_LINK;
+        }
+    }
+
+    if (recv_len > 0) {
+        struct io_uring_sqe *sqe;
+
+        if (recv_data == io->recv_area) {
+            sqe = next_sqe(io, &tail, IORING_OP_READ_FIXED, URING_RECV_TAG);
+            sqe->buf_index = URING_RECV_BUFFER;
+        } else {
+            sqe = next_sqe(io, &tail, IORING_OP_RECV, URING_RECV_TAG);
+            sqe->msg_flags = MSG_WAITALL;
+        }
+        sqe->addr = (uint64_t)(uintptr_t)recv_data;
+        sqe->len = (uint32_t)recv_len;
+    }
+
+    __atomic_store_n(io->sq_tail, tail, __ATOMIC_RELEASE);
+
+    while (completed < count) {
+        unsigned head;
+        unsigned ready;
+        int ret;
+
+        ret = sys_io_uring_enter(io->ring_fd, count - submitted, count - completed, IORING_ENTER_GETEVENTS);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        submitted += (unsigned)ret;
+
+        head = *io->cq_head;
+        ready = __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != ready) {
+            struct io_uring_cqe *cqe = &io->cqes[head & *io->cq_mask];
+
+            if (cqe->user_data == URING_RECV_TAG) {
+                recv_result = cqe->res;
+            } else {
+                io->sends[cqe->user_data].result = cqe->res;
+            }
+            head++;
+            completed++;
+        }
+        __atomic_store_n(io->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    // A short or failed send cancels everything linked after it: finish those in order
+    for (i = 0; i < io->send_count; i++) {
+        struct uring_send *send = &io->sends[i];
+
+        if (send->result == (int)send->length) {
+            continue;
+        }
+        if (send->result < 0 && send->result != -ECANCELED) {
+            errno = -send->result;
+            return -1;
+        }
+        if (send_rest(io, send, send->result > 0 ? (size_t)send->result : 0) < 0) {
+            return -1;
+        }
+    }
+    io->send_count = 0;
+    io->send_used = 0;
+
+    if (recv_len == 0) {
+        return 0;
+    }
+    if (recv_result == -ECANCELED) {
+        return submit(io, recv_data, recv_len);
+    }
+    if (recv_result <= 0) {
+        errno = recv_result < 0 ? -recv_result : ECONNRESET;
+        return -1;
+    }
+    return recv_result;
+}
+
+int uring_io_queue(struct uring_io *io, const struct iovec *head, int head_count,
+                   const struct iovec *payload, int payload_count) {
+    size_t head_bytes = 0;
+    size_t payload_bytes = 0;
+    int payload_entries = 0;
+    int i;
+
+    for (i = 0; i < head_count; i++) {
+        head_bytes += head[i].iov_len;
+    }
+    for (i = 0; i < payload_count; i++) {
+        if (payload[i].iov_len > 0) {
+            payload_bytes += payload[i].iov_len;
+            payload_entries++;
+        }
+    }
+    if (head_bytes > URING_AREA_SIZE || payload_entries > URING_PAYLOAD_IOV) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    if (io->send_used + head_bytes > URING_AREA_SIZE || io->send_count + 2 > URING_MAX_SENDS) {
+        if (submit(io, NULL, 0) < 0) {
+            return -1;
+        }
+    }
+
+    if (head_bytes > 0) {
+        struct uring_send *send = io->send_count > 0 ? &io->sends[io->send_count - 1] : NULL;
+
+        // Back-to-back headers go out as one write
+        if (!send || send->kind != SEND_STAGED) {
+            send = &io->sends[io->send_count++];
+            send->kind = SEND_STAGED;
+            send->offset = io->send_used;
+            send->length = 0;
+        }
+        for (i = 0; i < head_count; i++) {
+            memcpy(io->send_area + io->send_used, head[i].iov_base, head[i].iov_len);
+            io->send_used += head[i].iov_len;
+            send->length += head[i].iov_len;
+        }
+    }
+
+    if (payload_entries > 0) {
+        struct uring_send *send = &io->sends[io->send_count++];
+        int entry = 0;
+
+        send->kind = SEND_PAYLOAD;
+        send->length = payload_bytes;
+        for (i = 0; i < payload_count; i++) {
+            if (payload[i].iov_len > 0) {
+                send->iov[entry++] = payload[i];
+            }
+        }
+        memset(&send->msg, 0, sizeof(send->msg));
+        send->msg.msg_iov = send->iov;
+        send->msg.msg_iovlen = entry;
+    }
+
+    return 0;
+}
+
+int uring_io_pending(const struct uring_io *io) {
+    return io->send_count;
+}
+
+int uring_io_flush(struct uring_io *io) {
+    if (io->send_count == 0) {
+        return 0;
+    }
+    return submit(io, NULL, 0) < 0 ? -1 : 0;
+}
+
+int uring_io_recv(struct uring_io *io, void *data, size_t len) {
+    char *out = (char *)data;
+
+    while (len > 0) {
+        ssize_t received;
+
+        if (io->recv_start < io->recv_end) {
+            size_t take = io->recv_end - io->recv_start;
+
+            if (take > len) {
+                take = len;
+            }
+            memcpy(out, io->recv_area + io->recv_start, take);
+            io->recv_start += take;
+            out += take;
+            len -= take;
+            continue;
+        }
+
+        // Large reads land straight in the caller's memory, small ones read ahead as far as the area goes
+        if (len >= URING_AREA_SIZE) {
+            received = submit(io, out, len);
+            if (received < 0) {
+                return -1;
+            }
+            out += received;
+            len -= (size_t)received;
+        } else {
+            io->recv_start = 0;
+            io->recv_end = 0;
+            received = submit(io, io->recv_area, URING_AREA_SIZE);
+            if (received < 0) {
+                return -1;
+            }
+            io->recv_end = (size_t)received;
+        }
+    }
+
+    return 0;
+}
+
+size_t uring_io_buffered(const struct uring_io *io) {
+    return io->recv_end - io->recv_start;
+}
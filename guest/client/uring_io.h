@@ -0,0 +1,50 @@
+/*
+ * io_uring engine for the library's main socket
+ *
+ * Outgoing frames are queued instead of sent: protocol headers are copied
+ * into a registered send area (back-to-back headers coalesce into one
+ * fixed-buffer write), payload buffers are referenced where they are. The
+ * queue goes out as one linked chain, so the host sees it in order, and the
+ * receive the caller is about to block on is linked behind it: a call costs
+ * one io_uring_enter for its frame, its payload and the first bytes of the
+ * answer. Received bytes land in a registered read-ahead area, so several
+ * pipelined responses usually arrive in a single completion.
+ *
+ * Raw system calls only, no liburing. uring_io_create() returns NULL when
+ * the kernel lacks an operation the engine needs, and callers keep using
+ * plain send/recv.
+ */
+
+#ifndef WINAPI_URING_IO_H
+#define WINAPI_URING_IO_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+struct uring_io;
+
+/* Engine for a connected, blocking stream socket, NULL if io_uring cannot serve it */
+struct uring_io *uring_io_create(int socket_fd);
+void uring_io_destroy(struct uring_io *io);
+
+/*
+ * Queue head entries (copied) followed by payload entries (sent from place,
+ * they must stay valid until the queue is flushed). A full queue is flushed
+ * first. Returns -1 if the connection failed.
+ */
+int uring_io_queue(struct uring_io *io, const struct iovec *head, int head_count,
+                   const struct iovec *payload, int payload_count);
+
+/* Sends queued and not yet submitted */
+int uring_io_pending(const struct uring_io *io);
+
+/* Submit the queue and wait until it is on the socket */
+int uring_io_flush(struct uring_io *io);
+
+/* Receive exactly len bytes, submitting the queue in the same io_uring_enter */
+int uring_io_recv(struct uring_io *io, void *data, size_t len);
+
+/* Bytes received ahead and not consumed yet */
+size_t uring_io_buffered(const struct uring_io *io);
+
+#endif /* WINAPI_URING_IO_H */
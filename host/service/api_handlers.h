@@ -0,0 +1,149 @@
+/*
+ * API handlers shared by the JSON and binary protocols
+ *
+ * Handlers run against a ClientSession and produce a complete response.
+ * Socket payload that follows a request has already been streamed through
+ * a PayloadSink by the connection (handlers get its digest), and READ
+ * payload to send back is described by BufferSendInfo rather than written
+ * here, so nothing in this file touches a socket.
+ */
+
+#ifndef WINAPI_API_HANDLERS_H
+#define WINAPI_API_HANDLERS_H
+
+#include "platform.h"
+#include "payload_sink.h"
+#include "json_codec.h"
+
+#include <string>
+#include <vector>
+#include <json/json.h>
+
+#include "../../common/protocol.h"
+
+// Shared Memory Layout
+#define HEADER_SIZE             4096
+#define REQUEST_BUFFER_SIZE     (15 * 1024 * 1024) // 15MB
+#define RESPONSE_BUFFER_SIZE    (15 * 1024 * 1024) // 15MB
+
+// SafeMemoryWrite boundary - switch to safe writes this far from buffer end
+#define SAFE_WRITE_BOUNDARY     (32 * 1024)  // 32KB before buffer end
+#define SAFE_WRITE_OFFSET       (RESPONSE_BUFFER_SIZE - SAFE_WRITE_BOUNDARY)
+
+// Largest buffer payload accepted over the socket without streaming
+#define MAX_SOCKET_PAYLOAD      (64ULL * 1024 * 1024)  // 64MB
+
+// Features this service offers during the connection handshake
+#define HOST_CAPABILITIES       (WINAPI_CAP_BINARY_FRAMING | WINAPI_CAP_PIPELINING | WINAPI_CAP_BATCH | \
+                                 WINAPI_CAP_CHECKSUM_CRC32C | WINAPI_CAP_STREAMING | WINAPI_CAP_STRIPING | \
+                                 WINAPI_CAP_SHM_RING | WINAPI_CAP_REGISTERED_BUFFERS)
+#define HOST_BUFFER_BACKINGS    (WINAPI_BACKING_SOCKET | WINAPI_BACKING_SHARED_FILE)
+#define HOST_MAX_FRAME_SIZE     ((UINT32)WINAPI_DEFAULT_MAX_FRAME_SIZE)
+
+class RingRegion;
+class BufferTable;
+
+// Per-session API state
+struct ClientSession {
+    SOCKET socket;
+    UINT32 session_id;
+    UINT64 session_key;          // Secret data connections attach with, 0 without striping
+    LPVOID request_buffer;       // Shared memory lease, NULL when another session holds it
+    LPVOID response_buffer;
+    RingRegion* ring;            // Shared memory rings (WINAPI_CAP_SHM_RING), NULL without
+    BufferTable* buffers;        // Registered buffers (WINAPI_CAP_REGISTERED_BUFFERS), NULL without
+    BOOL handshake_done;
+    winapi_handshake_t agreed;   // Feature set agreed during the handshake
+};
+
+// Structure to pass buffer send info
+struct BufferSendInfo {
+    BOOL needs_buffer_send;
+    UINT64 buffer_size;
+    UINT32 test_pattern;
+    BOOL stream;              // Send as a chunk stream paced by the client's credits
+    UINT64 stream_window;     // Bytes the client granted up front
+    UINT64 stream_id;         // Request the stream answers
+    UINT32 stripe_count;      // Data connections the stream is striped across, 0 for this connection
+};
+
+// Typed buffer test arguments shared by the JSON and binary front ends
+struct BufferTestArgs {
+    UINT32 operation;
+    UINT32 test_pattern;
+    UINT64 payload_size;
+    BOOL socket_transfer;
+    BOOL stream;                   // Payload travels as a chunk stream of any size (binary only)
+    UINT32 stream_window;
+    UINT32 stripe_count;           // Data connections carrying the stream, 0 for this connection
+    const PayloadDigest* payload;  // Socket payload received after the request, NULL if none
+    const winapi_buffer_desc_t* ranges;  // Registered ranges (WINAPI_MSG_FLAG_REGISTERED), NULL if none
+    UINT32 range_count;
+};
+
+// Binary response frame (header immediately followed by inline data)
+struct BinaryResponseFrame {
+    winapi_message_header_t header;
+    UINT8 inline_data[WINAPI_MAX_INLINE_DATA];
+};
+
+// Dispatch table entry for one API of WINAPI_API_LIST
+struct ApiHandler {
+    const char* name;      // JSON name
+    BOOL offload;          // Expensive enough to run on the handler pool
+    DWORD (*run_json)(ClientSession* session, const Json::Value& request, const PayloadDigest* payload,
+                      Json::Value& response, BufferSendInfo* send_info);
+    DWORD (*run_binary)(ClientSession* session, const winapi_message_t* request, const PayloadDigest* payload,
+                        BinaryResponseFrame* response, BufferSendInfo* send_info);
+    DWORD (*run_fast)(ClientSession* session, const JsonRequest& request, const PayloadDigest* payload,
+                      JsonResponse& response, BufferSendInfo* send_info);
+};
+
+// Handler for an API ID, NULL if unknown
+const ApiHandler* FindApiHandler(UINT32 api_id);
+
+// Socket payload following a request (0 when none is read)
+UINT64 SocketPayloadSize(const winapi_message_t* request);
+UINT64 SocketPayloadSize(const Json::Value& request);
+UINT64 SocketPayloadSize(const JsonRequest& request);
+
+// Whether a chunk stream follows a binary request, and its total size
+BOOL StreamedPayloadSize(const winapi_message_t* request, UINT64* size);
+
+// Data connections a binary request's stream is striped across, 0 if not striped
+UINT32 StripeCount(const winapi_message_t* request);
+
+// JSON protocol
+DWORD ProcessAPIRequest(ClientSession* session, const Json::Value& request, const PayloadDigest* payload, std::string& response_json, BufferSendInfo* send_info);
+UINT32 RequestApiId(const Json::Value& request);
+DWORD DispatchAPICall(ClientSession* session, UINT32 api_id, const Json::Value& request, const PayloadDigest* payload, Json::Value& response, BufferSendInfo* send_info);
+Json::Value CreateErrorResponse(UINT32 request_id, const char* error_msg);
+Json::Value CreateSuccessResponse(UINT32 request_id);
+
+// JSON protocol through the fast codec (listed APIs only): append the length-prefixed response to output
+DWORD ProcessFastRequest(ClientSession* session, const JsonRequest& request, const PayloadDigest* payload, std::vector<char>& output, BufferSendInfo* send_info);
+UINT32 RequestApiId(const JsonRequest& request);
+
+// Binary protocol
+void ExecuteBinaryRequest(ClientSession* session, const winapi_message_t* request, const PayloadDigest* payload, BinaryResponseFrame* response, BufferSendInfo* send_info);
+DWORD ProcessBinaryRequest(ClientSession* session, const winapi_message_t* request, const PayloadDigest* payload, BinaryResponseFrame* response, BufferSendInfo* send_info);
+void SetBinaryError(BinaryResponseFrame* response, int32_t error_code, const char* error_msg);
+int32_t ToWinapiError(DWORD result);
+
+// Typed API implementations
+DWORD ExecuteBufferTest(ClientSession* session, const BufferTestArgs& args, winapi_buffer_test_response_t* result, BufferSendInfo* send_info, const char** error_msg);
+void ExecutePerformanceTest(const winapi_perf_test_request_t& request, winapi_perf_test_response_t* result);
+void ExecuteSharedBuffer(const std::string& operation, const std::string& file_path, UINT64 buffer_size, UINT32 buffer_id);
+DWORD ExecuteRegisterBuffers(ClientSession* session, const winapi_register_buffers_request_t& request, winapi_register_buffers_response_t* result, const char** error_msg);
+
+// Windows path of a guest /mnt/c path, other paths are returned unchanged
+std::string WindowsPath(const std::string& guest_path);
+
+// Connection control calls (JSON only)
+DWORD HandleHandshakeAPI(ClientSession* session, const Json::Value& request, Json::Value& response);
+DWORD HandleBatchAPI(ClientSession* session, const Json::Value& request, Json::Value& response);
+
+// Safe memory write near the end of shared memory (SEH on Windows)
+BOOL SafeMemoryWrite(UINT32* ptr, UINT32 value, UINT64 offset);
+
+#endif /* WINAPI_API_HANDLERS_H */
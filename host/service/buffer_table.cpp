@@ -0,0 +1,253 @@
+/*
+ * Registered buffers of one session
+ */
+
+#include "buffer_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "api_handlers.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+RegisteredBuffer::RegisteredBuffer(UINT32 backing, UINT64 size)
+    : backing(backing), size(size), data(NULL), view_size(0)
+#ifdef _WIN32
+      , file(INVALID_HANDLE_VALUE), mapping(NULL)
+#endif
+{
+}
+
+RegisteredBuffer::~RegisteredBuffer()
+{
+#ifdef _WIN32
+    if (data) {
+        UnmapViewOfFile(data);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+    }
+#else
+    if (data) {
+        munmap(data, view_size);
+    }
+#endif
+}
+
+/*
+ * Host path of a shared buffer file, FALSE unless it lies directly in the
+ * shared temp directory once canonicalised
+ */
+static BOOL SharedFilePath(const std::string& guest_path, std::string* path)
+{
+    static const std::string prefix = WINAPI_SHARED_FILE_DIR "/";
+
+    // A plain file name after the directory: no subdirectories, no way out
+    if (guest_path.compare(0, prefix.size(), prefix) != 0 || guest_path.size() == prefix.size() ||
+        guest_path.find("..") != std::string::npos || guest_path.find_first_of("/\\:", prefix.size()) != std::string::npos) {
+        return FALSE;
+    }
+
+#ifdef _WIN32
+    char full[MAX_PATH];
+    char dir[MAX_PATH];
+    DWORD full_length = GetFullPathNameA(WindowsPath(guest_path).c_str(), sizeof(full), full, NULL);
+    DWORD dir_length = GetFullPathNameA(WindowsPath(WINAPI_SHARED_FILE_DIR).c_str(), sizeof(dir), dir, NULL);
+    if (full_length == 0 || full_length >= sizeof(full) || dir_length == 0 || dir_length >= sizeof(dir) ||
+        _strnicmp(full, dir, dir_length) != 0 || full[dir_length] != '\\' || strchr(&full[dir_length + 1], '\\')) {
+        return FALSE;
+    }
+
+    // Links could lead anywhere
+    DWORD attributes = GetFileAttributesA(full);
+    if (attributes == INVALID_FILE_ATTRIBUTES ||
+        (attributes & (FILE_ATTRIBUTE_DIRECTORY | FILE_ATTRIBUTE_REPARSE_POINT))) {
+        return FALSE;
+    }
+#else
+    char full[PATH_MAX];
+    char dir[PATH_MAX];
+    if (!realpath(guest_path.c_str(), full) || !realpath(WINAPI_SHARED_FILE_DIR, dir)) {
+        return FALSE;
+    }
+    size_t dir_length = strlen(dir);
+    if (strncmp(full, dir, dir_length) != 0 || full[dir_length] != '/' || strchr(&full[dir_length + 1], '/')) {
+        return FALSE;
+    }
+#endif
+
+    *path = full;
+    return TRUE;
+}
+
+/*
+ * Whether the file carries the trailer the client writes past the data
+ */
+BOOL RegisteredBuffer::CheckTrailer(const winapi_shared_file_trailer_t& trailer) const
+{
+    return view_size >= WINAPI_SHARED_FILE_SIZE(size) && trailer.magic == WINAPI_SHARED_FILE_MAGIC &&
+           trailer.size == size;
+}
+
+/*
+ * Map the whole file, shared with the client, once it is known to be one
+ * of the client's shared buffer files
+ */
+BOOL RegisteredBuffer::Map(const std::string& guest_path)
+{
+    winapi_shared_file_trailer_t trailer;
+    std::string path;
+
+    memset(&trailer, 0, sizeof(trailer));
+    if (!SharedFilePath(guest_path, &path)) {
+        printf("[WARN] Registered buffer %s is not in %s\n", guest_path.c_str(), WINAPI_SHARED_FILE_DIR);
+        return FALSE;
+    }
+
+#ifdef _WIN32
+    LARGE_INTEGER file_size;
+    OVERLAPPED at;
+    DWORD bytes_read = 0;
+
+    file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                       FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OPEN_REPARSE_POINT, NULL);
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &file_size)) {
+        printf("[WARN] Cannot open registered buffer %s: %lu\n", path.c_str(), GetLastError());
+        return FALSE;
+    }
+    view_size = (size_t)file_size.QuadPart;
+
+    memset(&at, 0, sizeof(at));
+    at.Offset = (DWORD)WINAPI_SHARED_FILE_TRAILER(size);
+    at.OffsetHigh = (DWORD)(WINAPI_SHARED_FILE_TRAILER(size) >> 32);
+    if (view_size >= WINAPI_SHARED_FILE_SIZE(size) && !ReadFile(file, &trailer, sizeof(trailer), &bytes_read, &at)) {
+        bytes_read = 0;
+    }
+    if (bytes_read != sizeof(trailer) || !CheckTrailer(trailer)) {
+        printf("[WARN] Registered buffer %s has no shared file trailer\n", path.c_str());
+        return FALSE;
+    }
+
+    mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, 0, 0, NULL);
+    data = mapping ? (UINT8*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0) : NULL;
+#else
+    struct stat file_stat;
+
+    int fd = open(path.c_str(), O_RDWR | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0 || fstat(fd, &file_stat) < 0 || !S_ISREG(file_stat.st_mode)) {
+        printf("[WARN] Cannot open registered buffer %s: %d\n", path.c_str(), errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return FALSE;
+    }
+    view_size = (size_t)file_stat.st_size;
+
+    if (view_size < WINAPI_SHARED_FILE_SIZE(size) ||
+        pread(fd, &trailer, sizeof(trailer), (off_t)WINAPI_SHARED_FILE_TRAILER(size)) != (ssize_t)sizeof(trailer) ||
+        !CheckTrailer(trailer)) {
+        printf("[WARN] Registered buffer %s has no shared file trailer\n", path.c_str());
+        close(fd);
+        return FALSE;
+    }
+
+    void* view = mmap(NULL, view_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    data = view != MAP_FAILED ? (UINT8*)view : NULL;
+    close(fd);
+#endif
+
+    if (!data) {
+        printf("[WARN] Cannot map registered buffer %s (%zu of %llu bytes)\n",
+               path.c_str(), view_size, (unsigned long long)size);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BufferTable::BufferTable()
+{
+}
+
+/*
+ * Build the new entries first, then swap them in: a refused request leaves the table as it was
+ */
+BOOL BufferTable::Register(const winapi_register_buffers_request_t& request, const char** error_msg)
+{
+    std::shared_ptr<const RegisteredBuffer> updates[WINAPI_MAX_BUFFERS];
+
+    if (request.count > WINAPI_MAX_BUFFERS) {
+        *error_msg = "Too many buffers in one registration";
+        return FALSE;
+    }
+
+    for (UINT32 i = 0; i < request.count; i++) {
+        const winapi_registered_buffer_t& entry = request.entries[i];
+
+        if (entry.index >= WINAPI_MAX_REGISTERED_BUFFERS) {
+            *error_msg = "Registered buffer index out of range";
+            return FALSE;
+        }
+        if (entry.backing == 0) {
+            continue;
+        }
+        if ((entry.backing != WINAPI_BACKING_SOCKET && entry.backing != WINAPI_BACKING_SHARED_FILE) || entry.size == 0) {
+            *error_msg = "Invalid registered buffer";
+            return FALSE;
+        }
+
+        std::shared_ptr<RegisteredBuffer> buffer = std::make_shared<RegisteredBuffer>(entry.backing, entry.size);
+        if (entry.backing == WINAPI_BACKING_SHARED_FILE &&
+            !buffer->Map(std::string(entry.file_path, strnlen(entry.file_path, sizeof(entry.file_path))))) {
+            *error_msg = "Cannot map registered buffer";
+            return FALSE;
+        }
+        updates[i] = buffer;
+    }
+
+    // Requests still using a replaced entry keep its mapping until they finish
+    std::lock_guard<std::mutex> guard(lock);
+    if (request.flags & WINAPI_REGISTER_RESET) {
+        for (UINT32 i = 0; i < WINAPI_MAX_REGISTERED_BUFFERS; i++) {
+            entries[i].reset();
+        }
+    }
+    for (UINT32 i = 0; i < request.count; i++) {
+        entries[request.entries[i].index] = updates[i];
+    }
+    return TRUE;
+}
+
+std::shared_ptr<const RegisteredBuffer> BufferTable::Find(UINT32 index, UINT64 offset, UINT64 length) const
+{
+    if (index >= WINAPI_MAX_REGISTERED_BUFFERS) {
+        return NULL;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    const std::shared_ptr<const RegisteredBuffer>& entry = entries[index];
+    if (!entry || offset > entry->size || length > entry->size - offset) {
+        return NULL;
+    }
+    return entry;
+}
+
+UINT32 BufferTable::Count() const
+{
+    UINT32 count = 0;
+
+    std::lock_guard<std::mutex> guard(lock);
+    for (UINT32 i = 0; i < WINAPI_MAX_REGISTERED_BUFFERS; i++) {
+        count += entries[i] ? 1 : 0;
+    }
+    return count;
+}
@@ -0,0 +1,72 @@
+/*
+ * Registered buffers of one session
+ *
+ * With WINAPI_CAP_REGISTERED_BUFFERS the client describes its buffers once
+ * (register_buffers) and later requests name them by index, offset and
+ * length. A shared-file entry is mapped here when it is registered, its
+ * /mnt/c path translated once, and stays mapped until it is replaced or
+ * cleared or the session ends. The host writes to these mappings, so only
+ * shared buffer files the client made are accepted: directly in
+ * WINAPI_SHARED_FILE_DIR and ending with a trailer for the registered size.
+ * A socket entry only records the size its ranges are checked against.
+ * Registration runs on the reactor thread while buffer tests may run on
+ * the handler pool, so lookups hand out a reference that keeps an entry's
+ * mapping alive until the request is done.
+ */
+
+#ifndef WINAPI_BUFFER_TABLE_H
+#define WINAPI_BUFFER_TABLE_H
+
+#include "platform.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "../../common/protocol.h"
+
+// One table entry
+class RegisteredBuffer {
+public:
+    RegisteredBuffer(UINT32 backing, UINT64 size);
+    ~RegisteredBuffer();
+
+    // Map the client's file read/write: a shared buffer file in WINAPI_SHARED_FILE_DIR with a trailer for size bytes
+    BOOL Map(const std::string& guest_path);
+
+    const UINT32 backing;     // WINAPI_BACKING_SOCKET or WINAPI_BACKING_SHARED_FILE
+    const UINT64 size;
+    UINT8* data;              // Mapped file, NULL for socket entries
+
+private:
+    RegisteredBuffer(const RegisteredBuffer&);
+    RegisteredBuffer& operator=(const RegisteredBuffer&);
+
+    BOOL CheckTrailer(const winapi_shared_file_trailer_t& trailer) const;
+
+    size_t view_size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+class BufferTable {
+public:
+    BufferTable();
+
+    // Apply one register_buffers request, FALSE with error_msg set if an entry was refused
+    BOOL Register(const winapi_register_buffers_request_t& request, const char** error_msg);
+
+    // Entry holding [offset, offset + length) of index, NULL if there is none
+    std::shared_ptr<const RegisteredBuffer> Find(UINT32 index, UINT64 offset, UINT64 length) const;
+
+    // Entries in use
+    UINT32 Count() const;
+
+private:
+    mutable std::mutex lock;
+    std::shared_ptr<const RegisteredBuffer> entries[WINAPI_MAX_REGISTERED_BUFFERS];
+};
+
+#endif /* WINAPI_BUFFER_TABLE_H */
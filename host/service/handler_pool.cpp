@@ -0,0 +1,142 @@
+/*
+ * Work-stealing pool for API handlers
+ */
+
+#include "handler_pool.h"
+
+#include <stdio.h>
+
+#define MAX_HANDLER_THREADS     64
+
+HandlerPool::HandlerPool() : reactor(NULL), next_queue(0), queued(0), stopping(FALSE)
+{
+}
+
+HandlerPool::~HandlerPool()
+{
+    Shutdown();
+}
+
+BOOL HandlerPool::Start(unsigned worker_count, Reactor* reactor)
+{
+    this->reactor = reactor;
+
+    if (worker_count == 0) {
+        worker_count = std::thread::hardware_concurrency();
+    }
+    if (worker_count == 0) {
+        worker_count = 1;
+    }
+    if (worker_count > MAX_HANDLER_THREADS) {
+        worker_count = MAX_HANDLER_THREADS;
+    }
+
+    for (unsigned i = 0; i < worker_count; i++) {
+        queues.push_back(new WorkerQueue());
+    }
+
+    try {
+        for (unsigned i = 0; i < worker_count; i++) {
+            workers.push_back(std::thread(&HandlerPool::WorkerLoop, this, i));
+        }
+    } catch (const std::exception& e) {
+        printf("[ERROR] Failed to start handler workers: %s\n", e.what());
+        Shutdown();
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+unsigned HandlerPool::WorkerCount() const
+{
+    return (unsigned)queues.size();
+}
+
+void HandlerPool::Submit(HandlerTask* task)
+{
+    WorkerQueue* queue = queues[next_queue++ % queues.size()];
+
+    {
+        std::lock_guard<std::mutex> guard(queue->lock);
+        queue->tasks.push_back(task);
+    }
+    queued++;
+
+    // Taking the lock orders the count update before a worker's idle check
+    {
+        std::lock_guard<std::mutex> guard(idle_lock);
+    }
+    idle_wakeup.notify_one();
+}
+
+void HandlerPool::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> guard(idle_lock);
+        stopping = TRUE;
+    }
+    idle_wakeup.notify_all();
+
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+    workers.clear();
+
+    for (size_t i = 0; i < queues.size(); i++) {
+        delete queues[i];
+    }
+    queues.clear();
+}
+
+/*
+ * Worker: run own tasks oldest first, steal when out of work, sleep when nothing is queued
+ */
+void HandlerPool::WorkerLoop(unsigned index)
+{
+    for (;;) {
+        HandlerTask* task = TakeTask(index);
+        if (task) {
+            task->Execute();
+            reactor->Post(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(idle_lock);
+        idle_wakeup.wait(guard, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
+
+HandlerTask* HandlerPool::TakeTask(unsigned index)
+{
+    size_t count = queues.size();
+
+    for (size_t i = 0; i < count; i++) {
+        WorkerQueue* queue = queues[(index + i) % count];
+        HandlerTask* task = NULL;
+
+        {
+            std::lock_guard<std::mutex> guard(queue->lock);
+            if (!queue->tasks.empty()) {
+                // Own queue from the front, victims from the back
+                if (i == 0) {
+                    task = queue->tasks.front();
+                    queue->tasks.pop_front();
+                } else {
+                    task = queue->tasks.back();
+                    queue->tasks.pop_back();
+                }
+            }
+        }
+
+        if (task) {
+            queued--;
+            return task;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,64 @@
+/*
+ * Work-stealing pool for API handlers
+ *
+ * The reactor thread decodes requests and hands expensive ones (checksums
+ * over large payloads, shared memory fills) to a small set of compute
+ * workers, so a long handler never holds up I/O for other requests.
+ * Each worker owns a queue; submissions are spread round-robin and an idle
+ * worker steals from the back of its neighbours' queues. Finished tasks
+ * are posted back to the reactor, which sends the responses.
+ */
+
+#ifndef WINAPI_HANDLER_POOL_H
+#define WINAPI_HANDLER_POOL_H
+
+#include "platform.h"
+#include "reactor.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Request executed on a worker, then completed on the reactor thread (ReactorTask::Run)
+class HandlerTask : public ReactorTask {
+public:
+    virtual void Execute() = 0;
+};
+
+class HandlerPool {
+public:
+    HandlerPool();
+    ~HandlerPool();
+
+    // Start worker_count workers (0 for one per CPU) posting completions to reactor
+    BOOL Start(unsigned worker_count, Reactor* reactor);
+    unsigned WorkerCount() const;
+
+    void Submit(HandlerTask* task);
+
+    // Run every queued task, then stop the workers
+    void Shutdown();
+
+private:
+    struct WorkerQueue {
+        std::mutex lock;
+        std::deque<HandlerTask*> tasks;
+    };
+
+    void WorkerLoop(unsigned index);
+    HandlerTask* TakeTask(unsigned index);
+
+    Reactor* reactor;
+    std::vector<WorkerQueue*> queues;
+    std::vector<std::thread> workers;
+    std::atomic<unsigned> next_queue;
+    std::atomic<size_t> queued;
+    std::mutex idle_lock;
+    std::condition_variable idle_wakeup;
+    BOOL stopping;
+};
+
+#endif /* WINAPI_HANDLER_POOL_H */
@@ -0,0 +1,775 @@
+/*
+ * Allocation-free JSON codec for the request hot path
+ */
+
+#include "json_codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <memory>
+
+/*
+ * Codec mode from WINAPI_JSON_CODEC ("fast", "jsoncpp" or "verify")
+ */
+static JsonCodecMode ReadJsonCodecMode()
+{
+    const char* mode = getenv("WINAPI_JSON_CODEC");
+
+    if (mode && strcmp(mode, "jsoncpp") == 0) {
+        printf("[INFO] JSON codec: jsoncpp only\n");
+        return JSON_CODEC_JSONCPP;
+    }
+    if (mode && strcmp(mode, "verify") == 0) {
+        printf("[INFO] JSON codec: fast path verified against jsoncpp\n");
+        return JSON_CODEC_VERIFY;
+    }
+    return JSON_CODEC_FAST;
+}
+
+JsonCodecMode GetJsonCodecMode()
+{
+    static const JsonCodecMode mode = ReadJsonCodecMode();
+    return mode;
+}
+
+JsonScalar::JsonScalar()
+    : type(JSON_FAST_NULL), number(0), string(NULL), length(0)
+{
+}
+
+JsonScalar::JsonScalar(int value)
+    : type(value < 0 ? JSON_FAST_INT : JSON_FAST_UINT), number(value < 0 ? 0 - (UINT64)(long long)value : (UINT64)value),
+      string(NULL), length(0)
+{
+}
+
+JsonScalar::JsonScalar(unsigned value)
+    : type(JSON_FAST_UINT), number(value), string(NULL), length(0)
+{
+}
+
+JsonScalar::JsonScalar(bool value)
+    : type(JSON_FAST_BOOL), number(value ? 1 : 0), string(NULL), length(0)
+{
+}
+
+JsonScalar::JsonScalar(const char* value)
+    : type(JSON_FAST_STRING), number(0), string(value), length(strlen(value))
+{
+}
+
+bool JsonScalar::isInt() const
+{
+    if (type == JSON_FAST_INT) {
+        return number <= (UINT64)INT_MAX + 1;
+    }
+    return type == JSON_FAST_UINT && number <= (UINT64)INT_MAX;
+}
+
+bool JsonScalar::isUInt() const
+{
+    return type == JSON_FAST_UINT && number <= UINT_MAX;
+}
+
+int JsonScalar::asInt() const
+{
+    switch (type) {
+        case JSON_FAST_INT:
+            if (!isInt()) {
+                Json::throwLogicError("LargestInt out of Int range");
+            }
+            return (int)(0 - (long long)(number - 1) - 1);
+        case JSON_FAST_UINT:
+            if (!isInt()) {
+                Json::throwLogicError(number <= (UINT64)LLONG_MAX ? "LargestInt out of Int range" : "LargestUInt out of Int range");
+            }
+            return (int)number;
+        case JSON_FAST_BOOL:
+            return (int)number;
+        case JSON_FAST_NULL:
+            return 0;
+        default:
+            Json::throwLogicError("Value is not convertible to Int.");
+    }
+}
+
+unsigned JsonScalar::asUInt() const
+{
+    switch (type) {
+        case JSON_FAST_INT:
+            Json::throwLogicError("LargestInt out of UInt range");
+        case JSON_FAST_UINT:
+            if (!isUInt()) {
+                Json::throwLogicError(number <= (UINT64)LLONG_MAX ? "LargestInt out of UInt range" : "LargestUInt out of UInt range");
+            }
+            return (unsigned)number;
+        case JSON_FAST_BOOL:
+            return (unsigned)number;
+        case JSON_FAST_NULL:
+            return 0;
+        default:
+            Json::throwLogicError("Value is not convertible to UInt.");
+    }
+}
+
+UINT64 JsonScalar::asUInt64() const
+{
+    switch (type) {
+        case JSON_FAST_INT:
+            Json::throwLogicError("LargestInt out of UInt64 range");
+        case JSON_FAST_UINT:
+        case JSON_FAST_BOOL:
+            return number;
+        case JSON_FAST_NULL:
+            return 0;
+        default:
+            Json::throwLogicError("Value is not convertible to UInt64.");
+    }
+}
+
+bool JsonScalar::asBool() const
+{
+    switch (type) {
+        case JSON_FAST_INT:
+        case JSON_FAST_UINT:
+        case JSON_FAST_BOOL:
+            return number != 0;
+        case JSON_FAST_NULL:
+            return false;
+        default:
+            Json::throwLogicError("Value is not convertible to bool.");
+    }
+}
+
+std::string JsonScalar::asString() const
+{
+    char digits[24];
+
+    switch (type) {
+        case JSON_FAST_STRING:
+            return std::string(string, length);
+        case JSON_FAST_INT:
+            snprintf(digits, sizeof(digits), "-%llu", (unsigned long long)number);
+            return digits;
+        case JSON_FAST_UINT:
+            snprintf(digits, sizeof(digits), "%llu", (unsigned long long)number);
+            return digits;
+        case JSON_FAST_BOOL:
+            return number ? "true" : "false";
+        default:
+            return "";
+    }
+}
+
+bool JsonScalar::getString(const char** begin, const char** end) const
+{
+    if (type != JSON_FAST_STRING) {
+        return false;
+    }
+    *begin = string;
+    *end = string + length;
+    return true;
+}
+
+bool JsonScalar::operator==(const char* other) const
+{
+    return type == JSON_FAST_STRING && strlen(other) == length && memcmp(string, other, length) == 0;
+}
+
+/*
+ * Same value as jsoncpp parses it: integers that fit Int64 are intValue, larger ones uintValue
+ */
+Json::Value JsonScalar::ToJson() const
+{
+    switch (type) {
+        case JSON_FAST_INT:
+            return Json::Value((Json::Int64)(0 - (long long)(number - 1) - 1));
+        case JSON_FAST_UINT:
+            if (number <= (UINT64)LLONG_MAX) {
+                return Json::Value((Json::Int64)number);
+            }
+            return Json::Value((Json::UInt64)number);
+        case JSON_FAST_BOOL:
+            return Json::Value(number != 0);
+        case JSON_FAST_STRING:
+            return Json::Value(string, string + length);
+        default:
+            return Json::Value();
+    }
+}
+
+JsonRequest::JsonRequest()
+    : member_count(0), text_size(0)
+{
+}
+
+JsonRequest::JsonRequest(const JsonRequest& other)
+    : member_count(0), text_size(0)
+{
+    *this = other;
+}
+
+/*
+ * Copy only the members and text in use
+ */
+JsonRequest& JsonRequest::operator=(const JsonRequest& other)
+{
+    member_count = other.member_count;
+    text_size = other.text_size;
+    memcpy(members, other.members, member_count * sizeof(Member));
+    memcpy(text, other.text, text_size);
+    return *this;
+}
+
+static BOOL IsJsonSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/*
+ * Plain string at *pos (after the opening quote): printable ASCII, no escapes
+ */
+static BOOL ScanJsonString(const char* json, size_t length, size_t* pos, const char** begin, size_t* size)
+{
+    size_t start = *pos;
+
+    while (*pos < length && json[*pos] != '"') {
+        unsigned char c = (unsigned char)json[*pos];
+        if (c < 0x20 || c >= 0x80 || c == '\\') {
+            return FALSE;
+        }
+        (*pos)++;
+    }
+    if (*pos == length) {
+        return FALSE;
+    }
+
+    *begin = &json[start];
+    *size = *pos - start;
+    (*pos)++;
+    return TRUE;
+}
+
+/*
+ * Integer at *pos, FALSE for fractions, exponents and values beyond 64 bits
+ */
+static BOOL ScanJsonInteger(const char* json, size_t length, size_t* pos, BOOL* negative, UINT64* magnitude)
+{
+    UINT64 limit;
+    size_t digits = 0;
+
+    *negative = json[*pos] == '-';
+    if (*negative) {
+        (*pos)++;
+    }
+    limit = *negative ? (UINT64)LLONG_MAX + 1 : ULLONG_MAX;
+
+    *magnitude = 0;
+    while (*pos < length && json[*pos] >= '0' && json[*pos] <= '9') {
+        UINT64 digit = (UINT64)(json[*pos] - '0');
+        if (*magnitude > (limit - digit) / 10) {
+            return FALSE;
+        }
+        *magnitude = *magnitude * 10 + digit;
+        (*pos)++;
+        digits++;
+    }
+
+    // jsoncpp reads '.', 'e' and friends as part of the number; leave those to it
+    if (digits == 0 || (*pos < length && !IsJsonSpace(json[*pos]) && json[*pos] != ',' && json[*pos] != '}')) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Literal (true, false, null) at *pos
+ */
+static BOOL ScanJsonLiteral(const char* json, size_t length, size_t* pos, const char* literal)
+{
+    size_t size = strlen(literal);
+
+    if (length - *pos < size || memcmp(&json[*pos], literal, size) != 0) {
+        return FALSE;
+    }
+    *pos += size;
+    return *pos == length || IsJsonSpace(json[*pos]) || json[*pos] == ',' || json[*pos] == '}';
+}
+
+BOOL JsonRequest::AddText(const char* data, size_t length, UINT32* offset)
+{
+    if (length > sizeof(text) - text_size) {
+        return FALSE;
+    }
+    memcpy(&text[text_size], data, length);
+    *offset = (UINT32)text_size;
+    text_size += length;
+    return TRUE;
+}
+
+/*
+ * Scan a flat request object
+ */
+BOOL JsonRequest::Parse(const char* json, size_t length)
+{
+    size_t pos = 0;
+
+    member_count = 0;
+    text_size = 0;
+
+    while (pos < length && IsJsonSpace(json[pos])) {
+        pos++;
+    }
+    if (pos == length || json[pos] != '{') {
+        return FALSE;
+    }
+    pos++;
+
+    for (;;) {
+        while (pos < length && IsJsonSpace(json[pos])) {
+            pos++;
+        }
+        if (pos == length) {
+            return FALSE;
+        }
+
+        // Closing brace right after the opening one or a member, never after a comma
+        if (json[pos] == '}') {
+            if (member_count != 0) {
+                return FALSE;
+            }
+            break;
+        }
+
+        if (json[pos] != '"' || member_count == JSON_FAST_MAX_MEMBERS) {
+            return FALSE;
+        }
+        pos++;
+
+        Member* member = &members[member_count];
+        const char* key;
+        size_t key_length;
+        if (!ScanJsonString(json, length, &pos, &key, &key_length) ||
+            !AddText(key, key_length, &member->key_offset)) {
+            return FALSE;
+        }
+        member->key_length = (UINT32)key_length;
+
+        while (pos < length && IsJsonSpace(json[pos])) {
+            pos++;
+        }
+        if (pos == length || json[pos] != ':') {
+            return FALSE;
+        }
+        pos++;
+        while (pos < length && IsJsonSpace(json[pos])) {
+            pos++;
+        }
+        if (pos == length) {
+            return FALSE;
+        }
+
+        member->number = 0;
+        member->text_offset = 0;
+        member->text_length = 0;
+
+        char c = json[pos];
+        if (c == '"') {
+            const char* value;
+            size_t value_length;
+            pos++;
+            if (!ScanJsonString(json, length, &pos, &value, &value_length) ||
+                !AddText(value, value_length, &member->text_offset)) {
+                return FALSE;
+            }
+            member->type = JSON_FAST_STRING;
+            member->text_length = (UINT32)value_length;
+        } else if (c == '-' || (c >= '0' && c <= '9')) {
+            BOOL negative;
+            if (!ScanJsonInteger(json, length, &pos, &negative, &member->number)) {
+                return FALSE;
+            }
+            member->type = negative && member->number != 0 ? JSON_FAST_INT : JSON_FAST_UINT;
+        } else if (c == 't' || c == 'f') {
+            if (!ScanJsonLiteral(json, length, &pos, c == 't' ? "true" : "false")) {
+                return FALSE;
+            }
+            member->type = JSON_FAST_BOOL;
+            member->number = c == 't' ? 1 : 0;
+        } else if (c == 'n') {
+            if (!ScanJsonLiteral(json, length, &pos, "null")) {
+                return FALSE;
+            }
+            member->type = JSON_FAST_NULL;
+        } else {
+            // Objects, arrays, comments
+            return FALSE;
+        }
+        member_count++;
+
+        while (pos < length && IsJsonSpace(json[pos])) {
+            pos++;
+        }
+        if (pos == length) {
+            return FALSE;
+        }
+        if (json[pos] == '}') {
+            break;
+        }
+        if (json[pos] != ',') {
+            return FALSE;
+        }
+        pos++;
+    }
+
+    // Only whitespace may follow (jsoncpp ignores anything, leave that to it)
+    for (pos++; pos < length; pos++) {
+        if (!IsJsonSpace(json[pos])) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+JsonScalar JsonRequest::Value(const Member& member) const
+{
+    JsonScalar value;
+
+    value.type = member.type;
+    value.number = member.number;
+    if (member.type == JSON_FAST_STRING) {
+        value.string = &text[member.text_offset];
+        value.length = member.text_length;
+    }
+    return value;
+}
+
+/*
+ * Member by key; the last one wins like in jsoncpp
+ */
+const JsonRequest::Member* JsonRequest::Find(const char* key) const
+{
+    size_t key_length = strlen(key);
+
+    for (UINT32 i = member_count; i > 0; i--) {
+        const Member* member = &members[i - 1];
+        if (member->key_length == key_length && memcmp(&text[member->key_offset], key, key_length) == 0) {
+            return member;
+        }
+    }
+    return NULL;
+}
+
+JsonScalar JsonRequest::get(const char* key, const JsonScalar& default_value) const
+{
+    const Member* member = Find(key);
+    return member ? Value(*member) : default_value;
+}
+
+JsonScalar JsonRequest::operator[](const char* key) const
+{
+    const Member* member = Find(key);
+    return member ? Value(*member) : JsonScalar();
+}
+
+Json::Value JsonRequest::ToJson() const
+{
+    Json::Value json(Json::objectValue);
+
+    for (UINT32 i = 0; i < member_count; i++) {
+        const Member& member = members[i];
+        json[std::string(&text[member.key_offset], member.key_length)] = Value(member).ToJson();
+    }
+    return json;
+}
+
+JsonResponse::JsonResponse()
+{
+    Clear();
+}
+
+void JsonResponse::Clear()
+{
+    node_count = 0;
+    text_size = 0;
+    overflow = FALSE;
+    AddNode(NULL);
+}
+
+int JsonResponse::AddNode(const char* key)
+{
+    if (node_count == JSON_FAST_MAX_NODES) {
+        overflow = TRUE;
+        return -1;
+    }
+
+    Node* node = &nodes[node_count];
+    node->key = key;
+    node->type = JSON_FAST_NULL;
+    node->number = 0;
+    node->text_offset = 0;
+    node->text_length = 0;
+    node->first_child = -1;
+    node->last_child = -1;
+    node->next_sibling = -1;
+    return node_count++;
+}
+
+JsonResponseValue JsonResponseValue::operator[](const char* key)
+{
+    if (node < 0) {
+        return *this;
+    }
+
+    JsonResponse::Node* value = &document->nodes[node];
+    if (value->type == JSON_FAST_NULL) {
+        value->type = JSON_FAST_OBJECT;
+    } else if (value->type != JSON_FAST_OBJECT) {
+        Json::throwLogicError("in Json::Value::resolveReference(): requires objectValue");
+    }
+
+    for (int child = value->first_child; child >= 0; child = document->nodes[child].next_sibling) {
+        if (strcmp(document->nodes[child].key, key) == 0) {
+            return JsonResponseValue(document, child);
+        }
+    }
+
+    int child = document->AddNode(key);
+    if (child >= 0) {
+        value = &document->nodes[node];
+        if (value->last_child >= 0) {
+            document->nodes[value->last_child].next_sibling = child;
+        } else {
+            value->first_child = child;
+        }
+        value->last_child = child;
+    }
+    return JsonResponseValue(document, child);
+}
+
+void JsonResponseValue::SetNumber(JsonFastType type, UINT64 number)
+{
+    if (node < 0) {
+        return;
+    }
+    JsonResponse::Node* value = &document->nodes[node];
+    value->type = type;
+    value->number = number;
+    value->first_child = value->last_child = -1;
+}
+
+void JsonResponseValue::SetBool(bool value)
+{
+    SetNumber(JSON_FAST_BOOL, value ? 1 : 0);
+}
+
+void JsonResponseValue::SetString(const char* begin, const char* end)
+{
+    size_t length = end - begin;
+
+    if (node < 0) {
+        return;
+    }
+    if (length > sizeof(document->text) - document->text_size) {
+        document->overflow = TRUE;
+        return;
+    }
+
+    JsonResponse::Node* value = &document->nodes[node];
+    memcpy(&document->text[document->text_size], begin, length);
+    value->type = JSON_FAST_STRING;
+    value->text_offset = (UINT32)document->text_size;
+    value->text_length = (UINT32)length;
+    value->first_child = value->last_child = -1;
+    document->text_size += length;
+}
+
+JsonResponseValue& JsonResponseValue::operator=(const char* value)
+{
+    SetString(value, value + strlen(value));
+    return *this;
+}
+
+JsonResponseValue& JsonResponseValue::operator=(const std::string& value)
+{
+    SetString(value.data(), value.data() + value.size());
+    return *this;
+}
+
+static void AppendText(std::vector<char>& output, const char* text, size_t length)
+{
+    output.insert(output.end(), text, text + length);
+}
+
+static void AppendIndent(std::vector<char>& output, int depth)
+{
+    output.push_back('\n');
+    output.insert(output.end(), (size_t)depth, '\t');
+}
+
+/*
+ * Quoted string escaped like jsoncpp's valueToQuotedStringN (fast path strings are ASCII)
+ */
+static void AppendQuoted(std::vector<char>& output, const char* text, size_t length)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    output.push_back('"');
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)text[i];
+        switch (c) {
+            case '"':  AppendText(output, "\\\"", 2); break;
+            case '\\': AppendText(output, "\\\\", 2); break;
+            case '\b': AppendText(output, "\\b", 2); break;
+            case '\f': AppendText(output, "\\f", 2); break;
+            case '\n': AppendText(output, "\\n", 2); break;
+            case '\r': AppendText(output, "\\r", 2); break;
+            case '\t': AppendText(output, "\\t", 2); break;
+            default:
+                if (c < 0x20) {
+                    char escape[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+                    AppendText(output, escape, sizeof(escape));
+                } else {
+                    output.push_back((char)c);
+                }
+        }
+    }
+    output.push_back('"');
+}
+
+/*
+ * One value at indentation depth, laid out like jsoncpp's BuiltStyledStreamWriter
+ */
+void JsonResponse::WriteNode(int index, int depth, std::vector<char>& output) const
+{
+    const Node& node = nodes[index];
+    char digits[24];
+    int length;
+
+    switch (node.type) {
+        case JSON_FAST_NULL:
+            AppendText(output, "null", 4);
+            break;
+        case JSON_FAST_BOOL:
+            node.number ? AppendText(output, "true", 4) : AppendText(output, "false", 5);
+            break;
+        case JSON_FAST_INT:
+        case JSON_FAST_UINT:
+            length = snprintf(digits, sizeof(digits), node.type == JSON_FAST_INT ? "-%llu" : "%llu",
+                              (unsigned long long)node.number);
+            AppendText(output, digits, (size_t)length);
+            break;
+        case JSON_FAST_STRING:
+            AppendQuoted(output, &text[node.text_offset], node.text_length);
+            break;
+        case JSON_FAST_OBJECT: {
+            if (node.first_child < 0) {
+                AppendText(output, "{}", 2);
+                break;
+            }
+
+            // Members in std::map order, as jsoncpp keeps them
+            int sorted[JSON_FAST_MAX_NODES];
+            int count = 0;
+            for (int child = node.first_child; child >= 0; child = nodes[child].next_sibling) {
+                int i = count++;
+                while (i > 0 && strcmp(nodes[sorted[i - 1]].key, nodes[child].key) > 0) {
+                    sorted[i] = sorted[i - 1];
+                    i--;
+                }
+                sorted[i] = child;
+            }
+
+            // A nested object starts on its own line, the root right away
+            if (depth > 0) {
+                AppendIndent(output, depth);
+            }
+            output.push_back('{');
+            for (int i = 0; i < count; i++) {
+                const char* key = nodes[sorted[i]].key;
+                AppendIndent(output, depth + 1);
+                AppendQuoted(output, key, strlen(key));
+                AppendText(output, " : ", 3);
+                WriteNode(sorted[i], depth + 1, output);
+                if (i + 1 < count) {
+                    output.push_back(',');
+                }
+            }
+            AppendIndent(output, depth);
+            output.push_back('}');
+            break;
+        }
+    }
+}
+
+BOOL JsonResponse::Write(std::vector<char>& output) const
+{
+    if (overflow) {
+        return FALSE;
+    }
+    WriteNode(0, 0, output);
+    return TRUE;
+}
+
+Json::Value JsonResponse::NodeToJson(int index) const
+{
+    const Node& node = nodes[index];
+
+    switch (node.type) {
+        case JSON_FAST_INT:
+            return Json::Value((Json::Int64)(0 - (long long)(node.number - 1) - 1));
+        case JSON_FAST_UINT:
+            return Json::Value((Json::UInt64)node.number);
+        case JSON_FAST_BOOL:
+            return Json::Value(node.number != 0);
+        case JSON_FAST_STRING:
+            return Json::Value(&text[node.text_offset], &text[node.text_offset] + node.text_length);
+        case JSON_FAST_OBJECT: {
+            Json::Value json(Json::objectValue);
+            for (int child = node.first_child; child >= 0; child = nodes[child].next_sibling) {
+                json[nodes[child].key] = NodeToJson(child);
+            }
+            return json;
+        }
+        default:
+            return Json::Value();
+    }
+}
+
+Json::Value JsonResponse::ToJson() const
+{
+    return NodeToJson(0);
+}
+
+/*
+ * Parse the frame with jsoncpp too and compare the values
+ */
+BOOL VerifyJsonRequest(const JsonRequest& request, const char* json, size_t length)
+{
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    Json::Value expected;
+
+    if (!reader->parse(json, json + length, &expected, NULL) || !(request.ToJson() == expected)) {
+        printf("[ERROR] JSON codec mismatch on request: %.*s\n", (int)length, json);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Write the response with jsoncpp too and compare the bytes from offset on
+ */
+void VerifyJsonResponse(const JsonResponse& response, std::vector<char>& output, size_t offset)
+{
+    Json::StreamWriterBuilder builder;
+    std::string expected = Json::writeString(builder, response.ToJson());
+
+    if (output.size() - offset != expected.size() || memcmp(&output[offset], expected.data(), expected.size()) != 0) {
+        printf("[ERROR] JSON codec mismatch on response: %.*s\n", (int)(output.size() - offset), &output[offset]);
+        output.resize(offset);
+        output.insert(output.end(), expected.begin(), expected.end());
+    }
+}
@@ -0,0 +1,204 @@
+/*
+ * Allocation-free JSON codec for the request hot path
+ *
+ * JsonRequest pulls the members of a flat request object straight from the
+ * frame bytes into fixed storage; JsonResponse is a small fixed-size
+ * document that is written out in exactly the format of jsoncpp's default
+ * StreamWriterBuilder (members sorted, tab indentation). Both mirror the
+ * subset of the Json::Value interface the API handlers use, so the same
+ * decode and encode hooks serve either codec.
+ *
+ * Anything beyond flat objects of integers, booleans, null and plain ASCII
+ * strings (nesting, escapes, fractions, comments) is left to jsoncpp:
+ * JsonRequest::Parse() fails and the caller parses the frame the usual way.
+ * WINAPI_JSON_CODEC=jsoncpp turns the fast path off, =verify runs jsoncpp
+ * next to it and reports any request or response they disagree on.
+ */
+
+#ifndef WINAPI_JSON_CODEC_H
+#define WINAPI_JSON_CODEC_H
+
+#include "platform.h"
+
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <json/json.h>
+
+#define JSON_FAST_MAX_MEMBERS   16       // Members of a fast request, and of each response object
+#define JSON_FAST_MAX_NODES     32       // Values of a fast response
+#define JSON_FAST_TEXT_SIZE     2048     // Key and string bytes of a fast request or response
+
+enum JsonCodecMode {
+    JSON_CODEC_FAST,        // Fast path, jsoncpp for what it does not handle
+    JSON_CODEC_JSONCPP,     // jsoncpp only
+    JSON_CODEC_VERIFY       // Fast path checked against jsoncpp
+};
+
+// Mode picked from WINAPI_JSON_CODEC on first use
+JsonCodecMode GetJsonCodecMode();
+
+enum JsonFastType {
+    JSON_FAST_NULL,
+    JSON_FAST_INT,          // Negative
+    JSON_FAST_UINT,         // Zero or positive
+    JSON_FAST_BOOL,
+    JSON_FAST_STRING,
+    JSON_FAST_OBJECT        // Responses only
+};
+
+// Scalar member of a JsonRequest, converted the way Json::Value converts
+class JsonScalar {
+public:
+    JsonScalar();
+    JsonScalar(int value);
+    JsonScalar(unsigned value);
+    JsonScalar(bool value);
+    JsonScalar(const char* value);
+
+    bool isNull() const { return type == JSON_FAST_NULL; }
+    bool isBool() const { return type == JSON_FAST_BOOL; }
+    bool isString() const { return type == JSON_FAST_STRING; }
+    bool isInt() const;
+    bool isUInt() const;
+
+    // Throw Json::LogicError where jsoncpp would
+    int asInt() const;
+    unsigned asUInt() const;
+    UINT64 asUInt64() const;
+    bool asBool() const;
+    std::string asString() const;
+
+    bool getString(const char** begin, const char** end) const;
+    bool operator==(const char* other) const;
+
+    Json::Value ToJson() const;
+
+private:
+    friend class JsonRequest;
+
+    JsonFastType type;      // NULL, INT, UINT, BOOL or STRING
+    UINT64 number;          // Magnitude of INT, value of UINT and BOOL
+    const char* string;
+    size_t length;
+};
+
+// Flat request object scanned from the frame; strings are copied, the frame may go
+class JsonRequest {
+public:
+    JsonRequest();
+    JsonRequest(const JsonRequest& other);
+    JsonRequest& operator=(const JsonRequest& other);
+
+    // FALSE for anything but a flat object the fast path can represent exactly
+    BOOL Parse(const char* json, size_t length);
+
+    bool isObject() const { return true; }
+    JsonScalar get(const char* key, const JsonScalar& default_value) const;
+    JsonScalar operator[](const char* key) const;
+
+    Json::Value ToJson() const;
+
+private:
+    struct Member {
+        UINT32 key_offset;       // Into text
+        UINT32 key_length;
+        JsonFastType type;
+        UINT64 number;
+        UINT32 text_offset;      // String value
+        UINT32 text_length;
+    };
+
+    JsonScalar Value(const Member& member) const;
+    const Member* Find(const char* key) const;
+    BOOL AddText(const char* data, size_t length, UINT32* offset);
+
+    Member members[JSON_FAST_MAX_MEMBERS];
+    UINT32 member_count;
+    char text[JSON_FAST_TEXT_SIZE];
+    size_t text_size;
+};
+
+class JsonResponse;
+
+// Value of a JsonResponse, assigned like a Json::Value
+class JsonResponseValue {
+public:
+    JsonResponseValue(JsonResponse* document, int node) : document(document), node(node) {}
+
+    // Member by key, added (and this value made an object) if missing
+    JsonResponseValue operator[](const char* key);
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value, JsonResponseValue&>::type operator=(T value)
+    {
+        if (std::is_same<T, bool>::value) {
+            SetBool(value != 0);
+        } else if (std::is_signed<T>::value && (long long)value < 0) {
+            SetNumber(JSON_FAST_INT, 0 - (UINT64)(long long)value);
+        } else {
+            SetNumber(JSON_FAST_UINT, (UINT64)value);
+        }
+        return *this;
+    }
+    JsonResponseValue& operator=(const char* value);
+    JsonResponseValue& operator=(const std::string& value);
+
+    void SetString(const char* begin, const char* end);
+
+private:
+    void SetBool(bool value);
+    void SetNumber(JsonFastType type, UINT64 number);
+
+    JsonResponse* document;
+    int node;
+};
+
+// Fixed-size response document; key strings must outlive it, string values are copied
+class JsonResponse {
+public:
+    JsonResponse();
+
+    JsonResponseValue Root() { return JsonResponseValue(this, 0); }
+    JsonResponseValue operator[](const char* key) { return Root()[key]; }
+
+    // Reset to an empty document
+    void Clear();
+
+    // Append the document as jsoncpp would write it; FALSE if it did not fit the fixed storage
+    BOOL Write(std::vector<char>& output) const;
+
+    Json::Value ToJson() const;
+
+private:
+    friend class JsonResponseValue;
+
+    struct Node {
+        const char* key;
+        JsonFastType type;
+        UINT64 number;
+        UINT32 text_offset;
+        UINT32 text_length;
+        int first_child;
+        int last_child;
+        int next_sibling;
+    };
+
+    int AddNode(const char* key);
+    void WriteNode(int index, int depth, std::vector<char>& output) const;
+    Json::Value NodeToJson(int index) const;
+
+    Node nodes[JSON_FAST_MAX_NODES];
+    int node_count;
+    char text[JSON_FAST_TEXT_SIZE];
+    size_t text_size;
+    BOOL overflow;          // A value did not fit, the document is incomplete
+};
+
+// Check a fast parse against jsoncpp (verify mode)
+BOOL VerifyJsonRequest(const JsonRequest& request, const char* json, size_t length);
+
+// Check a written response against jsoncpp (verify mode); on a mismatch the output is replaced by jsoncpp's
+void VerifyJsonResponse(const JsonResponse& response, std::vector<char>& output, size_t offset);
+
+#endif /* WINAPI_JSON_CODEC_H */
@@ -10,9 +10,7 @@
 #define WIN32_LEAN_AND_MEAN
 #endif
 
-#include <windows.h>
-#include <winsock2.h>
-#include <ws2tcpip.h>
+#include "platform.h"
 #include <hvsocket.h>
 #include <guiddef.h>
 #include <stdio.h>
@@ -30,6 +28,8 @@
 #endif
 
 #include "../../common/protocol.h"
+#include "api_handlers.h"
+#include "session.h"
 
 // AF_VSOCK definition for Windows (may not be available on all versions)
 #ifndef AF_VSOCK
@@ -59,34 +59,12 @@ struct sockaddr_vm {
 #define TCP_SOCKET_PORT         4660               // TCP fallback port
 #define SHARED_MEMORY_NAME      L"WinApiSharedMemory"
 #define SHARED_MEMORY_SIZE      (32 * 1024 * 1024) // 32MB
-#define MAX_CLIENTS             16
-
-// Shared Memory Layout
-#define HEADER_SIZE             4096
-#define REQUEST_BUFFER_SIZE     (15 * 1024 * 1024) // 15MB
-#define RESPONSE_BUFFER_SIZE    (15 * 1024 * 1024) // 15MB
-
-// SafeMemoryWrite boundary - switch to safe writes this far from buffer end
-#define SAFE_WRITE_BOUNDARY     (32 * 1024)  // 32KB before buffer end
-#define SAFE_WRITE_OFFSET       (RESPONSE_BUFFER_SIZE - SAFE_WRITE_BOUNDARY)
+#define MAX_CLIENTS             16                 // Listen backlog and default session limit
+#define MAX_SESSIONS_LIMIT      4096               // Upper bound for --max-sessions
 
 // Magic values
-#define WINAPI_MAGIC            0x57494E41  // "WINA"
 #define PROTOCOL_VERSION        1
 
-// Shared memory header structure
-struct shared_memory_header {
-    UINT32 magic;
-    UINT32 version;
-    UINT32 request_count;
-    UINT32 flags;
-    UINT64 request_offset;
-    UINT64 response_offset;
-    UINT32 request_size;
-    UINT32 response_size;
-    UINT32 reserved[12];
-};
-
 // Global state
 struct service_context {
     SOCKET listen_socket;
@@ -94,14 +72,18 @@ struct service_context {
     BOOL using_tcp;            // TRUE if using TCP fallback
     HANDLE shared_memory_handle;
     LPVOID shared_memory_view;
-    struct shared_memory_header *header;
+    winapi_shm_header_t *header;
     LPVOID request_buffer;
     LPVOID response_buffer;
     HANDLE stop_event;
     BOOL running;
+    LONG max_sessions;         // Concurrent client session limit
+    unsigned handler_threads;  // Handler pool size, 0 for one per CPU
 };
 
 static struct service_context g_ctx = {0};
+static SessionServer g_server;
+
 static SERVICE_STATUS_HANDLE g_service_status_handle = NULL;
 static SERVICE_STATUS g_service_status = {0};
 static BOOL g_force_tcp = TRUE;  // Default to TCP mode
@@ -112,33 +94,11 @@ void WINAPI ServiceCtrlHandler(DWORD ctrl);
 DWORD WINAPI ServiceWorkerThread(LPVOID lpParam);
 DWORD InitializeService();
 void CleanupService();
-DWORD HandleClient(SOCKET client_socket);
-DWORD ProcessAPIRequest(SOCKET client_socket, const char* request_json, char* response_json, size_t response_size);
 
 // Windows exception handler for crash detection
 LONG WINAPI WindowsExceptionHandler(EXCEPTION_POINTERS* ExceptionInfo);
 void SignalHandler(int signal_num);
 
-// Safe memory write with SEH
-BOOL SafeMemoryWrite(UINT32* ptr, UINT32 value, UINT64 offset);
-
-// Structure to pass buffer send info
-struct BufferSendInfo {
-    BOOL needs_buffer_send;
-    UINT64 buffer_size;
-    UINT32 test_pattern;
-};
-
-// JSON helper functions
-Json::Value CreateErrorResponse(UINT32 request_id, const char* error_msg);
-Json::Value CreateSuccessResponse(UINT32 request_id);
-
-// API implementations
-DWORD HandleEchoAPI(SOCKET client_socket, const Json::Value& request, Json::Value& response);
-DWORD HandleBufferTestAPI(SOCKET client_socket, const Json::Value& request, Json::Value& response);
-DWORD HandlePerformanceAPI(SOCKET client_socket, const Json::Value& request, Json::Value& response);
-DWORD HandleSharedBufferAPI(SOCKET client_socket, const Json::Value& request, Json::Value& response);
-
 /*
  * Windows exception handler for crash detection (replaces Unix signals)
  */
@@ -255,6 +215,7 @@ void SignalHandler(int signal_num)
             printf("Stopping worker thread...\n");
             fflush(stdout);
             g_ctx.running = FALSE;
+            g_server.Stop();
 
             // Set stop event to wake up any waiting operations
             if (g_ctx.stop_event) {
@@ -336,10 +297,16 @@ int main(int argc, char* argv[])
             // Run as console application for debugging
             printf("Running Windows API Remoting Service in console mode...\n");
 
-            // Check for VSOCK flag (TCP is now default)
-            if (argc > 2 && _stricmp(argv[2], "--vsock") == 0) {
-                printf("Enabling VSOCK mode (will attempt VSOCK first)\n");
-                g_force_tcp = FALSE;
+            for (int i = 2; i < argc; i++) {
+                // Check for VSOCK flag (TCP is now default)
+                if (_stricmp(argv[i], "--vsock") == 0) {
+                    printf("Enabling VSOCK mode (will attempt VSOCK first)\n");
+                    g_force_tcp = FALSE;
+                } else if (_stricmp(argv[i], "--max-sessions") == 0 && i + 1 < argc) {
+                    g_ctx.max_sessions = atol(argv[++i]);
+                } else if (_stricmp(argv[i], "--handler-threads") == 0 && i + 1 < argc) {
+                    g_ctx.handler_threads = (unsigned)atoi(argv[++i]);
+                }
             }
 
             if (InitializeService() != ERROR_SUCCESS) {
@@ -368,6 +335,8 @@ int main(int argc, char* argv[])
             printf("Usage: %s [options]\n", argv[0]);
             printf("  console         Run in console mode (TCP default)\n");
             printf("  console --vsock Run in console mode with VSOCK preferred\n");
+            printf("  console --max-sessions N  Serve up to N clients concurrently (default %d)\n", MAX_CLIENTS);
+            printf("  console --handler-threads N  Run buffer tests and batches on N workers (default: one per CPU)\n");
             printf("  install         Show install instructions\n");
             printf("  --help          Show this help\n");
             return 0;
@@ -453,6 +422,7 @@ void WINAPI ServiceCtrlHandler(DWORD ctrl)
             g_service_status.dwCurrentState = SERVICE_STOP_PENDING;
             SetServiceStatus(g_service_status_handle, &g_service_status);
             g_ctx.running = FALSE;
+            g_server.Stop();
             SetEvent(g_ctx.stop_event);
             break;
         default:
@@ -472,6 +442,22 @@ DWORD InitializeService()
     g_ctx.listen_socket = INVALID_SOCKET;
     g_ctx.tcp_listen_socket = INVALID_SOCKET;
 
+    // Session limit: --max-sessions, then WINAPI_MAX_SESSIONS, then the default
+    const char* max_sessions_env = getenv("WINAPI_MAX_SESSIONS");
+    if (g_ctx.max_sessions <= 0 && max_sessions_env) {
+        g_ctx.max_sessions = atol(max_sessions_env);
+    }
+    if (g_ctx.max_sessions <= 0) {
+        g_ctx.max_sessions = MAX_CLIENTS;
+    }
+    g_ctx.max_sessions = std::min(g_ctx.max_sessions, (LONG)MAX_SESSIONS_LIMIT);
+
+    const char* handler_threads_env = getenv("WINAPI_HANDLER_THREADS");
+    if (g_ctx.handler_threads == 0 && handler_threads_env) {
+        g_ctx.handler_threads = (unsigned)atoi(handler_threads_env);
+    }
+    printf("Serving up to %ld concurrent sessions\n", g_ctx.max_sessions);
+
     // Initialize Winsock
     printf("Initializing Winsock...\n");
     if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
@@ -672,547 +658,16 @@ DWORD WINAPI ServiceWorkerThread(LPVOID lpParam)
 {
     UNREFERENCED_PARAMETER(lpParam);
 
-    fd_set readfds;
-    struct timeval timeout;
-    SOCKET client_socket;
-    union {
-        SOCKADDR_HV hv_addr;
-        struct sockaddr_in tcp_addr;
-        SOCKADDR generic_addr;
-    } client_addr;
-    int addr_len;
-    static int heartbeat_counter = 0;
-
     printf("Worker thread started, waiting for connections...\n");
     printf("   Transport: %s\n", g_ctx.using_tcp ? "TCP" : "VSOCK");
 
-    while (g_ctx.running) {
-        FD_ZERO(&readfds);
-        FD_SET(g_ctx.listen_socket, &readfds);
-
-        timeout.tv_sec = 1;
-        timeout.tv_usec = 0;
-
-        int result = select(0, &readfds, NULL, NULL, &timeout);
-        if (result == SOCKET_ERROR) {
-            DWORD error = WSAGetLastError();
-            if (g_ctx.running) {
-                printf("select() failed: %d\n", error);
-            }
-            break;
-        }
-
-        // Check if we should stop (graceful shutdown)
-        if (!g_ctx.running) {
-            break;
-        }
-
-        // Heartbeat every 30 seconds
-        if (++heartbeat_counter >= 30) {
-	  //printf("Service running (%s), waiting for connections...\n",
-	  //g_ctx.using_tcp ? "TCP" : "VSOCK");
-
-	  heartbeat_counter = 0;
-        }
-
-        if (result > 0 && FD_ISSET(g_ctx.listen_socket, &readfds)) {
-            printf("Incoming %s connection detected...\n",
-                   g_ctx.using_tcp ? "TCP" : "VSOCK");
-
-            // Set appropriate address length based on socket type
-            if (g_ctx.using_tcp) {
-                addr_len = sizeof(client_addr.tcp_addr);
-            } else {
-                addr_len = sizeof(client_addr.hv_addr);
-            }
-
-            // Check if service is still running before accepting
-            if (!g_ctx.running) {
-                break;
-            }
-
-            client_socket = accept(g_ctx.listen_socket, &client_addr.generic_addr, &addr_len);
-
-            if (client_socket != INVALID_SOCKET) {
-                if (g_ctx.using_tcp) {
-                    char* client_ip = inet_ntoa(client_addr.tcp_addr.sin_addr);
-                    printf("[OK] TCP connection accepted from %s:%d\n",
-                           client_ip, ntohs(client_addr.tcp_addr.sin_port));
-                } else {
-                    printf("[OK] VSOCK connection accepted successfully\n");
-                }
-
-                // Handle client in separate thread or inline
-                HandleClient(client_socket);
-                closesocket(client_socket);
-                printf("Client disconnected\n");
-            } else {
-                DWORD error = WSAGetLastError();
-                // Only report error if service is still running (avoid noise during shutdown)
-                if (g_ctx.running) {
-                    if (error == WSAENOTSOCK || error == WSAEINVAL) {
-                        printf("Socket closed during shutdown\n");
-                    } else {
-                        printf("accept() failed: %d\n", error);
-                    }
-                }
-                break;
-            }
-        }
+    // One reactor thread serves the listening socket and every session
+    if (!g_server.Initialize(g_ctx.listen_socket, g_ctx.max_sessions, g_ctx.handler_threads,
+                            g_ctx.request_buffer, g_ctx.response_buffer)) {
+        return 1;
     }
+    g_server.Run();
 
     printf("Worker thread exiting cleanly\n");
     return 0;
 }
-
-/*
- * Handle client connection
- */
-DWORD HandleClient(SOCKET client_socket)
-{
-    char request_buffer[65536];
-    char response_buffer[65536];
-    UINT32 msg_len;
-    int bytes_received;
-    int request_count = 0;
-
-    while (TRUE) {
-        // Receive message length
-        bytes_received = recv(client_socket, (char*)&msg_len, sizeof(msg_len), MSG_WAITALL);
-        if (bytes_received != sizeof(msg_len)) {
-            if (bytes_received == 0) {
-                printf("[INFO] Client disconnected gracefully\n");
-            } else {
-                printf("[ERROR] Failed to receive message length: %d\n", WSAGetLastError());
-            }
-            break;
-        }
-
-        msg_len = ntohl(msg_len);
-        if (msg_len > sizeof(request_buffer) - 1) {
-            break;
-        }
-
-        // Receive JSON message
-        bytes_received = recv(client_socket, request_buffer, msg_len, MSG_WAITALL);
-        if (bytes_received != (int)msg_len) {
-            break;
-        }
-
-        request_buffer[msg_len] = '\0';
-        request_count++;
-
-        // Process request
-        DWORD result;
-        try {
-            result = ProcessAPIRequest(client_socket, request_buffer, response_buffer, sizeof(response_buffer));
-        } catch (...) {
-            printf("[ERROR] Exception during request processing\n");
-            break;
-        }
-
-        if (result == ERROR_SUCCESS) {
-            // Send response
-            UINT32 response_len = (UINT32)strlen(response_buffer);
-            UINT32 net_len = htonl(response_len);
-
-            int sent = send(client_socket, (char*)&net_len, sizeof(net_len), 0);
-            if (sent != sizeof(net_len)) {
-                break;
-            }
-
-            sent = send(client_socket, response_buffer, response_len, 0);
-            if (sent != (int)response_len) {
-                break;
-            }
-
-            // Check if we need to send buffer data for READ operations
-            Json::Value parsed_response;
-            Json::Reader response_reader;
-
-            try {
-                if (response_reader.parse(response_buffer, parsed_response)) {
-                    Json::Value result_section = parsed_response.get("result", Json::Value());
-
-                    // Only check for buffer data if result is an object (buffer test responses)
-                    // Echo responses have result as a string, so skip buffer check
-                    if (!result_section.isNull() && result_section.isObject() &&
-                        result_section.isMember("needs_buffer_send") && result_section.get("needs_buffer_send", false).asBool()) {
-                    uint64_t buffer_size = result_section.get("buffer_size", 0).asUInt64();
-                    uint32_t test_pattern = result_section.get("test_pattern", 0).asUInt();
-
-                    // Generate and send buffer data
-                    uint32_t* pattern_buffer = new uint32_t[buffer_size / sizeof(uint32_t)];
-                    uint64_t uint32_count = buffer_size / sizeof(uint32_t);
-
-                    for (uint64_t i = 0; i < uint32_count; i++) {
-                        pattern_buffer[i] = test_pattern;
-                    }
-
-                    // Send buffer data in chunks
-                    char* send_ptr = (char*)pattern_buffer;
-                    size_t total_sent = 0;
-                    while (total_sent < buffer_size) {
-                        size_t chunk_size = min(buffer_size - total_sent, 65536ULL); // 64KB chunks
-                        int chunk_sent = send(client_socket, send_ptr + total_sent, (int)chunk_size, 0);
-                        if (chunk_sent <= 0) {
-                            delete[] pattern_buffer;
-                            return ERROR_SUCCESS;
-                        }
-                        total_sent += chunk_sent;
-                    }
-                        delete[] pattern_buffer;
-                    }
-                }
-            } catch (const std::exception& e) {
-                UNREFERENCED_PARAMETER(e);
-                // Ignore JSON parsing exceptions for buffer data check
-            } catch (...) {
-                // Ignore unknown exceptions for buffer data check
-            }
-        } else {
-            // Send error response
-            UINT32 response_len = (UINT32)strlen(response_buffer);
-            UINT32 net_len = htonl(response_len);
-            send(client_socket, (char*)&net_len, sizeof(net_len), 0);
-            send(client_socket, response_buffer, response_len, 0);
-        }
-    }
-
-    return ERROR_SUCCESS;
-}
-
-/*
- * Process API request
- */
-DWORD ProcessAPIRequest(SOCKET client_socket, const char* request_json, char* response_json, size_t response_size)
-{
-    Json::Value request, response;
-    Json::Reader reader;
-    Json::StreamWriterBuilder builder;
-
-    // Parse request
-    if (!reader.parse(request_json, request)) {
-        printf("[ERROR] JSON parsing failed: %s\n", reader.getFormattedErrorMessages().c_str());
-        strncpy(response_json, "{\"error\":\"Invalid JSON\",\"details\":\"JSON parsing failed\"}", response_size - 1);
-        response_json[response_size - 1] = '\0';
-        return ERROR_INVALID_DATA;
-    }
-
-    // Get API name and request ID
-    std::string api = request.get("api", "").asString();
-    UINT32 request_id = request.get("request_id", 0).asUInt();
-
-    if (api.empty()) {
-        printf("[ERROR] Missing API name in request\n");
-        response = CreateErrorResponse(request_id, "Missing API name");
-        std::string response_str = Json::writeString(builder, response);
-        strncpy(response_json, response_str.c_str(), response_size - 1);
-        response_json[response_size - 1] = '\0';
-        return ERROR_INVALID_PARAMETER;
-    }
-
-    // Process based on API
-    DWORD result = ERROR_SUCCESS;
-
-    if (api == "echo") {
-        result = HandleEchoAPI(client_socket, request, response);
-    }
-    else if (api == "buffer_test") {
-        try {
-            result = HandleBufferTestAPI(client_socket, request, response);
-        } catch (const std::exception& e) {
-            printf("[ERROR] Exception in HandleBufferTestAPI: %s\n", e.what());
-            response = CreateErrorResponse(request_id, "Server exception occurred");
-            result = ERROR_INVALID_FUNCTION;
-        } catch (...) {
-            printf("[ERROR] Unknown exception in HandleBufferTestAPI\n");
-            response = CreateErrorResponse(request_id, "Unknown server exception");
-            result = ERROR_INVALID_FUNCTION;
-        }
-    }
-    else if (api == "performance") {
-        result = HandlePerformanceAPI(client_socket, request, response);
-    }
-    else if (api == "shared_buffer") {
-        result = HandleSharedBufferAPI(client_socket, request, response);
-    }
-    else {
-        response = CreateErrorResponse(request_id, "Unknown API");
-        result = ERROR_INVALID_FUNCTION;
-    }
-
-    // Convert response to JSON string
-    std::string response_str = Json::writeString(builder, response);
-    strncpy(response_json, response_str.c_str(), response_size - 1);
-    response_json[response_size - 1] = '\0';
-
-    return result;
-}
-
-/*
- * Helper function to create error response
- */
-Json::Value CreateErrorResponse(UINT32 request_id, const char* error_msg)
-{
-    Json::Value response;
-    response["request_id"] = request_id;
-    response["status"] = "error";
-    response["error"] = error_msg;
-    return response;
-}
-
-/*
- * Helper function to create success response
- */
-Json::Value CreateSuccessResponse(UINT32 request_id)
-{
-    Json::Value response;
-    response["request_id"] = request_id;
-    response["status"] = "success";
-    return response;
-}
-
-/*
- * Handle echo API
- */
-DWORD HandleEchoAPI(SOCKET client_socket, const Json::Value& request, Json::Value& response)
-{
-    UNREFERENCED_PARAMETER(client_socket);
-
-    UINT32 request_id = request.get("request_id", 0).asUInt();
-    std::string input = request.get("input", "").asString();
-
-    response = CreateSuccessResponse(request_id);
-    response["result"] = input;  // Echo back the input
-
-    return ERROR_SUCCESS;
-}
-
-/*
- * Handle buffer test API
- */
-DWORD HandleBufferTestAPI(SOCKET client_socket, const Json::Value& request, Json::Value& response)
-{
-    UINT32 request_id = request.get("request_id", 0).asUInt();
-    int operation = request.get("operation", 0).asInt();
-
-    UINT32 test_pattern;
-    try {
-        // Handle both signed and unsigned values from JSON
-        if (request["test_pattern"].isInt()) {
-            test_pattern = (UINT32)request.get("test_pattern", 0).asInt();
-        } else {
-            test_pattern = request.get("test_pattern", 0).asUInt();
-        }
-    } catch (...) {
-        response = CreateErrorResponse(request_id, "JSON parsing error - test_pattern");
-        return ERROR_INVALID_DATA;
-    }
-
-    UINT64 payload_size = request.get("payload_size", 0).asUInt64();
-
-    BOOL socket_transfer;
-    try {
-        socket_transfer = request.get("socket_transfer", false).asBool() ? TRUE : FALSE;
-    } catch (...) {
-        response = CreateErrorResponse(request_id, "JSON parsing error");
-        return ERROR_INVALID_DATA;
-    }
-
-    // Validate parameters
-    if (payload_size == 0) {
-        response = CreateErrorResponse(request_id, "Invalid payload size");
-        return ERROR_INVALID_PARAMETER;
-    }
-
-    if (socket_transfer && payload_size > 64 * 1024 * 1024) {  // 64MB limit for socket transfer
-        response = CreateErrorResponse(request_id, "Payload too large for socket transfer");
-        return ERROR_INVALID_PARAMETER;
-    }
-
-    response = CreateSuccessResponse(request_id);
-
-    Json::Value result;
-    result["bytes_processed"] = (Json::UInt64)payload_size;
-    result["checksum"] = test_pattern;  // Simple implementation
-    result["status"] = 0;  // Success
-
-    // Handle different operations
-    switch (operation) {
-        case WINAPI_BUFFER_OP_READ:
-            if (socket_transfer) {
-                // Store info for buffer sending after JSON response
-                result["needs_buffer_send"] = true;
-                result["buffer_size"] = (Json::UInt64)payload_size;
-                result["test_pattern"] = test_pattern;
-            } else if (payload_size <= RESPONSE_BUFFER_SIZE) {
-                if (!g_ctx.response_buffer) {
-                    response = CreateErrorResponse(request_id, "Shared memory response buffer not available");
-                    return ERROR_INVALID_HANDLE;
-                }
-
-                // Fill response buffer with test pattern (shared memory)
-                UINT32* buf = (UINT32*)g_ctx.response_buffer;
-                UINT64 uint32_count = payload_size / sizeof(UINT32);
-
-                for (UINT64 i = 0; i < uint32_count; i++) {
-                    UINT64 byte_offset = i * sizeof(UINT32);
-                    if (byte_offset + sizeof(UINT32) > RESPONSE_BUFFER_SIZE) {
-                        break; // Stop before exceeding buffer
-                    }
-
-                    if (byte_offset > SAFE_WRITE_OFFSET) {  // Use safe write near boundary
-                        if (!SafeMemoryWrite(&buf[i], test_pattern, byte_offset)) {
-                            break;
-                        }
-                    } else {
-                        buf[i] = test_pattern;
-                    }
-                }
-            } else {
-                response = CreateErrorResponse(request_id, "Payload too large for shared memory response");
-                return ERROR_INVALID_PARAMETER;
-            }
-            break;
-
-        case WINAPI_BUFFER_OP_WRITE:
-        case WINAPI_BUFFER_OP_VERIFY:
-            if (socket_transfer) {
-                // Receive buffer data over socket
-                if (payload_size > 64 * 1024 * 1024) {
-                    response = CreateErrorResponse(request_id, "Payload too large");
-                    return ERROR_INVALID_PARAMETER;
-                }
-
-                char* temp_buffer = nullptr;
-                try {
-                    temp_buffer = new char[payload_size];
-                } catch (...) {
-                    response = CreateErrorResponse(request_id, "Memory allocation failed");
-                    return ERROR_NOT_ENOUGH_MEMORY;
-                }
-
-                int total_received = 0;
-                while (total_received < (int)payload_size) {
-                    int bytes_remaining = (int)(payload_size - total_received);
-                    int bytes_to_receive = min(bytes_remaining, 65536);  // 64KB chunks
-
-                    int received = recv(client_socket, temp_buffer + total_received, bytes_to_receive, 0);
-                    if (received <= 0) {
-                        delete[] temp_buffer;
-                        response = CreateErrorResponse(request_id, "Socket receive failed");
-                        return ERROR_NETWORK_UNREACHABLE;
-                    }
-                    total_received += received;
-                }
-
-                // Calculate checksum
-                UINT32 checksum = 0;
-                UINT32* buf = (UINT32*)temp_buffer;
-                for (UINT64 i = 0; i < payload_size / sizeof(UINT32); i++) {
-                    checksum ^= buf[i];
-                }
-                result["checksum"] = checksum;
-                delete[] temp_buffer;
-            } else if (payload_size <= REQUEST_BUFFER_SIZE) {
-                // Verify data in request buffer (shared memory)
-                if (!g_ctx.request_buffer) {
-                    response = CreateErrorResponse(request_id, "Shared memory not available");
-                    return ERROR_INVALID_HANDLE;
-                }
-
-                UINT32* buf = (UINT32*)g_ctx.request_buffer;
-                UINT32 checksum = 0;
-                for (UINT64 i = 0; i < payload_size / sizeof(UINT32); i++) {
-                    checksum ^= buf[i];
-                }
-                result["checksum"] = checksum;
-            } else {
-                response = CreateErrorResponse(request_id, "Payload too large for shared memory");
-                return ERROR_INVALID_PARAMETER;
-            }
-            break;
-    }
-
-    response["result"] = result;
-    return ERROR_SUCCESS;
-}
-
-/*
- * Handle performance API
- */
-DWORD HandlePerformanceAPI(SOCKET client_socket, const Json::Value& request, Json::Value& response)
-{
-    UNREFERENCED_PARAMETER(client_socket);
-
-    UINT32 request_id = request.get("request_id", 0).asUInt();
-    int test_type = request.get("test_type", 0).asInt();
-    int iterations = request.get("iterations", 1000).asInt();
-    UINT64 target_bytes = request.get("target_bytes", 1024).asUInt64();
-
-    UNREFERENCED_PARAMETER(test_type);
-    UNREFERENCED_PARAMETER(target_bytes);
-
-    response = CreateSuccessResponse(request_id);
-
-    // Simulate performance metrics
-    Json::Value result;
-    result["min_latency_ns"] = (Json::UInt64)1000;     // 1 us
-    result["max_latency_ns"] = (Json::UInt64)100000;   // 100 us
-    result["avg_latency_ns"] = (Json::UInt64)10000;    // 10 us
-    result["throughput_mbps"] = (Json::UInt64)1000;    // 1000 MB/s
-    result["iterations_completed"] = iterations;
-
-    response["result"] = result;
-    return ERROR_SUCCESS;
-}
-
-/*
- * Handle shared buffer API
- */
-DWORD HandleSharedBufferAPI(SOCKET client_socket, const Json::Value& request, Json::Value& response)
-{
-    UNREFERENCED_PARAMETER(client_socket);
-
-    UINT32 request_id = request.get("request_id", 0).asUInt();
-    std::string operation = request.get("operation", "").asString();
-    std::string file_path = request.get("file_path", "").asString();
-    UINT64 buffer_size = request.get("buffer_size", 0).asUInt64();
-    UINT32 buffer_id = request.get("buffer_id", 0).asUInt();
-
-    printf("Shared buffer request: operation='%s', file='%s', size=%I64u bytes, id=%u\n",
-           operation.c_str(), file_path.c_str(), buffer_size, buffer_id);
-
-    // Convert Linux path to Windows path
-    std::string windows_path = file_path;
-    if (windows_path.substr(0, 6) == "/mnt/c") {
-        windows_path = "C:" + windows_path.substr(6);
-        std::replace(windows_path.begin(), windows_path.end(), '/', '\\');
-    }
-
-    printf("Windows path: %s\n", windows_path.c_str());
-
-    // For now, just simulate processing (no-op as requested)
-    if (operation == "process") {
-        // Optional: Could map the file and do actual processing here
-        // HANDLE file_handle = CreateFileA(windows_path.c_str(), ...);
-        // LPVOID mapped_memory = MapViewOfFile(...);
-        // [do processing]
-        // UnmapViewOfFile(mapped_memory);
-        // CloseHandle(file_handle);
-
-        printf("[OK] Simulated processing of shared buffer (no-op)\n");
-    }
-
-    response = CreateSuccessResponse(request_id);
-
-    Json::Value result;
-    result["operation"] = operation;
-    result["buffer_id"] = buffer_id;
-    result["bytes_processed"] = (Json::UInt64)buffer_size;
-    result["status"] = "processed";
-
-    response["result"] = result;
-    return ERROR_SUCCESS;
-}
@@ -0,0 +1,70 @@
+/*
+ * Streaming sink for received socket payloads
+ */
+
+#include "payload_sink.h"
+
+#include <string.h>
+
+#include "../../common/checksum.h"
+
+PayloadSink::PayloadSink() : remaining(0), crc(FALSE), partial_size(0)
+{
+    memset(&digest, 0, sizeof(digest));
+}
+
+void PayloadSink::Reset(UINT64 size, BOOL crc)
+{
+    memset(&digest, 0, sizeof(digest));
+    this->remaining = size;
+    this->crc = crc;
+    this->partial_size = 0;
+}
+
+void PayloadSink::Consume(const char* data, size_t size)
+{
+    digest.size += size;
+    remaining -= size;
+
+    if (crc) {
+        digest.crc = winapi_crc32c(digest.crc, data, size);
+    }
+
+    // Words are counted from the start of the payload, not of the chunk
+    while (partial_size > 0 && size > 0) {
+        partial[partial_size++] = (UINT8)*data++;
+        size--;
+        if (partial_size == sizeof(UINT32)) {
+            UINT32 word;
+            memcpy(&word, partial, sizeof(word));
+            digest.checksum ^= word;
+            partial_size = 0;
+        }
+    }
+
+    // The chunk ended inside the carried word, which stays partial
+    if (partial_size > 0) {
+        return;
+    }
+
+    size_t whole = size & ~(sizeof(UINT32) - 1);
+    digest.checksum ^= winapi_checksum_xor(data, whole);
+
+    partial_size = size - whole;
+    memcpy(partial, data + whole, partial_size);
+}
+
+UINT32 PayloadSink::TakeCrc()
+{
+    UINT32 chunk_crc = digest.crc;
+    digest.crc = 0;
+    return chunk_crc;
+}
+
+void PayloadSink::Merge(const PayloadDigest& part)
+{
+    digest.size += part.size;
+    digest.checksum ^= part.checksum;
+    digest.corrupt |= part.corrupt;
+    remaining -= part.size;
+}
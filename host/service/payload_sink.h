@@ -0,0 +1,58 @@
+/*
+ * Streaming sink for received socket payloads
+ *
+ * WRITE/VERIFY payloads (plain or chunk streams) are never stored: the connection
+ * receives them a chunk at a time into one scratch buffer and feeds each
+ * chunk to a PayloadSink, which folds it into the XOR checksum and CRC32C
+ * while it is still in cache. Handlers only see the resulting digest.
+ * Striped chunks are digested by their data connection and merged into
+ * the request's sink; the XOR checksum does not depend on arrival order.
+ */
+
+#ifndef WINAPI_PAYLOAD_SINK_H
+#define WINAPI_PAYLOAD_SINK_H
+
+#include "platform.h"
+
+// Receive chunk for streamed payloads, reused for every payload
+#define PAYLOAD_CHUNK_SIZE      (256 * 1024)
+
+// What the handlers get to see of a socket payload
+struct PayloadDigest {
+    UINT64 size;           // Bytes received
+    UINT32 checksum;       // XOR of the payload's 32-bit words
+    UINT32 crc;            // CRC32C, when the frame carried one
+    BOOL corrupt;          // A stream chunk failed its CRC32C
+};
+
+class PayloadSink {
+public:
+    PayloadSink();
+
+    // Expect size bytes, computing the CRC32C too when crc is set
+    void Reset(UINT64 size, BOOL crc);
+
+    UINT64 Remaining() const { return remaining; }
+
+    // Fold the next bytes of the payload into the digest
+    void Consume(const char* data, size_t size);
+
+    const PayloadDigest& Digest() const { return digest; }
+
+    // CRC32C of the bytes consumed since the last call (stream chunks are checked one by one)
+    UINT32 TakeCrc();
+
+    void MarkCorrupt() { digest.corrupt = TRUE; }
+
+    // Account for a word-aligned part of the payload digested by another sink (CRC not merged)
+    void Merge(const PayloadDigest& part);
+
+private:
+    PayloadDigest digest;
+    UINT64 remaining;
+    BOOL crc;
+    UINT8 partial[sizeof(UINT32)];  // Word split across chunks
+    size_t partial_size;
+};
+
+#endif /* WINAPI_PAYLOAD_SINK_H */
@@ -0,0 +1,171 @@
+/*
+ * Streaming source for generated READ payloads
+ */
+
+#include "payload_source.h"
+
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+
+#include "../../common/checksum.h"
+
+#define PATTERN_CACHE_SIZE      8
+
+/*
+ * Pre-filled chunk for a pattern, shared by every payload that uses it
+ */
+std::shared_ptr<const PatternChunk> AcquirePatternChunk(UINT32 pattern)
+{
+    static std::mutex cache_lock;
+    static std::shared_ptr<const PatternChunk> cache[PATTERN_CACHE_SIZE];
+    static unsigned next_slot = 0;
+
+    std::lock_guard<std::mutex> guard(cache_lock);
+
+    for (unsigned i = 0; i < PATTERN_CACHE_SIZE; i++) {
+        if (cache[i] && cache[i]->pattern == pattern) {
+            return cache[i];
+        }
+    }
+
+    // Evicted chunks stay alive until the payloads referencing them are sent
+    std::shared_ptr<PatternChunk> chunk = std::make_shared<PatternChunk>();
+    chunk->pattern = pattern;
+    std::fill(chunk->words, chunk->words + PATTERN_CHUNK_SIZE / sizeof(UINT32), pattern);
+    chunk->crc = winapi_crc32c(0, chunk->words, PATTERN_CHUNK_SIZE);
+
+    cache[next_slot++ % PATTERN_CACHE_SIZE] = chunk;
+    return chunk;
+}
+
+/*
+ * CRC32C of size bytes of pattern; the whole chunks are never hashed again,
+ * their CRC is extended by the chunk count
+ */
+UINT32 PatternCrc32c(UINT32 pattern, UINT64 size)
+{
+    std::shared_ptr<const PatternChunk> chunk = AcquirePatternChunk(pattern);
+    UINT64 chunks = size / PATTERN_CHUNK_SIZE;
+    UINT32 run_crc = chunk->crc;
+    UINT64 run_size = PATTERN_CHUNK_SIZE;
+    UINT32 crc = 0;
+
+    // Runs of 1, 2, 4, ... chunks, appended for each bit set in the count
+    while (chunks > 0) {
+        if (chunks & 1) {
+            crc = winapi_crc32c_combine(crc, run_crc, run_size);
+        }
+        run_crc = winapi_crc32c_combine(run_crc, run_crc, run_size);
+        run_size *= 2;
+        chunks >>= 1;
+    }
+    return winapi_crc32c(crc, chunk->words, (size_t)(size % PATTERN_CHUNK_SIZE));
+}
+
+PatternSource::PatternSource()
+    : size(0), data_size(0), wire_size(0), sent(0), stream(FALSE), stream_id(0), granted(0), first(0), stride(1)
+{
+    memset(chunk_crc, 0, sizeof(chunk_crc));
+    memset(headers, 0, sizeof(headers));
+}
+
+void PatternSource::Reset(UINT32 pattern, UINT64 size)
+{
+    this->chunk = size ? AcquirePatternChunk(pattern) : NULL;
+    this->size = size;
+    this->data_size = size;
+    this->wire_size = size;
+    this->sent = 0;
+    this->stream = FALSE;
+    this->granted = size;
+    this->first = 0;
+    this->stride = 1;
+}
+
+void PatternSource::ResetStream(UINT32 pattern, UINT64 size, UINT64 request_id, UINT64 window, BOOL crc,
+                                UINT64 first, UINT64 stride)
+{
+    // An empty stream is still one (last) chunk
+    UINT64 chunks = size == 0 ? 1 : (size + WINAPI_STREAM_CHUNK_SIZE - 1) / WINAPI_STREAM_CHUNK_SIZE;
+    UINT64 last_size = size - (chunks - 1) * WINAPI_STREAM_CHUNK_SIZE;
+    UINT64 own_chunks = first < chunks ? (chunks - first + stride - 1) / stride : 0;
+    BOOL owns_last = own_chunks > 0 && first + (own_chunks - 1) * stride == chunks - 1;
+
+    this->chunk = AcquirePatternChunk(pattern);
+    this->size = size;
+    this->data_size = own_chunks == 0 ? 0 :
+                      (own_chunks - 1) * WINAPI_STREAM_CHUNK_SIZE + (owns_last ? last_size : WINAPI_STREAM_CHUNK_SIZE);
+    this->wire_size = data_size + own_chunks * sizeof(winapi_stream_chunk_t);
+    this->sent = 0;
+    this->stream = TRUE;
+    this->stream_id = request_id;
+    this->granted = std::min(window, data_size);
+    this->first = first;
+    this->stride = stride;
+    this->chunk_crc[0] = crc ? PatternCrc32c(pattern, WINAPI_STREAM_CHUNK_SIZE) : 0;
+    this->chunk_crc[1] = crc ? PatternCrc32c(pattern, last_size) : 0;
+}
+
+void PatternSource::Grant(UINT64 bytes)
+{
+    granted = std::min(data_size, granted + bytes);
+}
+
+int PatternSource::Gather(IoVec* vecs, int max_vecs, BOOL* complete)
+{
+    // A plain payload is one chunk without a header
+    size_t header_size = stream ? sizeof(winapi_stream_chunk_t) : 0;
+    UINT64 chunk_size = stream ? WINAPI_STREAM_CHUNK_SIZE : size;
+    UINT64 offset = sent;
+    int count = 0;
+
+    while (offset < wire_size && count < max_vecs) {
+        UINT64 index = offset / (header_size + chunk_size);
+        UINT64 within = offset % (header_size + chunk_size);
+        UINT64 payload_offset = (first + index * stride) * chunk_size;
+        UINT64 length = std::min(chunk_size, size - payload_offset);
+        UINT64 data_start = index * chunk_size;   // Within data_size
+
+        if (within < header_size) {
+            // A header goes out with the first byte of its data, or alone for an empty stream
+            if (length > 0 && granted <= data_start) {
+                break;
+            }
+
+            BOOL last = payload_offset + length == size;
+            winapi_stream_chunk_t* header = &headers[index % PATTERN_HEADER_RING];
+            header->magic = WINAPI_STREAM_MAGIC;
+            header->flags = data_start + length == data_size ? WINAPI_STREAM_LAST : 0;
+            header->request_id = stream_id;
+            header->offset = payload_offset;
+            header->size = (UINT32)length;
+            header->crc = chunk_crc[last ? 1 : 0];
+
+            SetIoVec(&vecs[count++], (const char*)header + within, (size_t)(header_size - within));
+            offset += header_size - within;
+            continue;
+        }
+
+        UINT64 data_offset = data_start + within - header_size;
+        UINT64 end = std::min(data_start + length, granted);
+        if (data_offset >= end) {
+            break;
+        }
+
+        // The chunk holds whole words, so resuming at offset % chunk size keeps the stream aligned
+        size_t phase = (size_t)(data_offset % PATTERN_CHUNK_SIZE);
+        size_t vec_length = (size_t)std::min(end - data_offset, (UINT64)(PATTERN_CHUNK_SIZE - phase));
+
+        SetIoVec(&vecs[count++], (const char*)chunk->words + phase, vec_length);
+        offset += vec_length;
+    }
+
+    *complete = offset == wire_size;
+    return count;
+}
+
+void PatternSource::Advance(UINT64 bytes)
+{
+    sent += bytes;
+}
@@ -0,0 +1,85 @@
+/*
+ * Streaming source for generated READ payloads
+ *
+ * A socket READ answers with buffer_size bytes of test_pattern. Instead of
+ * materializing them, the service keeps one pre-filled chunk per recently
+ * used pattern and points scatter-gather entries at it over and over while
+ * the payload is sent, so a READ of any size costs one shared chunk.
+ *
+ * A streamed READ interleaves winapi_stream_chunk_t headers with the data
+ * and sends no further than the client's credit. A striped READ gives each
+ * data connection its own source over every K-th chunk. Full chunks of a
+ * pattern share their CRC, so headers are filled in as they are gathered.
+ */
+
+#ifndef WINAPI_PAYLOAD_SOURCE_H
+#define WINAPI_PAYLOAD_SOURCE_H
+
+#include "platform.h"
+
+#include <memory>
+
+#include "../../common/protocol.h"
+
+#define PATTERN_CHUNK_SIZE      (64 * 1024)
+
+// Chunk headers one gather can point at (a full chunk takes 17 entries of 64)
+#define PATTERN_HEADER_RING     8
+
+struct PatternChunk {
+    UINT32 pattern;
+    UINT32 crc;               // CRC32C of the whole chunk
+    UINT32 words[PATTERN_CHUNK_SIZE / sizeof(UINT32)];
+};
+
+// Pre-filled chunk of pattern, shared by every payload that uses it
+std::shared_ptr<const PatternChunk> AcquirePatternChunk(UINT32 pattern);
+
+// CRC32C of size bytes of pattern
+UINT32 PatternCrc32c(UINT32 pattern, UINT64 size);
+
+class PatternSource {
+public:
+    PatternSource();
+
+    // Stream size bytes of pattern (size 0 for no payload)
+    void Reset(UINT32 pattern, UINT64 size);
+
+    // Send chunks first, first + stride, ... of size bytes of pattern as the stream of request_id,
+    // window bytes granted so far
+    void ResetStream(UINT32 pattern, UINT64 size, UINT64 request_id, UINT64 window, BOOL crc,
+                     UINT64 first = 0, UINT64 stride = 1);
+
+    // Let a stream send bytes more data
+    void Grant(UINT64 bytes);
+
+    BOOL Streamed() const { return stream; }
+    UINT64 StreamId() const { return stream_id; }
+
+    // Bytes on the wire, chunk headers included
+    UINT64 Size() const { return wire_size; }
+    UINT64 Remaining() const { return wire_size - sent; }
+
+    // Point up to max_vecs entries at the next sendable bytes, returns the entries used;
+    // *complete tells whether they reach the end of the payload
+    int Gather(IoVec* vecs, int max_vecs, BOOL* complete);
+
+    // Mark bytes as sent
+    void Advance(UINT64 bytes);
+
+private:
+    std::shared_ptr<const PatternChunk> chunk;
+    UINT64 size;              // Pattern bytes of the whole payload
+    UINT64 data_size;         // Pattern bytes sent by this source
+    UINT64 wire_size;
+    UINT64 sent;              // Wire bytes sent
+    BOOL stream;
+    UINT64 stream_id;
+    UINT64 granted;           // Bytes of data_size the receiver accepts
+    UINT64 first;             // Chunks sent: first, first + stride, ...
+    UINT64 stride;
+    UINT32 chunk_crc[2];      // Full and last chunk
+    winapi_stream_chunk_t headers[PATTERN_HEADER_RING];  // Headers of gathered chunks
+};
+
+#endif /* WINAPI_PAYLOAD_SOURCE_H */
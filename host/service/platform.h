@@ -0,0 +1,159 @@
+/*
+ * Platform layer for the portable service core
+ *
+ * The reactor, sessions and API handlers are written against the Win32
+ * names used by the rest of the service (SOCKET, DWORD, CRITICAL_SECTION,
+ * Interlocked*). On Windows this header only pulls in Winsock; elsewhere it
+ * maps those names onto POSIX so the same core builds and runs on Linux.
+ */
+
+#ifndef WINAPI_PLATFORM_H
+#define WINAPI_PLATFORM_H
+
+#ifdef _WIN32
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+
+#define SOCKET_WOULD_BLOCK(err)   ((err) == WSAEWOULDBLOCK)
+#define SOCKET_SEND_FLAGS         0
+
+/* Last socket error code */
+inline int LastSocketError()
+{
+    return WSAGetLastError();
+}
+
+/* Switch a socket to non-blocking mode */
+inline BOOL SetSocketNonBlocking(SOCKET socket)
+{
+    u_long mode = 1;
+    return ioctlsocket(socket, FIONBIO, &mode) == 0;
+}
+
+/* Scatter-gather entry for SendVectored */
+typedef WSABUF IoVec;
+
+inline void SetIoVec(IoVec* vec, const void* data, size_t length)
+{
+    vec->buf = (CHAR*)data;
+    vec->len = (ULONG)length;
+}
+
+/* Send several buffers in one call, returns bytes sent or SOCKET_ERROR */
+inline long SendVectored(SOCKET socket, IoVec* vecs, int count)
+{
+    DWORD sent = 0;
+    if (WSASend(socket, vecs, (DWORD)count, &sent, 0, NULL, NULL) == SOCKET_ERROR) {
+        return SOCKET_ERROR;
+    }
+    return (long)sent;
+}
+
+#else  /* POSIX */
+
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <strings.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+typedef int SOCKET;
+typedef int BOOL;
+typedef uint8_t UINT8;
+typedef uint32_t UINT32;
+typedef uint64_t UINT64;
+typedef int32_t INT32;
+typedef uint32_t DWORD;
+typedef long LONG;
+typedef void* PVOID;
+typedef void* LPVOID;
+
+#define TRUE  1
+#define FALSE 0
+
+#define INVALID_SOCKET            (-1)
+#define SOCKET_ERROR              (-1)
+#define SD_RECEIVE                SHUT_RD
+#define SD_SEND                   SHUT_WR
+#define SD_BOTH                   SHUT_RDWR
+#define closesocket               close
+#define _stricmp                  strcasecmp
+
+/* Win32 error codes returned by the service core */
+#define ERROR_SUCCESS             0
+#define ERROR_INVALID_FUNCTION    1
+#define ERROR_INVALID_HANDLE      6
+#define ERROR_NOT_ENOUGH_MEMORY   8
+#define ERROR_INVALID_DATA        13
+#define ERROR_INVALID_PARAMETER   87
+#define ERROR_NETWORK_UNREACHABLE 1231
+
+#define UNREFERENCED_PARAMETER(p) ((void)(p))
+
+#define SOCKET_WOULD_BLOCK(err)   ((err) == EAGAIN || (err) == EWOULDBLOCK)
+#define SOCKET_SEND_FLAGS         MSG_NOSIGNAL   // Report EPIPE instead of raising SIGPIPE
+
+typedef pthread_mutex_t CRITICAL_SECTION;
+
+inline void InitializeCriticalSection(CRITICAL_SECTION* lock) { pthread_mutex_init(lock, NULL); }
+inline void DeleteCriticalSection(CRITICAL_SECTION* lock) { pthread_mutex_destroy(lock); }
+inline void EnterCriticalSection(CRITICAL_SECTION* lock) { pthread_mutex_lock(lock); }
+inline void LeaveCriticalSection(CRITICAL_SECTION* lock) { pthread_mutex_unlock(lock); }
+
+inline LONG InterlockedIncrement(volatile LONG* value) { return __atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedDecrement(volatile LONG* value) { return __atomic_sub_fetch(value, 1, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedExchange(volatile LONG* target, LONG value) { return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST); }
+
+inline void Sleep(DWORD milliseconds) { usleep(milliseconds * 1000); }
+inline DWORD GetLastError() { return (DWORD)errno; }
+inline int WSAGetLastError() { return errno; }
+
+/* Last socket error code */
+inline int LastSocketError()
+{
+    return errno;
+}
+
+/* Switch a socket to non-blocking mode */
+inline BOOL SetSocketNonBlocking(SOCKET socket)
+{
+    int flags = fcntl(socket, F_GETFL, 0);
+    return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+/* Scatter-gather entry for SendVectored */
+typedef struct iovec IoVec;
+
+inline void SetIoVec(IoVec* vec, const void* data, size_t length)
+{
+    vec->iov_base = (void*)data;
+    vec->iov_len = length;
+}
+
+/* Send several buffers in one call, returns bytes sent or SOCKET_ERROR */
+inline long SendVectored(SOCKET socket, IoVec* vecs, int count)
+{
+    struct msghdr message = {};
+    message.msg_iov = vecs;
+    message.msg_iovlen = (size_t)count;
+    return (long)sendmsg(socket, &message, SOCKET_SEND_FLAGS);
+}
+
+#endif /* _WIN32 */
+
+#endif /* WINAPI_PLATFORM_H */
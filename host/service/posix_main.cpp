@@ -0,0 +1,140 @@
+/*
+ * Windows API Remoting Service - POSIX entry point
+ *
+ * Runs the same reactor, sessions and API handlers as the Windows service
+ * behind a plain TCP listener, so the protocol and the service core can be
+ * load-tested and debugged on Linux. There is no VSOCK transport and no
+ * fixed shared memory; clients use socket and shared file buffer backings.
+ */
+
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <algorithm>
+
+#include "../../common/protocol.h"
+#include "api_handlers.h"
+#include "session.h"
+
+#define TCP_SOCKET_PORT         4660
+#define MAX_CLIENTS             16                 // Listen backlog and default session limit
+#define MAX_SESSIONS_LIMIT      4096               // Upper bound for --max-sessions
+
+static SessionServer g_server;
+
+/*
+ * Safe memory write (no fixed shared memory on POSIX, plain store)
+ */
+BOOL SafeMemoryWrite(UINT32* ptr, UINT32 value, UINT64 offset)
+{
+    UNREFERENCED_PARAMETER(offset);
+    *ptr = value;
+    return TRUE;
+}
+
+/*
+ * SIGINT/SIGTERM: stop the reactor, main() cleans up once it returns
+ */
+static void SignalHandler(int signal_num)
+{
+    UNREFERENCED_PARAMETER(signal_num);
+    g_server.Stop();
+}
+
+/*
+ * Create the TCP listening socket
+ */
+static SOCKET CreateListenSocket(int port)
+{
+    SOCKET listen_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listen_socket == INVALID_SOCKET) {
+        printf("[ERROR] TCP socket() failed: %d\n", errno);
+        return INVALID_SOCKET;
+    }
+
+    int reuse = 1;
+    setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in tcp_addr;
+    memset(&tcp_addr, 0, sizeof(tcp_addr));
+    tcp_addr.sin_family = AF_INET;
+    tcp_addr.sin_addr.s_addr = INADDR_ANY;  // Listen on all interfaces
+    tcp_addr.sin_port = htons(port);
+
+    if (bind(listen_socket, (struct sockaddr*)&tcp_addr, sizeof(tcp_addr)) == SOCKET_ERROR) {
+        printf("[ERROR] TCP bind() failed: %d\n", errno);
+        closesocket(listen_socket);
+        return INVALID_SOCKET;
+    }
+
+    if (listen(listen_socket, MAX_CLIENTS) == SOCKET_ERROR) {
+        printf("[ERROR] Failed to start listening on socket: %d\n", errno);
+        closesocket(listen_socket);
+        return INVALID_SOCKET;
+    }
+
+    return listen_socket;
+}
+
+int main(int argc, char* argv[])
+{
+    int port = TCP_SOCKET_PORT;
+    LONG max_sessions = 0;
+    unsigned handler_threads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-sessions") == 0 && i + 1 < argc) {
+            max_sessions = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--handler-threads") == 0 && i + 1 < argc) {
+            handler_threads = (unsigned)atoi(argv[++i]);
+        } else {
+            printf("Usage: %s [options]\n", argv[0]);
+            printf("  --port N          Listen on TCP port N (default %d)\n", TCP_SOCKET_PORT);
+            printf("  --max-sessions N  Serve up to N clients concurrently (default %d)\n", MAX_CLIENTS);
+            printf("  --handler-threads N  Run buffer tests and batches on N workers (default: one per CPU)\n");
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    // Session limit: --max-sessions, then WINAPI_MAX_SESSIONS, then the default
+    const char* max_sessions_env = getenv("WINAPI_MAX_SESSIONS");
+    if (max_sessions <= 0 && max_sessions_env) {
+        max_sessions = atol(max_sessions_env);
+    }
+    if (max_sessions <= 0) {
+        max_sessions = MAX_CLIENTS;
+    }
+    max_sessions = std::min(max_sessions, (LONG)MAX_SESSIONS_LIMIT);
+
+    const char* handler_threads_env = getenv("WINAPI_HANDLER_THREADS");
+    if (handler_threads == 0 && handler_threads_env) {
+        handler_threads = (unsigned)atoi(handler_threads_env);
+    }
+
+    // Failed sends are reported by send(), not by SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, SignalHandler);
+    signal(SIGTERM, SignalHandler);
+
+    SOCKET listen_socket = CreateListenSocket(port);
+    if (listen_socket == INVALID_SOCKET) {
+        return 1;
+    }
+    printf("[OK] Listening on TCP port %d\n", port);
+    fflush(stdout);
+
+    if (!g_server.Initialize(listen_socket, max_sessions, handler_threads, NULL, NULL)) {
+        closesocket(listen_socket);
+        return 1;
+    }
+    g_server.Run();
+
+    closesocket(listen_socket);
+    printf("Shutdown complete.\n");
+    return 0;
+}
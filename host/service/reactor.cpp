@@ -0,0 +1,562 @@
+/*
+ * Event-driven reactor: portable loop plus epoll and IOCP backends
+ */
+
+#include "reactor.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+#ifdef _WIN32
+
+#include <unordered_map>
+
+/*
+ * IOCP backend
+ *
+ * Completion ports report finished I/O rather than readiness, so readiness
+ * is derived the usual way: a zero-byte overlapped WSARecv completes when a
+ * connection has data (or was closed). Listener accepts and "send buffer
+ * space available again" come from WSAEventSelect; a thread pool wait on the
+ * event posts them to the same port, so one GetQueuedCompletionStatusEx
+ * call sees everything.
+ */
+struct IocpSocketState {
+    OVERLAPPED read_overlapped;
+    HANDLE port;
+    SOCKET socket;
+    ReactorHandler* handler;
+    unsigned interest;
+    BOOL listener;
+    BOOL read_posted;               // Zero-byte WSARecv outstanding
+    BOOL removed;                   // Freed once nothing is queued for it anymore
+    volatile LONG posted_packets;   // Event-select packets queued on the port
+    WSAEVENT select_event;
+    HANDLE wait_handle;
+};
+
+class IocpBackend : public ReactorBackend {
+public:
+    IocpBackend() : port(NULL) {}
+
+    ~IocpBackend()
+    {
+        if (port) {
+            CloseHandle(port);
+        }
+    }
+
+    BOOL Initialize()
+    {
+        port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+        return port != NULL;
+    }
+
+    const char* Name() const override
+    {
+        return "iocp";
+    }
+
+    BOOL Add(SOCKET socket, ReactorHandler* handler, unsigned interest, BOOL listener) override
+    {
+        IocpSocketState* state = new IocpSocketState();
+        ZeroMemory(state, sizeof(*state));
+        state->port = port;
+        state->socket = socket;
+        state->handler = handler;
+        state->interest = interest;
+        state->listener = listener;
+
+        if (!listener && CreateIoCompletionPort((HANDLE)socket, port, (ULONG_PTR)state, 0) == NULL) {
+            printf("[ERROR] Failed to associate socket with completion port: %lu\n", GetLastError());
+            delete state;
+            return FALSE;
+        }
+
+        // FD_WRITE only fires after a send hit WSAEWOULDBLOCK, exactly when the handler waits for it
+        state->select_event = WSACreateEvent();
+        if (state->select_event == WSA_INVALID_EVENT ||
+            WSAEventSelect(socket, state->select_event, listener ? FD_ACCEPT : FD_WRITE) == SOCKET_ERROR ||
+            !RegisterWaitForSingleObject(&state->wait_handle, state->select_event, SelectCallback, state,
+                                         INFINITE, WT_EXECUTEDEFAULT)) {
+            printf("[ERROR] Failed to register socket events: %d\n", WSAGetLastError());
+            if (state->select_event != WSA_INVALID_EVENT) {
+                WSACloseEvent(state->select_event);
+            }
+            delete state;
+            return FALSE;
+        }
+
+        sockets[socket] = state;
+        if ((interest & REACTOR_READ) && !listener) {
+            PostZeroByteRead(state);
+        }
+        return TRUE;
+    }
+
+    BOOL Modify(SOCKET socket, ReactorHandler* handler, unsigned interest) override
+    {
+        UNREFERENCED_PARAMETER(handler);
+
+        auto it = sockets.find(socket);
+        if (it == sockets.end()) {
+            return FALSE;
+        }
+
+        IocpSocketState* state = it->second;
+        state->interest = interest;
+        if ((interest & REACTOR_READ) && !state->listener && !state->read_posted) {
+            PostZeroByteRead(state);
+        }
+        return TRUE;
+    }
+
+    void Remove(SOCKET socket, ReactorHandler* handler) override
+    {
+        UNREFERENCED_PARAMETER(handler);
+
+        auto it = sockets.find(socket);
+        if (it == sockets.end()) {
+            return;
+        }
+
+        IocpSocketState* state = it->second;
+        sockets.erase(it);
+
+        // Waits for a running SelectCallback, no new packets are posted afterwards
+        UnregisterWaitEx(state->wait_handle, INVALID_HANDLE_VALUE);
+        WSAEventSelect(socket, NULL, 0);
+        WSACloseEvent(state->select_event);
+
+        if (state->read_posted) {
+            CancelIoEx((HANDLE)socket, &state->read_overlapped);
+        }
+
+        state->removed = TRUE;
+        ReleaseIfIdle(state);
+    }
+
+    int Wait(ReactorEvent* events, int max_events, int timeout_ms) override
+    {
+        OVERLAPPED_ENTRY entries[64];
+        ULONG count = 0;
+        int produced = 0;
+
+        if (max_events > 64) {
+            max_events = 64;
+        }
+
+        if (!GetQueuedCompletionStatusEx(port, entries, (ULONG)max_events, &count,
+                                         timeout_ms < 0 ? INFINITE : (DWORD)timeout_ms, FALSE)) {
+            return GetLastError() == WAIT_TIMEOUT ? 0 : -1;
+        }
+
+        for (ULONG i = 0; i < count; i++) {
+            IocpSocketState* state = (IocpSocketState*)entries[i].lpCompletionKey;
+            unsigned mask;
+
+            if (state == NULL) {
+                events[produced].handler = NULL;  // Wakeup
+                events[produced].events = 0;
+                produced++;
+                continue;
+            }
+
+            if (entries[i].lpOverlapped == &state->read_overlapped) {
+                state->read_posted = FALSE;
+                mask = REACTOR_READ;
+                if (entries[i].Internal != 0) {
+                    mask |= REACTOR_ERROR;
+                }
+            } else {
+                InterlockedDecrement(&state->posted_packets);
+                mask = entries[i].dwNumberOfBytesTransferred;
+            }
+
+            if (state->removed) {
+                ReleaseIfIdle(state);
+                continue;
+            }
+
+            // Zero-byte reads are one-shot, re-arm before the handler drains the socket
+            if ((mask & REACTOR_READ) && (state->interest & REACTOR_READ) && !state->listener && !state->read_posted) {
+                PostZeroByteRead(state);
+            }
+
+            events[produced].handler = state->handler;
+            events[produced].events = mask;
+            produced++;
+        }
+
+        return produced;
+    }
+
+    void Wakeup() override
+    {
+        PostQueuedCompletionStatus(port, 0, 0, NULL);
+    }
+
+private:
+    static void CALLBACK SelectCallback(PVOID context, BOOLEAN timed_out)
+    {
+        UNREFERENCED_PARAMETER(timed_out);
+
+        IocpSocketState* state = (IocpSocketState*)context;
+        WSANETWORKEVENTS network_events;
+        unsigned mask = 0;
+
+        if (WSAEnumNetworkEvents(state->socket, state->select_event, &network_events) == SOCKET_ERROR) {
+            return;
+        }
+        if (network_events.lNetworkEvents & FD_ACCEPT) {
+            mask |= REACTOR_READ;
+        }
+        if (network_events.lNetworkEvents & FD_WRITE) {
+            mask |= REACTOR_WRITE;
+        }
+
+        if (mask) {
+            InterlockedIncrement(&state->posted_packets);
+            PostQueuedCompletionStatus(state->port, mask, (ULONG_PTR)state, NULL);
+        }
+    }
+
+    void PostZeroByteRead(IocpSocketState* state)
+    {
+        WSABUF buffer;
+        DWORD flags = 0;
+
+        buffer.buf = NULL;
+        buffer.len = 0;
+        ZeroMemory(&state->read_overlapped, sizeof(state->read_overlapped));
+
+        if (WSARecv(state->socket, &buffer, 1, NULL, &flags, &state->read_overlapped, NULL) == 0 ||
+            WSAGetLastError() == WSA_IO_PENDING) {
+            state->read_posted = TRUE;
+            return;
+        }
+
+        // Report the failure through the port so the handler sees it in order
+        InterlockedIncrement(&state->posted_packets);
+        PostQueuedCompletionStatus(port, REACTOR_READ | REACTOR_ERROR, (ULONG_PTR)state, NULL);
+    }
+
+    void ReleaseIfIdle(IocpSocketState* state)
+    {
+        if (state->removed && !state->read_posted && state->posted_packets == 0) {
+            delete state;
+        }
+    }
+
+    HANDLE port;
+    std::unordered_map<SOCKET, IocpSocketState*> sockets;
+};
+
+ReactorBackend* CreateReactorBackend()
+{
+    IocpBackend* backend = new IocpBackend();
+    if (!backend->Initialize()) {
+        printf("[ERROR] Failed to create I/O completion port: %lu\n", GetLastError());
+        delete backend;
+        return NULL;
+    }
+    return backend;
+}
+
+#else  /* POSIX */
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+/*
+ * epoll backend (level-triggered)
+ */
+class EpollBackend : public ReactorBackend {
+public:
+    EpollBackend() : epoll_fd(-1), wake_fd(-1) {}
+
+    ~EpollBackend()
+    {
+        if (epoll_fd >= 0) {
+            close(epoll_fd);
+        }
+        if (wake_fd >= 0) {
+            close(wake_fd);
+        }
+    }
+
+    BOOL Initialize()
+    {
+        struct epoll_event ev;
+
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd < 0 || wake_fd < 0) {
+            return FALSE;
+        }
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+        return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) == 0;
+    }
+
+    const char* Name() const override
+    {
+        return "epoll";
+    }
+
+    BOOL Add(SOCKET socket, ReactorHandler* handler, unsigned interest, BOOL listener) override
+    {
+        UNREFERENCED_PARAMETER(listener);
+        return Control(EPOLL_CTL_ADD, socket, handler, interest);
+    }
+
+    BOOL Modify(SOCKET socket, ReactorHandler* handler, unsigned interest) override
+    {
+        return Control(EPOLL_CTL_MOD, socket, handler, interest);
+    }
+
+    void Remove(SOCKET socket, ReactorHandler* handler) override
+    {
+        UNREFERENCED_PARAMETER(handler);
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, socket, NULL);
+    }
+
+    int Wait(ReactorEvent* events, int max_events, int timeout_ms) override
+    {
+        struct epoll_event ready[64];
+        int count;
+
+        if (max_events > 64) {
+            max_events = 64;
+        }
+
+        count = epoll_wait(epoll_fd, ready, max_events, timeout_ms);
+        if (count < 0) {
+            return errno == EINTR ? 0 : -1;
+        }
+
+        for (int i = 0; i < count; i++) {
+            unsigned mask = 0;
+
+            events[i].handler = (ReactorHandler*)ready[i].data.ptr;
+            if (events[i].handler == NULL) {
+                uint64_t counter;
+                ssize_t drained = read(wake_fd, &counter, sizeof(counter));
+                UNREFERENCED_PARAMETER(drained);
+            }
+
+            if (ready[i].events & EPOLLIN) {
+                mask |= REACTOR_READ;
+            }
+            if (ready[i].events & EPOLLOUT) {
+                mask |= REACTOR_WRITE;
+            }
+            if (ready[i].events & (EPOLLERR | EPOLLHUP)) {
+                mask |= REACTOR_READ | REACTOR_ERROR;
+            }
+            events[i].events = mask;
+        }
+
+        return count;
+    }
+
+    void Wakeup() override
+    {
+        uint64_t one = 1;
+        ssize_t written = write(wake_fd, &one, sizeof(one));
+        UNREFERENCED_PARAMETER(written);
+    }
+
+private:
+    BOOL Control(int op, SOCKET socket, ReactorHandler* handler, unsigned interest)
+    {
+        struct epoll_event ev;
+
+        ev.events = 0;
+        if (interest & REACTOR_READ) {
+            ev.events |= EPOLLIN;
+        }
+        if (interest & REACTOR_WRITE) {
+            ev.events |= EPOLLOUT;
+        }
+        ev.data.ptr = handler;
+        return epoll_ctl(epoll_fd, op, socket, &ev) == 0;
+    }
+
+    int epoll_fd;
+    int wake_fd;
+};
+
+ReactorBackend* CreateReactorBackend()
+{
+    EpollBackend* backend = new EpollBackend();
+    if (!backend->Initialize()) {
+        printf("[ERROR] Failed to create epoll instance: %d\n", errno);
+        delete backend;
+        return NULL;
+    }
+    return backend;
+}
+
+#endif /* _WIN32 */
+
+/*
+ * Reactor
+ */
+Reactor::Reactor() : backend(NULL), stopping(0)
+{
+}
+
+Reactor::~Reactor()
+{
+    ReleaseClosed();
+    delete backend;
+}
+
+BOOL Reactor::Initialize()
+{
+    backend = CreateReactorBackend();
+    return backend != NULL;
+}
+
+const char* Reactor::BackendName() const
+{
+    return backend ? backend->Name() : "none";
+}
+
+BOOL Reactor::Add(SOCKET socket, ReactorHandler* handler, unsigned interest, BOOL listener)
+{
+    if (!SetSocketNonBlocking(socket)) {
+        printf("[ERROR] Failed to make socket non-blocking: %d\n", LastSocketError());
+        return FALSE;
+    }
+    return backend->Add(socket, handler, interest, listener);
+}
+
+BOOL Reactor::Modify(SOCKET socket, ReactorHandler* handler, unsigned interest)
+{
+    return backend->Modify(socket, handler, interest);
+}
+
+void Reactor::Remove(SOCKET socket, ReactorHandler* handler)
+{
+    backend->Remove(socket, handler);
+}
+
+void Reactor::Close(SOCKET socket, ReactorHandler* handler)
+{
+    if (handler->closed) {
+        return;
+    }
+
+    backend->Remove(socket, handler);
+    closesocket(socket);
+    handler->closed = TRUE;
+    ForgetPoll(handler);
+    closed_handlers.push_back(handler);
+}
+
+void Reactor::Release(ReactorHandler* handler)
+{
+    handler->closed = TRUE;
+    ForgetPoll(handler);
+    closed_handlers.push_back(handler);
+}
+
+void Reactor::Post(ReactorTask* task)
+{
+    {
+        std::lock_guard<std::mutex> guard(posted_lock);
+        posted_tasks.push_back(task);
+    }
+    backend->Wakeup();
+}
+
+void Reactor::RunPosted()
+{
+    std::vector<ReactorTask*> tasks;
+
+    {
+        std::lock_guard<std::mutex> guard(posted_lock);
+        tasks.swap(posted_tasks);
+    }
+
+    for (size_t i = 0; i < tasks.size(); i++) {
+        tasks[i]->Run(this);
+        delete tasks[i];
+    }
+}
+
+void Reactor::Poll(ReactorHandler* handler)
+{
+    if (!handler->closed &&
+        std::find(polled_handlers.begin(), polled_handlers.end(), handler) == polled_handlers.end()) {
+        polled_handlers.push_back(handler);
+    }
+}
+
+/*
+ * Give every handler that asked for it another turn; those that still have
+ * nothing ask again and keep the next wait from blocking
+ */
+void Reactor::RunPolled()
+{
+    std::vector<ReactorHandler*> handlers;
+
+    handlers.swap(polled_handlers);
+    for (size_t i = 0; i < handlers.size() && !stopping; i++) {
+        if (!handlers[i]->closed) {
+            handlers[i]->OnEvent(this, 0);
+        }
+    }
+}
+
+void Reactor::ForgetPoll(ReactorHandler* handler)
+{
+    polled_handlers.erase(std::remove(polled_handlers.begin(), polled_handlers.end(), handler),
+                          polled_handlers.end());
+}
+
+void Reactor::Run()
+{
+    ReactorEvent events[64];
+
+    while (!stopping) {
+        int count = backend->Wait(events, 64, polled_handlers.empty() ? -1 : 0);
+        if (count < 0) {
+            printf("[ERROR] Reactor wait failed: %d\n", LastSocketError());
+            break;
+        }
+
+        for (int i = 0; i < count && !stopping; i++) {
+            if (events[i].handler && !events[i].handler->closed) {
+                events[i].handler->OnEvent(this, events[i].events);
+            }
+        }
+
+        // Completions handed back by other threads (they come with a wakeup)
+        RunPosted();
+
+        RunPolled();
+
+        // Handlers closed during this batch may still have had events queued in it
+        ReleaseClosed();
+    }
+}
+
+void Reactor::Stop()
+{
+    InterlockedExchange(&stopping, 1);
+    if (backend) {
+        backend->Wakeup();
+    }
+}
+
+void Reactor::ReleaseClosed()
+{
+    for (size_t i = 0; i < closed_handlers.size(); i++) {
+        delete closed_handlers[i];
+    }
+    closed_handlers.clear();
+}
@@ -0,0 +1,122 @@
+/*
+ * Event-driven reactor for the service core
+ *
+ * One thread multiplexes the listening socket and every client socket.
+ * Handlers receive readiness events (readable, writable, error) and do
+ * non-blocking I/O themselves. The OS-specific part sits behind
+ * ReactorBackend: epoll on Linux, an I/O completion port on Windows.
+ * A handler busy-polling something other than a socket asks for another
+ * turn with Poll(), and the loop then checks the sockets without blocking.
+ */
+
+#ifndef WINAPI_REACTOR_H
+#define WINAPI_REACTOR_H
+
+#include "platform.h"
+
+#include <mutex>
+#include <vector>
+
+// Readiness events
+#define REACTOR_READ    0x1
+#define REACTOR_WRITE   0x2
+#define REACTOR_ERROR   0x4   // Hang-up or socket error, reading reports the details
+
+class Reactor;
+
+// Socket owner registered with the reactor
+class ReactorHandler {
+public:
+    ReactorHandler() : closed(FALSE) {}
+    virtual ~ReactorHandler() {}
+
+    virtual void OnEvent(Reactor* reactor, unsigned events) = 0;
+
+    BOOL closed;   // Set by Reactor::Close, no further events are delivered
+};
+
+// Work handed to the reactor thread from another thread
+class ReactorTask {
+public:
+    virtual ~ReactorTask() {}
+
+    // Runs on the reactor thread; the task is deleted afterwards
+    virtual void Run(Reactor* reactor) = 0;
+};
+
+struct ReactorEvent {
+    ReactorHandler* handler;   // NULL for a wakeup
+    unsigned events;
+};
+
+// OS readiness mechanism
+class ReactorBackend {
+public:
+    virtual ~ReactorBackend() {}
+
+    virtual const char* Name() const = 0;
+    virtual BOOL Add(SOCKET socket, ReactorHandler* handler, unsigned interest, BOOL listener) = 0;
+    virtual BOOL Modify(SOCKET socket, ReactorHandler* handler, unsigned interest) = 0;
+    virtual void Remove(SOCKET socket, ReactorHandler* handler) = 0;
+
+    // Wait for events (timeout_ms < 0 waits forever), returns the event count or -1
+    virtual int Wait(ReactorEvent* events, int max_events, int timeout_ms) = 0;
+
+    // Interrupt Wait from any thread
+    virtual void Wakeup() = 0;
+};
+
+// Backend for the platform the service was built for
+ReactorBackend* CreateReactorBackend();
+
+class Reactor {
+public:
+    Reactor();
+    ~Reactor();
+
+    BOOL Initialize();
+    const char* BackendName() const;
+
+    BOOL Add(SOCKET socket, ReactorHandler* handler, unsigned interest, BOOL listener = FALSE);
+    BOOL Modify(SOCKET socket, ReactorHandler* handler, unsigned interest);
+
+    // Unregister a socket the caller keeps owning
+    void Remove(SOCKET socket, ReactorHandler* handler);
+
+    // Unregister and close the socket; the handler is deleted once the current batch is done
+    void Close(SOCKET socket, ReactorHandler* handler);
+
+    // Delete a handler (already closed or never added) once the current batch is done
+    void Release(ReactorHandler* handler);
+
+    // Queue a task for the reactor thread (thread-safe)
+    void Post(ReactorTask* task);
+
+    // Call handler->OnEvent with no events after the next pass, which does not block (reactor thread)
+    void Poll(ReactorHandler* handler);
+
+    // Run tasks posted so far
+    void RunPosted();
+
+    // Dispatch events until Stop() is called
+    void Run();
+
+    // Thread-safe (and signal-safe on POSIX)
+    void Stop();
+
+    // Delete handlers closed outside of Run()
+    void ReleaseClosed();
+
+private:
+    void RunPolled();
+    void ForgetPoll(ReactorHandler* handler);
+
+    ReactorBackend* backend;
+    volatile LONG stopping;
+    std::vector<ReactorHandler*> closed_handlers;
+    std::vector<ReactorHandler*> polled_handlers;
+    std::mutex posted_lock;
+    std::vector<ReactorTask*> posted_tasks;
+};
+
+#endif /* WINAPI_REACTOR_H */
@@ -0,0 +1,137 @@
+/*
+ * Shared memory rings of one session
+ */
+
+#include "ring_region.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "api_handlers.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Default spin window ceiling of an empty request ring
+#define DEFAULT_RING_SPIN_US 50
+
+/*
+ * Spin window ceiling from WINAPI_RING_SPIN_US, in nanoseconds
+ */
+static UINT64 ReadRingSpinLimit()
+{
+    const char* spin_us = getenv("WINAPI_RING_SPIN_US");
+    return (UINT64)(spin_us ? strtoul(spin_us, NULL, 0) : DEFAULT_RING_SPIN_US) * 1000;
+}
+
+static UINT64 RingSpinLimit()
+{
+    static const UINT64 limit = ReadRingSpinLimit();
+    return limit;
+}
+
+RingRegion::RingRegion()
+    : view(NULL), size(0)
+#ifdef _WIN32
+      , file(INVALID_HANDLE_VALUE), mapping(NULL)
+#endif
+{
+    memset(&requests, 0, sizeof(requests));
+    memset(&responses, 0, sizeof(responses));
+    winapi_ring_poll_init(&poller, 0);
+}
+
+RingRegion::~RingRegion()
+{
+    Close();
+}
+
+/*
+ * Map the whole file read/write, shared with the client
+ */
+BOOL RingRegion::Open(const std::string& guest_path)
+{
+#ifdef _WIN32
+    std::string path = WindowsPath(guest_path);
+    LARGE_INTEGER file_size;
+
+    // The client unlinks the file as soon as the handshake is over
+    file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                       FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &file_size)) {
+        printf("[WARN] Cannot open ring region %s: %lu\n", path.c_str(), GetLastError());
+        Close();
+        return FALSE;
+    }
+    size = (size_t)file_size.QuadPart;
+
+    mapping = size >= WINAPI_SHM_RING_REGION_SIZE ?
+              CreateFileMappingA(file, NULL, PAGE_READWRITE, 0, 0, NULL) : NULL;
+    view = mapping ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0) : NULL;
+#else
+    const std::string& path = guest_path;
+    struct stat file_stat;
+
+    int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &file_stat) < 0) {
+        printf("[WARN] Cannot open ring region %s: %d\n", path.c_str(), errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return FALSE;
+    }
+    size = (size_t)file_stat.st_size;
+
+    if (size >= WINAPI_SHM_RING_REGION_SIZE) {
+        view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (view == MAP_FAILED) {
+            view = NULL;
+        }
+    }
+    close(fd);
+#endif
+
+    if (!view) {
+        printf("[WARN] Cannot map ring region %s (%zu bytes)\n", path.c_str(), size);
+        Close();
+        return FALSE;
+    }
+
+    if (winapi_shm_attach(view, size, &requests, &responses) < 0) {
+        printf("[WARN] Ring region %s has an invalid layout\n", path.c_str());
+        Close();
+        return FALSE;
+    }
+
+    winapi_ring_poll_init(&poller, RingSpinLimit());
+    printf("[INFO] Mapped ring region %s: %u slots of %u bytes each way, polled for up to %llu us\n",
+           path.c_str(), requests.slot_count, requests.slot_size, (unsigned long long)(poller.spin_limit_ns / 1000));
+    return TRUE;
+}
+
+void RingRegion::Close()
+{
+#ifdef _WIN32
+    if (view) {
+        UnmapViewOfFile(view);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+    }
+    mapping = NULL;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if (view) {
+        munmap(view, size);
+    }
+#endif
+    view = NULL;
+    size = 0;
+}
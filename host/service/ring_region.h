@@ -0,0 +1,46 @@
+/*
+ * Shared memory rings of one session
+ *
+ * With WINAPI_CAP_SHM_RING the client creates the region and names it in
+ * its handshake; the service maps the same file (a /mnt/c path becomes a
+ * C: path on Windows) and checks its layout before agreeing. Requests are
+ * taken from the client-to-host ring and small responses go back through
+ * the host-to-client ring, both on the reactor thread only. An empty
+ * request ring is busy-polled for up to WINAPI_RING_SPIN_US microseconds
+ * (default 50, 0 to always block) before the client is asked for a
+ * doorbell.
+ */
+
+#ifndef WINAPI_RING_REGION_H
+#define WINAPI_RING_REGION_H
+
+#include "platform.h"
+
+#include <string>
+
+#include "../../common/shm_ring.h"
+
+class RingRegion {
+public:
+    RingRegion();
+    ~RingRegion();
+
+    // Map the client's region file and attach to its rings
+    BOOL Open(const std::string& guest_path);
+
+    winapi_ring_t requests;       // Client to host, consumed here
+    winapi_ring_t responses;      // Host to client, produced here
+    winapi_ring_poll_t poller;    // Busy-poll state of the request ring
+
+private:
+    void Close();
+
+    void* view;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+#endif /* WINAPI_RING_REGION_H */
@@ -0,0 +1,1300 @@
+/*
+ * Client sessions on the reactor
+ */
+
+#include "session.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+
+#include "buffer_table.h"
+#include "ring_region.h"
+#include "../../common/checksum.h"
+
+#define READ_CHUNK_SIZE         (64 * 1024)
+#define MAX_READ_PER_EVENT      (4 * 1024 * 1024)  // Lets other connections run between large payloads
+#define MAX_SEND_VECS           64                 // Scatter-gather entries per send
+#define MAX_SPARE_OUTPUT        (256 * 1024)       // Largest sent response buffer kept for reuse
+
+ConnectionTask::ConnectionTask(ClientConnection* connection, BOOL ordered)
+    : connection(connection), ordered(ordered), binary(FALSE), ring(FALSE), json_valid(FALSE), fast(FALSE), json_output(NULL),
+      json_output_start(0), has_payload(FALSE), payload(), send_info(), failed(FALSE)
+{
+}
+
+/*
+ * Run the request's handler (pool worker, or reactor thread for inline requests)
+ */
+void ConnectionTask::Execute()
+{
+    if (binary) {
+        ExecuteBinaryRequest(&connection->session, &request, has_payload ? &payload : NULL, &binary_response, &send_info);
+        return;
+    }
+
+    if (fast) {
+        try {
+            ProcessFastRequest(&connection->session, fast_request, has_payload ? &payload : NULL, *json_output, &send_info);
+        } catch (...) {
+            printf("[ERROR] Exception during request processing\n");
+            failed = TRUE;
+        }
+        return;
+    }
+
+    if (!json_valid) {
+        Json::StreamWriterBuilder builder;
+        json_response = Json::writeString(builder, CreateErrorResponse(0, "Invalid JSON"));
+        return;
+    }
+
+    try {
+        ProcessAPIRequest(&connection->session, json, has_payload ? &payload : NULL, json_response, &send_info);
+    } catch (...) {
+        printf("[ERROR] Exception during request processing\n");
+        failed = TRUE;
+    }
+}
+
+void ConnectionTask::Run(Reactor* reactor)
+{
+    connection->CompleteTask(this, reactor);
+}
+
+ClientConnection::ClientConnection(SessionServer* server, SOCKET socket, UINT32 session_id)
+    : pending_tasks(0), owner(NULL), lane(0), server(server), input_start(0), input_end(0), frame_size(0),
+      frame_json_valid(FALSE), frame_fast_valid(FALSE), frame_binary(FALSE), frame_ring(FALSE), ring_polling(FALSE), payload_pending(FALSE), payload_complete(FALSE), payload_stream(FALSE), chunk_pending(FALSE),
+      chunk_remaining(0), stream_granted(0), stream_received(0), stream_size(0), stripe_count(0), kicked(FALSE),
+      ordered_pending(FALSE), pending_output(0), output_blocked(FALSE),
+      interest(REACTOR_READ)
+{
+    memset(&stream_chunk, 0, sizeof(stream_chunk));
+    memset(&session, 0, sizeof(session));
+    session.socket = socket;
+    session.session_id = session_id;
+
+    // Until the handshake completes, only plain JSON is accepted
+    session.agreed.buffer_backings = WINAPI_BACKING_SOCKET;
+}
+
+/*
+ * Reactor event: read what arrived, run complete requests, send responses
+ */
+void ClientConnection::OnEvent(Reactor* reactor, unsigned events)
+{
+    if ((events & REACTOR_READ) && !ReadInput()) {
+        server->CloseConnection(this);
+        return;
+    }
+
+    Service(reactor);
+}
+
+void ClientConnection::Service(Reactor* reactor)
+{
+    for (;;) {
+        if (!ProcessInput() || !ProcessRing()) {
+            server->CloseConnection(this);
+            return;
+        }
+
+        BOOL backlogged = pending_output >= MAX_PENDING_OUTPUT;
+        if (!FlushOutput()) {
+            server->CloseConnection(this);
+            return;
+        }
+
+        // Requests held back by a full output queue run once it has drained
+        if (!backlogged || pending_output >= MAX_PENDING_OUTPUT) {
+            break;
+        }
+    }
+
+    UpdateInterest(reactor);
+    if (ring_polling) {
+        reactor->Poll(this);
+    }
+
+    // Data connections run after their session, which may have queued READ
+    // stripes or credits on them or be waiting for their last chunk
+    if (owner && owner->payload_pending && owner->payload_complete) {
+        owner->Service(reactor);
+    }
+    ServiceLanes(reactor);
+}
+
+/*
+ * Run the data connections this session queued work on
+ */
+void ClientConnection::ServiceLanes(Reactor* reactor)
+{
+    for (size_t i = 0; i < lanes.size() && !closed; i++) {
+        ClientConnection* data = lanes[i];
+        if (data && data->kicked) {
+            data->kicked = FALSE;
+            data->Service(reactor);
+        }
+    }
+}
+
+/*
+ * Receive everything the socket has without blocking; payload bytes go
+ * straight through the sink instead of into the input buffer
+ */
+BOOL ClientConnection::ReadInput()
+{
+    size_t total_received = 0;
+
+    while (total_received < MAX_READ_PER_EVENT) {
+        BOOL streaming = chunk_pending && chunk_remaining > 0;
+        char* buffer;
+        size_t capacity;
+
+        if (streaming) {
+            buffer = server->PayloadChunk();
+            capacity = (size_t)std::min(chunk_remaining, (UINT64)PAYLOAD_CHUNK_SIZE);
+        } else {
+            // Reclaim consumed space before growing the buffer
+            if (input_start == input_end) {
+                input_start = input_end = 0;
+            } else if (input_start > 0 && input.size() - input_end < READ_CHUNK_SIZE) {
+                memmove(&input[0], &input[input_start], input_end - input_start);
+                input_end -= input_start;
+                input_start = 0;
+            }
+
+            size_t wanted = std::max((size_t)READ_CHUNK_SIZE, frame_size);
+            if (input.size() - input_end < READ_CHUNK_SIZE || input.size() < wanted) {
+                input.resize(std::max(input_end + READ_CHUNK_SIZE, wanted));
+            }
+            buffer = &input[input_end];
+            capacity = input.size() - input_end;
+        }
+
+        int received = recv(session.socket, buffer, (int)capacity, 0);
+        if (received == 0) {
+            printf("[INFO] Client disconnected gracefully\n");
+            return FALSE;
+        }
+        if (received < 0) {
+            int error = LastSocketError();
+            if (SOCKET_WOULD_BLOCK(error)) {
+                break;
+            }
+            printf("[ERROR] Failed to receive from client: %d\n", error);
+            return FALSE;
+        }
+
+        // Checksummed while still in cache, then the chunk is reused
+        if (streaming) {
+            payload_sink.Consume(buffer, received);
+            chunk_remaining -= received;
+        } else {
+            input_end += received;
+        }
+        total_received += received;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Run every complete request in the input buffer; stream chunks and credits
+ * are handled even while new requests are held back
+ */
+BOOL ClientConnection::ProcessInput()
+{
+    for (;;) {
+        if (chunk_pending) {
+            // Payload bytes that arrived with the frame, ReadInput streams the rest
+            size_t buffered = (size_t)std::min((UINT64)(input_end - input_start), chunk_remaining);
+            if (buffered > 0) {
+                payload_sink.Consume(&input[input_start], buffered);
+                input_start += buffered;
+                chunk_remaining -= buffered;
+            }
+            if (chunk_remaining > 0) {
+                break;
+            }
+            FinishChunk();
+        }
+
+        if (payload_pending && payload_complete) {
+            if (!DispatchFrame()) {
+                return FALSE;
+            }
+
+            payload_pending = FALSE;
+            frame_json_valid = FALSE;
+            frame_fast_valid = FALSE;
+            frame_json = Json::Value();
+            continue;
+        }
+
+        size_t size;
+        if (!FrameSize(&size)) {
+            return FALSE;
+        }
+        if (size == 0 || input_end - input_start < size) {
+            break;
+        }
+
+        const char* frame = &input[input_start];
+        UINT32 magic;
+        memcpy(&magic, frame, sizeof(magic));
+
+        UINT32 message_type = !frame_json_valid && magic == WINAPI_MESSAGE_MAGIC ?
+                              ((const winapi_message_header_t*)frame)->message_type : 0;
+        if (!frame_json_valid && magic == WINAPI_STREAM_MAGIC) {
+            if (!StartChunk(frame)) {
+                return FALSE;
+            }
+        } else if (message_type == WINAPI_MSG_CREDIT) {
+            GrantCredit(frame);
+        } else if (message_type == WINAPI_MSG_DOORBELL) {
+            // Nothing to do: ProcessRing follows every pass over the input
+        } else if (owner) {
+            printf("[ERROR] Request received on a data connection of session %u\n", owner->session.session_id);
+            return FALSE;
+        } else if (payload_pending && stripe_count > 0) {
+            // Pipelined behind a striped payload still arriving on the data connections
+            break;
+        } else if (payload_pending) {
+            printf("[ERROR] Request received in the middle of a payload stream\n");
+            return FALSE;
+        } else if (pending_output >= MAX_PENDING_OUTPUT || pending_tasks >= MAX_PENDING_TASKS || ordered_pending) {
+            // New requests wait for the output queue or the pool to drain
+            break;
+        } else if (!StartRequest(frame)) {
+            return FALSE;
+        }
+
+        input_start += size;
+        frame_size = 0;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Decode the request frame at the head of the input and expect its payload;
+ * the request stays in frame_request / frame_json while the payload streams in
+ */
+BOOL ClientConnection::StartRequest(const char* frame)
+{
+    frame_binary = !frame_json_valid && *(const UINT32*)frame == WINAPI_MESSAGE_MAGIC;
+    frame_ring = FALSE;
+
+    if (frame_binary) {
+        const winapi_message_header_t* header = (const winapi_message_header_t*)frame;
+        size_t descriptors_size = header->buffer_count * sizeof(winapi_buffer_desc_t);
+
+        memcpy(&frame_request.header, header, sizeof(*header));
+        memcpy(frame_request.buffers, frame + sizeof(*header), descriptors_size);
+        memcpy(frame_request.inline_data, frame + sizeof(*header) + descriptors_size, header->inline_size);
+    }
+
+    UINT32 stripes = frame_binary ? StripeCount(&frame_request) : 0;
+    if (stripes > 0 && !LanesReady(stripes)) {
+        printf("[ERROR] Request %llu is striped across %u data connections, session %u has fewer\n",
+               (unsigned long long)frame_request.header.request_id, stripes, session.session_id);
+        return FALSE;
+    }
+
+    UINT64 payload_size = 0;
+    payload_stream = frame_binary && (session.agreed.capabilities & WINAPI_CAP_STREAMING) &&
+                     StreamedPayloadSize(&frame_request, &payload_size);
+    if (!payload_stream) {
+        if (frame_binary) {
+            payload_size = SocketPayloadSize(&frame_request);
+        } else if (frame_json_valid) {
+            payload_size = frame_fast_valid ? SocketPayloadSize(frame_fast) : SocketPayloadSize(frame_json);
+        }
+    }
+
+    payload_sink.Reset(payload_size, frame_binary && (frame_request.header.flags & WINAPI_MSG_FLAG_CRC32C));
+    payload_pending = TRUE;
+    payload_complete = FALSE;
+    stripe_count = payload_stream ? stripes : 0;
+
+    if (stripe_count > 0) {
+        // Chunks arrive on the data connections
+        stream_size = payload_size;
+        payload_complete = payload_size == 0;
+        StartStripes();
+    } else if (payload_stream) {
+        // Chunks follow as the client gets credit
+        stream_granted = 0;
+        QueueCredit(frame_request.header.request_id, WINAPI_STREAM_WINDOW);
+    } else {
+        chunk_pending = TRUE;
+        chunk_remaining = payload_size;
+    }
+    return TRUE;
+}
+
+/*
+ * Run the requests waiting in the client's request ring under the same
+ * limits as socket requests; once it is empty, ask for a doorbell
+ */
+BOOL ClientConnection::ProcessRing()
+{
+    RingRegion* ring = session.ring;
+    UINT64 frame[WINAPI_RING_SLOT_SIZE / sizeof(UINT64)];
+
+    ring_polling = FALSE;
+
+    // The frame_* state belongs to a socket request until its payload is in
+    while (ring && !payload_pending) {
+        // Held back like socket requests; the pass after the backlog clears picks them up
+        if (pending_output >= MAX_PENDING_OUTPUT || pending_tasks >= MAX_PENDING_TASKS || ordered_pending) {
+            break;
+        }
+
+        long size = winapi_ring_receive(&ring->requests, frame, sizeof(frame));
+        if (size < 0) {
+            printf("[ERROR] Corrupt request ring on session %u\n", session.session_id);
+            return FALSE;
+        }
+        if (size == 0) {
+            // Spin a slice of the window and come back after the reactor's next pass
+            int poll_state = winapi_ring_poll(&ring->requests, &ring->poller, RING_POLL_SLICE_NS);
+            if (poll_state == WINAPI_POLL_AGAIN) {
+                ring_polling = TRUE;
+                break;
+            }
+            if (poll_state == WINAPI_POLL_BLOCK && winapi_ring_wait(&ring->requests)) {
+                break;
+            }
+            continue;
+        }
+        winapi_ring_poll_arrival(&ring->poller);
+
+        if (!StartRingRequest((const char*)frame, (size_t)size) || !DispatchFrame()) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/*
+ * Decode a request taken from the ring: one whole frame, without payload
+ */
+BOOL ClientConnection::StartRingRequest(const char* frame, size_t size)
+{
+    const winapi_message_header_t* header = (const winapi_message_header_t*)frame;
+
+    if (size < sizeof(*header) || header->magic != WINAPI_MESSAGE_MAGIC ||
+        header->message_type != WINAPI_MSG_REQUEST ||
+        header->buffer_count > WINAPI_MAX_BUFFERS || header->inline_size > WINAPI_MAX_INLINE_DATA ||
+        size != sizeof(*header) + header->buffer_count * sizeof(winapi_buffer_desc_t) + header->inline_size ||
+        (header->flags & (WINAPI_MSG_FLAG_SOCKET_PAYLOAD | WINAPI_MSG_FLAG_STREAM | WINAPI_MSG_FLAG_STRIPED))) {
+        printf("[ERROR] Invalid frame in the request ring of session %u\n", session.session_id);
+        return FALSE;
+    }
+
+    size_t descriptors_size = header->buffer_count * sizeof(winapi_buffer_desc_t);
+    memcpy(&frame_request.header, header, sizeof(*header));
+    memcpy(frame_request.buffers, frame + sizeof(*header), descriptors_size);
+    memcpy(frame_request.inline_data, frame + sizeof(*header) + descriptors_size, header->inline_size);
+
+    frame_binary = TRUE;
+    frame_ring = TRUE;
+    payload_sink.Reset(0, FALSE);
+    return TRUE;
+}
+
+/*
+ * Hand a response to the client through its response ring, waking it if it
+ * went idle; FALSE if the ring is full and the socket has to carry it
+ */
+BOOL ClientConnection::SendRing(const char* frame, size_t size)
+{
+    const void* parts[1] = { frame };
+    size_t sizes[1] = { size };
+
+    if (!session.ring || winapi_ring_send(&session.ring->responses, parts, sizes, 1) < 0) {
+        return FALSE;
+    }
+    if (winapi_ring_doorbell(&session.ring->responses)) {
+        QueueDoorbell();
+    }
+    return TRUE;
+}
+
+/*
+ * Wake a client waiting on the socket for its response ring
+ */
+void ClientConnection::QueueDoorbell()
+{
+    winapi_message_header_t header;
+    BufferSendInfo no_payload = BufferSendInfo();
+
+    memset(&header, 0, sizeof(header));
+    header.magic = WINAPI_MESSAGE_MAGIC;
+    header.version = WINAPI_PROTOCOL_VERSION;
+    header.message_type = WINAPI_MSG_DOORBELL;
+
+    if (session.agreed.capabilities & WINAPI_CAP_CHECKSUM_CRC32C) {
+        header.flags |= WINAPI_MSG_FLAG_CRC32C;
+        header.frame_crc = winapi_frame_crc32c(&header, NULL, 0, NULL, 0);
+    }
+
+    QueueOutput((const char*)&header, sizeof(header), &no_payload);
+}
+
+/*
+ * Whether data connections 0 to count - 1 are attached
+ */
+BOOL ClientConnection::LanesReady(UINT32 count) const
+{
+    if (count > lanes.size()) {
+        return FALSE;
+    }
+    for (UINT32 i = 0; i < count; i++) {
+        if (!lanes[i]) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Striped payload expected: open the window on every lane that has chunks to send
+ */
+void ClientConnection::StartStripes()
+{
+    UINT64 chunks = (stream_size + WINAPI_STREAM_CHUNK_SIZE - 1) / WINAPI_STREAM_CHUNK_SIZE;
+
+    for (UINT32 i = 0; i < stripe_count; i++) {
+        ClientConnection* data = lanes[i];
+        data->stream_granted = 0;
+        data->stream_received = 0;
+        if (i < chunks) {
+            data->QueueCredit(frame_request.header.request_id, WINAPI_STREAM_WINDOW);
+            data->kicked = TRUE;
+        }
+    }
+}
+
+/*
+ * Stream chunk header: its data goes through the sink like a plain payload
+ */
+BOOL ClientConnection::StartChunk(const char* frame)
+{
+    winapi_stream_chunk_t chunk;
+    memcpy(&chunk, frame, sizeof(chunk));
+
+    if (owner) {
+        return StartStripeChunk(chunk);
+    }
+
+    UINT64 remaining = payload_sink.Remaining();
+    UINT64 received = payload_sink.Digest().size;
+
+    if (!payload_pending || !payload_stream || stripe_count > 0 || chunk.request_id != frame_request.header.request_id ||
+        chunk.offset != received ||
+        chunk.size > WINAPI_STREAM_CHUNK_SIZE || chunk.size > remaining ||
+        ((chunk.flags & WINAPI_STREAM_LAST) != 0) != (chunk.size == remaining) ||
+        received + chunk.size > stream_granted) {
+        printf("[ERROR] Unexpected stream chunk for request %llu: %u bytes\n",
+               (unsigned long long)chunk.request_id, chunk.size);
+        return FALSE;
+    }
+
+    stream_chunk = chunk;
+    chunk_pending = TRUE;
+    chunk_remaining = chunk.size;
+    return TRUE;
+}
+
+/*
+ * Stream chunk on a data connection: digested here, merged into the session's payload
+ */
+BOOL ClientConnection::StartStripeChunk(const winapi_stream_chunk_t& chunk)
+{
+    ClientConnection* primary = owner;
+    UINT32 stripes = primary->stripe_count;
+
+    // Lane chunks arrive in order and all but the payload's last are full
+    UINT64 expected = stripes == 0 ? 0 :
+                      (lane + (stream_received / WINAPI_STREAM_CHUNK_SIZE) * stripes) * (UINT64)WINAPI_STREAM_CHUNK_SIZE;
+
+    if (!primary->payload_pending || stripes == 0 || chunk.request_id != primary->frame_request.header.request_id ||
+        chunk.offset != expected || chunk.offset >= primary->stream_size ||
+        chunk.size != std::min((UINT64)WINAPI_STREAM_CHUNK_SIZE, primary->stream_size - chunk.offset) ||
+        stream_received + chunk.size > stream_granted) {
+        printf("[ERROR] Unexpected stream chunk on data connection %u of session %u: request %llu, offset %llu\n",
+               lane, primary->session.session_id, (unsigned long long)chunk.request_id,
+               (unsigned long long)chunk.offset);
+        return FALSE;
+    }
+
+    payload_sink.Reset(chunk.size, (primary->frame_request.header.flags & WINAPI_MSG_FLAG_CRC32C) ? TRUE : FALSE);
+    stream_received += chunk.size;
+    stream_chunk = chunk;
+    chunk_pending = TRUE;
+    chunk_remaining = chunk.size;
+    return TRUE;
+}
+
+/*
+ * Data connection chunk received: check it, merge it and credit the lane if it carries more
+ */
+void ClientConnection::FinishStripeChunk()
+{
+    ClientConnection* primary = owner;
+
+    if (primary->frame_request.header.flags & WINAPI_MSG_FLAG_CRC32C) {
+        UINT32 crc = payload_sink.TakeCrc();
+        if (crc != stream_chunk.crc) {
+            printf("[ERROR] Stream chunk CRC mismatch on request %llu at offset %llu: 0x%08x, expected 0x%08x\n",
+                   (unsigned long long)stream_chunk.request_id, (unsigned long long)stream_chunk.offset,
+                   crc, stream_chunk.crc);
+            payload_sink.MarkCorrupt();
+        }
+    }
+
+    primary->payload_sink.Merge(payload_sink.Digest());
+    if (primary->payload_sink.Remaining() == 0) {
+        primary->payload_complete = TRUE;
+    }
+
+    UINT64 next = stream_chunk.offset + (UINT64)primary->stripe_count * WINAPI_STREAM_CHUNK_SIZE;
+    if (next < primary->stream_size) {
+        QueueCredit(stream_chunk.request_id, stream_chunk.size);
+    }
+}
+
+/*
+ * All bytes of the chunk (or plain payload) went through the sink
+ */
+void ClientConnection::FinishChunk()
+{
+    chunk_pending = FALSE;
+
+    if (owner) {
+        FinishStripeChunk();
+        return;
+    }
+
+    if (!payload_stream) {
+        payload_complete = TRUE;
+        return;
+    }
+
+    if (frame_request.header.flags & WINAPI_MSG_FLAG_CRC32C) {
+        UINT32 crc = payload_sink.TakeCrc();
+        if (crc != stream_chunk.crc) {
+            printf("[ERROR] Stream chunk CRC mismatch on request %llu: 0x%08x, expected 0x%08x\n",
+                   (unsigned long long)stream_chunk.request_id, crc, stream_chunk.crc);
+            payload_sink.MarkCorrupt();
+        }
+    }
+
+    if (stream_chunk.flags & WINAPI_STREAM_LAST) {
+        payload_complete = TRUE;
+    } else {
+        QueueCredit(stream_chunk.request_id, stream_chunk.size);
+    }
+}
+
+/*
+ * Credit frame from the client: let its READ stream send further
+ */
+void ClientConnection::GrantCredit(const char* frame)
+{
+    const winapi_message_header_t* header = (const winapi_message_header_t*)frame;
+    winapi_stream_credit_t credit;
+
+    if (header->inline_size != sizeof(credit) || header->buffer_count != 0) {
+        printf("[WARN] Ignoring malformed credit frame\n");
+        return;
+    }
+    memcpy(&credit, frame + sizeof(*header), sizeof(credit));
+
+    if ((header->flags & WINAPI_MSG_FLAG_CRC32C) &&
+        winapi_frame_crc32c(header, NULL, 0, &credit, sizeof(credit)) != header->frame_crc) {
+        printf("[WARN] Ignoring credit frame with a bad CRC\n");
+        return;
+    }
+
+    for (size_t i = 0; i < output.size(); i++) {
+        PatternSource& payload = output[i].payload;
+        if (payload.Streamed() && payload.StreamId() == header->request_id) {
+            payload.Grant(credit.bytes);
+            output_blocked = FALSE;
+            return;
+        }
+    }
+}
+
+/*
+ * Let the client stream bytes more of request_id's payload
+ */
+void ClientConnection::QueueCredit(UINT64 request_id, UINT64 bytes)
+{
+    BinaryResponseFrame frame;
+    winapi_stream_credit_t credit;
+    BufferSendInfo no_payload = BufferSendInfo();
+
+    memset(&frame.header, 0, sizeof(frame.header));
+    frame.header.magic = WINAPI_MESSAGE_MAGIC;
+    frame.header.version = WINAPI_PROTOCOL_VERSION;
+    frame.header.message_type = WINAPI_MSG_CREDIT;
+    frame.header.request_id = request_id;
+    frame.header.inline_size = sizeof(credit);
+
+    credit.bytes = bytes;
+    memcpy(frame.inline_data, &credit, sizeof(credit));
+
+    if (session.agreed.capabilities & WINAPI_CAP_CHECKSUM_CRC32C) {
+        frame.header.flags |= WINAPI_MSG_FLAG_CRC32C;
+        frame.header.frame_crc = winapi_frame_crc32c(&frame.header, NULL, 0, frame.inline_data, sizeof(credit));
+    }
+
+    stream_granted += bytes;
+    QueueOutput((const char*)&frame, sizeof(frame.header) + sizeof(credit), &no_payload);
+}
+
+/*
+ * Size of the frame at the head of the input, 0 while too little has arrived to tell
+ */
+BOOL ClientConnection::FrameSize(size_t* size)
+{
+    const char* frame = input.empty() ? NULL : &input[input_start];
+    size_t available = input_end - input_start;
+    UINT32 first_word;
+
+    *size = frame_size;
+    if (frame_size != 0 || available < sizeof(first_word)) {
+        return TRUE;
+    }
+    memcpy(&first_word, frame, sizeof(first_word));
+
+    // Binary frames and stream chunks start with a magic instead of a JSON length
+    if (first_word == WINAPI_MESSAGE_MAGIC) {
+        const winapi_message_header_t* header = (const winapi_message_header_t*)frame;
+
+        if (!(session.agreed.capabilities & WINAPI_CAP_BINARY_FRAMING)) {
+            printf("[ERROR] Binary frame received before binary framing was negotiated\n");
+            return FALSE;
+        }
+        if (available < sizeof(*header)) {
+            return TRUE;
+        }
+
+        // Oversized frames cannot be skipped safely, drop the connection
+        if (header->buffer_count > WINAPI_MAX_BUFFERS || header->inline_size > WINAPI_MAX_INLINE_DATA) {
+            printf("[ERROR] Invalid binary frame: %u buffers, %u inline bytes\n",
+                   header->buffer_count, header->inline_size);
+            return FALSE;
+        }
+
+        size_t descriptors_size = header->buffer_count * sizeof(winapi_buffer_desc_t);
+        size_t body_size = sizeof(*header) + descriptors_size + header->inline_size;
+        if (available < body_size) {
+            return TRUE;
+        }
+
+        frame_size = body_size;
+    } else if (first_word == WINAPI_STREAM_MAGIC) {
+        if (!(session.agreed.capabilities & WINAPI_CAP_STREAMING)) {
+            printf("[ERROR] Stream chunk received before streaming was negotiated\n");
+            return FALSE;
+        }
+        if (available < sizeof(winapi_stream_chunk_t)) {
+            return TRUE;
+        }
+
+        // The data after the header goes through the sink, not the input buffer
+        frame_size = sizeof(winapi_stream_chunk_t);
+    } else {
+        UINT32 msg_len = ntohl(first_word);
+
+        if (msg_len > MAX_JSON_REQUEST_SIZE) {
+            printf("[ERROR] JSON request too large: %u bytes\n", msg_len);
+            return FALSE;
+        }
+        if (available < sizeof(first_word) + msg_len) {
+            return TRUE;
+        }
+
+        // Parsed once here; the request says whether a socket payload follows it. Flat
+        // calls of listed APIs take the fast codec, everything else goes through jsoncpp
+        const char* json = frame + sizeof(first_word);
+        JsonCodecMode mode = GetJsonCodecMode();
+        frame_fast_valid = mode != JSON_CODEC_JSONCPP && frame_fast.Parse(json, msg_len) && RequestApiId(frame_fast) != 0;
+        if (frame_fast_valid && mode == JSON_CODEC_VERIFY) {
+            frame_fast_valid = VerifyJsonRequest(frame_fast, json, msg_len);
+        }
+
+        if (frame_fast_valid) {
+            frame_json_valid = TRUE;
+        } else {
+            Json::CharReaderBuilder builder;
+            std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+            frame_json_valid = reader->parse(json, json + msg_len, &frame_json, NULL) ? TRUE : FALSE;
+        }
+
+        frame_size = sizeof(first_word) + msg_len;
+    }
+
+    *size = frame_size;
+    return TRUE;
+}
+
+/*
+ * Run the decoded request inline or hand it to the pool
+ */
+BOOL ClientConnection::DispatchFrame()
+{
+    BOOL offload;
+
+    if (!frame_binary && frame_json_valid && !frame_fast_valid && frame_json.get("api", "").asString() == "attach") {
+        AttachLane();
+        return TRUE;
+    }
+
+    // Only APIs flagged in the dispatch table (and batches) are worth a thread hop
+    if (frame_binary) {
+        const ApiHandler* handler = FindApiHandler(frame_request.header.api_id);
+        offload = handler && handler->offload;
+    } else if (frame_fast_valid) {
+        offload = FindApiHandler(RequestApiId(frame_fast))->offload;
+    } else if (frame_json_valid) {
+        const ApiHandler* handler = FindApiHandler(RequestApiId(frame_json));
+        offload = handler ? handler->offload : frame_json.get("api", "").asString() == "batch";
+    } else {
+        offload = FALSE;
+    }
+
+    // Pipelined binary requests may complete in any order
+    BOOL ordered = !frame_binary || !(session.agreed.capabilities & WINAPI_CAP_PIPELINING);
+
+    // A ring request leaves any JSON frame parsed at the head of the input alone
+    if (!offload) {
+        ConnectionTask task(this, ordered);
+        task.binary = frame_binary;
+        task.ring = frame_ring;
+        task.request = frame_request;
+        if (!frame_binary) {
+            task.json.swap(frame_json);
+            task.json_valid = frame_json_valid;
+        }
+        task.has_payload = payload_sink.Digest().size > 0;
+        task.payload = payload_sink.Digest();
+        if (!frame_binary && frame_fast_valid) {
+            // Inline fast codec responses are written straight into the output
+            task.fast = TRUE;
+            task.fast_request = frame_fast;
+            task.json_output = &OutputTail().data;
+            task.json_output_start = task.json_output->size();
+        }
+        task.Execute();
+        return FinishTask(&task);
+    }
+
+    ConnectionTask* task = new ConnectionTask(this, ordered);
+    task->binary = frame_binary;
+    task->ring = frame_ring;
+    if (frame_binary) {
+        task->request = frame_request;
+    } else {
+        task->json.swap(frame_json);
+        task->json_valid = frame_json_valid;
+    }
+    task->has_payload = payload_sink.Digest().size > 0;
+    task->payload = payload_sink.Digest();
+    if (!frame_binary && frame_fast_valid) {
+        task->fast = TRUE;
+        task->fast_request = frame_fast;
+        task->json_output = &task->json_frame;
+    }
+
+    pending_tasks++;
+    if (ordered) {
+        ordered_pending = TRUE;
+    }
+    server->Pool()->Submit(task);
+    return TRUE;
+}
+
+/*
+ * Queue the response of a finished request
+ */
+BOOL ClientConnection::FinishTask(ConnectionTask* task)
+{
+    if (task->failed) {
+        return FALSE;
+    }
+
+    if (task->binary) {
+        size_t size = sizeof(task->binary_response.header) + task->binary_response.header.inline_size;
+
+        // Ring requests are answered through the ring unless a payload follows or it is full
+        if (task->ring && !task->send_info.needs_buffer_send && SendRing((const char*)&task->binary_response, size)) {
+            return TRUE;
+        }
+        QueueOutput((const char*)&task->binary_response, size, &task->send_info);
+        return TRUE;
+    }
+
+    if (task->fast && task->json_output == &task->json_frame) {
+        QueueOutput(task->json_frame.data(), task->json_frame.size(), &task->send_info);
+    } else if (task->fast) {
+        QueuePayload(output.back(), task->json_output->size() - task->json_output_start, &task->send_info);
+    } else {
+        QueueJson(task->json_response, &task->send_info);
+    }
+    return TRUE;
+}
+
+/*
+ * Queue a JSON response behind its length prefix
+ */
+void ClientConnection::QueueJson(const std::string& json, const BufferSendInfo* send_info)
+{
+    OutputChunk& chunk = OutputTail();
+    UINT32 net_len = htonl((UINT32)json.size());
+
+    chunk.data.insert(chunk.data.end(), (const char*)&net_len, (const char*)&net_len + sizeof(net_len));
+    chunk.data.insert(chunk.data.end(), json.begin(), json.end());
+    QueuePayload(chunk, sizeof(net_len) + json.size(), send_info);
+}
+
+/*
+ * "attach" call: make this connection a data connection of another session
+ */
+void ClientConnection::AttachLane()
+{
+    UINT32 request_id = frame_json.get("request_id", 0).asUInt();
+    UINT32 owner_id = frame_json.get("session_id", 0).asUInt();
+    UINT64 key = frame_json.get("session_key", 0).asUInt64();
+    UINT32 number = frame_json.get("lane", 0).asUInt();
+    BufferSendInfo no_payload = BufferSendInfo();
+    Json::Value response;
+
+    ClientConnection* primary = server->FindSession(owner_id);
+    BOOL taken = primary && number < primary->lanes.size() && primary->lanes[number];
+
+    if (!primary || primary == this || key != primary->session.session_key || number >= WINAPI_MAX_DATA_CONNECTIONS ||
+        taken || session.handshake_done || owner || !lanes.empty()) {
+        printf("[WARN] Rejected data connection %u for session %u\n", number, owner_id);
+        response = CreateErrorResponse(request_id, "Invalid data connection");
+    } else {
+        owner = primary;
+        lane = number;
+        primary->lanes.resize(std::max(primary->lanes.size(), (size_t)number + 1), NULL);
+        primary->lanes[number] = this;
+
+        // Chunks and credits are framed as agreed by the session
+        session.agreed = primary->session.agreed;
+        session.handshake_done = TRUE;
+        server->ReleaseSharedMemory(this);
+
+        printf("[INFO] Session %u: data connection %u attached (session %u)\n",
+               primary->session.session_id, number, session.session_id);
+        response = CreateSuccessResponse(request_id);
+    }
+
+    Json::StreamWriterBuilder builder;
+    QueueJson(Json::writeString(builder, response), &no_payload);
+}
+
+/*
+ * Pool task finished: queue its response and pick up where the connection left off
+ */
+void ClientConnection::CompleteTask(ConnectionTask* task, Reactor* reactor)
+{
+    pending_tasks--;
+    if (task->ordered) {
+        ordered_pending = FALSE;
+    }
+
+    if (closed) {
+        if (pending_tasks == 0) {
+            server->ReleaseConnection(this);
+        }
+        return;
+    }
+
+    if (!FinishTask(task)) {
+        server->CloseConnection(this);
+        return;
+    }
+
+    Service(reactor);
+}
+
+/*
+ * Queue a response; a READ payload is generated while it is sent
+ */
+void ClientConnection::QueueOutput(const char* data, size_t size, const BufferSendInfo* send_info)
+{
+    OutputChunk& chunk = OutputTail();
+    chunk.data.insert(chunk.data.end(), data, data + size);
+    QueuePayload(chunk, size, send_info);
+}
+
+/*
+ * Chunk the next response bytes are appended to
+ */
+OutputChunk& ClientConnection::OutputTail()
+{
+    // Small responses share a chunk so pipelined completions go out in one send
+    if (output.empty() || output.back().payload.Size() != 0) {
+        output.push_back(OutputChunk());
+        output.back().offset = 0;
+        output.back().data.swap(spare_output);
+    }
+    return output.back();
+}
+
+/*
+ * Account for size response bytes just appended to chunk and queue their READ payload
+ */
+void ClientConnection::QueuePayload(OutputChunk& chunk, size_t size, const BufferSendInfo* send_info)
+{
+    if (send_info->needs_buffer_send && send_info->stripe_count > 0) {
+        QueueStripes(send_info);
+    } else if (send_info->needs_buffer_send && send_info->stream) {
+        chunk.payload.ResetStream(send_info->test_pattern, send_info->buffer_size, send_info->stream_id,
+                                  send_info->stream_window,
+                                  (session.agreed.capabilities & WINAPI_CAP_CHECKSUM_CRC32C) ? TRUE : FALSE);
+    } else if (send_info->needs_buffer_send) {
+        chunk.payload.Reset(send_info->test_pattern, send_info->buffer_size);
+    }
+    pending_output += size + (chunk.payload.Streamed() ? 0 : chunk.payload.Size());
+}
+
+/*
+ * Striped READ: each data connection streams every K-th chunk behind the response
+ */
+void ClientConnection::QueueStripes(const BufferSendInfo* send_info)
+{
+    BOOL crc = (session.agreed.capabilities & WINAPI_CAP_CHECKSUM_CRC32C) ? TRUE : FALSE;
+
+    for (UINT32 i = 0; i < send_info->stripe_count && i < lanes.size(); i++) {
+        ClientConnection* data = lanes[i];
+        if (!data) {
+            continue;
+        }
+
+        OutputChunk chunk;
+        chunk.offset = 0;
+        chunk.payload.ResetStream(send_info->test_pattern, send_info->buffer_size, send_info->stream_id,
+                                  send_info->stream_window, crc, i, send_info->stripe_count);
+        if (chunk.payload.Size() != 0) {
+            data->output.push_back(chunk);
+            data->kicked = TRUE;
+        }
+    }
+}
+
+/*
+ * Send queued output until the socket would block, gathering responses and
+ * payload chunks into one vectored send per iteration
+ */
+BOOL ClientConnection::FlushOutput()
+{
+    while (!output.empty()) {
+        IoVec vecs[MAX_SEND_VECS];
+        int count = 0;
+
+        for (size_t i = 0; i < output.size() && count < MAX_SEND_VECS; i++) {
+            OutputChunk& chunk = output[i];
+            BOOL complete;
+            if (chunk.offset < chunk.data.size()) {
+                SetIoVec(&vecs[count++], &chunk.data[chunk.offset], chunk.data.size() - chunk.offset);
+            }
+            count += chunk.payload.Gather(&vecs[count], MAX_SEND_VECS - count, &complete);
+
+            // Later responses wait behind a stream out of credit
+            if (!complete) {
+                break;
+            }
+        }
+
+        output_blocked = count == 0;
+        if (output_blocked) {
+            break;
+        }
+
+        long sent = SendVectored(session.socket, vecs, count);
+        if (sent < 0) {
+            int error = LastSocketError();
+            if (SOCKET_WOULD_BLOCK(error)) {
+                return TRUE;
+            }
+            printf("[ERROR] Failed to send to client: %d\n", error);
+            return FALSE;
+        }
+
+        // Retire what went out; after a short write the next send reports would-block
+        // (FD_WRITE on Windows is only re-armed by a failed send)
+        UINT64 remaining = (UINT64)sent;
+        while (!output.empty()) {
+            OutputChunk& chunk = output.front();
+            size_t data_left = chunk.data.size() - chunk.offset;
+            size_t data_sent = (size_t)std::min(remaining, (UINT64)data_left);
+            chunk.offset += data_sent;
+            remaining -= data_sent;
+
+            UINT64 payload_sent = std::min(remaining, chunk.payload.Remaining());
+            chunk.payload.Advance(payload_sent);
+            remaining -= payload_sent;
+            pending_output -= data_sent + (chunk.payload.Streamed() ? 0 : payload_sent);
+
+            if (chunk.offset < chunk.data.size() || chunk.payload.Remaining() != 0) {
+                break;
+            }
+
+            // Keep one response buffer around so steady traffic does not reallocate
+            if (chunk.data.capacity() <= MAX_SPARE_OUTPUT && chunk.data.capacity() > spare_output.capacity()) {
+                chunk.data.clear();
+                spare_output.swap(chunk.data);
+            }
+            output.pop_front();
+        }
+    }
+
+    return TRUE;
+}
+
+/*
+ * Ask for writability only while output can be sent, stop reading while it is
+ * backlogged unless a payload or a client credit is needed to make progress
+ */
+void ClientConnection::UpdateInterest(Reactor* reactor)
+{
+    unsigned wanted = 0;
+
+    if ((pending_output < MAX_PENDING_OUTPUT && pending_tasks < MAX_PENDING_TASKS) || payload_pending || output_blocked) {
+        wanted |= REACTOR_READ;
+    }
+    if (!output.empty() && !output_blocked) {
+        wanted |= REACTOR_WRITE;
+    }
+
+    if (wanted != interest && reactor->Modify(session.socket, this, wanted)) {
+        interest = wanted;
+    }
+}
+
+SessionServer::SessionServer()
+    : listen_socket(INVALID_SOCKET), max_sessions(0), next_session_id(0),
+      request_buffer(NULL), response_buffer(NULL), shared_memory_owner(NULL), payload_chunk(PAYLOAD_CHUNK_SIZE)
+{
+}
+
+/*
+ * Receive chunk shared by every connection's payload (reactor thread only)
+ */
+char* SessionServer::PayloadChunk()
+{
+    return &payload_chunk[0];
+}
+
+/*
+ * Register the listening socket with a new reactor
+ */
+BOOL SessionServer::Initialize(SOCKET listen_socket, LONG max_sessions, unsigned handler_threads,
+                               LPVOID request_buffer, LPVOID response_buffer)
+{
+    this->listen_socket = listen_socket;
+    this->max_sessions = max_sessions;
+    this->request_buffer = request_buffer;
+    this->response_buffer = response_buffer;
+
+    if (!reactor.Initialize()) {
+        printf("[ERROR] Failed to initialize the reactor\n");
+        return FALSE;
+    }
+    if (!pool.Start(handler_threads, &reactor)) {
+        return FALSE;
+    }
+    if (!reactor.Add(listen_socket, this, REACTOR_READ, TRUE)) {
+        printf("[ERROR] Failed to register the listening socket: %d\n", LastSocketError());
+        return FALSE;
+    }
+
+    printf("[OK] Reactor ready (%s backend, %u handler threads), serving up to %ld concurrent sessions\n",
+           reactor.BackendName(), pool.WorkerCount(), max_sessions);
+    return TRUE;
+}
+
+const char* SessionServer::BackendName() const
+{
+    return reactor.BackendName();
+}
+
+HandlerPool* SessionServer::Pool()
+{
+    return &pool;
+}
+
+/*
+ * Serve connections until Stop(), then disconnect every session
+ */
+void SessionServer::Run()
+{
+    reactor.Run();
+
+    // Let running handlers finish and deliver their completions
+    pool.Shutdown();
+    reactor.RunPosted();
+
+    reactor.Remove(listen_socket, this);
+    while (!connections.empty()) {
+        CloseConnection(*connections.begin());
+    }
+    reactor.ReleaseClosed();
+}
+
+void SessionServer::Stop()
+{
+    reactor.Stop();
+}
+
+/*
+ * Listening socket readable: accept pending connections
+ */
+void SessionServer::OnEvent(Reactor* reactor, unsigned events)
+{
+    UNREFERENCED_PARAMETER(reactor);
+    UNREFERENCED_PARAMETER(events);
+
+    AcceptConnections();
+}
+
+void SessionServer::AcceptConnections()
+{
+    for (;;) {
+        struct sockaddr_storage client_addr;
+        socklen_t addr_len = sizeof(client_addr);
+
+        SOCKET client_socket = accept(listen_socket, (struct sockaddr*)&client_addr, &addr_len);
+        if (client_socket == INVALID_SOCKET) {
+            int error = LastSocketError();
+            if (!SOCKET_WOULD_BLOCK(error)) {
+                printf("accept() failed: %d\n", error);
+            }
+            return;
+        }
+
+        if (client_addr.ss_family == AF_INET) {
+            struct sockaddr_in* tcp_addr = (struct sockaddr_in*)&client_addr;
+            char client_ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &tcp_addr->sin_addr, client_ip, sizeof(client_ip));
+            printf("[OK] TCP connection accepted from %s:%d\n", client_ip, ntohs(tcp_addr->sin_port));
+
+            // Ring doorbells are lone small writes, Nagle would hold one back for the previous one's delayed ACK
+            int no_delay = 1;
+            setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+        } else {
+            printf("[OK] VSOCK connection accepted successfully\n");
+        }
+
+        if ((LONG)connections.size() >= max_sessions) {
+            printf("[WARN] Session limit (%ld) reached, rejecting connection\n", max_sessions);
+            closesocket(client_socket);
+            continue;
+        }
+
+        ClientConnection* connection = new ClientConnection(this, client_socket, ++next_session_id);
+
+        // Only one session at a time can use the fixed shared memory buffers
+        if (request_buffer && shared_memory_owner == NULL) {
+            shared_memory_owner = connection;
+            connection->session.request_buffer = request_buffer;
+            connection->session.response_buffer = response_buffer;
+        }
+
+        if (!reactor.Add(client_socket, connection, REACTOR_READ)) {
+            printf("[ERROR] Failed to register session %u: %d\n", connection->session.session_id, LastSocketError());
+            if (shared_memory_owner == connection) {
+                shared_memory_owner = NULL;
+            }
+            closesocket(client_socket);
+            delete connection;
+            continue;
+        }
+
+        connections.insert(connection);
+        printf("[INFO] Session %u started (%ld/%ld active)\n",
+               connection->session.session_id, (LONG)connections.size(), max_sessions);
+    }
+}
+
+/*
+ * Disconnect a session; it is freed once its pool tasks have completed
+ */
+void SessionServer::CloseConnection(ClientConnection* connection)
+{
+    if (connection->closed) {
+        return;
+    }
+
+    connections.erase(connection);
+    reactor.Remove(connection->session.socket, connection);
+    closesocket(connection->session.socket);
+    connection->closed = TRUE;
+
+    printf("Client disconnected (session %u)\n", connection->session.session_id);
+
+    // A session and its data connections go down together, striped streams need all of them
+    ClientConnection* primary = connection->owner;
+    if (primary) {
+        primary->lanes[connection->lane] = NULL;
+        connection->owner = NULL;
+        CloseConnection(primary);
+    }
+
+    std::vector<ClientConnection*> lanes;
+    lanes.swap(connection->lanes);
+    for (size_t i = 0; i < lanes.size(); i++) {
+        if (lanes[i]) {
+            lanes[i]->owner = NULL;
+            CloseConnection(lanes[i]);
+        }
+    }
+
+    if (connection->pending_tasks == 0) {
+        ReleaseConnection(connection);
+    }
+}
+
+void SessionServer::ReleaseConnection(ClientConnection* connection)
+{
+    // Pool tasks may have been using the shared memory lease until now
+    ReleaseSharedMemory(connection);
+    delete connection->session.ring;
+    connection->session.ring = NULL;
+    delete connection->session.buffers;
+    connection->session.buffers = NULL;
+    reactor.Release(connection);
+}
+
+void SessionServer::ReleaseSharedMemory(ClientConnection* connection)
+{
+    if (shared_memory_owner == connection) {
+        shared_memory_owner = NULL;
+        connection->session.request_buffer = NULL;
+        connection->session.response_buffer = NULL;
+    }
+}
+
+ClientConnection* SessionServer::FindSession(UINT32 session_id)
+{
+    for (std::set<ClientConnection*>::iterator it = connections.begin(); it != connections.end(); ++it) {
+        ClientConnection* connection = *it;
+        if (connection->session.session_id == session_id && connection->session.session_key != 0) {
+            return connection;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,220 @@
+/*
+ * Client sessions on the reactor
+ *
+ * Each connection is a ClientConnection: bytes are read without blocking
+ * into an input buffer and complete frames (JSON or binary) are handed to
+ * the API handlers. A socket payload following a frame is checksummed a
+ * chunk at a time as it arrives and never stored; streamed payloads arrive
+ * in chunk frames, each answered with a credit frame once consumed, and
+ * streamed READs go no further than the client's credits. A session may
+ * attach data connections ("lanes") that carry the chunks of striped
+ * streams; they run on the same reactor thread, digest their chunks and
+ * merge them into the session's sink, and each sends its share of a striped
+ * READ. Responses are queued and flushed as the socket accepts them, several
+ * at a time through one vectored send. READ payloads are streamed from a
+ * shared pre-filled chunk instead of being materialized up front.
+ *
+ * Cheap requests run inline on the reactor thread. Buffer tests and
+ * batches go to the handler pool and complete back on the reactor thread;
+ * pipelined binary requests complete in any order, everything else keeps
+ * request order by pausing the connection until its response is queued.
+ *
+ * With shared memory rings agreed, requests are also taken from the
+ * client's request ring after every pass over the socket input, under the
+ * same limits, and their small responses go back through the response
+ * ring. Doorbell frames on the socket only wake the connection up. An
+ * empty request ring is spun on a slice at a time, the reactor polling the
+ * sockets in between, until its adaptive window runs out; only then does
+ * the connection ask for a doorbell.
+ */
+
+#ifndef WINAPI_SESSION_H
+#define WINAPI_SESSION_H
+
+#include "platform.h"
+#include "reactor.h"
+#include "api_handlers.h"
+#include "handler_pool.h"
+#include "payload_source.h"
+
+#include <deque>
+#include <vector>
+#include <set>
+
+// Largest JSON request accepted on a connection
+#define MAX_JSON_REQUEST_SIZE   (64 * 1024 - 1)
+
+// Stop reading requests while this much response data is waiting to be sent
+#define MAX_PENDING_OUTPUT      (4 * 1024 * 1024)
+
+// Stop reading requests while this many are running on the handler pool
+#define MAX_PENDING_TASKS       256
+
+// Longest a connection spins on its empty request ring before the sockets get a look
+#define RING_POLL_SLICE_NS      2000
+
+class SessionServer;
+class ClientConnection;
+
+// Response bytes queued for the socket, optionally followed by a READ payload
+struct OutputChunk {
+    std::vector<char> data;
+    size_t offset;            // Bytes of data already sent
+    PatternSource payload;    // Generated while sending, after data
+};
+
+// One decoded request and its response
+class ConnectionTask : public HandlerTask {
+public:
+    ConnectionTask(ClientConnection* connection, BOOL ordered);
+
+    void Execute() override;
+    void Run(Reactor* reactor) override;
+
+    ClientConnection* connection;
+    BOOL ordered;                     // Connection runs no further requests until this one completes
+    BOOL binary;
+    BOOL ring;                        // Taken from the request ring, a payload-less response goes back that way
+    winapi_message_t request;
+    Json::Value json;
+    BOOL json_valid;
+    BOOL fast;                        // JSON request scanned by the fast codec, json is unused
+    JsonRequest fast_request;
+    std::vector<char>* json_output;   // Where the fast codec writes the framed response
+    size_t json_output_start;
+    std::vector<char> json_frame;     // That buffer on the pool; inline requests write to the connection's output
+    BOOL has_payload;
+    PayloadDigest payload;            // Socket payload, digested while it was received
+    BinaryResponseFrame binary_response;
+    std::string json_response;
+    BufferSendInfo send_info;
+    BOOL failed;                      // Handler threw, the connection is dropped
+};
+
+class ClientConnection : public ReactorHandler {
+public:
+    ClientConnection(SessionServer* server, SOCKET socket, UINT32 session_id);
+
+    void OnEvent(Reactor* reactor, unsigned events) override;
+
+    // Run queued requests and send what is ready
+    void Service(Reactor* reactor);
+
+    // Pool task finished (reactor thread)
+    void CompleteTask(ConnectionTask* task, Reactor* reactor);
+
+    ClientSession session;
+    int pending_tasks;            // Requests on the handler pool, the connection outlives them
+    ClientConnection* owner;      // Session this data connection is attached to, NULL otherwise
+    UINT32 lane;
+    std::vector<ClientConnection*> lanes;  // Attached data connections by lane, NULL where none
+
+private:
+    BOOL ReadInput();
+    BOOL ProcessInput();
+    BOOL FrameSize(size_t* frame_size);
+    BOOL StartRequest(const char* frame);
+    BOOL ProcessRing();
+    BOOL StartRingRequest(const char* frame, size_t size);
+    BOOL SendRing(const char* frame, size_t size);
+    void QueueDoorbell();
+    BOOL StartChunk(const char* frame);
+    BOOL StartStripeChunk(const winapi_stream_chunk_t& chunk);
+    void FinishChunk();
+    void FinishStripeChunk();
+    BOOL LanesReady(UINT32 count) const;
+    void StartStripes();
+    void QueueStripes(const BufferSendInfo* send_info);
+    void ServiceLanes(Reactor* reactor);
+    void AttachLane();
+    void GrantCredit(const char* frame);
+    void QueueCredit(UINT64 request_id, UINT64 bytes);
+    BOOL DispatchFrame();
+    BOOL FinishTask(ConnectionTask* task);
+    void QueueJson(const std::string& json, const BufferSendInfo* send_info);
+    void QueueOutput(const char* data, size_t size, const BufferSendInfo* send_info);
+    OutputChunk& OutputTail();
+    void QueuePayload(OutputChunk& chunk, size_t size, const BufferSendInfo* send_info);
+    BOOL FlushOutput();
+    void UpdateInterest(Reactor* reactor);
+
+    SessionServer* server;
+    std::vector<char> input;      // Received bytes in [input_start, input_end)
+    size_t input_start;
+    size_t input_end;
+    size_t frame_size;            // Size of the frame at input_start once known, 0 otherwise (payload excluded)
+    winapi_message_t frame_request;  // Decoded binary request of that frame
+    Json::Value frame_json;       // Parsed JSON request of that frame
+    BOOL frame_json_valid;        // Parsed by either codec
+    JsonRequest frame_fast;       // Same request scanned by the fast codec
+    BOOL frame_fast_valid;
+    BOOL frame_binary;
+    BOOL frame_ring;              // frame_request came from the request ring
+    BOOL ring_polling;            // Request ring is empty but still within its spin window
+    BOOL payload_pending;         // Frame consumed, waiting for its payload to stream through payload_sink
+    BOOL payload_complete;
+    BOOL payload_stream;          // Payload arrives as chunk frames
+    BOOL chunk_pending;           // Payload bytes (the whole payload unless streamed) are still arriving
+    UINT64 chunk_remaining;
+    winapi_stream_chunk_t stream_chunk;  // Header of the chunk being received
+    UINT64 stream_granted;        // Stream bytes the client has been allowed to send
+    UINT64 stream_received;       // Stream bytes received on this data connection
+    UINT64 stream_size;           // Total of the striped payload being received
+    UINT32 stripe_count;          // Data connections carrying that payload, 0 if not striped
+    BOOL kicked;                  // Data connection has work queued by its session
+    PayloadSink payload_sink;
+    BOOL ordered_pending;         // An in-order request is on the handler pool
+    std::deque<OutputChunk> output;
+    std::vector<char> spare_output;  // Buffer of a sent chunk, reused by the next one
+    UINT64 pending_output;        // Queued bytes, streamed payloads excluded (credits bound them)
+    BOOL output_blocked;          // Output waits for stream credits, not for the socket
+    unsigned interest;
+};
+
+// Listening socket plus every connection accepted from it
+class SessionServer : public ReactorHandler {
+public:
+    SessionServer();
+
+    BOOL Initialize(SOCKET listen_socket, LONG max_sessions, unsigned handler_threads,
+                    LPVOID request_buffer, LPVOID response_buffer);
+    const char* BackendName() const;
+    HandlerPool* Pool();
+    char* PayloadChunk();
+
+    // Serve connections on the calling thread until Stop()
+    void Run();
+
+    // Thread-safe (and signal-safe on POSIX)
+    void Stop();
+
+    void OnEvent(Reactor* reactor, unsigned events) override;
+
+    // Connections count against max_sessions; closing a session closes its data connections and vice versa
+    void CloseConnection(ClientConnection* connection);
+
+    // Session with striping agreed, to attach data connections to
+    ClientConnection* FindSession(UINT32 session_id);
+
+    // Give up the fixed shared memory lease if connection holds it
+    void ReleaseSharedMemory(ClientConnection* connection);
+
+    // Free a closed connection once no pool task refers to it
+    void ReleaseConnection(ClientConnection* connection);
+
+private:
+    void AcceptConnections();
+
+    Reactor reactor;
+    HandlerPool pool;
+    SOCKET listen_socket;
+    LONG max_sessions;
+    UINT32 next_session_id;
+    std::set<ClientConnection*> connections;
+    LPVOID request_buffer;        // Fixed shared memory, leased to one session at a time
+    LPVOID response_buffer;
+    ClientConnection* shared_memory_owner;
+    std::vector<char> payload_chunk;  // PAYLOAD_CHUNK_SIZE bytes
+};
+
+#endif /* WINAPI_SESSION_H */
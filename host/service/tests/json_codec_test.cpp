@@ -0,0 +1,221 @@
+/*
+ * The fast JSON codec must answer every request byte for byte like jsoncpp
+ */
+
+#include "../api_handlers.h"
+#include "../json_codec.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Provided by the service's entry point; a plain store as on POSIX
+BOOL SafeMemoryWrite(UINT32* ptr, UINT32 value, UINT64 offset)
+{
+    UNREFERENCED_PARAMETER(offset);
+    *ptr = value;
+    return TRUE;
+}
+
+// One JSON request, and whether the fast codec is expected to take it or leave it to jsoncpp
+struct RequestCase {
+    const char* name;
+    const char* json;
+    bool fast;
+};
+
+// Requests of every listed API; handshake, batch and attach are connection control calls jsoncpp always handles
+static const RequestCase g_requests[] = {
+    // Echo
+    { "echo", R"({"api":"echo","api_id":1,"request_id":1,"input":"Hello, Windows!"})", true },
+    { "echo by name", R"({"api":"echo","request_id":2,"input":"by name"})", true },
+    { "echo reordered keys", R"({"input":"reordered","request_id":3,"api_id":1,"api":"echo"})", true },
+    { "echo whitespace", " \r\n\t{ \"api\" : \"echo\" ,\n\t\"request_id\" : 4 , \"input\" : \"spaced\" }\n ", true },
+    { "echo duplicate key", R"({"api":"echo","request_id":5,"input":"first","input":"second"})", true },
+    { "echo missing input", R"({"api":"echo","request_id":6})", true },
+    { "echo missing request_id", R"({"api":"echo","input":"no id"})", true },
+    { "echo input not a string", R"({"api":"echo","request_id":8,"input":42})", true },
+    { "echo null input", R"({"api":"echo","request_id":9,"input":null})", true },
+    { "echo empty input", R"({"api":"echo","request_id":10,"input":""})", true },
+    { "echo escapes", R"({"api":"echo","request_id":11,"input":"tab\tquote\"back\\slash\/nl\nbell\u0007"})", false },
+    { "echo escaped unicode", R"({"api":"echo","request_id":12,"input":"caf\u00e9 \u20ac \ud83d\ude00"})", false },
+    { "echo raw unicode", "{\"api\":\"echo\",\"request_id\":13,\"input\":\"caf\xc3\xa9 \xe2\x82\xac\"}", false },
+    { "echo escaped key", R"({"api":"echo","request_id":14,"in\u0070ut":"escaped key"})", false },
+    { "echo nested member", R"({"api":"echo","request_id":15,"input":"nested","extra":{"a":[1,2]}})", false },
+    { "echo max request_id", R"({"api":"echo","request_id":4294967295,"input":"max id"})", true },
+
+    // Buffer test: shared memory, socket payloads and argument errors
+    { "buffer write", R"({"api":"buffer_test","api_id":2,"request_id":20,"operation":2,"test_pattern":305419896,"payload_size":4096})", true },
+    { "buffer read", R"({"api_id":2,"request_id":21,"operation":1,"test_pattern":2863311530,"payload_size":65536})", true },
+    { "buffer negative pattern", R"({"api_id":2,"request_id":22,"operation":1,"test_pattern":-1,"payload_size":4096})", true },
+    { "buffer smallest pattern", R"({"api_id":2,"request_id":23,"operation":1,"test_pattern":-2147483648,"payload_size":4096})", true },
+    { "buffer max pattern", R"({"api_id":2,"request_id":24,"operation":1,"test_pattern":4294967295,"payload_size":4096})", true },
+    { "buffer pattern too large", R"({"api_id":2,"request_id":25,"operation":1,"test_pattern":4294967296,"payload_size":4096})", true },
+    { "buffer pattern below Int64", R"({"api_id":2,"request_id":26,"operation":1,"test_pattern":-9223372036854775808,"payload_size":4096})", true },
+    { "buffer socket read", R"({"api_id":2,"request_id":27,"operation":1,"test_pattern":1,"payload_size":67108864,"socket_transfer":true})", true },
+    { "buffer socket write", R"({"socket_transfer":true,"payload_size":1003,"test_pattern":7,"operation":2,"request_id":28,"api_id":2})", true },
+    { "buffer socket verify", R"({"api_id":2,"request_id":29,"operation":3,"test_pattern":7,"payload_size":1003,"socket_transfer":1})", true },
+    { "buffer socket too large", R"({"api_id":2,"request_id":30,"operation":1,"test_pattern":1,"payload_size":67108865,"socket_transfer":true})", true },
+    { "buffer size beyond Int64", R"({"api_id":2,"request_id":31,"operation":2,"payload_size":18446744073709551615})", true },
+    { "buffer size beyond UInt64", R"({"api_id":2,"request_id":32,"operation":2,"payload_size":18446744073709551616})", false },
+    { "buffer negative size", R"({"api_id":2,"request_id":33,"operation":2,"payload_size":-4096})", true },
+    { "buffer fractional size", R"({"api_id":2,"request_id":34,"operation":2,"payload_size":4096.0})", false },
+    { "buffer missing size", R"({"api_id":2,"request_id":35,"operation":2})", true },
+    { "buffer missing operation", R"({"api_id":2,"request_id":36,"payload_size":4096})", true },
+    { "buffer socket_transfer string", R"({"api_id":2,"request_id":37,"operation":2,"payload_size":4096,"socket_transfer":"yes"})", true },
+    { "buffer operation string", R"({"api_id":2,"request_id":38,"operation":"write","payload_size":4096})", true },
+
+    // Performance test
+    { "performance", R"({"api":"performance","api_id":3,"request_id":40,"test_type":1,"iterations":10,"target_bytes":4096})", true },
+    { "performance defaults", R"({"api":"performance","request_id":41})", true },
+    { "performance negative iterations", R"({"api_id":3,"request_id":42,"iterations":-5})", true },
+    { "performance iterations beyond Int", R"({"api_id":3,"request_id":43,"iterations":3000000000})", true },
+    { "performance bool iterations", R"({"api_id":3,"request_id":44,"iterations":true})", true },
+
+    // Shared buffer
+    { "shared buffer", R"({"api":"shared_buffer","api_id":4,"request_id":50,"operation":"process","file_path":"/mnt/c/temp/buffer_1.dat","buffer_size":4096,"buffer_id":1})", true },
+    { "shared buffer reordered", R"({"buffer_id":2,"buffer_size":8192,"file_path":"/tmp/buffer_2.dat","operation":"map","request_id":51,"api_id":4})", true },
+    { "shared buffer missing fields", R"({"api_id":4,"request_id":52})", true },
+    { "shared buffer escaped path", R"({"api_id":4,"request_id":53,"operation":"pro\"cess","file_path":"C:\\temp\\buffer.dat","buffer_size":1})", false },
+    { "shared buffer unicode path", R"({"api_id":4,"request_id":54,"operation":"process","file_path":"/mnt/c/temp/\u00fcber.dat","buffer_size":1})", false },
+
+    // Registered buffers need binary framing
+    { "register buffers", R"({"api":"register_buffers","api_id":5,"request_id":60,"entries":[]})", false },
+    { "register buffers flat", R"({"api_id":5,"request_id":61,"flags":1})", true },
+
+    // An unknown API ID is not looked up by name, jsoncpp answers it
+    { "unknown api_id", R"({"api":"echo","api_id":99,"request_id":70,"input":"unknown"})", false },
+};
+
+static int CheckRequest(ClientSession* session, const RequestCase& test, const PayloadDigest* payload)
+{
+    Json::CharReaderBuilder reader_builder;
+    std::unique_ptr<Json::CharReader> reader(reader_builder.newCharReader());
+    size_t length = strlen(test.json);
+    Json::Value value;
+
+    if (!reader->parse(test.json, test.json + length, &value, NULL)) {
+        printf("FAIL %s: jsoncpp cannot parse the request\n", test.name);
+        return 1;
+    }
+
+    JsonRequest request;
+    bool fast = request.Parse(test.json, length) && RequestApiId(request) != 0;
+    if (fast != test.fast) {
+        printf("FAIL %s: fast codec %s the request\n", test.name, fast ? "took" : "declined");
+        return 1;
+    }
+    if (!fast) {
+        return 0;
+    }
+    if (!VerifyJsonRequest(request, test.json, length)) {
+        printf("FAIL %s: fast codec parsed the request differently\n", test.name);
+        return 1;
+    }
+
+    BufferSendInfo expected_send = {};
+    std::string expected;
+    DWORD expected_result = ProcessAPIRequest(session, value, payload, expected, &expected_send);
+
+    BufferSendInfo actual_send = {};
+    std::vector<char> output;
+    DWORD actual_result = ProcessFastRequest(session, request, payload, output, &actual_send);
+
+    // Skip the length prefix
+    std::string actual(output.begin() + sizeof(UINT32), output.end());
+    if (actual != expected) {
+        printf("FAIL %s: responses differ\n--- jsoncpp\n%s\n--- fast\n%s\n", test.name, expected.c_str(), actual.c_str());
+        return 1;
+    }
+    if (actual_result != expected_result || memcmp(&actual_send, &expected_send, sizeof(actual_send)) != 0) {
+        printf("FAIL %s: result %lu, jsoncpp %lu\n", test.name, (unsigned long)actual_result, (unsigned long)expected_result);
+        return 1;
+    }
+    return 0;
+}
+
+// One response built the same way into both documents
+template <typename Response>
+static void BuildEscapes(Response& response)
+{
+    response["request_id"] = 1u;
+    response["status"] = "quote\" backslash\\ slash/ \b\f\n\r\t \x01\x1f del\x7f";
+    response["error"] = std::string("embedded\0nul", 12);
+}
+
+template <typename Response>
+static void BuildNumbers(Response& response)
+{
+    response["uint64_max"] = (Json::UInt64)18446744073709551615ULL;
+    response["int64_min"] = (Json::Int64)(-9223372036854775807LL - 1);
+    response["int_min"] = (int)-2147483647 - 1;
+    response["uint_max"] = 4294967295u;
+    response["zero"] = 0;
+    response["false"] = false;
+    response["true"] = true;
+}
+
+template <typename Response>
+static void BuildNested(Response& response)
+{
+    response["z_last"] = "inserted first";
+    response["result"]["b"] = 2;
+    response["result"]["a"] = 1;
+    response["result"]["inner"]["key"] = "deep";
+    response["A_upper"] = "sorts before lower case";
+    response["result"]["a"] = "overwritten";
+    response["empty"]["nested"] = "replaced";
+    response[""] = "empty key";
+}
+
+template <typename Builder>
+static int CheckResponse(const char* name, Builder build)
+{
+    Json::StreamWriterBuilder builder;
+    Json::Value value;
+    JsonResponse response;
+    std::vector<char> output;
+
+    build(value);
+    build(response);
+    std::string expected = Json::writeString(builder, value);
+
+    if (!response.Write(output) || std::string(output.begin(), output.end()) != expected) {
+        printf("FAIL %s: responses differ\n--- jsoncpp\n%s\n--- fast\n%.*s\n", name, expected.c_str(),
+               (int)output.size(), output.data());
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    std::vector<char> request_buffer(REQUEST_BUFFER_SIZE, 0x5A);
+    std::vector<char> response_buffer(RESPONSE_BUFFER_SIZE);
+    ClientSession session = {};
+    PayloadDigest payload = {};
+    int failures = 0;
+
+    session.request_buffer = request_buffer.data();
+    session.response_buffer = response_buffer.data();
+    session.handshake_done = TRUE;
+
+    // The socket payload the buffer test requests announce
+    payload.size = 1003;
+    payload.checksum = 0xC0FFEE11;
+
+    for (size_t i = 0; i < sizeof(g_requests) / sizeof(g_requests[0]); i++) {
+        failures += CheckRequest(&session, g_requests[i], &payload);
+    }
+
+    failures += CheckResponse("escaped strings", [](auto& response) { BuildEscapes(response); });
+    failures += CheckResponse("large integers", [](auto& response) { BuildNumbers(response); });
+    failures += CheckResponse("nested and reordered keys", [](auto& response) { BuildNested(response); });
+
+    if (failures == 0) {
+        printf("Fast JSON codec matches jsoncpp for every request and response\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
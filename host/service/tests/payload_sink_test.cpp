@@ -0,0 +1,63 @@
+/*
+ * PayloadSink digests must not depend on how a payload is split into reads
+ */
+
+#include "../payload_sink.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+// Digest of payload fed in pieces of the given sizes, repeated until it is used up
+static PayloadDigest Feed(const std::vector<char>& payload, const std::vector<size_t>& pieces)
+{
+    PayloadSink sink;
+    size_t offset = 0;
+    size_t next = 0;
+
+    sink.Reset(payload.size(), TRUE);
+    while (offset < payload.size()) {
+        size_t size = std::min(pieces[next++ % pieces.size()], payload.size() - offset);
+        sink.Consume(payload.data() + offset, size);
+        offset += size;
+    }
+    return sink.Digest();
+}
+
+static int Check(const char* name, const std::vector<char>& payload, const std::vector<size_t>& pieces)
+{
+    PayloadDigest whole = Feed(payload, std::vector<size_t>(1, payload.size()));
+    PayloadDigest split = Feed(payload, pieces);
+
+    if (split.size != whole.size || split.checksum != whole.checksum || split.crc != whole.crc) {
+        printf("FAIL %s (%zu bytes): checksum 0x%08x crc 0x%08x, whole 0x%08x crc 0x%08x\n", name, payload.size(),
+               split.checksum, split.crc, whole.checksum, whole.crc);
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    static const size_t sizes[] = { 16, 1003, 65536 + 7 };
+    int failures = 0;
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        std::vector<char> payload(sizes[i]);
+        for (size_t j = 0; j < payload.size(); j++) {
+            payload[j] = (char)(j * 131 + 17);
+        }
+
+        failures += Check("1-byte reads", payload, { 1 });
+        failures += Check("2-byte reads", payload, { 2 });
+        failures += Check("3-byte reads", payload, { 3 });
+        failures += Check("1+1+14 reads", payload, { 1, 1, 14 });
+        failures += Check("mixed reads", payload, { 3, 1, 2, 4096, 5 });
+    }
+
+    if (failures == 0) {
+        printf("PayloadSink digests match for every split\n");
+    }
+    return failures == 0 ? 0 : 1;
+}